@@ -9,10 +9,13 @@
  */
 
 #include <vmcmc/algorithm.hpp>
+#include <vmcmc/cache.hpp>
+#include <vmcmc/checkpoint.hpp>
 #include <vmcmc/exception.hpp>
 #include <vmcmc/math.hpp>
 #include <vmcmc/io.hpp>
 #include <vmcmc/logger.hpp>
+#include <vmcmc/random.hpp>
 #include <vmcmc/stringutils.hpp>
 
 #include <boost/numeric/ublas/io.hpp>
@@ -20,6 +23,7 @@
 #ifdef USE_TBB
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
+#include <tbb/task_group.h>
 using namespace tbb;
 #endif // USE_TBB
 
@@ -31,7 +35,18 @@ LOG_DEFINE("vmcmc.algorithm");
 
 Algorithm::Algorithm() :
     fTotalLength( 1E6 ),
-    fCycleLength( 50 )
+    fCycleLength( 50 ),
+    fBurnIn( 0 ),
+    fThinning( 1 ),
+    fCompressRejections( false ),
+    fAsynchronous( false ),
+    fSeed( 0 ),
+    fStreamKey( 0 ),
+    fCheckpointInterval( 1 ),
+    fCompletedSteps( 0 ),
+    fResuming( false ),
+    fChainWindow( 0 ),
+    fLikelihoodCacheCapacity( 0 )
 { }
 
 Algorithm::~Algorithm()
@@ -40,6 +55,87 @@ Algorithm::~Algorithm()
 void Algorithm::SetParameterConfig(const ParameterConfig& paramConfig)
 {
     fParameterConfig = paramConfig;
+    fLimits = fParameterConfig.GetLimits();
+}
+
+void Algorithm::SetAsynchronous(bool enable)
+{
+#ifndef USE_TBB
+    if (enable)
+        LOG(Warn, "TBB is not available for asynchronous sampling.");
+    enable = false;
+#endif
+    fAsynchronous = enable;
+}
+
+void Algorithm::SetCheckpointFile(const string& filePath, size_t nCycles)
+{
+    fCheckpointFile = filePath;
+    fCheckpointInterval = max<size_t>( nCycles, 1 );
+}
+
+void Algorithm::SetChainWindow(size_t nSteps, const string& spillFilePrefix)
+{
+    fChainWindow = nSteps;
+    fSpillFilePrefix = spillFilePrefix;
+}
+
+size_t Algorithm::GetLikelihoodCacheHits() const
+{
+    return (fLikelihoodCache) ? fLikelihoodCache->GetHits() : 0;
+}
+
+size_t Algorithm::GetLikelihoodCacheMisses() const
+{
+    return (fLikelihoodCache) ? fLikelihoodCache->GetMisses() : 0;
+}
+
+void Algorithm::AddWriter(shared_ptr<Writer> writer)
+{
+    if (writer && writer->IsDeferred())
+        writer = make_shared<AsyncWriter>( writer );
+
+    fWriters.push_back( writer );
+}
+
+void Algorithm::PrepareChain(Chain& chain, ptrdiff_t cIndex)
+{
+    // the statistics count every step, before it may be discarded
+    if (cIndex >= 0) {
+        if (fOnlineStatistics.size() != NumberOfChains())
+            fOnlineStatistics.assign( NumberOfChains(), OnlineStatistics(fParameterConfig.size()) );
+
+        LOG_ASSERT( (size_t) cIndex < fOnlineStatistics.size() );
+        chain.SetOnlineStatistics( &fOnlineStatistics[cIndex] );
+    }
+
+    chain.SetThinning( fBurnIn, fThinning );
+    chain.SetCompressed( fCompressRejections );
+
+    if (fChainWindow > 0) {
+        // the writers access the steps of the last cycle
+        chain.SetWindow( max( fChainWindow, fCycleLength+1 ) );
+
+        // a resumed chain discards the blocks spilled after the checkpoint
+        if (!fSpillFilePrefix.empty() && cIndex >= 0)
+            chain.SetSpillFile( fSpillFilePrefix + "-" + to_string(cIndex) + ".spill",
+                (fResuming && (size_t) cIndex < fSpillSizes.size()) ? fSpillSizes[cIndex] : 0 );
+    }
+
+    // a compressed chain grows with the number of accepted steps
+    if (!chain.IsCompressed() && fTotalLength >= fBurnIn)
+        chain.reserve( (fTotalLength - fBurnIn) / fThinning + 1 );
+}
+
+Random::engine_type Algorithm::CreateStream(size_t cIndex, size_t subIndex) const
+{
+    // stream 0 is used by the per-thread instances
+    return Random::engine_type( fStreamKey, ((uint64_t) (cIndex+1) << 32) | (uint32_t) subIndex );
+}
+
+void Algorithm::AdvanceIndependently(size_t /*cIndex*/, size_t /*nSteps*/)
+{
+    throw Exception() << "This sampler cannot advance its chains independently.";
 }
 
 void Algorithm::Initialize()
@@ -49,6 +145,32 @@ void Algorithm::Initialize()
 
     math::constrain<size_t>(fCycleLength, 1, fTotalLength);
 
+    if (fChainWindow > 0 && fCompressRejections)
+        throw Exception() << "Chain windows cannot be combined with compressed rejections.";
+
+    fCompletedSteps = 0;
+
+    // resized by PrepareChain(), once the number of chains is known
+    fOnlineStatistics.clear();
+
+    fLimits = fParameterConfig.GetLimits();
+    fNLimitRejections.fValue = 0;
+    fNPriorRejections.fValue = 0;
+
+    if (fSeed != 0) {
+        fStreamKey = fSeed;
+    }
+    else {
+        auto& random = Random::Instance();
+        fStreamKey = (uint64_t) random() << 32;
+        fStreamKey |= random();
+    }
+
+    if (fLikelihoodCacheCapacity > 0)
+        fLikelihoodCache = make_shared<LikelihoodCache>( fLikelihoodCacheCapacity, fParameterConfig.size() );
+    else
+        fLikelihoodCache.reset();
+
     // TODO: perform consistency checks on the parameter list
 }
 
@@ -57,8 +179,40 @@ void Algorithm::Finalize()
     fStatistics.ClearChains();
 
     const size_t nChains = NumberOfChains();
-    for (size_t iChain = 0; iChain < nChains; iChain++)
-        fStatistics.AddChain( GetChain(iChain) );
+
+    // the statistics refer to the histories, which must not be relocated
+    fHistories.clear();
+    fHistories.reserve( nChains );
+
+    // chains whose evicted steps are lost
+    vector<bool> truncated( nChains, false );
+
+    for (size_t iChain = 0; iChain < nChains; iChain++) {
+        const Chain& chain = GetChain(iChain);
+
+        if (chain.GetFirstIndex() == 0) {
+            fStatistics.AddChain( chain );
+        }
+        else if (!chain.GetSpillFile().empty()) {
+            fHistories.push_back( chain.GetHistory() );
+            fStatistics.AddChain( fHistories.back() );
+        }
+        else {
+            LOG(Info, "Diagnostics for chain " << iChain << " only cover the steps from "
+                << chain.GetFirstIndex() << " on, which are still in memory.");
+            fStatistics.AddChain( chain );
+            truncated[iChain] = true;
+        }
+    }
+
+    LOG(Info, "Proposals rejected without evaluating the likelihood: " << GetLimitRejections()
+        << " outside the parameter limits, " << GetPriorRejections() << " with a zero prior.");
+
+    if (fLikelihoodCache) {
+        const size_t hits = fLikelihoodCache->GetHits();
+        const size_t misses = fLikelihoodCache->GetMisses();
+        LOG(Info, "Likelihood cache hits: " << hits << " of " << hits + misses << " evaluations.");
+    }
 
     // if TBB is available, calculate diagnostics in parallel
 #ifdef USE_TBB
@@ -71,7 +225,6 @@ void Algorithm::Finalize()
                 ChainStatistics& stats = fStatistics.GetChainStats( iChain );
                 stats.GetMode();
                 stats.GetVariance();
-                stats.GetAccRate();
                 stats.GetAutoCorrelationTime();
             }
         }
@@ -86,7 +239,8 @@ void Algorithm::Finalize()
 
         ChainStatistics& stats = fStatistics.GetChainStats( iChain );
 
-        const double accRate = stats.GetAccRate();
+        // the chain counts the steps discarded by burn-in and thinning, too
+        const double accRate = GetChain(iChain).GetAccRate();
         LOG(Info, "  Acceptance Rate: " << accRate);
 
         const Sample& mode = stats.GetMode();
@@ -99,9 +253,22 @@ void Algorithm::Finalize()
             LOG(Info, "  68% Confidence interval for parameter " << iParam << ": " << ci);
         }
 
-        Sample& mean = stats.GetMean();
-        Evaluate(mean);
-        LOG(Info, "  Mean: " << mean);
+        // the online accumulators still cover the evicted steps
+        if (truncated[iChain] && iChain < fOnlineStatistics.size()) {
+            const OnlineStatistics& online = fOnlineStatistics[iChain];
+
+            Sample mean( online.GetMean() );
+            Evaluate(mean);
+            LOG(Info, "  Mean: " << mean);
+
+            const MatrixLower covariance = online.GetCovarianceMatrix();
+            LOG(Info, "  Covariance matrix: " << covariance);
+        }
+        else {
+            Sample& mean = stats.GetMean();
+            Evaluate(mean);
+            LOG(Info, "  Mean: " << mean);
+        }
 
         for (size_t iParam = 0; iParam < stats.NumberOfParams(); iParam++) {
             double median = stats.GetMedian(iParam);
@@ -124,14 +291,18 @@ void Algorithm::Finalize()
         LOG(Info, "  Correlation matrix: " << cor);
     }
 
-    fStatistics.SelectPercentageRange(0.5, 1.0);
+    // without an explicit burn-in, discard the first half of each chain
+    if (fBurnIn == 0)
+        fStatistics.SelectPercentageRange(0.5, 1.0);
     const double R = fStatistics.GetGelmanRubin();
     LOG(Info, "Rubin-Gelman diagnostic R: " << R);
 }
 
 double Algorithm::EvaluatePrior(const std::vector<double>& paramValues) const
 {
-    if (!fParameterConfig.IsInsideLimits( paramValues ))
+    LOG_ASSERT( paramValues.size() == fLimits.size() );
+
+    if (!fLimits.IsInside( paramValues.data() ))
         return 0.0;
 
     return (fPrior) ? fPrior( paramValues ) : 1.0;
@@ -151,108 +322,395 @@ double Algorithm::EvaluateNegLogLikelihood(const std::vector<double>& paramValue
     return (fNegLogLikelihood) ? fNegLogLikelihood( paramValues ) : -log(fLikelihood( paramValues ));
 }
 
-bool Algorithm::Evaluate(Sample& sample) const
+double Algorithm::EvaluateNegLogLikelihood(const std::vector<double>& paramValues, std::vector<double>& gradient) const
 {
-    LOG_ASSERT(fLikelihood || fNegLogLikelihood, "No target function specified.");
+    LOG_ASSERT(fNegLogLikelihoodGradient, "No target function with gradient specified.");
+
+    if (gradient.size() != paramValues.size())
+        gradient.resize( paramValues.size() );
 
+    return fNegLogLikelihoodGradient( paramValues, gradient );
+}
+
+bool Algorithm::EvaluatePrior(Sample& sample) const
+{
     sample.Reset();
 
-    if (!fParameterConfig.IsInsideLimits( sample.Values() ))
-        return false;
+    LOG_ASSERT( sample.size() == fLimits.size() );
 
-    const std::vector<double>& paramValues = sample.Values().data();
+    if (!fLimits.IsInside( sample.Values() )) {
+        fNLimitRejections.Increment();
+        return false;
+    }
 
-    const double prior = (fPrior) ? fPrior( paramValues ) : 1.0;
-    if (prior == 0.0)
+    const double prior = (fPrior) ? fPrior( sample.Values().data() ) : 1.0;
+    if (prior == 0.0) {
+        fNPriorRejections.Increment();
         return false;
+    }
 
     sample.SetPrior( prior );
 
-    if (fLikelihood) {
-        const double likelihood = fLikelihood( paramValues );
+    return true;
+}
+
+bool Algorithm::Evaluate(Sample& sample) const
+{
+    LOG_ASSERT(fLikelihood || fNegLogLikelihood, "No target function specified.");
+
+    if (!EvaluatePrior( sample ))
+        return false;
+
+    const std::vector<double>& paramValues = sample.Values().data();
+
+    double likelihood, negLogLikelihood;
+
+    if (fLikelihoodCache && fLikelihoodCache->Find( paramValues.data(), likelihood, negLogLikelihood )) {
         sample.SetLikelihood( likelihood );
-        sample.SetNegLogLikelihood( -log(likelihood) );
+        sample.SetNegLogLikelihood( negLogLikelihood );
+        return true;
+    }
+
+    if (fLikelihood) {
+        likelihood = fLikelihood( paramValues );
+        negLogLikelihood = -log(likelihood);
     }
     else {
-        const double negLogLikelihood = fNegLogLikelihood( paramValues );
-        sample.SetNegLogLikelihood( negLogLikelihood );
-        sample.SetLikelihood( exp(-negLogLikelihood) );
+        negLogLikelihood = fNegLogLikelihood( paramValues );
+        likelihood = exp(-negLogLikelihood);
     }
 
+    sample.SetLikelihood( likelihood );
+    sample.SetNegLogLikelihood( negLogLikelihood );
+
+    if (fLikelihoodCache)
+        fLikelihoodCache->Insert( paramValues.data(), likelihood, negLogLikelihood );
+
     return true;
 }
 
+void Algorithm::EvaluateBatch(Sample* const* samples, size_t nSamples)
+{
+    if (!fBatchNegLogLikelihood) {
+        for (size_t i = 0; i < nSamples; i++)
+            Evaluate( *samples[i] );
+        return;
+    }
+
+    const size_t dim = fParameterConfig.size();
+
+    // gather the points with a non-zero prior
+    // (the buffers only grow, so repeated batches do not allocate)
+    if (fBatchPoints.size() < nSamples * dim)
+        fBatchPoints.resize( nSamples * dim );
+    if (fBatchResults.size() < nSamples) {
+        fBatchResults.resize( nSamples );
+        fBatchIndices.resize( nSamples );
+    }
+
+    size_t nPoints = 0;
+
+    for (size_t i = 0; i < nSamples; i++) {
+        Sample& sample = *samples[i];
+
+        if (!EvaluatePrior( sample ))
+            continue;
+
+        LOG_ASSERT( sample.size() == dim );
+
+        // only pass the points missing in the cache to the target
+        double likelihood, negLogLikelihood;
+        if (fLikelihoodCache && fLikelihoodCache->Find( sample.Values().data().data(),
+                likelihood, negLogLikelihood )) {
+            sample.SetLikelihood( likelihood );
+            sample.SetNegLogLikelihood( negLogLikelihood );
+            continue;
+        }
+
+        copy( sample.Values().begin(), sample.Values().end(), fBatchPoints.begin() + nPoints * dim );
+        fBatchIndices[nPoints++] = i;
+    }
+
+    if (nPoints == 0)
+        return;
+
+    fBatchNegLogLikelihood( fBatchPoints.data(), nPoints, dim, fBatchResults.data() );
+
+    // scatter the results back
+    for (size_t k = 0; k < nPoints; k++) {
+        Sample& sample = *samples[ fBatchIndices[k] ];
+        sample.SetNegLogLikelihood( fBatchResults[k] );
+        sample.SetLikelihood( exp(-fBatchResults[k]) );
+
+        if (fLikelihoodCache)
+            fLikelihoodCache->Insert( fBatchPoints.data() + k * dim, sample.GetLikelihood(),
+                sample.GetNegLogLikelihood() );
+    }
+}
+
+void Algorithm::SaveState(CheckpointWriter& /*checkpoint*/) const
+{
+    throw Exception() << "This sampler does not support checkpointing.";
+}
+
+void Algorithm::LoadState(CheckpointReader& /*checkpoint*/)
+{
+    throw Exception() << "This sampler does not support checkpointing.";
+}
+
+void Algorithm::SaveCheckpoint()
+{
+    CheckpointWriter checkpoint;
+
+    // the sizes of the spill files precede the state, as they are needed
+    // to prepare the chains of a resumed run
+    checkpoint.PutUInt( NumberOfChains() );
+    for (size_t iChain = 0; iChain < NumberOfChains(); iChain++)
+        checkpoint.PutUInt( GetChain(iChain).SyncSpillFile() );
+
+    checkpoint.PutUInt( fCompletedSteps );
+    checkpoint.PutUInt( fParameterConfig.size() );
+    checkpoint.PutUInt( NumberOfChains() );
+    checkpoint.PutObject( Random::Instance().GetEngine() );
+
+    SaveState( checkpoint );
+
+    checkpoint.PutUInt( fOnlineStatistics.size() );
+    for (const auto& statistics : fOnlineStatistics)
+        statistics.SaveState( checkpoint );
+
+    // the output up to this step
+    checkpoint.PutUInt( fWriters.size() );
+    for (auto& writer : fWriters)
+        writer->SaveState( checkpoint );
+
+    checkpoint.Commit( fCheckpointFile );
+
+    LOG(Debug, "Checkpoint at step " << fCompletedSteps << " written to '"
+        << fCheckpointFile << "' (" << checkpoint.size() << " bytes).");
+}
+
+void Algorithm::LoadCheckpoint(CheckpointReader& checkpoint, const string& filePath)
+{
+    const size_t completedSteps = checkpoint.GetUInt();
+    const size_t nParams = checkpoint.GetUInt();
+    const size_t nChains = checkpoint.GetUInt();
+
+    if (nParams != fParameterConfig.size() || nChains != NumberOfChains()
+            || fSpillSizes.size() != nChains)
+        throw Exception() << "The checkpoint '" << filePath << "' with " << nChains
+            << " chains of " << nParams << " parameters does not match the sampler configuration.";
+
+    if (completedSteps > fTotalLength)
+        throw Exception() << "The checkpoint '" << filePath << "' at step " << completedSteps
+            << " exceeds the total length of " << fTotalLength << " steps.";
+
+    checkpoint.GetObject( Random::Instance().GetEngine() );
+
+    LoadState( checkpoint );
+
+    // replace the statistics of the restored tails, which were already
+    // counted by the interrupted run (in place, the chains may refer to them)
+    const size_t nStatistics = checkpoint.GetUInt();
+    if (fOnlineStatistics.size() != nStatistics)
+        fOnlineStatistics.assign( nStatistics, OnlineStatistics(fParameterConfig.size()) );
+    for (auto& statistics : fOnlineStatistics)
+        statistics.LoadState( checkpoint );
+
+    // continue the output at the checkpoint
+    if (checkpoint.GetUInt() != fWriters.size())
+        throw Exception() << "The checkpoint '" << filePath << "' does not match the number of writers.";
+
+    for (auto& writer : fWriters) {
+        writer->Initialize( nChains, fParameterConfig, true );
+        writer->LoadState( checkpoint );
+    }
+
+    fCompletedSteps = completedSteps;
+
+    LOG(Info, "Resuming from checkpoint '" << filePath << "' at step " << fCompletedSteps << ".");
+}
+
 void Algorithm::Run()
 {
+    fResuming = false;
+
     Initialize();
 
-    // Let the derived sampler instance advance the Markov chain for
-    // nCycles of fCycleLength plus nRemainingSteps to yield a total chain
-    // length of fTotalLength.
+    Execute();
+}
 
-    const size_t nCycles = fTotalLength / fCycleLength;
-    const size_t nChains = NumberOfChains();
+void Algorithm::Resume(const string& filePath)
+{
+    CheckpointReader checkpoint( filePath );
 
-    vector<reference_wrapper<const Chain>> chainRefs;
-    for (size_t iChain = 0; iChain < nChains; iChain++)
-        chainRefs.emplace_back( GetChain(iChain) );
+    fSpillSizes.resize( checkpoint.GetUInt() );
+    for (auto& spillSize : fSpillSizes)
+        spillSize = checkpoint.GetUInt();
+
+    fResuming = true;
+
+    Initialize();
+
+    LoadCheckpoint( checkpoint, filePath );
+
+    Execute();
+
+    fResuming = false;
+}
+
+void Algorithm::Execute()
+{
+    const size_t nChains = NumberOfChains();
 
     // print the starting points
     for (size_t iChain = 0; iChain < nChains; iChain++) {
-        const Chain& chain = chainRefs[iChain];
+        const Chain& chain = GetChain(iChain);
         if (!chain.empty())
             LOG(Info, "Chain " << iChain << " starting point: " << chain.back());
     }
 
     // length trackers for each chain
+    // (a resumed chain starts with its last state, which was already written)
     vector<size_t> cChainLengths(nChains, 0);
+    if (fCompletedSteps > 0)
+        for (size_t iChain = 0; iChain < nChains; iChain++)
+            cChainLengths[iChain] = GetChain(iChain).size();
+
+    // summary statistics of samplers not preparing their chains, updated
+    // with each cycle
+    if (fOnlineStatistics.size() != nChains)
+        fOnlineStatistics.assign( nChains, OnlineStatistics(fParameterConfig.size()) );
+
+    // initialize writers (a resumed run continues the writers restored by
+    // LoadCheckpoint())
+    if (!fResuming)
+        for (auto& writer : fWriters)
+            writer->Initialize( nChains, fParameterConfig );
+
+    bool asynchronous = fAsynchronous;
+
+    if (asynchronous && !CanAdvanceIndependently()) {
+        LOG(Warn, "The chains of this sampler cannot be advanced asynchronously,"
+            " using lock-step cycles.");
+        asynchronous = false;
+    }
+
+    if (asynchronous && !fCheckpointFile.empty()) {
+        LOG(Warn, "Checkpointing requires lock-step cycles.");
+        asynchronous = false;
+    }
+
+    if (asynchronous)
+        RunAsynchronous( cChainLengths );
+    else
+        RunCycles( cChainLengths );
+
+    // calculate diagnostics
+    Finalize();
 
-    // initialize writers
+    // finalize writers
     for (auto& writer : fWriters)
-        writer->Initialize( nChains, fParameterConfig );
+        writer->Finalize();
+
+    LOG(Info, "MCMC run finished.");
+}
 
-    // advance the samplers in cycles
-    for (size_t iCycle = 0; iCycle <= nCycles; iCycle++) {
+void Algorithm::RunCycles(vector<size_t>& chainLengths)
+{
+    const size_t nChains = chainLengths.size();
+    mutex writerMutex;
 
-        const size_t nSteps = (iCycle < nCycles) ? fCycleLength : fTotalLength % fCycleLength;
+    // Let the derived sampler instance advance the Markov chain in cycles
+    // of fCycleLength (the last one possibly shorter) to yield a total chain
+    // length of fTotalLength.
+    for (size_t iCycle = 1; fCompletedSteps < fTotalLength; iCycle++) {
 
-        if (nSteps == 0)
-            break;
+        const size_t nSteps = min( fCycleLength, fTotalLength - fCompletedSteps );
 
         Advance(nSteps);
+        fCompletedSteps += nSteps;
 
         // output new samples and update chain length counters
-        for (size_t iChain = 0; iChain < nChains; iChain++) {
-            const Chain& chain = chainRefs[iChain];
-            for (auto& writer : fWriters) {
-                writer->Write( iChain, chainRefs[iChain], cChainLengths[iChain] );
-            }
+        for (size_t iChain = 0; iChain < nChains; iChain++)
+            Output( iChain, chainLengths[iChain], writerMutex );
 
-            cChainLengths[iChain] = chain.size();
-        }
+        for (size_t iChain = 0; iChain < nChains; iChain++)
+            LogProgress( iChain, fCompletedSteps, nSteps );
+
+        if (!fCheckpointFile.empty() &&
+                (iCycle % fCheckpointInterval == 0 || fCompletedSteps == fTotalLength))
+            SaveCheckpoint();
+    }
+}
+
+void Algorithm::RunAsynchronous(vector<size_t>& chainLengths)
+{
+#ifdef USE_TBB
+    const size_t nChains = chainLengths.size();
+    const size_t firstStep = fCompletedSteps;
+    mutex writerMutex;
+
+    // each chain runs through its cycles in a separate task, synchronizing
+    // with the other chains only when passing its samples to the writers
+    task_group tasks;
 
+    for (size_t iChain = 0; iChain < nChains; iChain++) {
+        tasks.run( [this, iChain, firstStep, &chainLengths, &writerMutex]() {
+            for (size_t iStep = firstStep; iStep < fTotalLength; ) {
 
-        // some intermediate logging (in 5% progress increments)
-        if ((iCycle+1) % (nCycles/20) == 0) {
-            const size_t iStep = (iCycle+1) * fCycleLength;
+                const size_t nSteps = min( fCycleLength, fTotalLength - iStep );
 
-            for (size_t iChain = 0; iChain < nChains; iChain++) {
-                const Sample& sample = GetChain(iChain).back();
+                this->AdvanceIndependently( iChain, nSteps );
+                iStep += nSteps;
 
-                LOG(Info, "Chain " << iChain << ", step " << iStep << " (" <<
-                      ((iCycle+1)*100/nCycles) << "%): " << sample);
+                this->Output( iChain, chainLengths[iChain], writerMutex );
+                this->LogProgress( iChain, iStep, nSteps );
             }
-        }
+        } );
     }
 
-    // calculate diagnostics
-    Finalize();
+    tasks.wait();
 
-    // finalize writers
-    for (auto& writer : fWriters)
-        writer->Finalize();
+    fCompletedSteps = fTotalLength;
+#else
+    LOG(Fatal, "TBB not available - asynchronous sampling should be deactivated.");
+#endif
+}
 
-    LOG(Info, "MCMC run finished.");
+void Algorithm::Output(size_t cIndex, size_t& startIndex, mutex& writerMutex)
+{
+    const Chain& chain = GetChain(cIndex);
+
+    {
+        lock_guard<mutex> lock( writerMutex );
+        for (auto& writer : fWriters)
+            writer->Write( cIndex, chain, startIndex );
+    }
+
+    // chains prepared by PrepareChain() count each step themselves
+    if (!chain.GetOnlineStatistics())
+        fOnlineStatistics[cIndex].Add( chain, startIndex );
+
+    startIndex = chain.size();
+}
+
+void Algorithm::LogProgress(size_t cIndex, size_t iStep, size_t nSteps)
+{
+    // some intermediate logging (in 5% progress increments)
+    const size_t nLogSteps = max<size_t>( fTotalLength / 20, 1 );
+
+    if (iStep >= fTotalLength || iStep / nLogSteps == (iStep - nSteps) / nLogSteps)
+        return;
+
+    const Chain& chain = GetChain(cIndex);
+    if (chain.empty())
+        return;
+
+    const SampleView sample = chain.back();
+
+    LOG(Info, "Chain " << cIndex << ", step " << iStep << " (" <<
+          (iStep*100/fTotalLength) << "%): " << sample);
 }
 
 } /* namespace vmcmc */
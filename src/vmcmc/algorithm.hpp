@@ -15,16 +15,24 @@
 
 #include <vmcmc/parameter.hpp>
 #include <vmcmc/chain.hpp>
+#include <vmcmc/random.hpp>
 #include <vmcmc/typetraits.hpp>
 
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <string>
 #include <vector>
+#include <mutex>
 #include <cmath>
 
 namespace vmcmc
 {
 
 class Writer;
+class LikelihoodCache;
+class CheckpointWriter;
+class CheckpointReader;
 
 /**
  * Abstract base class for the core MCMC sampling algorithms.
@@ -40,6 +48,8 @@ class Algorithm
 {
 public:
     using DefaultCallable = std::function<double (const std::vector<double>&)>;
+    using BatchCallable = std::function<void (const double* points, size_t nPoints, size_t dim, double* results)>;
+    using GradientCallable = std::function<double (const std::vector<double>& params, std::vector<double>& gradient)>;
 
 public:
     Algorithm();
@@ -68,17 +78,156 @@ public:
     template <size_t NParams, typename CallableT>
     void SetNegLogLikelihood(CallableT negLoglikelihood);
 
+    /**
+     * Set a target function evaluating -log(likelihood) for several points
+     * in one call.
+     * The callable receives @p nPoints points of @p dim parameters each,
+     * stored consecutively in @p points, and writes one result per point
+     * into @p results. Samplers evaluating several candidates per step
+     * (e.g. for multiple chains) pass them in a single batch.
+     * @param batchNegLogLikelihood
+     */
+    void SetBatchNegLogLikelihood(BatchCallable batchNegLogLikelihood);
+
+    /**
+     * Set a target function evaluating -log(likelihood) together with its
+     * gradient with respect to the parameters.
+     * The callable returns -log(likelihood) and writes the partial
+     * derivatives into @p gradient, which is passed with the size of
+     * @p params. Gradient-based samplers (e.g. Hamiltonian) require this
+     * kind of target function, all other samplers discard the gradient.
+     * @param negLogLikelihoodGradient
+     */
+    void SetNegLogLikelihoodGradient(GradientCallable negLogLikelihoodGradient);
+    bool HasGradient() const { return (bool) fNegLogLikelihoodGradient; }
+
     void SetTotalLength(size_t length) { fTotalLength = length; }
     size_t GetTotalLength() const { return fTotalLength; }
 
+    /**
+     * Discard the first @p nSteps steps of each chain as burn-in, before they
+     * are stored in the chain or passed to the writers (see
+     * Chain::SetThinning()). If set, the final diagnostics cover all stored
+     * steps, otherwise the second half of each chain.
+     * @param nSteps
+     */
+    void SetBurnIn(size_t nSteps) { fBurnIn = nSteps; }
+    size_t GetBurnIn() const { return fBurnIn; }
+
+    /**
+     * Store only every @p interval-th step of each chain after the burn-in.
+     * The acceptance rates still count all steps.
+     * @param interval
+     */
+    void SetThinning(size_t interval) { fThinning = std::max<size_t>( interval, 1 ); }
+    size_t GetThinning() const { return fThinning; }
+
+    /**
+     * Store consecutive rejected steps as a single state with a multiplicity
+     * (see Chain::SetCompressed()). This reduces the memory footprint of
+     * chains with low acceptance rates.
+     * @param compress
+     */
+    void SetCompressRejections(bool compress) { fCompressRejections = compress; }
+    bool GetCompressRejections() const { return fCompressRejections; }
+
+    /**
+     * Advance the chains asynchronously in Run().
+     * Instead of advancing all chains in lock-step cycles, each chain is
+     * advanced and written in its own (work-stealing) TBB task, without
+     * waiting for slower chains at the end of each cycle. This requires a
+     * sampler with independently advancing chains (see
+     * CanAdvanceIndependently()), otherwise Run() falls back to lock-step
+     * cycles.
+     * @param enable
+     */
+    void SetAsynchronous(bool enable);
+    bool IsAsynchronous() const { return fAsynchronous; }
+
+    /**
+     * Periodically save the sampler state to a checkpoint file, from which
+     * an interrupted run can be continued with Resume().
+     * The file is replaced atomically after every @p nCycles cycles of
+     * SetCycleLength() steps and at the end of the run. A checkpoint only
+     * holds the current state of the sampler (e.g. the chain tails, adapted
+     * proposals, the random number engine and the online statistics), the
+     * chain history is persisted by the writers, which are flushed to the
+     * storage device along with the spill files before each checkpoint.
+     * Checkpointing requires lock-step cycles (see SetAsynchronous()).
+     * @param filePath An empty path disables checkpointing.
+     * @param nCycles
+     */
+    void SetCheckpointFile(const std::string& filePath, size_t nCycles = 1);
+    const std::string& GetCheckpointFile() const { return fCheckpointFile; }
+
+    /**
+     * Keep only a window of the most recent steps of each chain in memory
+     * (see Chain::SetWindow()), which bounds the memory footprint of long
+     * runs. The evicted steps have been passed to the writers and the online
+     * statistics before.
+     * Without spill files, the final diagnostics only cover the window.
+     * @param nSteps The window size (at least one cycle), 0 to keep all steps
+     * in memory.
+     * @param spillFilePrefix If not empty, the evicted steps of chain i are
+     * appended to the file "<prefix>-<i>.spill", which is memory-mapped to
+     * calculate the final diagnostics for the full chains.
+     */
+    void SetChainWindow(size_t nSteps, const std::string& spillFilePrefix = "");
+    size_t GetChainWindow() const { return fChainWindow; }
+
+    /**
+     * Set the key of the random number streams owned by the chains (see
+     * CreateStream()). Given the key, the chains are reproducible regardless
+     * of the number of threads and their scheduling.
+     * @param seed If 0, the key is drawn from the random number generator of
+     * the thread calling Initialize().
+     */
+    void SetSeed(uint64_t seed) { fSeed = seed; }
+    uint64_t GetSeed() const { return fSeed; }
+
+    /**
+     * Memoize the target function results of up to @p capacity points,
+     * keyed by their exact parameter values. This saves evaluations of
+     * expensive targets at repeated points, e.g. proposals reflected back to
+     * a previous state, or the start points of several chains.
+     * The cache is thread-safe and bounded: a new entry may replace an older
+     * one. Gradients are not cached.
+     * @param capacity The maximum number of cached points, 0 to disable the
+     * cache.
+     */
+    void SetLikelihoodCache(size_t capacity) { fLikelihoodCacheCapacity = capacity; }
+    size_t GetLikelihoodCacheCapacity() const { return fLikelihoodCacheCapacity; }
+
+    size_t GetLikelihoodCacheHits() const;
+    size_t GetLikelihoodCacheMisses() const;
+
+    /**
+     * Get the number of proposals rejected outside the parameter limits,
+     * without evaluating the prior or the likelihood.
+     * @return
+     */
+    size_t GetLimitRejections() const { return fNLimitRejections.fValue; }
+
+    /**
+     * Get the number of proposals rejected due to a zero prior, without
+     * evaluating the likelihood.
+     * @return
+     */
+    size_t GetPriorRejections() const { return fNPriorRejections.fValue; }
+
+    void SetCycleLength(size_t length) { fCycleLength = length; }
+    size_t GetCycleLength() const { return fCycleLength; }
+
     /**
      * Add an output writer by specifying its type and passing constructor
      * arguments.
+     * Writers with an expensive encoding (see Writer::IsDeferred()) are
+     * wrapped in an AsyncWriter.
      * @param args
      */
     template <typename WriterT, typename... ArgsT>
     void AddWriter(ArgsT&&... args);
-    void AddWriter(std::shared_ptr<Writer> writer) { fWriters.push_back( writer ); }
+    void AddWriter(std::shared_ptr<Writer> writer);
 
     /**
      * Evaluate the prior for the given parameter values.
@@ -101,6 +250,17 @@ public:
      */
     double EvaluateNegLogLikelihood(const std::vector<double>& paramValues) const;
 
+    /**
+     * Evaluate the target function -log(likelihood) and its gradient for the
+     * given parameter values. Requires a target function set with
+     * SetNegLogLikelihoodGradient().
+     * @param paramValues
+     * @param[out] gradient The gradient of -log(likelihood), resized to the
+     * number of parameters if required.
+     * @return The negative logarithm (natural base) of the likelihood.
+     */
+    double EvaluateNegLogLikelihood(const std::vector<double>& paramValues, std::vector<double>& gradient) const;
+
     /**
      * Evalutate the target function prior, likelihood and -log(likelihood)
      * at the position defined by the @p sample, and update the \p sample
@@ -111,11 +271,35 @@ public:
      */
     bool Evaluate(Sample& sample) const;
 
+    /**
+     * Evaluate the prior at the position defined by the @p sample, resetting
+     * its likelihood values.
+     * @param sample
+     * @return False if the likelihood does not need to be evaluated (e.g.
+     * due to a zero prior).
+     */
+    bool EvaluatePrior(Sample& sample) const;
+
     /**
      * Start sampling!
      */
     void Run();
 
+    /**
+     * Continue a run from a checkpoint file written by a sampler with the
+     * same configuration (see SetCheckpointFile()) until the total length is
+     * reached.
+     * The chains start with their state at the checkpoint, while the writers
+     * and spill files append to the output of the interrupted run, and the
+     * online statistics continue from the checkpoint. Since the chains draw
+     * from their own random number streams, the resumed run reproduces the
+     * uninterrupted run exactly. The output written by the interrupted run
+     * after its last checkpoint is discarded, so that each step is written
+     * exactly once.
+     * @param filePath
+     */
+    void Resume(const std::string& filePath);
+
     virtual void Initialize();
 
     virtual void Advance(size_t nSteps = 1) = 0;
@@ -128,19 +312,157 @@ public:
     ChainSetStatistics& GetStatistics() { return fStatistics; }
     const ChainSetStatistics& GetStatistics() const { return fStatistics; }
 
+    /**
+     * Get the summary statistics of a chain, accumulated while running.
+     * They cover every step, including the steps discarded by the burn-in
+     * and thinning.
+     * @param cIndex The chain index.
+     * @return
+     */
+    const OnlineStatistics& GetOnlineStatistics(size_t cIndex = 0) const { return fOnlineStatistics[cIndex]; }
+
 protected:
+    /**
+     * Whether the chains returned by GetChain() can be advanced
+     * independently of each other with AdvanceIndependently().
+     * @return
+     */
+    virtual bool CanAdvanceIndependently() const { return false; }
+
+    /**
+     * Advance a single chain by @p nSteps, independently of all other
+     * chains. Invoked concurrently for different chains in asynchronous
+     * mode (see SetAsynchronous()).
+     * @param cIndex The chain index.
+     * @param nSteps
+     */
+    virtual void AdvanceIndependently(size_t cIndex, size_t nSteps);
+
+    /**
+     * Prepare an empty chain according to the storage settings (burn-in,
+     * thinning, compression, window, spill file and capacity), and attach
+     * the online statistics, which count every step of the chain.
+     * Requires NumberOfChains() to be final.
+     * @param chain
+     * @param cIndex The index of the chain returned by GetChain(), -1 for
+     * auxiliary chains (e.g. tempered chains), which are not spilled.
+     */
+    void PrepareChain(Chain& chain, ptrdiff_t cIndex = -1);
+
+    /**
+     * Create the random number engine of a chain, keyed by the seed (see
+     * SetSeed()), the chain index and a sub-index (e.g. the index of a
+     * tempered chain). While advancing a chain, its engine is bound to the
+     * executing thread with a Random::ScopedEngine.
+     * @param cIndex
+     * @param subIndex
+     * @return
+     */
+    Random::engine_type CreateStream(size_t cIndex, size_t subIndex = 0) const;
+
+    /**
+     * Save the sampler specific state to a checkpoint.
+     * The default implementation throws, since the sampler does not
+     * support checkpointing.
+     * @param checkpoint
+     */
+    virtual void SaveState(CheckpointWriter& checkpoint) const;
+
+    /**
+     * Restore the state saved by SaveState() after Initialize().
+     * @param checkpoint
+     */
+    virtual void LoadState(CheckpointReader& checkpoint);
+
+    /**
+     * Evaluate a set of samples like Evaluate(), passing all samples with a
+     * non-zero prior to the batch target function in one call.
+     * Without a batch target function, the samples are evaluated one by one.
+     * @param samples
+     * @param nSamples
+     */
+    void EvaluateBatch(Sample* const* samples, size_t nSamples);
+
     ParameterConfig fParameterConfig;
+    ParameterLimits fLimits;
     DefaultCallable fPrior;
 
     DefaultCallable fLikelihood;
     DefaultCallable fNegLogLikelihood;
+    BatchCallable fBatchNegLogLikelihood;
+    GradientCallable fNegLogLikelihoodGradient;
 
     size_t fTotalLength;
     size_t fCycleLength;
+    size_t fBurnIn;
+    size_t fThinning;
+    bool fCompressRejections;
+    bool fAsynchronous;
+
+    uint64_t fSeed;
+    uint64_t fStreamKey;
+
+    std::string fCheckpointFile;
+    size_t fCheckpointInterval;
+    size_t fCompletedSteps;
+    bool fResuming;         // continue the output of an interrupted run
+    std::vector<size_t> fSpillSizes; // of the resumed chains at the checkpoint
+
+    size_t fChainWindow;
+    std::string fSpillFilePrefix;
+
+    size_t fLikelihoodCacheCapacity;
+    std::shared_ptr<LikelihoodCache> fLikelihoodCache;
 
     std::vector<std::shared_ptr<Writer>> fWriters;
 
     ChainSetStatistics fStatistics;
+    std::vector<OnlineStatistics> fOnlineStatistics;
+    std::vector<Chain> fHistories; // full chains restored from spill files
+
+private:
+    /**
+     * Advance the initialized sampler from fCompletedSteps to the total
+     * length, passing the samples to the writers.
+     */
+    void Execute();
+    void RunCycles(std::vector<size_t>& chainLengths);
+    void RunAsynchronous(std::vector<size_t>& chainLengths);
+
+    void SaveCheckpoint();
+    void LoadCheckpoint(CheckpointReader& checkpoint, const std::string& filePath);
+
+    /**
+     * Pass the samples of a chain appended since @p startIndex to the
+     * writers (serialized by @p writerMutex), and to the online statistics,
+     * unless the chain counts its steps itself (see PrepareChain()).
+     * @param cIndex The chain index.
+     * @param[in,out] startIndex Updated to the current chain length.
+     * @param writerMutex
+     */
+    void Output(size_t cIndex, size_t& startIndex, std::mutex& writerMutex);
+    void LogProgress(size_t cIndex, size_t iStep, size_t nSteps);
+
+    /**
+     * A copyable counter, incremented concurrently by the const evaluation
+     * methods.
+     */
+    struct Counter
+    {
+        Counter() : fValue( 0 ) { }
+        Counter(const Counter& other) : fValue( other.fValue.load() ) { }
+        Counter& operator= (const Counter& other) { fValue = other.fValue.load(); return *this; }
+        void Increment() { fValue.fetch_add( 1, std::memory_order_relaxed ); }
+        std::atomic<size_t> fValue;
+    };
+
+    mutable Counter fNLimitRejections;
+    mutable Counter fNPriorRejections;
+
+    // scratch buffers for batched evaluations
+    std::vector<double> fBatchPoints;
+    std::vector<double> fBatchResults;
+    std::vector<size_t> fBatchIndices;
 };
 
 namespace detail
@@ -194,6 +516,8 @@ inline void Algorithm::SetLikelihood(DefaultCallable likelihood)
 {
     fLikelihood = likelihood;
     fNegLogLikelihood = nullptr;
+    fBatchNegLogLikelihood = nullptr;
+    fNegLogLikelihoodGradient = nullptr;
 }
 
 template <size_t NParams, typename CallableT>
@@ -203,12 +527,16 @@ inline void Algorithm::SetLikelihood(CallableT f)
         return detail::apply_first_n<NParams>(f, v);
     };
     fNegLogLikelihood = nullptr;
+    fBatchNegLogLikelihood = nullptr;
+    fNegLogLikelihoodGradient = nullptr;
 }
 
 inline void Algorithm::SetNegLogLikelihood(DefaultCallable negLoglikelihood)
 {
     fLikelihood = nullptr;
     fNegLogLikelihood = negLoglikelihood;
+    fBatchNegLogLikelihood = nullptr;
+    fNegLogLikelihoodGradient = nullptr;
 }
 
 template <size_t NParams, typename CallableT>
@@ -218,12 +546,39 @@ inline void Algorithm::SetNegLogLikelihood(CallableT f)
     fNegLogLikelihood = [=](const std::vector<double>& v) {
         return detail::apply_first_n<NParams>(f, v);
     };
+    fBatchNegLogLikelihood = nullptr;
+    fNegLogLikelihoodGradient = nullptr;
+}
+
+inline void Algorithm::SetBatchNegLogLikelihood(BatchCallable f)
+{
+    fLikelihood = nullptr;
+    // single points are evaluated as batches of size 1
+    fNegLogLikelihood = [=](const std::vector<double>& v) {
+        double result;
+        f( v.data(), 1, v.size(), &result );
+        return result;
+    };
+    fBatchNegLogLikelihood = f;
+    fNegLogLikelihoodGradient = nullptr;
+}
+
+inline void Algorithm::SetNegLogLikelihoodGradient(GradientCallable f)
+{
+    fLikelihood = nullptr;
+    // samplers without use for the gradient evaluate it into a local buffer
+    fNegLogLikelihood = [=](const std::vector<double>& v) {
+        std::vector<double> gradient( v.size() );
+        return f( v, gradient );
+    };
+    fBatchNegLogLikelihood = nullptr;
+    fNegLogLikelihoodGradient = f;
 }
 
 template <typename WriterT, typename... ArgsT>
 inline void Algorithm::AddWriter(ArgsT&&... args)
 {
-    fWriters.emplace_back( std::make_shared<WriterT>(std::forward<ArgsT>(args)...) );
+    AddWriter( std::make_shared<WriterT>(std::forward<ArgsT>(args)...) );
 }
 
 } /* namespace vmcmc */
@@ -73,6 +73,55 @@ inline size_t choleskyDecompose(const InputMatrix& A, OutputTriangularMatrix& L)
     return 0;
 }
 
+/**
+ * Rank-1 update (or downdate) of a Cholesky decomposition in O(n^2):
+ * Given L with A = L L^T, compute the decomposition of A + x x^T (or
+ * A - x x^T) in place.
+ * A zero column of L (e.g. of a fixed parameter) is left unchanged, if the
+ * corresponding element of x is zero.
+ * @param L Lower triangular matrix, the Cholesky decomposition to be updated.
+ * @param x The update vector. Used as scratch buffer and overwritten.
+ * @param downdate If true, x x^T is subtracted instead of added.
+ * @return Nonzero if the downdated matrix is not positive definit (then the
+ * value is 1 + the number of the failing row and L is left in an undefined
+ * state)
+ */
+template <typename TriangularMatrix, typename VectorT>
+inline size_t choleskyUpdate(TriangularMatrix& L, VectorT& x, bool downdate = false)
+{
+    assert(L.size1() == L.size2());
+    assert(L.size1() == x.size());
+
+    const size_t n = L.size1();
+    const double sign = (downdate) ? -1.0 : 1.0;
+
+    for (size_t k = 0; k < n; k++) {
+
+        const double L_kk = L(k, k);
+
+        if (L_kk == 0 && x(k) == 0)
+            continue;
+
+        const double qr = L_kk * L_kk + sign * x(k) * x(k);
+
+        if (qr <= 0 || L_kk == 0) {
+            return 1 + k;
+        }
+
+        const double r = sqrt(qr);
+        const double c = r / L_kk;
+        const double s = x(k) / L_kk;
+        L(k, k) = r;
+
+        for (size_t i = k + 1; i < n; i++) {
+            const double L_ik = (L(i, k) + sign * s * x(i)) / c;
+            L(i, k) = L_ik;
+            x(i) = c * x(i) - s * L_ik;
+        }
+    }
+    return 0;
+}
+
 } /* namespace vmcmc */
 
 
@@ -0,0 +1,153 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/cache.hpp>
+#include <vmcmc/logger.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace vmcmc
+{
+
+LOG_DEFINE("vmcmc.cache");
+
+struct LikelihoodCache::Shard
+{
+    mutex fMutex;
+    vector<double> fKeys;      // parameter values of each slot
+    vector<double> fResults;   // likelihood and -log(likelihood) of each slot
+    vector<uint8_t> fOccupied;
+    size_t fHits = 0;
+    size_t fMisses = 0;
+
+    // keep the locks of neighbouring shards on separate cache lines
+    char fPadding[64];
+};
+
+LikelihoodCache::LikelihoodCache(size_t capacity, size_t nParams, size_t nShards) :
+    fNParams( nParams ),
+    fNShards( 1 ),
+    fNSlots( 1 )
+{
+    LOG_ASSERT( capacity > 0, "A likelihood cache requires a non-zero capacity." );
+
+    nShards = std::min( std::max<size_t>( nShards, 1 ), capacity );
+    while (fNShards < nShards)
+        fNShards *= 2;
+
+    fNSlots = std::max<size_t>( capacity / fNShards, 1 );
+
+    fShards.reset( new Shard[fNShards] );
+    for (size_t i = 0; i < fNShards; i++) {
+        Shard& shard = fShards[i];
+        shard.fKeys.resize( fNSlots * fNParams );
+        shard.fResults.resize( 2 * fNSlots );
+        shard.fOccupied.assign( fNSlots, 0 );
+    }
+}
+
+LikelihoodCache::~LikelihoodCache()
+{ }
+
+uint64_t LikelihoodCache::Hash(const double* values) const
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ull;
+
+    for (size_t i = 0; i < fNParams; i++) {
+        uint64_t bits;
+        memcpy( &bits, values + i, sizeof(bits) );
+        hash ^= bits + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+    }
+
+    // splitmix64 finalizer
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+LikelihoodCache::Shard& LikelihoodCache::GetShard(uint64_t hash)
+{
+    return fShards[hash & (fNShards-1)];
+}
+
+bool LikelihoodCache::Find(const double* values, double& likelihood, double& negLogLikelihood)
+{
+    const uint64_t hash = Hash( values );
+    const size_t slot = GetSlot( hash );
+    Shard& shard = GetShard( hash );
+
+    lock_guard<mutex> lock( shard.fMutex );
+
+    // compare the bit patterns, thus the exact parameter values
+    if (shard.fOccupied[slot] && memcmp( &shard.fKeys[slot * fNParams], values,
+            fNParams * sizeof(double) ) == 0) {
+        likelihood = shard.fResults[2*slot];
+        negLogLikelihood = shard.fResults[2*slot+1];
+        shard.fHits++;
+        return true;
+    }
+
+    shard.fMisses++;
+    return false;
+}
+
+void LikelihoodCache::Insert(const double* values, double likelihood, double negLogLikelihood)
+{
+    const uint64_t hash = Hash( values );
+    const size_t slot = GetSlot( hash );
+    Shard& shard = GetShard( hash );
+
+    lock_guard<mutex> lock( shard.fMutex );
+
+    copy( values, values + fNParams, shard.fKeys.begin() + slot * fNParams );
+    shard.fResults[2*slot] = likelihood;
+    shard.fResults[2*slot+1] = negLogLikelihood;
+    shard.fOccupied[slot] = 1;
+}
+
+void LikelihoodCache::clear()
+{
+    for (size_t i = 0; i < fNShards; i++) {
+        Shard& shard = fShards[i];
+        lock_guard<mutex> lock( shard.fMutex );
+        shard.fOccupied.assign( fNSlots, 0 );
+        shard.fHits = 0;
+        shard.fMisses = 0;
+    }
+}
+
+size_t LikelihoodCache::GetHits() const
+{
+    size_t result = 0;
+    for (size_t i = 0; i < fNShards; i++) {
+        lock_guard<mutex> lock( fShards[i].fMutex );
+        result += fShards[i].fHits;
+    }
+    return result;
+}
+
+size_t LikelihoodCache::GetMisses() const
+{
+    size_t result = 0;
+    for (size_t i = 0; i < fNShards; i++) {
+        lock_guard<mutex> lock( fShards[i].fMutex );
+        result += fShards[i].fMisses;
+    }
+    return result;
+}
+
+} /* namespace vmcmc */
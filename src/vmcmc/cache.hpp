@@ -0,0 +1,88 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief A bounded, thread-safe cache of target function results.
+ */
+
+#ifndef VMCMC_CACHE_H_
+#define VMCMC_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vmcmc
+{
+
+/**
+ * Memoizes the likelihood of points in the parameter space, keyed by the
+ * exact (bitwise) parameter values.
+ *
+ * The cache is split into shards, each guarded by its own mutex, such that
+ * concurrent threads rarely contend for the same lock. Each shard is a
+ * direct-mapped table of fixed size: a new entry replaces the entry in its
+ * slot, which bounds the memory footprint without any bookkeeping.
+ */
+class LikelihoodCache
+{
+public:
+    /**
+     * Construct a cache.
+     * @param capacity The maximum number of entries.
+     * @param nParams The number of parameters of each point.
+     * @param nShards The number of shards, rounded up to a power of two.
+     */
+    LikelihoodCache(size_t capacity, size_t nParams, size_t nShards = 64);
+    ~LikelihoodCache();
+
+    LikelihoodCache(const LikelihoodCache& other) = delete;
+    void operator=(const LikelihoodCache& other) = delete;
+
+    /**
+     * Look up the results for a point.
+     * @param values The parameter values.
+     * @param[out] likelihood
+     * @param[out] negLogLikelihood
+     * @return True on a cache hit.
+     */
+    bool Find(const double* values, double& likelihood, double& negLogLikelihood);
+
+    /**
+     * Store the results for a point, replacing any other entry in its slot.
+     * @param values The parameter values.
+     * @param likelihood
+     * @param negLogLikelihood
+     */
+    void Insert(const double* values, double likelihood, double negLogLikelihood);
+
+    void clear();
+
+    size_t GetCapacity() const { return fNShards * fNSlots; }
+    size_t GetNumberOfParams() const { return fNParams; }
+
+    size_t GetHits() const;
+    size_t GetMisses() const;
+
+private:
+    struct Shard;
+
+    uint64_t Hash(const double* values) const;
+    Shard& GetShard(uint64_t hash);
+    size_t GetSlot(uint64_t hash) const { return (hash >> 32) % fNSlots; }
+
+    size_t fNParams;
+    size_t fNShards;
+    size_t fNSlots; // per shard
+    std::unique_ptr<Shard[]> fShards;
+};
+
+} /* namespace vmcmc */
+
+#endif /* VMCMC_CACHE_H_ */
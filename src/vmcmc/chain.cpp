@@ -9,17 +9,562 @@
  */
 
 #include <vmcmc/chain.hpp>
+#include <vmcmc/checkpoint.hpp>
+#include <vmcmc/exception.hpp>
 #include <vmcmc/logger.hpp>
 #include <vmcmc/math.hpp>
 
 #include <boost/numeric/ublas/io.hpp>
 
+#include <fstream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 using namespace std;
 
 namespace vmcmc {
 
 LOG_DEFINE("vmcmc.chain");
 
+Chain::Block::Block(size_t nParams, size_t nRows, bool withRunStarts) :
+    Block( nParams, nRows, withRunStarts, nullptr,
+        new char[BlockBytes( nParams, nRows, withRunStarts )] )
+{
+    // one allocation per block, partitioned into the individual columns
+    char* buffer = reinterpret_cast<char*>( fValues );
+    fStorage.reset( buffer, [](void* ptr) { delete[] static_cast<char*>(ptr); } );
+}
+
+Chain::Block::Block(size_t nParams, size_t nRows, bool withRunStarts,
+        shared_ptr<void> storage, char* buffer) :
+    fStorage( storage )
+{
+    // all double/uint64 columns first, to keep them properly aligned
+    fValues            = reinterpret_cast<double*>( buffer );
+    fNegLogLikelihoods = fValues + nRows * nParams;
+    fLikelihoods       = fNegLogLikelihoods + nRows;
+    fPriors            = fLikelihoods + nRows;
+    fGenerations       = reinterpret_cast<uint64_t*>( fPriors + nRows );
+    fRunStarts         = (withRunStarts) ? fGenerations + nRows : nullptr;
+    fAccepted          = reinterpret_cast<uint8_t*>( fGenerations + (withRunStarts ? 2 : 1) * nRows );
+}
+
+size_t Chain::BlockBytes(size_t nParams, size_t nRows, bool withRunStarts)
+{
+    return nRows * ((nParams + 3) * sizeof(double)
+        + (withRunStarts ? 2 : 1) * sizeof(uint64_t) + sizeof(uint8_t));
+}
+
+Chain::Chain(size_t nParams, size_t blockSize) :
+    fNParams( nParams ),
+    fBlockShift( 0 ),
+    fBlockMask( 0 ),
+    fCompressed( false ),
+    fSize( 0 ),
+    fNRuns( 0 ),
+    fBurnIn( 0 ),
+    fThinning( 1 ),
+    fNSteps( 0 ),
+    fNAcceptedSteps( 0 ),
+    fLastStepStored( false ),
+    fOnlineStatistics( nullptr ),
+    fWindowBlocks( 0 ),
+    fFirstBlock( 0 ),
+    fSpillOffset( 0 )
+{
+    // round the block size up to the next power of 2
+    while (((size_t) 1 << fBlockShift) < blockSize)
+        fBlockShift++;
+
+    fBlockMask = ((size_t) 1 << fBlockShift) - 1;
+}
+
+Chain::Chain(const Chain& other) :
+    Chain( other.fNParams, other.GetBlockSize() )
+{
+    *this = other;
+}
+
+Chain::Chain(Chain&& other) :
+    fNParams( other.fNParams ),
+    fBlockShift( other.fBlockShift ),
+    fBlockMask( other.fBlockMask ),
+    fCompressed( other.fCompressed ),
+    fSize( other.fSize ),
+    fNRuns( other.fNRuns ),
+    fBlocks( move(other.fBlocks) ),
+    fBurnIn( other.fBurnIn ),
+    fThinning( other.fThinning ),
+    fNSteps( other.fNSteps ),
+    fNAcceptedSteps( other.fNAcceptedSteps ),
+    fLastStepStored( other.fLastStepStored ),
+    fOnlineStatistics( other.fOnlineStatistics ),
+    fWindowBlocks( other.fWindowBlocks ),
+    fFirstBlock( other.fFirstBlock ),
+    fSpillFile( move(other.fSpillFile) ),
+    fSpillStream( move(other.fSpillStream) ),
+    fSpillOffset( other.fSpillOffset )
+{
+    other.fSpillFile.clear();
+    other.fOnlineStatistics = nullptr;
+    other.clear();
+}
+
+Chain::~Chain()
+{ }
+
+Chain& Chain::operator=(const Chain& other)
+{
+    if (this == &other)
+        return *this;
+
+    clear();
+
+    fNParams = other.fNParams;
+    fBlockShift = other.fBlockShift;
+    fBlockMask = other.fBlockMask;
+    fCompressed = other.fCompressed;
+    // the window is copied, but not the spill file
+    fSpillFile.clear();
+    fSpillStream.reset();
+    fSpillOffset = 0;
+    fWindowBlocks = other.fWindowBlocks;
+    fFirstBlock = other.fFirstBlock;
+
+    const size_t firstRun = other.GetFirstIndex();
+    fNRuns = firstRun;
+
+    reserve( other.fNRuns - firstRun );
+
+    // copy row by row, keeping the runs of a compressed chain intact
+    for (size_t run = firstRun; run < other.fNRuns; run++) {
+        fSize = other.GetRunStart(run);
+        AppendRun();
+
+        Block& block = Locate(run);
+        const size_t offset = Offset(run);
+
+        const double* values = other.GetRunValues(run);
+        copy( values, values + fNParams, block.fValues + offset * fNParams );
+
+        block.fNegLogLikelihoods[offset] = other.GetRunNegLogLikelihood(run);
+        block.fLikelihoods[offset]       = other.GetRunLikelihood(run);
+        block.fPriors[offset]            = other.GetRunPrior(run);
+        block.fGenerations[offset]       = other.GetRunGeneration(run);
+        block.fAccepted[offset]          = other.IsRunAccepted(run);
+    }
+
+    fSize = other.fSize;
+
+    fBurnIn = other.fBurnIn;
+    fThinning = other.fThinning;
+    fNSteps = other.fNSteps;
+    fNAcceptedSteps = other.fNAcceptedSteps;
+    fLastStepStored = other.fLastStepStored;
+
+    return *this;
+}
+
+Chain& Chain::operator=(Chain&& other)
+{
+    fNParams = other.fNParams;
+    fBlockShift = other.fBlockShift;
+    fBlockMask = other.fBlockMask;
+    fCompressed = other.fCompressed;
+    fSize = other.fSize;
+    fNRuns = other.fNRuns;
+    fBlocks = move(other.fBlocks);
+    fBurnIn = other.fBurnIn;
+    fThinning = other.fThinning;
+    fNSteps = other.fNSteps;
+    fNAcceptedSteps = other.fNAcceptedSteps;
+    fLastStepStored = other.fLastStepStored;
+    fOnlineStatistics = other.fOnlineStatistics;
+    fWindowBlocks = other.fWindowBlocks;
+    fFirstBlock = other.fFirstBlock;
+    fSpillFile = move(other.fSpillFile);
+    fSpillStream = move(other.fSpillStream);
+    fSpillOffset = other.fSpillOffset;
+
+    other.fSpillFile.clear();
+    other.fOnlineStatistics = nullptr;
+    other.clear();
+
+    return *this;
+}
+
+void Chain::SetCompressed(bool compress)
+{
+    if (compress == fCompressed)
+        return;
+
+    if (fSize > 0)
+        throw Exception() << "The compression of a non-empty chain cannot be changed.";
+
+    if (compress && IsWindowed())
+        throw Exception() << "A chain with a window cannot be compressed.";
+
+    // the run start column is part of the block layout
+    fBlocks.clear();
+    fCompressed = compress;
+}
+
+void Chain::SetThinning(size_t burnIn, size_t interval)
+{
+    if (fSize > 0 || fNSteps > 0)
+        throw Exception() << "The thinning of a non-empty chain cannot be changed.";
+
+    fBurnIn = burnIn;
+    fThinning = max<size_t>( interval, 1 );
+}
+
+void Chain::SetWindow(size_t nRows)
+{
+    if (fSize > 0)
+        throw Exception() << "The window of a non-empty chain cannot be changed.";
+
+    if (nRows > 0 && fCompressed)
+        throw Exception() << "A compressed chain cannot have a window.";
+
+    // the newest block may hold a single row only
+    fWindowBlocks = (nRows == 0) ? 0 : ((nRows + fBlockMask) >> fBlockShift) + 1;
+    fBlocks.clear();
+}
+
+void Chain::SetSpillFile(const string& filePath, size_t keepBytes)
+{
+    if (fSize > 0)
+        throw Exception() << "The spill file of a non-empty chain cannot be changed.";
+
+    fSpillFile = filePath;
+    fSpillStream.reset();
+    fSpillOffset = keepBytes;
+
+    if (fSpillFile.empty())
+        return;
+
+    struct stat fileStat;
+    const size_t fileSize = (stat( fSpillFile.c_str(), &fileStat ) == 0) ? fileStat.st_size : 0;
+
+    if (fileSize < keepBytes)
+        throw Exception() << "The spill file '" << fSpillFile << "' is shorter than "
+            << keepBytes << " bytes.";
+
+    fSpillStream.reset( new ofstream );
+    OpenSpillFile();
+}
+
+size_t Chain::SyncSpillFile() const
+{
+    if (!fSpillStream)
+        return 0;
+
+    fSpillStream->flush();
+    if (fSpillStream->fail())
+        throw Exception() << "Cannot write to spill file '" << fSpillFile << "'.";
+
+    syncFile( fSpillFile );
+
+    return fSpillOffset + fFirstBlock * BlockBytes( fNParams, GetBlockSize(), false );
+}
+
+void Chain::OpenSpillFile()
+{
+    fSpillStream->close();
+
+    // keep the content preceding the spilled blocks
+    if (fSpillOffset > 0 && truncate( fSpillFile.c_str(), fSpillOffset ) != 0)
+        throw Exception() << "Cannot truncate spill file '" << fSpillFile << "'.";
+
+    fSpillStream->open( fSpillFile, ios::binary | ((fSpillOffset > 0) ? ios::app : ios::trunc) );
+
+    if (!fSpillStream->is_open())
+        throw Exception() << "Cannot open spill file '" << fSpillFile << "'.";
+}
+
+void Chain::Spill(const Block& block)
+{
+    if (!fSpillStream)
+        return;
+
+    fSpillStream->write( reinterpret_cast<const char*>( block.fValues ),
+        BlockBytes( fNParams, GetBlockSize(), false ) );
+
+    if (fSpillStream->fail())
+        throw Exception() << "Cannot write to spill file '" << fSpillFile << "'.";
+}
+
+Chain Chain::GetHistory() const
+{
+    if (fFirstBlock == 0)
+        return *this;
+
+    if (!fSpillStream)
+        throw Exception() << "The evicted steps of the chain were not spilled to a file.";
+
+    fSpillStream->flush();
+
+    const size_t blockBytes = BlockBytes( fNParams, GetBlockSize(), false );
+    // the mapping starts at a page boundary, so the preceding content is included
+    const size_t mappedBytes = fSpillOffset + fFirstBlock * blockBytes;
+
+    const int fd = open( fSpillFile.c_str(), O_RDONLY );
+    if (fd < 0)
+        throw Exception() << "Cannot open spill file '" << fSpillFile << "'.";
+
+    // the blocks are mapped privately, so that they are writable like regular blocks
+    void* address = mmap( nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    close( fd );
+
+    if (address == MAP_FAILED)
+        throw Exception() << "Cannot map spill file '" << fSpillFile << "'.";
+
+    shared_ptr<void> mapping( address, [mappedBytes](void* ptr) { munmap( ptr, mappedBytes ); } );
+
+    Chain history( fNParams, GetBlockSize() );
+
+    char* blocks = static_cast<char*>(address) + fSpillOffset;
+    for (size_t iBlock = 0; iBlock < fFirstBlock; iBlock++)
+        history.AppendBlock( mapping, blocks + iBlock * blockBytes, GetBlockSize() );
+
+    for (size_t row = GetFirstIndex(); row < fNRuns; row++)
+        history.push_back( GetRunValues(row), GetRunNegLogLikelihood(row), GetRunLikelihood(row),
+            GetRunPrior(row), GetRunGeneration(row), IsRunAccepted(row) );
+
+    return history;
+}
+
+void Chain::AppendBlock(shared_ptr<void> storage, void* data, size_t nRows)
+{
+    if (fCompressed || IsWindowed())
+        throw Exception() << "External blocks cannot be appended to a compressed or windowed chain.";
+
+    if (fNRuns != capacity())
+        throw Exception() << "External blocks can only be appended to a chain with full blocks.";
+
+    LOG_ASSERT( nRows <= GetBlockSize() );
+
+    fBlocks.emplace_back( fNParams, GetBlockSize(), false, storage, static_cast<char*>(data) );
+
+    fSize += nRows;
+    fNRuns += nRows;
+
+    // count the appended steps like pushed ones
+    const Block& block = fBlocks.back();
+    for (size_t i = 0; i < nRows; i++)
+        if (block.fAccepted[i] && fNSteps + i > 0)
+            fNAcceptedSteps++;
+
+    fNSteps += nRows;
+    fLastStepStored = (nRows > 0);
+}
+
+void Chain::reserve(size_t n)
+{
+    size_t nBlocks = (n + fBlockMask) >> fBlockShift;
+
+    if (IsWindowed())
+        nBlocks = min( nBlocks, fWindowBlocks );
+
+    fBlocks.reserve( nBlocks );
+
+    while (fBlocks.size() < nBlocks)
+        fBlocks.emplace_back( fNParams, GetBlockSize(), fCompressed );
+}
+
+void Chain::clear()
+{
+    fBlocks.clear();
+
+    Rewind();
+}
+
+void Chain::Rewind()
+{
+    fSize = 0;
+    fNRuns = 0;
+    fFirstBlock = 0;
+    fNSteps = 0;
+    fNAcceptedSteps = 0;
+    fLastStepStored = false;
+
+    if (fSpillStream)
+        OpenSpillFile();
+}
+
+void Chain::Grow()
+{
+    if (IsWindowed() && fBlocks.size() >= fWindowBlocks) {
+        // evict the oldest block and recycle its storage for the new rows
+        Spill( fBlocks.front() );
+        rotate( fBlocks.begin(), fBlocks.begin() + 1, fBlocks.end() );
+        fFirstBlock++;
+        return;
+    }
+
+    fBlocks.emplace_back( fNParams, GetBlockSize(), fCompressed );
+}
+
+void Chain::AppendRun()
+{
+    if (fNRuns == capacity())
+        Grow();
+
+    if (fCompressed)
+        Locate(fNRuns).fRunStarts[Offset(fNRuns)] = fSize;
+
+    fNRuns++;
+}
+
+size_t Chain::FindCompressedRun(size_t index) const
+{
+    LOG_ASSERT( index < fSize );
+
+    // find the last block starting at or before index
+    const size_t nUsedBlocks = (fNRuns + fBlockMask) >> fBlockShift;
+
+    const auto blockIt = upper_bound( fBlocks.begin(), fBlocks.begin() + nUsedBlocks, index,
+        [](size_t i, const Block& block) { return i < block.fRunStarts[0]; } );
+
+    const size_t iBlock = distance( fBlocks.begin(), blockIt ) - 1;
+    const size_t nRows = min( GetBlockSize(), fNRuns - (iBlock << fBlockShift) );
+
+    // then find the last run in that block starting at or before index
+    const uint64_t* runStarts = fBlocks[iBlock].fRunStarts;
+    const size_t offset = distance( runStarts, upper_bound( runStarts, runStarts + nRows, index ) ) - 1;
+
+    return (iBlock << fBlockShift) + offset;
+}
+
+bool Chain::ExtendsLastRun(bool accepted, const double* values) const
+{
+    // the generations of a run must be consecutive
+    if (!fCompressed || accepted || fNRuns == 0 || fThinning > 1)
+        return false;
+
+    const double* lastValues = GetRunValues(fNRuns-1);
+    return equal( values, values + fNParams, lastValues );
+}
+
+void Chain::push_back(const Sample& sample)
+{
+    if (fNParams == 0 && fSize == 0) {
+        // adopt the number of parameters from the first sample
+        fBlocks.clear();
+        fNParams = sample.size();
+    }
+
+    LOG_ASSERT( sample.size() == fNParams, "Sample size " << sample.size()
+        << " does not match the chain's number of parameters " << fNParams << "." );
+
+    push_back( &sample.Values()[0], sample.GetNegLogLikelihood(), sample.GetLikelihood(),
+        sample.GetPrior(), sample.GetGeneration(), sample.IsAccepted() );
+}
+
+void Chain::push_back(const SampleView& sample)
+{
+    if (fNParams == 0 && fSize == 0) {
+        fBlocks.clear();
+        fNParams = sample.size();
+    }
+
+    LOG_ASSERT( sample.size() == fNParams, "Sample size " << sample.size()
+        << " does not match the chain's number of parameters " << fNParams << "." );
+
+    push_back( sample.Values().begin(), sample.GetNegLogLikelihood(), sample.GetLikelihood(),
+        sample.GetPrior(), sample.GetGeneration(), sample.IsAccepted() );
+}
+
+void Chain::push_back(const double* values, double negLogLikelihood, double likelihood,
+    double prior, size_t generation, bool accepted)
+{
+    // the first step has no preceding state to be accepted from
+    if (accepted && fNSteps > 0)
+        fNAcceptedSteps++;
+    fNSteps++;
+
+    if (fOnlineStatistics)
+        fOnlineStatistics->Add( values, accepted );
+
+    fLastStepStored = IsStored( generation );
+    if (!fLastStepStored)
+        return;
+
+    if (ExtendsLastRun( accepted, values )) {
+        // a rejected step only increases the multiplicity of the last state
+        fSize++;
+        return;
+    }
+
+    AppendRun();
+    WriteRow( fNRuns-1, values, negLogLikelihood, likelihood, prior, generation, accepted );
+    fSize++;
+}
+
+Sample Chain::GetSample(size_t index) const
+{
+    Sample result( fNParams );
+    GetSample( index, result );
+    return result;
+}
+
+void Chain::GetSample(size_t index, Sample& target) const
+{
+    LOG_ASSERT( index < fSize );
+
+    const size_t run = FindRun(index);
+    const double* values = GetRunValues(run);
+
+    if (target.size() != fNParams)
+        target.Values().resize( fNParams, false );
+
+    copy( values, values + fNParams, target.Values().begin() );
+
+    target.SetNegLogLikelihood( GetRunNegLogLikelihood(run) );
+    target.SetLikelihood( GetRunLikelihood(run) );
+    target.SetPrior( GetRunPrior(run) );
+    target.SetGeneration( GetRunGeneration(run) + (index - GetRunStart(run)) );
+    target.SetAccepted( index == GetRunStart(run) && IsRunAccepted(run) );
+}
+
+void Chain::SetSample(size_t index, const Sample& sample)
+{
+    LOG_ASSERT( index < fSize && sample.size() == fNParams );
+
+    size_t run = FindRun(index);
+
+    if (GetRunLength(run) > 1) {
+        // split the last step off a compressed run
+        if (index != fSize-1)
+            throw Exception() << "Cannot overwrite step " << index << " inside a compressed run.";
+
+        AppendRun();
+        run = fNRuns - 1;
+        Locate(run).fRunStarts[Offset(run)] = index;
+    }
+
+    WriteRow( run, &sample.Values()[0], sample.GetNegLogLikelihood(), sample.GetLikelihood(),
+        sample.GetPrior(), sample.GetGeneration(), sample.IsAccepted() );
+}
+
+void Chain::WriteRow(size_t run, const double* values, double negLogLikelihood,
+    double likelihood, double prior, size_t generation, bool accepted)
+{
+    Block& block = Locate(run);
+    const size_t offset = Offset(run);
+
+    copy( values, values + fNParams, block.fValues + offset * fNParams );
+
+    block.fNegLogLikelihoods[offset] = negLogLikelihood;
+    block.fLikelihoods[offset]       = likelihood;
+    block.fPriors[offset]            = prior;
+    block.fGenerations[offset]       = generation;
+    block.fAccepted[offset]          = accepted;
+}
+
 ChainStatistics::ChainStatistics(const Chain& sampleChain) :
     fSampleChain( sampleChain ),
     fSelectedRange{ 0, -1 }
@@ -40,6 +585,7 @@ void ChainStatistics::Reset()
     fCholesky.reset();
 
     fAutoCorrelation.clear();
+    fAutoCorrelationFunction.clear();
     fAutoCorrelationTime.reset();
 
     fAccRate.reset();
@@ -64,13 +610,17 @@ pair<size_t, size_t> ChainStatistics::GetIndices() const
 {
     const size_t N = fSampleChain.size();
 
-    const size_t startIndex = std::min<size_t>(N, (fSelectedRange.first < 0)
+    // evicted steps of a windowed chain are not available anymore
+    const size_t startIndex = std::max<size_t>(fSampleChain.GetFirstIndex(),
+        std::min<size_t>(N, (fSelectedRange.first < 0)
             ? N + fSelectedRange.first
-            : fSelectedRange.first );
+            : fSelectedRange.first ));
 
-    const size_t endIndex = std::min<size_t>(N, (fSelectedRange.second < 0)
+    // a selection ending before the window yields an empty range
+    const size_t endIndex = std::max<size_t>(startIndex,
+        std::min<size_t>(N, (fSelectedRange.second < 0)
             ? N + fSelectedRange.second + 1
-            : fSelectedRange.second );
+            : fSelectedRange.second ));
 
     assert(startIndex >= 0 && endIndex >= startIndex);
 
@@ -83,21 +633,42 @@ pair<Chain::const_iterator, Chain::const_iterator> ChainStatistics::GetIterators
     return make_pair( next(begin(fSampleChain), indexPair.first), next(begin(fSampleChain), indexPair.second) );
 }
 
+vector<pair<double, size_t>> ChainStatistics::GetSortedColumn(size_t paramIndex) const
+{
+    // collect each selected run's value together with its multiplicity
+    vector<pair<double, size_t>> column;
+
+    ForEachRun( [&](size_t run, size_t weight) {
+        column.emplace_back( fSampleChain.GetRunValues(run)[paramIndex], weight );
+    } );
+
+    sort( column.begin(), column.end() );
+
+    return column;
+}
+
 const Sample& ChainStatistics::GetMode()
 {
     if (fMode)
         return fMode.get();
 
-    auto itRange = GetIterators();
+    auto indexRange = GetIndices();
 
     Sample result( NumberOfParams() );
 
-    if (itRange.first != itRange.second) {
-        result = *min_element( itRange.first, itRange.second,
-            [](const Sample& s1, const Sample& s2) {
-                return s1.GetNegLogLikelihood() < s2.GetNegLogLikelihood();
+    if (indexRange.first != indexRange.second) {
+        size_t modeIndex = indexRange.first;
+        double minNegLogLikelihood = fSampleChain.GetNegLogLikelihood(modeIndex);
+
+        ForEachRun( [&](size_t run, size_t) {
+            const double nll = fSampleChain.GetRunNegLogLikelihood(run);
+            if (nll < minNegLogLikelihood) {
+                minNegLogLikelihood = nll;
+                modeIndex = fSampleChain.GetRunStart(run);
             }
-        );
+        } );
+
+        fSampleChain.GetSample( modeIndex, result );
     }
 
     fMode = move(result);
@@ -109,16 +680,23 @@ Sample& ChainStatistics::GetMean()
     if (fMean)
         return fMean.get();
 
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
+    auto indexRange = GetIndices();
+    const size_t N = indexRange.second - indexRange.first;
 
-    Sample result( NumberOfParams() );
+    const size_t nParams = NumberOfParams();
+    Sample result( nParams );
 
     if (N > 0) {
-        for (auto it = itRange.first; it != itRange.second; ++it)
-            result += *it;
+        vector<double> sum( nParams, 0.0 );
 
-        result /= (double) N;
+        ForEachRun( [&](size_t run, size_t weight) {
+            const double* values = fSampleChain.GetRunValues(run);
+            for (size_t p = 0; p < nParams; p++)
+                sum[p] += (double) weight * values[p];
+        } );
+
+        for (size_t p = 0; p < nParams; p++)
+            result[p] = sum[p] / (double) N;
     }
 
     fMean = move(result);
@@ -132,27 +710,25 @@ double ChainStatistics::GetMedian(size_t paramIndex)
     if (mapIt != fMedian.end())
         return mapIt->second;
 
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
+    auto indexRange = GetIndices();
+    const size_t N = indexRange.second - indexRange.first;
 
-    double result = fMedian.emplace( paramIndex, numeric::NaN() ).first->second;
+    double& result = fMedian.emplace( paramIndex, numeric::NaN() ).first->second;
 
     if (N > 0) {
-        using SampleRef = reference_wrapper<const Sample>;
-
-        auto cmp = [=](const SampleRef& s1, const SampleRef& s2) -> bool {
-            return s1.get().Values()[paramIndex] < s2.get().Values()[paramIndex];
-        };
+        // Sort the selected parameter column (one entry per run), then pick
+        // the entry covering the central step.
 
-        // Construct a view of all samples, then sort with respect to the
-        // selected parameter using the selection algorith 'nth_element'.
+        const vector<pair<double, size_t>> column = GetSortedColumn( paramIndex );
 
-        vector<SampleRef> test( itRange.first, itRange.second );
-        auto middleIt = next( test.begin(), (N/2) );
-        nth_element( test.begin(), middleIt, test.end(), cmp);
-
-        const Sample& medianSample = middleIt->get();
-        result = medianSample.Values()[paramIndex];
+        size_t cumulativeWeight = 0;
+        for (const auto& entry : column) {
+            cumulativeWeight += entry.second;
+            if (cumulativeWeight > N/2) {
+                result = entry.first;
+                break;
+            }
+        }
     }
 
     return result;
@@ -163,17 +739,20 @@ const Vector& ChainStatistics::GetVariance()
     if (fVariance)
         return fVariance.get();
 
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
+    auto indexRange = GetIndices();
+    const size_t N = indexRange.second - indexRange.first;
 
     const Sample& mean = GetMean();
 
-    Vector result( NumberOfParams() );
+    const size_t nParams = NumberOfParams();
+    Vector result( nParams, 0.0 );
 
     if (N > 1) {
-        for (auto it = itRange.first; it != itRange.second; it++)
-            for (size_t p = 0; p < result.size(); p++)
-                result[p] += math::pow<2>( it->Values()[p] - mean.Values()[p] );
+        ForEachRun( [&](size_t run, size_t weight) {
+            const double* values = fSampleChain.GetRunValues(run);
+            for (size_t p = 0; p < nParams; p++)
+                result[p] += (double) weight * math::pow<2>( values[p] - mean[p] );
+        } );
 
         result /= (double) (N-1);
     }
@@ -201,19 +780,22 @@ const Vector& ChainStatistics::GetRms()
     if (fRms)
         return fRms.get();
 
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
+    auto indexRange = GetIndices();
+    const size_t N = indexRange.second - indexRange.first;
 
-    Vector result( NumberOfParams() );
+    const size_t nParams = NumberOfParams();
+    Vector result( nParams, 0.0 );
 
     if (N > 0) {
-        for (auto it = itRange.first; it != itRange.second; it++)
-            for (size_t p = 0; p < result.size(); p++)
-                result[p] += math::pow<2>( it->Values()[p] );
+        ForEachRun( [&](size_t run, size_t weight) {
+            const double* values = fSampleChain.GetRunValues(run);
+            for (size_t p = 0; p < nParams; p++)
+                result[p] += (double) weight * math::pow<2>( values[p] );
+        } );
 
         result /= (double) N;
 
-        for (size_t p = 0; p < result.size(); p++)
+        for (size_t p = 0; p < nParams; p++)
             result[p] = sqrt( result[p] );
     }
 
@@ -226,8 +808,8 @@ const MatrixLower& ChainStatistics::GetCovarianceMatrix()
     if (fCovariance)
         return fCovariance.get();
 
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
+    auto indexRange = GetIndices();
+    const size_t N = indexRange.second - indexRange.first;
 
     const size_t nParams = NumberOfParams();
 
@@ -237,15 +819,21 @@ const MatrixLower& ChainStatistics::GetCovarianceMatrix()
 
         const Sample& mean = GetMean();
 
-        for (auto it = itRange.first; it != itRange.second; it++) {
+        vector<double> diff( nParams );
+
+        ForEachRun( [&](size_t run, size_t weight) {
+            const double* values = fSampleChain.GetRunValues(run);
+            for (size_t p = 0; p < nParams; p++)
+                diff[p] = values[p] - mean[p];
+
             // iterate rows
             for (size_t j = 0; j < nParams; ++j) {
                 // iterate columns
                 for (size_t k = 0; k <= j; ++k) {
-                    result(j, k) += (it->Values()[j] - mean.Values()[j]) * (it->Values()[k] - mean.Values()[k]);
+                    result(j, k) += (double) weight * diff[j] * diff[k];
                 }
             }
-        }
+        } );
 
         result /= (double) (N-1);
     }
@@ -259,8 +847,8 @@ const MatrixUnitLower& ChainStatistics::GetCorrelationMatrix()
     if (fCorrelation)
         return fCorrelation.get();
 
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
+    auto indexRange = GetIndices();
+    const size_t N = indexRange.second - indexRange.first;
 
     const size_t nParams = NumberOfParams();
 
@@ -285,8 +873,8 @@ const MatrixLower& ChainStatistics::GetCholeskyDecomposition()
     if (fCholesky)
         return fCholesky.get();
 
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
+    auto indexRange = GetIndices();
+    const size_t N = indexRange.second - indexRange.first;
 
     const size_t nParams = NumberOfParams();
 
@@ -314,31 +902,41 @@ const Vector& ChainStatistics::GetAutoCorrelation(size_t lag)
     if (mapIt != fAutoCorrelation.end())
         return mapIt->second;
 
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
+    auto indexRange = GetIndices();
+    const size_t N = indexRange.second - indexRange.first;
 
-    Vector& result = fAutoCorrelation.emplace( lag, Vector(NumberOfParams()) ).first->second;
+    const size_t nParams = NumberOfParams();
+
+    Vector& result = fAutoCorrelation.emplace( lag, Vector(nParams, 0.0) ).first->second;
 
     if (lag < N) {
 
         const Sample& mean = GetMean();
         const Vector& variance = GetVariance();
 
-        const size_t nParams = NumberOfParams();
+        // walk the chain at t and t+lag simultaneously, advancing by
+        // segments over which both positions stay within their runs
+        const size_t endIndex = indexRange.second - lag;
+        size_t t = indexRange.first;
+        size_t runT = fSampleChain.FindRun( t );
+        size_t runH = fSampleChain.FindRun( t + lag );
 
-        vector<double> nominators(nParams, 0.0);
-        vector<double> var_t(nParams, 0.0);
-        vector<double> var_h(nParams, 0.0);
+        while (t < endIndex) {
+            const size_t remainingT = fSampleChain.GetRunStart(runT) + fSampleChain.GetRunLength(runT) - t;
+            const size_t remainingH = fSampleChain.GetRunStart(runH) + fSampleChain.GetRunLength(runH) - (t + lag);
+            const size_t segment = min( min(remainingT, remainingH), endIndex - t );
 
-        auto it_t = itRange.first;
-        auto it_h = next(it_t, lag);
-
-        for (; it_h != itRange.second; ++it_t, ++it_h) {
+            const double* X_t = fSampleChain.GetRunValues(runT);
+            const double* X_h = fSampleChain.GetRunValues(runH);
             for (size_t p = 0; p < nParams; ++p) {
-                const double X_t_diff = it_t->Values()[p] - mean.Values()[p];
-                const double X_h_diff = it_h->Values()[p] - mean.Values()[p];
-                result[p] += X_t_diff * X_h_diff;
+                result[p] += (double) segment * (X_t[p] - mean[p]) * (X_h[p] - mean[p]);
             }
+
+            t += segment;
+            if (segment == remainingT)
+                runT++;
+            if (segment == remainingH)
+                runH++;
         }
 
         result /= (double) (N-lag);
@@ -351,27 +949,39 @@ const Vector& ChainStatistics::GetAutoCorrelation(size_t lag)
     return result;
 }
 
+const vector<double>& ChainStatistics::GetAutoCorrelationFunction(size_t paramIndex)
+{
+    auto mapIt = fAutoCorrelationFunction.find(paramIndex);
+
+    if (mapIt != fAutoCorrelationFunction.end())
+        return mapIt->second;
+
+    // expand the selected parameter column into a series of steps
+    vector<double> series;
+    series.reserve( GetIndices().second - GetIndices().first );
+
+    ForEachRun( [&](size_t run, size_t weight) {
+        series.insert( series.end(), weight, fSampleChain.GetRunValues(run)[paramIndex] );
+    } );
+
+    vector<double>& result = fAutoCorrelationFunction[paramIndex];
+    result = math::autoCorrelation( series );
+
+    return result;
+}
+
 const Vector& ChainStatistics::GetAutoCorrelationTime()
 {
     if (fAutoCorrelationTime)
         return fAutoCorrelationTime.get();
 
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
-
-    Vector result(NumberOfParams(), 0.0);
-
-    size_t cThresholdMaintained = 0;
+    const size_t nParams = NumberOfParams();
 
-    for (size_t lag = 1; lag < N; lag++) {
-        const Vector& ac = GetAutoCorrelation(lag);
-        result += ac;
+    Vector result(nParams, 1.0);
 
-        if (ublas::norm_inf(ac) < 0.01 && ++cThresholdMaintained >= 3)
-            break;
-    }
+    for (size_t p = 0; p < nParams; p++)
+        result[p] = math::integratedAutoCorrelationTime( GetAutoCorrelationFunction(p) );
 
-    result = Vector(NumberOfParams(), 1.0) + 2.0 * result;
     fAutoCorrelationTime = move(result);
 
     return fAutoCorrelationTime.get();
@@ -382,19 +992,23 @@ double ChainStatistics::GetAccRate()
     if (fAccRate)
         return fAccRate.get();
 
-    auto itRange = GetIterators();
+    auto indexRange = GetIndices();
 
     // skip the first element
-    if (itRange.first != itRange.second)
-        std::advance(itRange.first, 1);
+    if (indexRange.first != indexRange.second)
+        indexRange.first++;
 
-    const size_t N = itRange.second - itRange.first;
+    const size_t N = indexRange.second - indexRange.first;
 
     size_t accepted = 0;
 
-    for (auto it = itRange.first; it != itRange.second; it++) {
-        if (it->IsAccepted())
-            accepted++;
+    // only the first step of a run can be an accepted one
+    if (N > 0) {
+        const size_t lastRun = fSampleChain.FindRun( indexRange.second-1 );
+        for (size_t run = fSampleChain.FindRun( indexRange.first ); run <= lastRun; run++) {
+            if (fSampleChain.IsRunAccepted(run) && fSampleChain.GetRunStart(run) >= indexRange.first)
+                accepted++;
+        }
     }
 
     fAccRate = (N == 0) ? 0.0 : (double) accepted / (double) N;
@@ -404,67 +1018,208 @@ double ChainStatistics::GetAccRate()
 
 pair<double, double> ChainStatistics::GetConfidenceInterval(size_t paramIndex, double centralValue, double level)
 {
-    auto itRange = GetIterators();
-    const size_t N = itRange.second - itRange.first;
+    auto indexRange = GetIndices();
+    const size_t N = indexRange.second - indexRange.first;
 
     pair<double, double> result(0.0, 0.0);
 
     if (N > 0) {
-        using SampleRef = reference_wrapper<const Sample>;
+        // Construct a sorted copy of the parameter column (one entry per
+        // run), then start collecting steps starting from a central step
+        // matching centralValue.
 
-        struct Cmp {
-            Cmp (size_t paramIndex) : fParamIndex( paramIndex ) { }
+        const vector<pair<double, size_t>> sortedValues = GetSortedColumn( paramIndex );
 
-            bool operator()(const SampleRef& s1, const SampleRef& s2) {
-                return s1.get().Values()[fParamIndex] < s2.get().Values()[fParamIndex];
-            }
-            bool operator()(const SampleRef& s1, const double& v2) {
-                return s1.get().Values()[fParamIndex] < v2;
-            }
-            bool operator()(const double& v1, const SampleRef& s2) {
-                return v1 < s2.get().Values()[fParamIndex] ;
-            }
-
-            size_t fParamIndex;
-        };
+        // positions of the steps within the sorted column
+        vector<size_t> cumulativeWeights( sortedValues.size() );
+        size_t centerBegin = 0, centerEnd = 0;
+        size_t cumulativeWeight = 0;
 
-        // Construct a sorted view of all samples, then start collecting
-        // samples starting from a central sample matching centralValue.
+        for (size_t k = 0; k < sortedValues.size(); k++) {
+            if (sortedValues[k].first < centralValue)
+                centerBegin += sortedValues[k].second;
+            if (sortedValues[k].first <= centralValue)
+                centerEnd += sortedValues[k].second;
 
-        vector<SampleRef> sortedSamples( itRange.first, itRange.second );
-        sort(sortedSamples.begin(), sortedSamples.end(), Cmp(paramIndex));
+            cumulativeWeight += sortedValues[k].second;
+            cumulativeWeights[k] = cumulativeWeight;
+        }
 
-        auto rangeMatchingCentralValue = equal_range(sortedSamples.cbegin(), sortedSamples.cend(),
-            centralValue, Cmp(paramIndex));
-        auto centerIt = rangeMatchingCentralValue.first;
-        const size_t nCentralValues = distance(rangeMatchingCentralValue.first, rangeMatchingCentralValue.second);
+        size_t center = centerBegin;
+        const size_t nCentralValues = centerEnd - centerBegin;
         if (nCentralValues > 1)
-            advance(centerIt, nCentralValues/2 );
+            center += nCentralValues/2;
+        center = min( center, N-1 );
+
+        const auto valueAt = [&](size_t position) {
+            const size_t k = distance( cumulativeWeights.cbegin(),
+                upper_bound( cumulativeWeights.cbegin(), cumulativeWeights.cend(), position ) );
+            return sortedValues[k].first;
+        };
 
         uint64_t C = (uint64_t) ((double) N * level);
 
-        auto lower = centerIt, upper = centerIt;
+        size_t lower = center, upper = center;
 
-        const auto frontIt = sortedSamples.cbegin();
-        const auto backIt = prev(sortedSamples.cend());
+        const size_t front = 0;
+        const size_t back = N-1;
 
         // pick C states starting from the center, go left and right alternately (until one end is hit):
         for (uint64_t i = 0; i < C; ++i) {
-            if ( (lower == frontIt || i%2 == 1) && upper != backIt) {
+            if ( (lower == front || i%2 == 1) && upper != back) {
                 ++upper;
             }
-            else if ((upper == backIt || i%2 == 0) && lower != frontIt) {
+            else if ((upper == back || i%2 == 0) && lower != front) {
                 --lower;
             }
+            else if (lower == front && upper == back) {
+                break;
+            }
         }
 
-        result = { lower->get().Values()[paramIndex], upper->get().Values()[paramIndex] };
+        result = { valueAt(lower), valueAt(upper) };
     }
 
     return result;
 }
 
 
+OnlineStatistics::OnlineStatistics(size_t nParams) :
+    fN( 0 ),
+    fNAccepted( 0 ),
+    fMean( nParams, 0.0 ),
+    fSumOfSquares( nParams, 0.0 ),
+    fCoMoments( ublas::zero_matrix<double>( nParams, nParams ) ),
+    fDelta( nParams, 0.0 )
+{ }
+
+void OnlineStatistics::Reset()
+{
+    *this = OnlineStatistics( NumberOfParams() );
+}
+
+void OnlineStatistics::Add(const double* values, bool accepted, size_t weight)
+{
+    if (weight == 0)
+        return;
+
+    // the first step has no preceding state to be accepted from
+    if (accepted && fN > 0)
+        fNAccepted++;
+
+    const size_t nParams = NumberOfParams();
+
+    fN += weight;
+    const double w = (double) weight / (double) fN;
+
+    for (size_t p = 0; p < nParams; p++) {
+        fDelta[p] = values[p] - fMean[p];
+        fMean[p] += w * fDelta[p];
+        fSumOfSquares[p] += (double) weight * math::pow<2>( values[p] );
+    }
+
+    // co-moments: weight * (x - oldMean) (x - newMean)^T
+    for (size_t j = 0; j < nParams; ++j) {
+        const double diff_j = values[j] - fMean[j];
+        for (size_t k = 0; k <= j; ++k) {
+            fCoMoments(j, k) += (double) weight * fDelta[k] * diff_j;
+        }
+    }
+}
+
+void OnlineStatistics::Add(const Chain& chain, size_t startIndex)
+{
+    if (startIndex >= chain.size())
+        return;
+
+    if (fN == 0 && NumberOfParams() != chain.NumberOfParams())
+        *this = OnlineStatistics( chain.NumberOfParams() );
+
+    LOG_ASSERT( chain.NumberOfParams() == NumberOfParams() );
+
+    for (size_t run = chain.FindRun(startIndex); run < chain.NumberOfRuns(); run++) {
+        const size_t runStart = chain.GetRunStart(run);
+        const size_t weight = runStart + chain.GetRunLength(run) - max(runStart, startIndex);
+        const bool accepted = runStart >= startIndex && chain.IsRunAccepted(run);
+
+        Add( chain.GetRunValues(run), accepted, weight );
+    }
+}
+
+Vector OnlineStatistics::GetVariance() const
+{
+    Vector result( NumberOfParams(), 0.0 );
+
+    if (fN > 1) {
+        for (size_t p = 0; p < result.size(); p++)
+            result[p] = fCoMoments(p, p) / (double) (fN-1);
+    }
+
+    return result;
+}
+
+Vector OnlineStatistics::GetError() const
+{
+    Vector result = GetVariance();
+
+    for (double& p : result)
+        p = sqrt(p);
+
+    return result;
+}
+
+Vector OnlineStatistics::GetRms() const
+{
+    Vector result( NumberOfParams(), 0.0 );
+
+    if (fN > 0) {
+        for (size_t p = 0; p < result.size(); p++)
+            result[p] = sqrt( fSumOfSquares[p] / (double) fN );
+    }
+
+    return result;
+}
+
+MatrixLower OnlineStatistics::GetCovarianceMatrix() const
+{
+    MatrixLower result = ublas::zero_matrix<double>( NumberOfParams(), NumberOfParams() );
+
+    if (fN > 1)
+        result = fCoMoments / (double) (fN-1);
+
+    return result;
+}
+
+double OnlineStatistics::GetAccRate() const
+{
+    return (fN < 2) ? 0.0 : (double) fNAccepted / (double) (fN-1);
+}
+
+void OnlineStatistics::SaveState(CheckpointWriter& checkpoint) const
+{
+    checkpoint.PutUInt( fN );
+    checkpoint.PutUInt( fNAccepted );
+    checkpoint.PutDoubles( fMean );
+    checkpoint.PutDoubles( fSumOfSquares );
+
+    for (size_t j = 0; j < NumberOfParams(); ++j)
+        for (size_t k = 0; k <= j; ++k)
+            checkpoint.PutDouble( fCoMoments(j, k) );
+}
+
+void OnlineStatistics::LoadState(CheckpointReader& checkpoint)
+{
+    fN = checkpoint.GetUInt();
+    fNAccepted = checkpoint.GetUInt();
+    checkpoint.GetDoubles( fMean );
+    checkpoint.GetDoubles( fSumOfSquares );
+
+    for (size_t j = 0; j < NumberOfParams(); ++j)
+        for (size_t k = 0; k <= j; ++k)
+            fCoMoments(j, k) = checkpoint.GetDouble();
+}
+
+
 void ChainSetStatistics::Reset()
 {
     for (auto& chainStats : fSingleChainStats)
@@ -15,15 +15,462 @@
 #include <vmcmc/blas.hpp>
 #include <vmcmc/sample.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
 #include <vector>
 #include <unordered_map>
 
 #include <boost/optional.hpp>
+#include <boost/iterator/iterator_facade.hpp>
 
 namespace vmcmc
 {
 
-using Chain = std::vector<Sample>;
+class Chain;
+class OnlineStatistics;
+class CheckpointWriter;
+class CheckpointReader;
+
+/**
+ * A read-only range of parameter values, pointing into the storage of a
+ * Chain.
+ */
+class ValueRange
+{
+public:
+    using value_type     = double;
+    using iterator       = const double*;
+    using const_iterator = const double*;
+
+public:
+    ValueRange(const double* first, size_t size) : fBegin( first ), fSize( size ) { }
+
+    const_iterator begin() const { return fBegin; }
+    const_iterator end() const { return fBegin + fSize; }
+    size_t size() const { return fSize; }
+
+    const double& operator[](size_t index) const { return fBegin[index]; }
+
+private:
+    const double* fBegin;
+    size_t fSize;
+};
+
+/**
+ * A lightweight, read-only view of a single sample stored in a Chain.
+ *
+ * The view mirrors the accessors of Sample, but does not own any data.
+ * It is invalidated, if the underlying chain is modified or destroyed.
+ */
+class SampleView
+{
+public:
+    SampleView(const Chain& chain, size_t index) : fChain( &chain ), fIndex( index ) { }
+
+    size_t GetIndex() const { return fIndex; }
+
+    size_t GetGeneration() const;
+
+    ValueRange Values() const;
+    const double& operator[](size_t index) const;
+    size_t size() const;
+
+    double GetLikelihood() const;
+    double GetNegLogLikelihood() const;
+    double GetPrior() const;
+    bool IsAccepted() const;
+
+    /**
+     * Materialize the viewed sample.
+     */
+    operator Sample() const;
+
+private:
+    const Chain* fChain;
+    size_t fIndex;
+};
+
+/**
+ * A Markov chain, storing a sequence of samples in columnar form.
+ *
+ * Instead of a list of individually allocated Sample objects, the chain
+ * stores the parameter values in contiguous, row-major arrays, accompanied by
+ * parallel columns for the generation, likelihood, -log(likelihood), prior
+ * and acceptance flag of each sample.
+ * The storage is organized in fixed-size blocks of rows, so that growing the
+ * chain never relocates the samples already stored. Once the required
+ * capacity has been reserved, appending samples does not allocate.
+ *
+ * Optionally, rejected steps can be run-length compressed (see
+ * SetCompressed()): A rejected sample repeating the previous state only
+ * extends the multiplicity of the previously stored row (a 'run'), instead
+ * of occupying a row of its own. The chain is still indexed by steps, the
+ * run accessors provide direct access to the distinct states and their
+ * multiplicities. Without compression, each run has a length of 1.
+ *
+ * Individual samples are accessed through lightweight SampleView objects or
+ * directly through the column accessors.
+ *
+ * For long runs, the memory footprint can be bounded by keeping only a
+ * window of the most recent rows in memory (see SetWindow()), or by
+ * discarding steps before they are stored (see SetThinning()).
+ */
+class Chain
+{
+public:
+    class const_iterator;
+
+    using iterator   = const_iterator;
+    using value_type = SampleView;
+    using size_type  = size_t;
+
+    static constexpr size_t kDefaultBlockSize = 1024;
+
+public:
+    /**
+     * Construct an empty chain.
+     * @param nParams The number of parameters per sample. If 0, the number
+     * of parameters is taken from the first sample appended.
+     * @param blockSize The number of rows per storage block (rounded up to
+     * a power of 2).
+     */
+    Chain(size_t nParams = 0, size_t blockSize = kDefaultBlockSize);
+    Chain(const Chain& other);
+    Chain(Chain&& other);
+    ~Chain();
+
+    Chain& operator=(const Chain& other);
+    Chain& operator=(Chain&& other);
+
+    size_t NumberOfParams() const { return fNParams; }
+    size_t GetBlockSize() const { return fBlockMask + 1; }
+
+    /**
+     * Enable or disable run-length compression of rejected steps.
+     * Can only be changed while the chain is empty.
+     * @param compress
+     */
+    void SetCompressed(bool compress);
+    bool IsCompressed() const { return fCompressed; }
+
+    /**
+     * Discard steps at the storage level: steps with a generation below
+     * @p burnIn are not stored, of the following ones only every
+     * @p interval-th step.
+     * The chain is indexed by the stored steps, while the generations of
+     * the stored samples still count all steps. Thinned chains (interval
+     * > 1) do not compress rejections. Can only be changed while the chain
+     * is empty.
+     * @param burnIn
+     * @param interval
+     */
+    void SetThinning(size_t burnIn, size_t interval = 1);
+    size_t GetBurnIn() const { return fBurnIn; }
+    size_t GetThinning() const { return fThinning; }
+
+    /**
+     * Check whether a step of the given generation is stored.
+     * @param generation
+     * @return
+     */
+    bool IsStored(size_t generation) const
+    {
+        return generation >= fBurnIn && (generation - fBurnIn) % fThinning == 0;
+    }
+
+    /**
+     * Whether the last step appended was stored (as back()) or discarded.
+     */
+    bool IsLastStepStored() const { return fLastStepStored; }
+
+    /**
+     * Get the number of steps appended, including the discarded ones.
+     */
+    size_t GetNumberOfSteps() const { return fNSteps; }
+
+    /**
+     * Get the number of accepted steps appended (excluding the first one),
+     * including the discarded ones.
+     */
+    size_t GetNumberOfAcceptedSteps() const { return fNAcceptedSteps; }
+
+    /**
+     * Get the fraction of accepted steps among all steps appended,
+     * excluding the first one.
+     */
+    double GetAccRate() const { return (fNSteps < 2) ? 0.0 : (double) fNAcceptedSteps / (double) (fNSteps-1); }
+
+    /**
+     * Pass every step appended to an accumulator, including the steps
+     * discarded by the burn-in and thinning. The accumulator is not owned
+     * and not copied along with the chain.
+     * @param statistics nullptr to detach the accumulator.
+     */
+    void SetOnlineStatistics(OnlineStatistics* statistics) { fOnlineStatistics = statistics; }
+    OnlineStatistics* GetOnlineStatistics() const { return fOnlineStatistics; }
+
+    /**
+     * Keep only a window of the most recent rows in memory.
+     * Once the window is full, the oldest block of rows is evicted (and
+     * appended to the spill file, if set) and its storage is recycled for
+     * the new rows, like a ring buffer. The chain is still indexed by steps,
+     * but only the steps from GetFirstIndex() on can be accessed.
+     * Requires an uncompressed chain and can only be changed while the
+     * chain is empty.
+     * @param nRows The minimum number of rows kept in memory, 0 (default)
+     * to keep all rows.
+     */
+    void SetWindow(size_t nRows);
+    bool IsWindowed() const { return fWindowBlocks > 0; }
+
+    /**
+     * Append the blocks evicted from the window to a file, in the layout of
+     * GetBlockData(). The full chain can be restored with GetHistory().
+     * The file is truncated, when the chain is cleared.
+     * @param filePath An empty path disables spilling.
+     * @param keepBytes The size of the existing content to keep (e.g. the
+     * blocks of an interrupted run up to its checkpoint, see
+     * Algorithm::Resume()), the remainder is discarded. The content kept is
+     * neither truncated nor part of GetHistory().
+     */
+    void SetSpillFile(const std::string& filePath, size_t keepBytes = 0);
+    const std::string& GetSpillFile() const { return fSpillFile; }
+
+    /**
+     * Flush the spill file to the storage device.
+     * @return The size of the spill file, 0 without a spill file.
+     */
+    size_t SyncSpillFile() const;
+
+    /**
+     * Get the index of the first step still kept in memory.
+     */
+    size_t GetFirstIndex() const { return fFirstBlock << fBlockShift; }
+
+    /**
+     * Get the complete chain, with the evicted steps memory-mapped from the
+     * spill file and a copy of the steps still in memory.
+     * Throws if steps were evicted without a spill file.
+     * @return
+     */
+    Chain GetHistory() const;
+
+    /**
+     * Get the number of steps in this chain.
+     */
+    size_t size() const { return fSize; }
+    bool empty() const { return fSize == 0; }
+
+    /**
+     * Get the number of rows (runs) the storage can hold without allocating.
+     */
+    size_t capacity() const { return (fFirstBlock + fBlocks.size()) * GetBlockSize(); }
+
+    /**
+     * Preallocate storage for at least @p n rows (runs) in memory, limited to
+     * the window size.
+     * @param n
+     */
+    void reserve(size_t n);
+    void clear();
+
+    /**
+     * Remove all rows like clear(), but keep the allocated blocks for the
+     * following rows.
+     */
+    void Rewind();
+
+    void push_back(const Sample& sample);
+    void push_back(const SampleView& sample);
+
+    /**
+     * Append a step given by its raw column values.
+     * The step is counted, but only stored if it passes the burn-in and
+     * thinning (see SetThinning()).
+     * @param values Pointer to NumberOfParams() parameter values.
+     * @param negLogLikelihood
+     * @param likelihood
+     * @param prior
+     * @param generation
+     * @param accepted
+     */
+    void push_back(const double* values, double negLogLikelihood, double likelihood,
+        double prior, size_t generation, bool accepted);
+
+    SampleView operator[](size_t index) const { return SampleView( *this, index ); }
+    SampleView front() const { return SampleView( *this, 0 ); }
+    SampleView back() const { return SampleView( *this, fSize-1 ); }
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    Sample GetSample(size_t index) const;
+
+    /**
+     * Copy a stored sample into an existing Sample object.
+     * Does not allocate, if @p target already has the correct size.
+     * @param index
+     * @param target
+     */
+    void GetSample(size_t index, Sample& target) const;
+
+    /**
+     * Overwrite a stored sample.
+     * In a compressed chain, only samples representing a run of their own
+     * or the very last step can be overwritten.
+     * @param index
+     * @param sample
+     */
+    void SetSample(size_t index, const Sample& sample);
+
+    size_t GetGeneration(size_t index) const;
+    const double* GetValues(size_t index) const { return GetRunValues( FindRun(index) ); }
+    double GetValue(size_t index, size_t paramIndex) const { return GetValues(index)[paramIndex]; }
+    double GetLikelihood(size_t index) const { return GetRunLikelihood( FindRun(index) ); }
+    double GetNegLogLikelihood(size_t index) const { return GetRunNegLogLikelihood( FindRun(index) ); }
+    double GetPrior(size_t index) const { return GetRunPrior( FindRun(index) ); }
+    bool IsAccepted(size_t index) const;
+
+    /**
+     * Get the number of distinct stored states.
+     */
+    size_t NumberOfRuns() const { return fNRuns; }
+
+    /**
+     * Find the run containing the step @p index.
+     * @param index
+     * @return The run index.
+     */
+    size_t FindRun(size_t index) const { return (fCompressed) ? FindCompressedRun(index) : index; }
+
+    size_t GetRunStart(size_t run) const { return (fCompressed) ? Locate(run).fRunStarts[Offset(run)] : run; }
+    size_t GetRunLength(size_t run) const;
+
+    const double* GetRunValues(size_t run) const { return Locate(run).fValues + Offset(run) * fNParams; }
+    double GetRunLikelihood(size_t run) const { return Locate(run).fLikelihoods[Offset(run)]; }
+    double GetRunNegLogLikelihood(size_t run) const { return Locate(run).fNegLogLikelihoods[Offset(run)]; }
+    double GetRunPrior(size_t run) const { return Locate(run).fPriors[Offset(run)]; }
+    size_t GetRunGeneration(size_t run) const { return Locate(run).fGenerations[Offset(run)]; }
+    bool IsRunAccepted(size_t run) const { return Locate(run).fAccepted[Offset(run)] != 0; }
+
+    /**
+     * Get the number of bytes of a storage block holding @p nRows rows.
+     * @param nParams
+     * @param nRows
+     * @param withRunStarts True for the blocks of a compressed chain.
+     * @return
+     */
+    static size_t BlockBytes(size_t nParams, size_t nRows, bool withRunStarts);
+
+    size_t NumberOfBlocks() const { return fBlocks.size(); }
+
+    /**
+     * Get the raw storage of a block of GetBlockSize() rows.
+     * The columns are stored one after another: the parameter values
+     * (row-major), -log(likelihood), likelihood and prior (double),
+     * the generation and, in compressed chains, the run start (uint64) and
+     * the acceptance flag (uint8).
+     * @param iBlock
+     * @return
+     */
+    const void* GetBlockData(size_t iBlock) const { return fBlocks[iBlock].fValues; }
+
+    /**
+     * Append a block of rows, stored externally in the layout of
+     * GetBlockData() (e.g. in a memory-mapped file), without copying.
+     * Requires an uncompressed chain without a window, whose blocks are all
+     * full.
+     * @param storage Shared ownership of the storage containing @p data.
+     * @param data Storage of GetBlockSize() rows, aligned to 8 bytes.
+     * @param nRows The number of rows in use.
+     */
+    void AppendBlock(std::shared_ptr<void> storage, void* data, size_t nRows);
+
+private:
+    /**
+     * A block of rows sharing one contiguous allocation, partitioned into
+     * the individual columns.
+     */
+    struct Block
+    {
+        Block(size_t nParams, size_t nRows, bool withRunStarts);
+        Block(size_t nParams, size_t nRows, bool withRunStarts,
+            std::shared_ptr<void> storage, char* buffer);
+
+        std::shared_ptr<void> fStorage;
+
+        double* fValues;
+        double* fNegLogLikelihoods;
+        double* fLikelihoods;
+        double* fPriors;
+        uint64_t* fGenerations;
+        uint64_t* fRunStarts;
+        uint8_t* fAccepted;
+    };
+
+    const Block& Locate(size_t row) const { return fBlocks[(row >> fBlockShift) - fFirstBlock]; }
+    Block& Locate(size_t row) { return fBlocks[(row >> fBlockShift) - fFirstBlock]; }
+    size_t Offset(size_t row) const { return row & fBlockMask; }
+
+    size_t FindCompressedRun(size_t index) const;
+
+    bool ExtendsLastRun(bool accepted, const double* values) const;
+    void AppendRun();
+    void WriteRow(size_t run, const double* values, double negLogLikelihood,
+        double likelihood, double prior, size_t generation, bool accepted);
+    void Grow();
+    void Spill(const Block& block);
+    void OpenSpillFile();
+
+    size_t fNParams;
+    size_t fBlockShift;
+    size_t fBlockMask;
+    bool fCompressed;
+    size_t fSize;
+    size_t fNRuns;
+    std::vector<Block> fBlocks;
+
+    size_t fBurnIn;
+    size_t fThinning;
+    size_t fNSteps;
+    size_t fNAcceptedSteps;
+    bool fLastStepStored;
+    OnlineStatistics* fOnlineStatistics;
+
+    size_t fWindowBlocks;   // the maximum number of blocks in memory (0: unlimited)
+    size_t fFirstBlock;     // the number of blocks evicted from memory
+    std::string fSpillFile;
+    std::unique_ptr<std::ofstream> fSpillStream;
+    size_t fSpillOffset;    // the size of the content preceding the spilled blocks
+};
+
+/**
+ * Random access iterator over the samples of a Chain, dereferencing to
+ * SampleView objects.
+ */
+class Chain::const_iterator : public boost::iterator_facade<
+    Chain::const_iterator, SampleView, std::random_access_iterator_tag, SampleView>
+{
+public:
+    const_iterator() : fChain( nullptr ), fIndex( 0 ) { }
+    const_iterator(const Chain& chain, size_t index) : fChain( &chain ), fIndex( index ) { }
+
+private:
+    friend class boost::iterator_core_access;
+
+    SampleView dereference() const { return SampleView( *fChain, fIndex ); }
+    bool equal(const const_iterator& other) const { return fIndex == other.fIndex; }
+    void increment() { ++fIndex; }
+    void decrement() { --fIndex; }
+    void advance(ptrdiff_t n) { fIndex += n; }
+    ptrdiff_t distance_to(const const_iterator& other) const { return (ptrdiff_t) other.fIndex - (ptrdiff_t) fIndex; }
+
+    const Chain* fChain;
+    size_t fIndex;
+};
 
 /**
  * Calculates statistical momenta and properties for a given Chain of Samples.
@@ -62,6 +509,22 @@ public:
     const MatrixLower& GetCholeskyDecomposition();
 
     const Vector& GetAutoCorrelation(size_t lag);
+
+    /**
+     * Get the normalized autocorrelation function of a parameter for all
+     * lags in [0, N), calculated via FFT in O(N log N).
+     * @param paramIndex
+     * @return
+     * @see math::autoCorrelation()
+     */
+    const std::vector<double>& GetAutoCorrelationFunction(size_t paramIndex);
+
+    /**
+     * Get the integrated autocorrelation time of each parameter, using
+     * Geyer's initial monotone sequence estimator on the autocorrelation
+     * function.
+     * @return
+     */
     const Vector& GetAutoCorrelationTime();
 
     std::pair<double, double> GetConfidenceInterval(size_t iParam, double centralValue, double level);
@@ -69,6 +532,15 @@ public:
     double GetAccRate();
 
 private:
+    /**
+     * Call @p function(run, weight) for each run overlapping the selected
+     * range, where the weight is the number of selected steps in that run.
+     */
+    template<class FunctionT>
+    void ForEachRun(FunctionT function) const;
+
+    std::vector<std::pair<double, size_t>> GetSortedColumn(size_t paramIndex) const;
+
     const Chain& fSampleChain;
     std::pair<ptrdiff_t, ptrdiff_t> fSelectedRange;
 
@@ -85,11 +557,75 @@ private:
     boost::optional<MatrixLower> fCholesky;
 
     std::unordered_map<size_t, Vector> fAutoCorrelation;
+    std::unordered_map<size_t, std::vector<double>> fAutoCorrelationFunction;
     boost::optional<Vector> fAutoCorrelationTime;
 
     boost::optional<double> fAccRate;
 };
 
+/**
+ * Accumulates summary statistics of a chain in a single pass.
+ *
+ * In contrast to ChainStatistics, which recalculates its results from the
+ * stored samples over a selected range, this accumulator is updated
+ * incrementally with each new sample (using Welford's algorithm for the
+ * mean and the co-moments). It requires O(d²) memory, independent of the
+ * chain length, and its results are available in O(d²) at any time.
+ */
+class OnlineStatistics
+{
+public:
+    OnlineStatistics(size_t nParams = 0);
+
+    void Reset();
+
+    /**
+     * Add a state with the multiplicity @p weight.
+     * @param values The parameter values.
+     * @param accepted Whether the state was reached by an accepted step.
+     * @param weight The number of steps this state represents.
+     */
+    void Add(const double* values, bool accepted, size_t weight = 1);
+
+    /**
+     * Add all steps of @p chain starting at @p startIndex.
+     * @param chain
+     * @param startIndex
+     */
+    void Add(const Chain& chain, size_t startIndex = 0);
+
+    size_t NumberOfParams() const { return fMean.size(); }
+    size_t GetCount() const { return fN; }
+    size_t GetNumberOfAccepted() const { return fNAccepted; }
+
+    const Vector& GetMean() const { return fMean; }
+    Vector GetVariance() const;
+    Vector GetError() const;
+    Vector GetRms() const;
+    MatrixLower GetCovarianceMatrix() const;
+
+    /**
+     * Get the fraction of accepted steps, excluding the first step added.
+     */
+    double GetAccRate() const;
+
+    /**
+     * Save the accumulated moments to a checkpoint (see Algorithm::Resume()).
+     * @param checkpoint
+     */
+    void SaveState(CheckpointWriter& checkpoint) const;
+    void LoadState(CheckpointReader& checkpoint);
+
+private:
+    size_t fN;
+    size_t fNAccepted;
+
+    Vector fMean;
+    Vector fSumOfSquares;
+    MatrixLower fCoMoments;
+    Vector fDelta;
+};
+
 /**
  * Manages a list of ChainStatistics and calculates statistical properties
  * regarding sets of individual chains.
@@ -131,9 +667,101 @@ private:
     boost::optional<double> fRubinGelman;
 };
 
+inline size_t Chain::GetRunLength(size_t run) const
+{
+    const size_t nextStart = (run+1 < fNRuns) ? GetRunStart(run+1) : fSize;
+    return nextStart - GetRunStart(run);
+}
+
+inline size_t Chain::GetGeneration(size_t index) const
+{
+    const size_t run = FindRun(index);
+    return GetRunGeneration(run) + (index - GetRunStart(run));
+}
+
+inline bool Chain::IsAccepted(size_t index) const
+{
+    const size_t run = FindRun(index);
+    return index == GetRunStart(run) && IsRunAccepted(run);
+}
+
+inline Chain::const_iterator Chain::begin() const
+{
+    return const_iterator( *this, 0 );
+}
+
+inline Chain::const_iterator Chain::end() const
+{
+    return const_iterator( *this, fSize );
+}
+
+inline size_t SampleView::GetGeneration() const
+{
+    return fChain->GetGeneration( fIndex );
+}
+
+inline ValueRange SampleView::Values() const
+{
+    return ValueRange( fChain->GetValues( fIndex ), fChain->NumberOfParams() );
+}
+
+inline const double& SampleView::operator[](size_t index) const
+{
+    return fChain->GetValues( fIndex )[index];
+}
+
+inline size_t SampleView::size() const
+{
+    return fChain->NumberOfParams();
+}
+
+inline double SampleView::GetLikelihood() const
+{
+    return fChain->GetLikelihood( fIndex );
+}
+
+inline double SampleView::GetNegLogLikelihood() const
+{
+    return fChain->GetNegLogLikelihood( fIndex );
+}
+
+inline double SampleView::GetPrior() const
+{
+    return fChain->GetPrior( fIndex );
+}
+
+inline bool SampleView::IsAccepted() const
+{
+    return fChain->IsAccepted( fIndex );
+}
+
+inline SampleView::operator Sample() const
+{
+    return fChain->GetSample( fIndex );
+}
+
 inline size_t ChainStatistics::NumberOfParams() const
 {
-    return (fSampleChain.empty()) ? 0 : fSampleChain.front().Values().size();
+    return (fSampleChain.empty()) ? 0 : fSampleChain.NumberOfParams();
+}
+
+template<class FunctionT>
+inline void ChainStatistics::ForEachRun(FunctionT function) const
+{
+    const std::pair<size_t, size_t> indexRange = GetIndices();
+
+    if (indexRange.first == indexRange.second)
+        return;
+
+    const size_t lastRun = fSampleChain.FindRun( indexRange.second-1 );
+
+    for (size_t run = fSampleChain.FindRun( indexRange.first ); run <= lastRun; run++) {
+        const size_t runStart = fSampleChain.GetRunStart(run);
+        const size_t runEnd = runStart + fSampleChain.GetRunLength(run);
+
+        const size_t weight = std::min(runEnd, indexRange.second) - std::max(runStart, indexRange.first);
+        function( run, weight );
+    }
 }
 
 } /* namespace vmcmc */
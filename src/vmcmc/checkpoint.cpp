@@ -0,0 +1,132 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/checkpoint.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace vmcmc
+{
+
+namespace {
+
+const char kCheckpointMagic[8] = { 'V', 'M', 'C', 'M', 'C', 'C', 'K', 'P' };
+constexpr uint64_t kCheckpointVersion = 5;
+
+}
+
+void syncFile(const string& filePath)
+{
+    const int fd = open( filePath.c_str(), O_RDONLY );
+    if (fd < 0)
+        throw Exception() << "Cannot open '" << filePath << "' for synchronization.";
+
+    const int result = fsync( fd );
+    close( fd );
+
+    if (result != 0)
+        throw Exception() << "Cannot synchronize '" << filePath << "' with the storage device.";
+}
+
+void CheckpointWriter::Write(const void* data, size_t nBytes)
+{
+    fBuffer.append( static_cast<const char*>(data), nBytes );
+}
+
+void CheckpointWriter::PutString(const string& value)
+{
+    PutUInt( value.size() );
+    Write( value.data(), value.size() );
+}
+
+void CheckpointWriter::Commit(const string& filePath) const
+{
+    const string tmpPath = filePath + ".tmp";
+
+    {
+        ofstream file( tmpPath, ios::binary | ios::trunc );
+
+        const uint64_t header[2] = { kCheckpointVersion, fBuffer.size() };
+        file.write( kCheckpointMagic, sizeof(kCheckpointMagic) );
+        file.write( reinterpret_cast<const char*>(header), sizeof(header) );
+        file.write( fBuffer.data(), fBuffer.size() );
+        file.close();
+
+        if (file.fail())
+            throw Exception() << "Cannot write checkpoint file '" << tmpPath << "'.";
+    }
+
+    // the content must be on disk before it replaces the previous checkpoint
+    syncFile( tmpPath );
+
+    // replacing the previous checkpoint is atomic on POSIX systems
+    if (rename( tmpPath.c_str(), filePath.c_str() ) != 0)
+        throw Exception() << "Cannot replace checkpoint file '" << filePath << "'.";
+
+    // persist the directory entry of the renamed file
+    const size_t separator = filePath.find_last_of( '/' );
+    if (separator == string::npos)
+        syncFile( "." );
+    else
+        syncFile( (separator == 0) ? "/" : filePath.substr( 0, separator ) );
+}
+
+CheckpointReader::CheckpointReader(const string& filePath) :
+    fPos( 0 )
+{
+    ifstream file( filePath, ios::binary );
+    if (!file.is_open())
+        throw Exception() << "Cannot open checkpoint file '" << filePath << "'.";
+
+    char magic[8];
+    uint64_t header[2];
+    file.read( magic, sizeof(magic) );
+    file.read( reinterpret_cast<char*>(header), sizeof(header) );
+
+    if (file.fail() || memcmp( magic, kCheckpointMagic, sizeof(magic) ) != 0)
+        throw Exception() << "File '" << filePath << "' is not a checkpoint file.";
+    if (header[0] != kCheckpointVersion)
+        throw Exception() << "Checkpoint file '" << filePath << "' has an unsupported version.";
+
+    fBuffer.assign( istreambuf_iterator<char>(file), istreambuf_iterator<char>() );
+
+    if (fBuffer.size() != header[1])
+        throw Exception() << "Checkpoint file '" << filePath << "' is truncated.";
+}
+
+void CheckpointReader::Read(void* target, size_t nBytes)
+{
+    if (fPos + nBytes > fBuffer.size())
+        throw Exception() << "Unexpected end of checkpoint data.";
+
+    memcpy( target, fBuffer.data() + fPos, nBytes );
+    fPos += nBytes;
+}
+
+string CheckpointReader::GetString()
+{
+    const size_t length = GetUInt();
+    if (fPos + length > fBuffer.size())
+        throw Exception() << "Unexpected end of checkpoint data.";
+
+    string result = fBuffer.substr( fPos, length );
+    fPos += length;
+    return result;
+}
+
+} /* namespace vmcmc */
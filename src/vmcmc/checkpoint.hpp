@@ -0,0 +1,144 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief Binary snapshots of the sampler state for checkpointing.
+ */
+
+#ifndef VMCMC_CHECKPOINT_H_
+#define VMCMC_CHECKPOINT_H_
+
+#include <vmcmc/exception.hpp>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace vmcmc
+{
+
+/**
+ * Flush the written data of a file (or the entries of a directory) to the
+ * storage device, so that it survives a crash of the system.
+ * Throws on failure.
+ * @param filePath
+ */
+void syncFile(const std::string& filePath);
+
+/**
+ * Collects the state of a sampler in a compact binary buffer, which is
+ * written to a checkpoint file in one go.
+ */
+class CheckpointWriter
+{
+public:
+    CheckpointWriter() { }
+
+    void PutUInt(uint64_t value) { Write( &value, sizeof(value) ); }
+    void PutDouble(double value) { Write( &value, sizeof(value) ); }
+    void PutString(const std::string& value);
+
+    /**
+     * Store the size and the elements of a range of doubles.
+     * @param range
+     */
+    template <typename RangeT>
+    void PutDoubles(const RangeT& range);
+
+    /**
+     * Store an object in its stream representation (e.g. the state of a
+     * random number engine or distribution).
+     * @param object
+     */
+    template <typename T>
+    void PutObject(const T& object);
+
+    size_t size() const { return fBuffer.size(); }
+
+    /**
+     * Write the checkpoint file atomically: the buffer is written to a
+     * temporary file, which then replaces @p filePath. Both the file and
+     * the replacement are synchronized with the storage device.
+     * @param filePath
+     */
+    void Commit(const std::string& filePath) const;
+
+private:
+    void Write(const void* data, size_t nBytes);
+
+    std::string fBuffer;
+};
+
+/**
+ * Reads the values stored by a CheckpointWriter in the same order.
+ * Throws if a file is invalid or exhausted.
+ */
+class CheckpointReader
+{
+public:
+    CheckpointReader(const std::string& filePath);
+
+    uint64_t GetUInt() { uint64_t value; Read( &value, sizeof(value) ); return value; }
+    double GetDouble() { double value; Read( &value, sizeof(value) ); return value; }
+    std::string GetString();
+
+    /**
+     * Read a range of doubles stored by CheckpointWriter::PutDoubles(). The
+     * range must already have the stored size.
+     * @param range
+     */
+    template <typename RangeT>
+    void GetDoubles(RangeT& range);
+
+    template <typename T>
+    void GetObject(T& object);
+
+private:
+    void Read(void* target, size_t nBytes);
+
+    std::string fBuffer;
+    size_t fPos;
+};
+
+template <typename RangeT>
+inline void CheckpointWriter::PutDoubles(const RangeT& range)
+{
+    PutUInt( range.size() );
+    for (double value : range)
+        PutDouble( value );
+}
+
+template <typename T>
+inline void CheckpointWriter::PutObject(const T& object)
+{
+    std::ostringstream strm;
+    strm << object;
+    PutString( strm.str() );
+}
+
+template <typename RangeT>
+inline void CheckpointReader::GetDoubles(RangeT& range)
+{
+    if (GetUInt() != range.size())
+        throw Exception() << "The checkpoint does not match the sampler configuration.";
+    for (double& value : range)
+        value = GetDouble();
+}
+
+template <typename T>
+inline void CheckpointReader::GetObject(T& object)
+{
+    std::istringstream strm( GetString() );
+    strm >> object;
+    if (strm.fail())
+        throw Exception() << "Invalid object state in checkpoint.";
+}
+
+} /* namespace vmcmc */
+
+#endif /* VMCMC_CHECKPOINT_H_ */
@@ -0,0 +1,239 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/codec.hpp>
+#include <vmcmc/exception.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace vmcmc
+{
+
+namespace codec
+{
+
+void putVarint(uint64_t value, vector<uint8_t>& output)
+{
+    while (value >= 0x80) {
+        output.push_back( (uint8_t) (value | 0x80) );
+        value >>= 7;
+    }
+    output.push_back( (uint8_t) value );
+}
+
+uint64_t getVarint(const uint8_t*& pos, const uint8_t* end)
+{
+    uint64_t result = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos == end)
+            throw Exception() << "Unexpected end of compressed data.";
+
+        const uint8_t byte = *pos++;
+        result |= (uint64_t) (byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0)
+            return result;
+    }
+
+    throw Exception() << "Invalid variable length integer in compressed data.";
+}
+
+void BitWriter::Put(uint64_t bits, unsigned nBits)
+{
+    while (nBits > 0) {
+        // move as many of the leading bits into the buffer as fit
+        const unsigned nTake = min( 64 - fNBits, nBits );
+        const uint64_t mask = (nTake == 64) ? ~(uint64_t) 0 : ((uint64_t) 1 << nTake) - 1;
+        const uint64_t chunk = (bits >> (nBits - nTake)) & mask;
+
+        fBuffer = (nTake == 64) ? chunk : (fBuffer << nTake) | chunk;
+        fNBits += nTake;
+        nBits -= nTake;
+
+        if (fNBits == 64) {
+            for (int shift = 56; shift >= 0; shift -= 8)
+                fOutput.push_back( (uint8_t) (fBuffer >> shift) );
+            fBuffer = 0;
+            fNBits = 0;
+        }
+    }
+}
+
+void BitWriter::Flush()
+{
+    if (fNBits == 0)
+        return;
+
+    const uint64_t padded = fBuffer << (64 - fNBits);
+    for (unsigned i = 0; i < (fNBits + 7) / 8; i++)
+        fOutput.push_back( (uint8_t) (padded >> (56 - 8*i)) );
+
+    fBuffer = 0;
+    fNBits = 0;
+}
+
+uint64_t BitReader::Get(unsigned nBits)
+{
+    uint64_t result = 0;
+
+    while (nBits > 0) {
+        if (fNBits == 0) {
+            if (fPos == fEnd)
+                throw Exception() << "Unexpected end of compressed data.";
+            fByte = *fPos++;
+            fNBits = 8;
+        }
+
+        const unsigned nTake = min( fNBits, nBits );
+        const uint64_t chunk = (fByte >> (fNBits - nTake)) & ((1u << nTake) - 1);
+
+        result = (result << nTake) | chunk;
+        fNBits -= nTake;
+        nBits -= nTake;
+    }
+
+    return result;
+}
+
+void encodeDeltas(const uint64_t* values, size_t nValues, vector<uint8_t>& output)
+{
+    uint64_t previous = 0;
+
+    for (size_t i = 0; i < nValues; i++) {
+        if (i == 0)
+            putVarint( values[i], output );
+        else
+            putVarint( zigzagEncode( (int64_t) (values[i] - previous) ), output );
+        previous = values[i];
+    }
+}
+
+void decodeDeltas(const uint8_t*& pos, const uint8_t* end, size_t nValues, uint64_t* values)
+{
+    for (size_t i = 0; i < nValues; i++) {
+        if (i == 0)
+            values[i] = getVarint( pos, end );
+        else
+            values[i] = values[i-1] + (uint64_t) zigzagDecode( getVarint( pos, end ) );
+    }
+}
+
+namespace {
+
+inline uint64_t toBits(double value)
+{
+    uint64_t bits;
+    memcpy( &bits, &value, sizeof(bits) );
+    return bits;
+}
+
+inline double fromBits(uint64_t bits)
+{
+    double value;
+    memcpy( &value, &bits, sizeof(value) );
+    return value;
+}
+
+inline unsigned countLeadingZeros(uint64_t x) { return __builtin_clzll( x ); }
+inline unsigned countTrailingZeros(uint64_t x) { return __builtin_ctzll( x ); }
+
+}
+
+void encodeXor(const double* values, size_t nValues, size_t stride, vector<uint8_t>& output)
+{
+    if (nValues == 0)
+        return;
+
+    BitWriter writer( output );
+
+    uint64_t previous = toBits( values[0] );
+    writer.Put( previous, 64 );
+
+    // the window of meaningful bits of the previous XOR
+    unsigned prevLeading = 64;
+    unsigned prevTrailing = 0;
+
+    for (size_t i = 1; i < nValues; i++) {
+        const uint64_t bits = toBits( values[i * stride] );
+        const uint64_t xorBits = bits ^ previous;
+        previous = bits;
+
+        if (xorBits == 0) {
+            writer.Put( 0, 1 );
+            continue;
+        }
+
+        // the number of leading zeros is stored with 5 bits
+        const unsigned leading = min( countLeadingZeros( xorBits ), 31u );
+        const unsigned trailing = countTrailingZeros( xorBits );
+
+        if (prevLeading < 64 && leading >= prevLeading && trailing >= prevTrailing) {
+            // reuse the previous window
+            writer.Put( 2, 2 );
+            writer.Put( xorBits >> prevTrailing, 64 - prevLeading - prevTrailing );
+        }
+        else {
+            const unsigned nMeaningful = 64 - leading - trailing;
+            writer.Put( 3, 2 );
+            writer.Put( leading, 5 );
+            // 64 meaningful bits are stored as 0
+            writer.Put( nMeaningful & 0x3F, 6 );
+            writer.Put( xorBits >> trailing, nMeaningful );
+
+            prevLeading = leading;
+            prevTrailing = trailing;
+        }
+    }
+
+    writer.Flush();
+}
+
+void decodeXor(const uint8_t* begin, const uint8_t* end, size_t nValues, double* values, size_t stride)
+{
+    if (nValues == 0)
+        return;
+
+    BitReader reader( begin, end );
+
+    uint64_t previous = reader.Get( 64 );
+    values[0] = fromBits( previous );
+
+    unsigned prevLeading = 64;
+    unsigned prevTrailing = 0;
+
+    for (size_t i = 1; i < nValues; i++) {
+        if (reader.Get( 1 ) != 0) {
+            if (reader.Get( 1 ) != 0) {
+                prevLeading = (unsigned) reader.Get( 5 );
+                unsigned nMeaningful = (unsigned) reader.Get( 6 );
+                if (nMeaningful == 0)
+                    nMeaningful = 64;
+                if (prevLeading + nMeaningful > 64)
+                    throw Exception() << "Invalid XOR window in compressed data.";
+                prevTrailing = 64 - prevLeading - nMeaningful;
+            }
+            else if (prevLeading == 64) {
+                throw Exception() << "Invalid XOR window in compressed data.";
+            }
+
+            previous ^= reader.Get( 64 - prevLeading - prevTrailing ) << prevTrailing;
+        }
+
+        values[i * stride] = fromBits( previous );
+    }
+}
+
+} /* namespace codec */
+
+} /* namespace vmcmc */
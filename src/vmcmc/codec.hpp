@@ -0,0 +1,148 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief Lightweight codecs for the compression of chain columns.
+ */
+
+#ifndef VMCMC_CODEC_H_
+#define VMCMC_CODEC_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace vmcmc
+{
+
+namespace codec
+{
+
+/**
+ * Map signed integers to unsigned ones, such that small absolute values
+ * yield small results (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...).
+ */
+inline uint64_t zigzagEncode(int64_t value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value)
+{
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+/**
+ * Append an unsigned integer in LEB128 format (7 bits per byte).
+ * @param value
+ * @param[out] output
+ */
+void putVarint(uint64_t value, std::vector<uint8_t>& output);
+
+/**
+ * Read an unsigned integer in LEB128 format.
+ * @param[in,out] pos Advanced past the integer.
+ * @param end Throws if the integer exceeds the input.
+ * @return
+ */
+uint64_t getVarint(const uint8_t*& pos, const uint8_t* end);
+
+/**
+ * Writes a stream of bits (most significant bit first) to a byte vector.
+ */
+class BitWriter
+{
+public:
+    BitWriter(std::vector<uint8_t>& output) : fOutput( output ), fBuffer( 0 ), fNBits( 0 ) { }
+
+    /**
+     * Append the @p nBits lowest bits of @p bits.
+     * @param bits
+     * @param nBits At most 64.
+     */
+    void Put(uint64_t bits, unsigned nBits);
+
+    /**
+     * Write the pending bits, padding the last byte with zeros.
+     */
+    void Flush();
+
+private:
+    std::vector<uint8_t>& fOutput;
+    uint64_t fBuffer;
+    unsigned fNBits;
+};
+
+/**
+ * Reads a stream of bits written by BitWriter.
+ */
+class BitReader
+{
+public:
+    BitReader(const uint8_t* begin, const uint8_t* end) : fPos( begin ), fEnd( end ), fByte( 0 ), fNBits( 0 ) { }
+
+    /**
+     * Read the next @p nBits bits. Throws if the input is exhausted.
+     * @param nBits At most 64.
+     * @return
+     */
+    uint64_t Get(unsigned nBits);
+
+private:
+    const uint8_t* fPos;
+    const uint8_t* fEnd;
+    unsigned fByte;
+    unsigned fNBits;
+};
+
+/**
+ * Encode a column of unsigned integers (e.g. generations) as the first
+ * value, followed by the zigzag encoded differences of subsequent values
+ * (1 byte per value for consecutive integers).
+ * @param values
+ * @param nValues
+ * @param[out] output
+ */
+void encodeDeltas(const uint64_t* values, size_t nValues, std::vector<uint8_t>& output);
+
+/**
+ * Decode a column encoded with encodeDeltas().
+ * @param[in,out] pos Advanced past the encoded column.
+ * @param end
+ * @param nValues
+ * @param[out] values
+ */
+void decodeDeltas(const uint8_t*& pos, const uint8_t* end, size_t nValues, uint64_t* values);
+
+/**
+ * Encode a column of doubles with the XOR scheme of the Gorilla time series
+ * database (Pelkonen et al., 2015): each value is stored as the XOR with its
+ * predecessor, reduced to its meaningful bits. Repeated values (e.g. the
+ * parameter values of rejected steps) take a single bit.
+ * @param values
+ * @param nValues
+ * @param stride The distance between consecutive values in @p values.
+ * @param[out] output
+ */
+void encodeXor(const double* values, size_t nValues, size_t stride, std::vector<uint8_t>& output);
+
+/**
+ * Decode a column encoded with encodeXor().
+ * @param begin
+ * @param end
+ * @param nValues
+ * @param[out] values
+ * @param stride The distance between consecutive values in @p values.
+ */
+void decodeXor(const uint8_t* begin, const uint8_t* end, size_t nValues, double* values, size_t stride);
+
+} /* namespace codec */
+
+} /* namespace vmcmc */
+
+#endif /* VMCMC_CODEC_H_ */
@@ -0,0 +1,230 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/dream.hpp>
+#include <vmcmc/exception.hpp>
+#include <vmcmc/logger.hpp>
+#include <vmcmc/metropolis.hpp>
+#include <vmcmc/random.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef USE_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+using namespace tbb;
+#endif // USE_TBB
+
+using namespace std;
+
+namespace vmcmc
+{
+
+LOG_DEFINE("vmcmc.dream");
+
+Dream::Dream() :
+    fNChains( 3 ),
+    fRandomizeStartPoint( false ),
+    fNPairs( 1 ),
+    fNCrossover( 3 ),
+    fModeJumpProbability( 0.2 ),
+    fArchiveThinning( 10 ),
+    fInitialArchiveSize( 0 ),
+    fJumpNoise( 0.05 ),
+    fAdditiveNoise( 1E-6 ),
+    fArchiveSize( 0 ),
+    fNStepsSinceArchive( 0 ),
+    fMultiThreading( true )
+{
+#ifndef USE_TBB
+    fMultiThreading = false;
+#endif
+}
+
+Dream::~Dream()
+{ }
+
+void Dream::SetMultiThreading(bool enable)
+{
+#ifndef USE_TBB
+    if (enable)
+        LOG(Warn, "TBB is not available for multi-threading.");
+    enable = false;
+#endif
+    fMultiThreading = enable;
+}
+
+void Dream::Initialize()
+{
+    Algorithm::Initialize();
+
+    const size_t nParams = fParameterConfig.size();
+    if (nParams == 0)
+        throw Exception() << "No parameters defined.";
+
+    fErrors = fParameterConfig.GetErrors();
+
+    // setup the archive with random draws from the parameter configuration,
+    // reserving space for the states appended while running
+    const size_t initialSize = max( (fInitialArchiveSize > 0) ? fInitialArchiveSize : 10 * nParams,
+        2 * fNPairs );
+
+    fArchive.clear();
+    fArchive.reserve( (initialSize + fNChains * (GetTotalLength() / fArchiveThinning + 1)) * nParams );
+    fArchiveSize = 0;
+    fNStepsSinceArchive = 0;
+
+    for (size_t i = 0; i < initialSize; i++)
+        AppendToArchive( fParameterConfig.GetStartValues( true ) );
+
+    // setup the chains
+    fChains.assign( fNChains, Chain(nParams) );
+    fStates.assign( fNChains, ChainState() );
+
+    for (size_t iChain = 0; iChain < fNChains; iChain++) {
+        ChainState& state = fStates[iChain];
+
+        state.fCurrent = Sample( fParameterConfig.GetStartValues( fRandomizeStartPoint ) );
+        state.fProposed = Sample( nParams );
+        state.fDimensions.reserve( nParams );
+        state.fIndices.reserve( 2 * fNPairs );
+        state.fStream = CreateStream( iChain );
+
+        Evaluate( state.fCurrent );
+
+        Chain& chain = fChains[iChain];
+        PrepareChain( chain, iChain );
+        chain.push_back( state.fCurrent );
+    }
+}
+
+void Dream::AppendToArchive(const Vector& values)
+{
+    fArchive.insert( fArchive.end(), values.begin(), values.end() );
+    fArchiveSize++;
+}
+
+void Dream::Advance(size_t nSteps)
+{
+    while (nSteps > 0) {
+
+        // the archive is constant until the next archive update, allowing
+        // to advance the chains independently
+        const size_t nBlockSteps = min( nSteps, fArchiveThinning - fNStepsSinceArchive );
+
+        if (fMultiThreading) {
+#ifdef USE_TBB
+            parallel_for(
+                blocked_range<size_t>(0, fNChains),
+                [&](const blocked_range<size_t>& range) {
+                    for (size_t iChain = range.begin(); iChain < range.end(); iChain++)
+                        this->AdvanceChain( iChain, nBlockSteps );
+                }
+            );
+#else
+            LOG(Fatal, "TBB not available - multi-threading should be deactivated.");
+#endif
+        }
+        else {
+            for (size_t iChain = 0; iChain < fNChains; iChain++)
+                AdvanceChain( iChain, nBlockSteps );
+        }
+
+        nSteps -= nBlockSteps;
+        fNStepsSinceArchive += nBlockSteps;
+
+        if (fNStepsSinceArchive == fArchiveThinning) {
+            for (const ChainState& state : fStates)
+                AppendToArchive( state.fCurrent.Values() );
+            fNStepsSinceArchive = 0;
+        }
+    }
+}
+
+void Dream::AdvanceChain(size_t iChain, size_t nSteps)
+{
+    ChainState& state = fStates[iChain];
+    Chain& chain = fChains[iChain];
+
+    Random::ScopedEngine stream( state.fStream );
+
+    for (size_t iStep = 0; iStep < nSteps; iStep++) {
+
+        const bool accepted = Step( state );
+
+        if (accepted) {
+            swap( state.fCurrent, state.fProposed );
+            state.fCurrent.SetAccepted( true );
+        }
+        else {
+            state.fCurrent.SetAccepted( false );
+            state.fCurrent.IncrementGeneration();
+        }
+
+        chain.push_back( state.fCurrent );
+    }
+}
+
+bool Dream::Step(ChainState& state)
+{
+    auto& random = Random::Instance();
+
+    const size_t nParams = fParameterConfig.size();
+    const Sample& current = state.fCurrent;
+    Sample& proposed = state.fProposed;
+
+    // select the subspace to be updated
+    const double crossover = (double) random.Uniform<size_t>( 1, fNCrossover ) / fNCrossover;
+
+    state.fDimensions.clear();
+    for (size_t j = 0; j < nParams; j++)
+        if (random.Bool( crossover ))
+            state.fDimensions.push_back( j );
+    if (state.fDimensions.empty())
+        state.fDimensions.push_back( random.Uniform<size_t>( 0, nParams-1 ) );
+
+    // draw distinct pairs of archived states
+    const size_t nPairs = random.Uniform<size_t>( 1, fNPairs );
+
+    state.fIndices.clear();
+    while (state.fIndices.size() < 2 * nPairs) {
+        const size_t index = random.Uniform<size_t>( 0, fArchiveSize-1 );
+        if (find( state.fIndices.begin(), state.fIndices.end(), index ) == state.fIndices.end())
+            state.fIndices.push_back( index );
+    }
+
+    // differential evolution jump in the selected subspace
+    const double gamma = random.Bool( fModeJumpProbability ) ? 1.0
+        : 2.38 / sqrt( 2.0 * nPairs * state.fDimensions.size() );
+
+    proposed.Values() = current.Values();
+    proposed.SetGeneration( current.GetGeneration() + 1 );
+
+    for (size_t j : state.fDimensions) {
+        double difference = 0.0;
+        for (size_t k = 0; k < nPairs; k++)
+            difference += fArchive[ state.fIndices[2*k] * nParams + j ]
+                - fArchive[ state.fIndices[2*k+1] * nParams + j ];
+
+        proposed[j] += (1.0 + random.Uniform( -fJumpNoise, fJumpNoise )) * gamma * difference
+            + random.Normal( 0.0, fAdditiveNoise * fErrors[j] );
+    }
+
+    fLimits.Reflect( proposed.Values() );
+
+    Evaluate( proposed );
+
+    const double mhRatio = MetropolisHastings::CalculateMHRatio( current, proposed );
+
+    return random.Bool( mhRatio );
+}
+
+} /* namespace vmcmc */
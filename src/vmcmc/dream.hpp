@@ -0,0 +1,151 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief Contains the implementation of the DREAM(ZS) multi-chain sampling
+ * algorithm.
+ */
+
+#ifndef VMCMC_DREAM_H_
+#define VMCMC_DREAM_H_
+
+#include <vmcmc/algorithm.hpp>
+
+namespace vmcmc
+{
+
+/**
+ * Implementation of the DREAM(ZS) algorithm (DiffeRential Evolution Adaptive
+ * Metropolis with sampling from past states, ter Braak & Vrugt, 2008).
+ *
+ * A population of chains is advanced with differential evolution proposals:
+ * the jump of a chain is given by the scaled differences between pairs of
+ * states, drawn from an archive of past states of all chains. Thereby the
+ * proposal distribution automatically adapts to the scale and correlations
+ * of the target. Each proposal only updates a random subspace of the
+ * parameters (randomized subspace sampling with crossover), which improves
+ * the efficiency in higher dimensions. With a small probability, the jump
+ * scale is set to 1, allowing jumps between the modes of multimodal targets.
+ *
+ * The archive is initialized with random draws from the parameter
+ * configuration and is extended with the current states of all chains
+ * every few steps (see SetArchiveThinning()). In between, the archive is
+ * constant, so that the chains can be advanced in parallel.
+ *
+ * The parallel direction update is implemented, the snooker update and the
+ * adaptation of crossover probabilities are not.
+ */
+class Dream : public Algorithm
+{
+public:
+    Dream();
+    virtual ~Dream();
+
+    virtual void Initialize() override;
+
+    virtual void Advance(size_t nSteps = 1) override;
+
+    virtual size_t NumberOfChains() override { return fNChains; }
+    virtual const Chain& GetChain(size_t cIndex = 0) override { return fChains[cIndex]; }
+
+    void SetNumberOfChains(size_t nChains) { fNChains = std::max<size_t>(nChains, 1); }
+
+    void SetRandomizeStartPoint(bool randomizeStartPoint) { fRandomizeStartPoint = randomizeStartPoint; }
+    bool IsRandomizeStartPoint() const { return fRandomizeStartPoint; }
+
+    void SetMultiThreading(bool enable);
+    bool IsMultiThreading() const { return fMultiThreading; }
+
+    /**
+     * Set the maximum number of state pairs used to build a proposal.
+     * The actual number is drawn uniformly from [1, nPairs] for each step.
+     * @param nPairs
+     */
+    void SetNumberOfPairs(size_t nPairs) { fNPairs = std::max<size_t>(nPairs, 1); }
+    size_t GetNumberOfPairs() const { return fNPairs; }
+
+    /**
+     * Set the number of crossover probabilities {1/n, 2/n, ..., 1}, from
+     * which the probability for each parameter to be updated is drawn.
+     * @param nCrossover
+     */
+    void SetNumberOfCrossover(size_t nCrossover) { fNCrossover = std::max<size_t>(nCrossover, 1); }
+    size_t GetNumberOfCrossover() const { return fNCrossover; }
+
+    /**
+     * Set the probability for a jump with scale 1 (mode jumping).
+     * @param probability
+     */
+    void SetModeJumpProbability(double probability) { fModeJumpProbability = probability; }
+    double GetModeJumpProbability() const { return fModeJumpProbability; }
+
+    /**
+     * Set the number of steps, after which the current states of all chains
+     * are appended to the archive.
+     * @param nSteps
+     */
+    void SetArchiveThinning(size_t nSteps) { fArchiveThinning = std::max<size_t>(nSteps, 1); }
+    size_t GetArchiveThinning() const { return fArchiveThinning; }
+
+    /**
+     * Set the number of random states, the archive is initialized with.
+     * @param nStates If 0 (default), 10 times the number of parameters.
+     */
+    void SetInitialArchiveSize(size_t nStates) { fInitialArchiveSize = nStates; }
+    size_t GetInitialArchiveSize() const { return fInitialArchiveSize; }
+
+    size_t GetArchiveSize() const { return fArchiveSize; }
+
+protected:
+    struct ChainState
+    {
+        Sample fCurrent;
+        Sample fProposed;
+        std::vector<size_t> fDimensions;
+        std::vector<size_t> fIndices;
+        Random::engine_type fStream;
+    };
+
+    void AdvanceChain(size_t iChain, size_t nSteps);
+
+    /**
+     * Propose a new state for a chain from the archive and accept or reject it.
+     * @return True if the proposal was accepted.
+     */
+    bool Step(ChainState& state);
+
+    void AppendToArchive(const Vector& values);
+
+    size_t fNChains;
+    bool fRandomizeStartPoint;
+
+    size_t fNPairs;
+    size_t fNCrossover;
+    double fModeJumpProbability;
+    size_t fArchiveThinning;
+    size_t fInitialArchiveSize;
+
+    // jump scale noise (relative) and additive noise (in units of the errors)
+    double fJumpNoise;
+    double fAdditiveNoise;
+    Vector fErrors;
+
+    std::vector<double> fArchive;
+    size_t fArchiveSize;
+    size_t fNStepsSinceArchive;
+
+    std::vector<Chain> fChains;
+    std::vector<ChainState> fStates;
+
+private:
+    bool fMultiThreading;
+};
+
+} /* namespace vmcmc */
+
+#endif /* VMCMC_DREAM_H_ */
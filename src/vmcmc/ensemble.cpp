@@ -0,0 +1,229 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/ensemble.hpp>
+#include <vmcmc/exception.hpp>
+#include <vmcmc/logger.hpp>
+#include <vmcmc/math.hpp>
+#include <vmcmc/metropolis.hpp>
+#include <vmcmc/random.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef USE_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+using namespace tbb;
+#endif // USE_TBB
+
+using namespace std;
+
+namespace vmcmc
+{
+
+LOG_DEFINE("vmcmc.ensemble");
+
+Ensemble::Ensemble() :
+    fNWalkers( 0 ),
+    fStretchScale( 2.0 ),
+    fMultiThreading( true )
+{
+#ifndef USE_TBB
+    fMultiThreading = false;
+#endif
+}
+
+Ensemble::~Ensemble()
+{ }
+
+void Ensemble::SetMultiThreading(bool enable)
+{
+#ifndef USE_TBB
+    if (enable)
+        LOG(Warn, "TBB is not available for multi-threading.");
+    enable = false;
+#endif
+    fMultiThreading = enable;
+}
+
+void Ensemble::Initialize()
+{
+    Algorithm::Initialize();
+
+    if (!(fStretchScale > 1.0))
+        throw Exception() << "The stretch scale must be larger than 1.";
+
+    const size_t nParams = fParameterConfig.size();
+
+    size_t nWalkers = (fNWalkers > 0) ? fNWalkers : 4 * nParams;
+    nWalkers = max<size_t>( nWalkers + nWalkers % 2, 2 );
+
+    if (nWalkers <= nParams)
+        LOG(Warn, "The number of walkers (" << nWalkers << ") should be at least twice the number"
+            " of parameters (" << nParams << ").");
+
+    fChains.assign( nWalkers, Chain(nParams) );
+    fWalkers.assign( nWalkers, WalkerState() );
+    fBatchSamples.resize( nWalkers / 2 );
+
+    for (size_t iWalker = 0; iWalker < nWalkers; iWalker++) {
+        WalkerState& walker = fWalkers[iWalker];
+
+        walker.fCurrent = Sample( fParameterConfig.GetStartValues( true ) );
+        walker.fProposed = Sample( nParams );
+        walker.fAsymmetry = 1.0;
+        walker.fStream = CreateStream( iWalker );
+    }
+
+    // evaluate the start points, one batch per half ensemble if available
+    const size_t nHalf = nWalkers / 2;
+    for (size_t iHalf = 0; iHalf < 2; iHalf++) {
+        if (fBatchNegLogLikelihood) {
+            for (size_t k = 0; k < nHalf; k++)
+                fBatchSamples[k] = &fWalkers[iHalf * nHalf + k].fCurrent;
+            EvaluateBatch( fBatchSamples.data(), nHalf );
+        }
+        else {
+            for (size_t k = 0; k < nHalf; k++)
+                Evaluate( fWalkers[iHalf * nHalf + k].fCurrent );
+        }
+    }
+
+    for (size_t iWalker = 0; iWalker < nWalkers; iWalker++) {
+        Chain& chain = fChains[iWalker];
+        PrepareChain( chain, iWalker );
+        chain.push_back( fWalkers[iWalker].fCurrent );
+    }
+}
+
+void Ensemble::Advance(size_t nSteps)
+{
+    // red-black scheme: each half of the ensemble is updated against the
+    // constant other half
+    for (size_t iStep = 0; iStep < nSteps; iStep++) {
+        AdvanceHalf( 0 );
+        AdvanceHalf( 1 );
+    }
+}
+
+void Ensemble::AdvanceHalf(size_t iHalf)
+{
+    const size_t nHalf = fWalkers.size() / 2;
+    const size_t first = iHalf * nHalf;
+
+    if (fBatchNegLogLikelihood) {
+        for (size_t k = 0; k < nHalf; k++) {
+            Propose( first + k, iHalf );
+            fBatchSamples[k] = &fWalkers[first + k].fProposed;
+        }
+
+        EvaluateBatch( fBatchSamples.data(), nHalf );
+
+        for (size_t k = 0; k < nHalf; k++)
+            AcceptOrReject( first + k );
+    }
+    else if (fMultiThreading) {
+#ifdef USE_TBB
+        parallel_for(
+            blocked_range<size_t>(first, first + nHalf),
+            [&](const blocked_range<size_t>& range) {
+                for (size_t iWalker = range.begin(); iWalker < range.end(); iWalker++) {
+                    this->Propose( iWalker, iHalf );
+                    this->Evaluate( fWalkers[iWalker].fProposed );
+                    this->AcceptOrReject( iWalker );
+                }
+            }
+        );
+#else
+        LOG(Fatal, "TBB not available - multi-threading should be deactivated.");
+#endif
+    }
+    else {
+        for (size_t iWalker = first; iWalker < first + nHalf; iWalker++) {
+            Propose( iWalker, iHalf );
+            Evaluate( fWalkers[iWalker].fProposed );
+            AcceptOrReject( iWalker );
+        }
+    }
+}
+
+void Ensemble::Propose(size_t iWalker, size_t iHalf)
+{
+    const size_t nHalf = fWalkers.size() / 2;
+    const size_t nParams = fParameterConfig.size();
+
+    WalkerState& walker = fWalkers[iWalker];
+
+    Random::ScopedEngine stream( walker.fStream );
+    auto& random = Random::Instance();
+    const Sample& other = fWalkers[ (1 - iHalf) * nHalf + random.Uniform<size_t>( 0, nHalf-1 ) ].fCurrent;
+
+    // draw the stretch factor from g(z) ~ 1/sqrt(z) in [1/a, a]
+    const double a = fStretchScale;
+    const double z = math::pow<2>( (a - 1.0) * random.Uniform() + 1.0 ) / a;
+
+    Sample& proposed = walker.fProposed;
+    proposed.SetGeneration( walker.fCurrent.GetGeneration() + 1 );
+
+    for (size_t i = 0; i < nParams; i++)
+        proposed[i] = other[i] + z * (walker.fCurrent[i] - other[i]);
+
+    walker.fAsymmetry = pow( z, (double) nParams - 1.0 );
+}
+
+void Ensemble::AcceptOrReject(size_t iWalker)
+{
+    WalkerState& walker = fWalkers[iWalker];
+
+    const double mhRatio = MetropolisHastings::CalculateMHRatio( walker.fCurrent,
+        walker.fProposed, walker.fAsymmetry );
+
+    Random::ScopedEngine stream( walker.fStream );
+
+    if (Random::Instance().Bool( mhRatio )) {
+        swap( walker.fCurrent, walker.fProposed );
+        walker.fCurrent.SetAccepted( true );
+    }
+    else {
+        walker.fCurrent.SetAccepted( false );
+        walker.fCurrent.IncrementGeneration();
+    }
+
+    fChains[iWalker].push_back( walker.fCurrent );
+}
+
+Chain Ensemble::GetEnsembleChain(size_t startStep) const
+{
+    const size_t nParams = fParameterConfig.size();
+
+    size_t nSteps = numeric_limits<size_t>::max();
+    for (const Chain& chain : fChains)
+        nSteps = min( nSteps, chain.size() );
+
+    // steps evicted from the chain windows are not available anymore
+    for (const Chain& chain : fChains)
+        startStep = max( startStep, chain.GetFirstIndex() );
+
+    Chain result( nParams );
+    if (fChains.empty() || startStep >= nSteps)
+        return result;
+
+    result.reserve( (nSteps - startStep) * fChains.size() );
+
+    for (size_t iStep = startStep; iStep < nSteps; iStep++)
+        for (const Chain& chain : fChains)
+            result.push_back( chain[iStep] );
+
+    return result;
+}
+
+} /* namespace vmcmc */
@@ -0,0 +1,116 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief Contains the implementation of the affine-invariant ensemble
+ * sampler.
+ */
+
+#ifndef VMCMC_ENSEMBLE_H_
+#define VMCMC_ENSEMBLE_H_
+
+#include <vmcmc/algorithm.hpp>
+
+namespace vmcmc
+{
+
+/**
+ * Implementation of the affine-invariant ensemble sampler with stretch moves
+ * (Goodman & Weare, 2010), as popularized by emcee.
+ *
+ * An ensemble of walkers is advanced together. Each walker proposes a point
+ * on the line through its own position and the position of a randomly
+ * chosen walker from the other half of the ensemble, stretched by a random
+ * factor. As the moves are invariant under affine transformations, the
+ * sampler performs equally well on badly scaled and strongly correlated
+ * targets and requires no tuning of a proposal function.
+ *
+ * The ensemble is split into two halves. While one half is updated, the
+ * other one is constant, so that the walkers of a half can be advanced in
+ * parallel (or evaluated in one call to a batch target function).
+ *
+ * Each walker is stored in its own chain, and is analyzed individually by
+ * the ChainSetStatistics of the algorithm. Since the walkers are not
+ * independent, the statistics of the whole ensemble are more meaningful,
+ * see GetEnsembleChain().
+ *
+ * The walkers start from random draws of the parameter configuration.
+ */
+class Ensemble : public Algorithm
+{
+public:
+    Ensemble();
+    virtual ~Ensemble();
+
+    virtual void Initialize() override;
+
+    virtual void Advance(size_t nSteps = 1) override;
+
+    virtual size_t NumberOfChains() override { return fChains.size(); }
+    virtual const Chain& GetChain(size_t cIndex = 0) override { return fChains[cIndex]; }
+
+    /**
+     * Set the number of walkers, rounded up to an even number.
+     * @param nWalkers If 0 (default), 4 times the number of parameters.
+     */
+    void SetNumberOfWalkers(size_t nWalkers) { fNWalkers = nWalkers; }
+    size_t GetNumberOfWalkers() const { return fNWalkers; }
+
+    void SetMultiThreading(bool enable);
+    bool IsMultiThreading() const { return fMultiThreading; }
+
+    /**
+     * Set the scale a > 1 of the stretch moves, limiting the stretch factor
+     * to [1/a, a].
+     * @param scale
+     */
+    void SetStretchScale(double scale) { fStretchScale = scale; }
+    double GetStretchScale() const { return fStretchScale; }
+
+    /**
+     * Merge the chains of all walkers into one chain, ordered by step.
+     * @param startStep The first step to include.
+     * @return
+     */
+    Chain GetEnsembleChain(size_t startStep = 0) const;
+
+protected:
+    struct WalkerState
+    {
+        Sample fCurrent;
+        Sample fProposed;
+        double fAsymmetry;
+        Random::engine_type fStream;
+    };
+
+    void AdvanceHalf(size_t iHalf);
+
+    /**
+     * Propose a stretch move of a walker against the walkers of the other
+     * half.
+     */
+    void Propose(size_t iWalker, size_t iHalf);
+
+    void AcceptOrReject(size_t iWalker);
+
+    size_t fNWalkers;
+    double fStretchScale;
+
+    std::vector<Chain> fChains;
+    std::vector<WalkerState> fWalkers;
+
+private:
+    bool fMultiThreading;
+
+    // scratch buffer for batched evaluations
+    std::vector<Sample*> fBatchSamples;
+};
+
+} /* namespace vmcmc */
+
+#endif /* VMCMC_ENSEMBLE_H_ */
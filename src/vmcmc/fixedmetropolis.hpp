@@ -0,0 +1,333 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief Contains a Metropolis sampler specialized for a fixed number of
+ * parameters, known at compile time.
+ */
+
+#ifndef VMCMC_FIXEDMETROPOLIS_H_
+#define VMCMC_FIXEDMETROPOLIS_H_
+
+#include <vmcmc/algorithm.hpp>
+#include <vmcmc/exception.hpp>
+#include <vmcmc/numeric.hpp>
+#include <vmcmc/random.hpp>
+
+#include <array>
+#include <cmath>
+
+#ifdef USE_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#endif // USE_TBB
+
+namespace vmcmc
+{
+
+/**
+ * Implementation of the Metropolis algorithm for a fixed number of
+ * parameters.
+ *
+ * In contrast to MetropolisHastings, the state of each chain is held in a
+ * std::array, the Cholesky factor of the Gaussian proposal is a fixed-size
+ * packed triangle, and the target function is stored with its own type and
+ * called with NParams unpacked arguments, like with
+ * Algorithm::SetNegLogLikelihood<NParams>(). This allows the compiler to
+ * inline the target and to unroll the proposal and the step, which pays off
+ * for cheap likelihoods with few parameters.
+ *
+ * Limits are handled by reflection, as in MetropolisHastings. Parallel
+ * tempering and custom proposal functions are not supported.
+ *
+ * Use makeFixedMetropolis() to deduce the type of the target function.
+ *
+ * @tparam NParams The number of parameters.
+ * @tparam NegLogLikelihoodT A callable returning -log(likelihood) for
+ * NParams arguments of type double.
+ */
+template <size_t NParams, typename NegLogLikelihoodT>
+class FixedMetropolis : public Algorithm
+{
+    static_assert(NParams > 0, "At least one parameter is required.");
+
+public:
+    using State = std::array<double, NParams>;
+
+public:
+    FixedMetropolis(NegLogLikelihoodT negLogLikelihood);
+    virtual ~FixedMetropolis() { }
+
+    virtual void Initialize() override;
+
+    virtual void Advance(size_t nSteps = 1) override;
+
+    virtual size_t NumberOfChains() override { return fNChains; }
+    virtual const Chain& GetChain(size_t cIndex = 0) override { return fChains[cIndex]; }
+
+    void SetNumberOfChains(size_t nChains) { fNChains = std::max<size_t>(nChains, 1); }
+
+    void SetRandomizeStartPoint(bool randomizeStartPoint) { fRandomizeStartPoint = randomizeStartPoint; }
+    bool IsRandomizeStartPoint() const { return fRandomizeStartPoint; }
+
+    void SetMultiThreading(bool enable) { fMultiThreading = enable; }
+    bool IsMultiThreading() const { return fMultiThreading; }
+
+    /**
+     * Evaluate the target function -log(likelihood) without type erasure.
+     * @param values
+     * @return
+     */
+    double EvaluateNegLogLikelihood(const State& values) const;
+
+    using Algorithm::EvaluateNegLogLikelihood;
+
+private:
+    struct ChainState
+    {
+        State fValues;
+        double fNegLogLikelihood;
+        double fLikelihood;
+        double fPrior;
+        size_t fGeneration;
+
+        Random::engine_type fStream;
+
+        // argument buffer for a user defined prior
+        std::vector<double> fPriorArgs;
+    };
+
+    double EvaluatePrior(const State& values, std::vector<double>& priorArgs) const;
+
+    void AdvanceChain(size_t iChain, size_t nSteps);
+
+    NegLogLikelihoodT fTarget;
+
+    size_t fNChains;
+    bool fRandomizeStartPoint;
+    bool fMultiThreading;
+
+    // lower triangle of the proposal Cholesky factor, packed row by row
+    std::array<double, NParams * (NParams+1) / 2> fCholesky;
+    State fLowerLimits;
+    State fUpperLimits;
+
+    std::vector<Chain> fChains;
+    std::vector<ChainState> fStates;
+};
+
+/**
+ * Construct a FixedMetropolis sampler, deducing the type of the target
+ * function.
+ * @param negLogLikelihood A callable returning -log(likelihood) for NParams
+ * arguments of type double.
+ * @return
+ */
+template <size_t NParams, typename NegLogLikelihoodT>
+inline FixedMetropolis<NParams, NegLogLikelihoodT> makeFixedMetropolis(NegLogLikelihoodT negLogLikelihood)
+{
+    return FixedMetropolis<NParams, NegLogLikelihoodT>( negLogLikelihood );
+}
+
+namespace detail
+{
+
+/**
+ * Call a variadic function using the elements of an array as arguments.
+ * @see apply_first_n
+ */
+template <size_t NParams, typename C, typename... Ts>
+typename std::enable_if<NParams == sizeof...(Ts), double>::type
+inline apply_array(const C& f, const std::array<double, NParams>& /*v*/, Ts... ts)
+{
+    return f(ts...);
+}
+
+/**
+ * @overload
+ */
+template <size_t NParams, typename C, typename... Ts>
+typename std::enable_if<NParams != sizeof...(Ts), double>::type
+inline apply_array(const C& f, const std::array<double, NParams>& v, Ts... ts)
+{
+    return apply_array<NParams>(f, v, v[NParams - sizeof...(Ts) - 1], ts...);
+}
+
+} /* namespace detail */
+
+template <size_t NParams, typename NegLogLikelihoodT>
+inline FixedMetropolis<NParams, NegLogLikelihoodT>::FixedMetropolis(NegLogLikelihoodT negLogLikelihood) :
+    fTarget( negLogLikelihood ),
+    fNChains( 1 ),
+    fRandomizeStartPoint( false ),
+    fMultiThreading( true )
+{
+#ifndef USE_TBB
+    fMultiThreading = false;
+#endif
+
+    // keep the type erased target available for the base class
+    Algorithm::SetNegLogLikelihood<NParams>( negLogLikelihood );
+
+    fCholesky.fill( 0.0 );
+    fLowerLimits.fill( -numeric::inf() );
+    fUpperLimits.fill( numeric::inf() );
+}
+
+template <size_t NParams, typename NegLogLikelihoodT>
+inline double FixedMetropolis<NParams, NegLogLikelihoodT>::EvaluateNegLogLikelihood(const State& values) const
+{
+    return detail::apply_array<NParams>( fTarget, values );
+}
+
+template <size_t NParams, typename NegLogLikelihoodT>
+inline double FixedMetropolis<NParams, NegLogLikelihoodT>::EvaluatePrior(const State& values,
+    std::vector<double>& priorArgs) const
+{
+    for (size_t i = 0; i < NParams; i++) {
+        if (!(values[i] >= fLowerLimits[i] && values[i] <= fUpperLimits[i]))
+            return 0.0;
+    }
+
+    if (!fPrior)
+        return 1.0;
+
+    std::copy( values.begin(), values.end(), priorArgs.begin() );
+    return fPrior( priorArgs );
+}
+
+template <size_t NParams, typename NegLogLikelihoodT>
+inline void FixedMetropolis<NParams, NegLogLikelihoodT>::Initialize()
+{
+    Algorithm::Initialize();
+
+    if (fParameterConfig.size() != NParams)
+        throw Exception() << "The parameter configuration defines " << fParameterConfig.size()
+            << " parameters, but the sampler requires " << NParams << ".";
+
+    // copy the proposal Cholesky factor and the limits into fixed-size arrays
+    const MatrixLower cholesky = fParameterConfig.GetCholeskyDecomp();
+
+    for (size_t j = 0, k = 0; j < NParams; j++)
+        for (size_t i = 0; i <= j; i++, k++)
+            fCholesky[k] = cholesky(j, i);
+
+    for (size_t i = 0; i < NParams; i++) {
+        fLowerLimits[i] = fParameterConfig[i].GetLowerLimit().get_value_or( -numeric::inf() );
+        fUpperLimits[i] = fParameterConfig[i].GetUpperLimit().get_value_or( numeric::inf() );
+    }
+
+    fChains.assign( fNChains, Chain(NParams) );
+    fStates.assign( fNChains, ChainState() );
+
+    for (size_t iChain = 0; iChain < fNChains; iChain++) {
+        ChainState& state = fStates[iChain];
+        state.fPriorArgs.resize( NParams );
+        state.fStream = CreateStream( iChain );
+
+        const Vector startValues = fParameterConfig.GetStartValues( fRandomizeStartPoint );
+        std::copy( startValues.begin(), startValues.end(), state.fValues.begin() );
+
+        state.fPrior = EvaluatePrior( state.fValues, state.fPriorArgs );
+        state.fNegLogLikelihood = (state.fPrior > 0.0)
+            ? EvaluateNegLogLikelihood( state.fValues ) : numeric::inf();
+        state.fLikelihood = std::exp( -state.fNegLogLikelihood );
+        state.fGeneration = 0;
+
+        Chain& chain = fChains[iChain];
+        PrepareChain( chain, iChain );
+
+        chain.push_back( state.fValues.data(), state.fNegLogLikelihood,
+            state.fLikelihood, state.fPrior, state.fGeneration, true );
+    }
+}
+
+template <size_t NParams, typename NegLogLikelihoodT>
+inline void FixedMetropolis<NParams, NegLogLikelihoodT>::Advance(size_t nSteps)
+{
+    if (fMultiThreading) {
+#ifdef USE_TBB
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, fNChains),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for (size_t iChain = range.begin(); iChain < range.end(); iChain++)
+                    this->AdvanceChain( iChain, nSteps );
+            }
+        );
+        return;
+#endif
+    }
+
+    for (size_t iChain = 0; iChain < fNChains; iChain++)
+        AdvanceChain( iChain, nSteps );
+}
+
+template <size_t NParams, typename NegLogLikelihoodT>
+inline void FixedMetropolis<NParams, NegLogLikelihoodT>::AdvanceChain(size_t iChain, size_t nSteps)
+{
+    ChainState& state = fStates[iChain];
+    Chain& chain = fChains[iChain];
+
+    Random::ScopedEngine stream( state.fStream );
+    auto& random = Random::Instance();
+
+    State noise;
+    State next;
+
+    for (size_t iStep = 0; iStep < nSteps; iStep++) {
+
+        // propose next = current + L * z
+        random.Normal( noise.data(), NParams );
+
+        for (size_t j = 0; j < NParams; j++) {
+            const double* row = fCholesky.data() + j * (j+1) / 2;
+            double sum = state.fValues[j];
+            for (size_t i = 0; i <= j; i++)
+                sum += row[i] * noise[i];
+            next[j] = sum;
+        }
+
+        // reflect from limits
+        for (size_t i = 0; i < NParams; i++) {
+            if (next[i] < fLowerLimits[i])
+                next[i] = 2.0 * fLowerLimits[i] - next[i];
+            else if (next[i] > fUpperLimits[i])
+                next[i] = 2.0 * fUpperLimits[i] - next[i];
+        }
+
+        const double prior = EvaluatePrior( next, state.fPriorArgs );
+
+        bool accepted = false;
+        double negLogLikelihood = numeric::inf();
+
+        if (prior > 0.0) {
+            negLogLikelihood = EvaluateNegLogLikelihood( next );
+
+            const double mhRatio = prior / state.fPrior
+                * std::exp( state.fNegLogLikelihood - negLogLikelihood );
+
+            accepted = random.Bool( mhRatio );
+        }
+
+        state.fGeneration++;
+
+        if (accepted) {
+            state.fValues = next;
+            state.fNegLogLikelihood = negLogLikelihood;
+            state.fLikelihood = std::exp( -negLogLikelihood );
+            state.fPrior = prior;
+        }
+
+        chain.push_back( state.fValues.data(), state.fNegLogLikelihood,
+            state.fLikelihood, state.fPrior, state.fGeneration, accepted );
+    }
+}
+
+} /* namespace vmcmc */
+
+#endif /* VMCMC_FIXEDMETROPOLIS_H_ */
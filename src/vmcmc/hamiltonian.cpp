@@ -0,0 +1,217 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/exception.hpp>
+#include <vmcmc/hamiltonian.hpp>
+#include <vmcmc/logger.hpp>
+#include <vmcmc/numeric.hpp>
+#include <vmcmc/random.hpp>
+
+#ifdef USE_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+using namespace tbb;
+#endif // USE_TBB
+
+using namespace std;
+
+namespace vmcmc
+{
+
+LOG_DEFINE("vmcmc.hamiltonian");
+
+Hamiltonian::Hamiltonian() :
+    fNChains( 1 ),
+    fRandomizeStartPoint( false ),
+    fStepSize( 0.1 ),
+    fNLeapfrogSteps( 20 ),
+    fMultiThreading( true )
+{
+#ifndef USE_TBB
+    fMultiThreading = false;
+#endif
+}
+
+Hamiltonian::~Hamiltonian()
+{ }
+
+void Hamiltonian::SetMultiThreading(bool enable)
+{
+#ifndef USE_TBB
+    if (enable)
+        LOG(Warn, "TBB is not available for multi-threading.");
+    enable = false;
+#endif
+    fMultiThreading = enable;
+}
+
+void Hamiltonian::Initialize()
+{
+    Algorithm::Initialize();
+
+    if (!fNegLogLikelihoodGradient)
+        throw Exception() << "The Hamiltonian sampler requires a target function with gradient.";
+
+    const size_t nParams = fParameterConfig.size();
+
+    // the momenta are sampled in coordinates scaled by the Cholesky
+    // decomposition of the inverse mass matrix
+    fInverseMassCholesky = fParameterConfig.GetCholeskyDecomp();
+
+    fChains.assign( fNChains, Chain(nParams) );
+    fStates.assign( fNChains, ChainState() );
+
+    for (size_t iChain = 0; iChain < fNChains; iChain++) {
+        ChainState& state = fStates[iChain];
+
+        state.fCurrent = Sample( fParameterConfig.GetStartValues( fRandomizeStartPoint ) );
+        state.fProposed = Sample( nParams );
+        state.fProposedGradient.resize( nParams );
+        state.fMomentum.resize( nParams );
+        state.fStream = CreateStream( iChain );
+
+        EvaluateWithGradient( state.fCurrent, state.fGradient );
+
+        Chain& chain = fChains[iChain];
+        PrepareChain( chain, iChain );
+        chain.push_back( state.fCurrent );
+    }
+}
+
+bool Hamiltonian::EvaluateWithGradient(Sample& sample, std::vector<double>& gradient) const
+{
+    if (!EvaluatePrior( sample ))
+        return false;
+
+    const double negLogLikelihood = EvaluateNegLogLikelihood( sample.Values().data(), gradient );
+    sample.SetNegLogLikelihood( negLogLikelihood );
+    sample.SetLikelihood( exp(-negLogLikelihood) );
+
+    return true;
+}
+
+void Hamiltonian::Advance(size_t nSteps)
+{
+    if (fMultiThreading) {
+#ifdef USE_TBB
+        parallel_for(
+            blocked_range<size_t>(0, fNChains),
+            [&](const blocked_range<size_t>& range) {
+                for (size_t iChain = range.begin(); iChain < range.end(); iChain++)
+                    this->AdvanceChain( iChain, nSteps );
+            }
+        );
+        return;
+#endif
+    }
+
+    for (size_t iChain = 0; iChain < fNChains; iChain++)
+        AdvanceChain( iChain, nSteps );
+}
+
+void Hamiltonian::AdvanceChain(size_t iChain, size_t nSteps)
+{
+    ChainState& state = fStates[iChain];
+    Chain& chain = fChains[iChain];
+
+    Random::ScopedEngine stream( state.fStream );
+    auto& random = Random::Instance();
+
+    for (size_t iStep = 0; iStep < nSteps; iStep++) {
+
+        // draw the momenta
+        random.Normal( state.fMomentum.data(), state.fMomentum.size() );
+
+        const double initialEnergy = Energy( state.fCurrent, state.fMomentum );
+
+        const double finalEnergy = Integrate( state );
+
+        const bool accepted = random.Bool( exp(initialEnergy - finalEnergy) );
+
+        if (accepted) {
+            swap( state.fCurrent, state.fProposed );
+            swap( state.fGradient, state.fProposedGradient );
+            state.fCurrent.SetAccepted( true );
+            state.fCurrent.IncrementGeneration();
+        }
+        else {
+            state.fCurrent.SetAccepted( false );
+            state.fCurrent.IncrementGeneration();
+        }
+
+        chain.push_back( state.fCurrent );
+    }
+}
+
+void Hamiltonian::Kick(vector<double>& p, const vector<double>& gradient, double epsilon) const
+{
+    const MatrixLower& L = fInverseMassCholesky;
+    const size_t nParams = L.size1();
+
+    for (size_t i = 0; i < nParams; i++) {
+        double sum = 0.0;
+        for (size_t j = i; j < nParams; j++)
+            sum += L(j, i) * gradient[j];
+        p[i] -= epsilon * sum;
+    }
+}
+
+void Hamiltonian::Drift(Sample& sample, const vector<double>& p, double epsilon) const
+{
+    const MatrixLower& L = fInverseMassCholesky;
+    const size_t nParams = L.size1();
+
+    for (size_t j = 0; j < nParams; j++) {
+        double sum = 0.0;
+        for (size_t i = 0; i <= j; i++)
+            sum += L(j, i) * p[i];
+        sample[j] += epsilon * sum;
+    }
+}
+
+double Hamiltonian::Energy(const Sample& sample, const vector<double>& p) const
+{
+    double kinetic = 0.0;
+    for (double pi : p)
+        kinetic += 0.5 * pi * pi;
+
+    const double energy = sample.GetNegLogLikelihood() - log( sample.GetPrior() ) + kinetic;
+
+    // diverging trajectories (NaN) are rejected
+    return (energy == energy) ? energy : numeric::inf();
+}
+
+double Hamiltonian::Integrate(ChainState& state)
+{
+    Sample& sample = state.fProposed;
+    vector<double>& p = state.fMomentum;
+    vector<double>& gradient = state.fProposedGradient;
+
+    sample.SetGeneration( state.fCurrent.GetGeneration() );
+    sample.Values() = state.fCurrent.Values();
+    gradient = state.fGradient;
+
+    // With the inverse mass matrix L L^T, the leapfrog integrator operates on
+    // the momenta in scaled coordinates: x += e L p, p -= e L^T grad(x).
+    Kick( p, gradient, 0.5 * fStepSize );
+
+    for (size_t iLeap = 0; iLeap < fNLeapfrogSteps; iLeap++) {
+        Drift( sample, p, fStepSize );
+
+        if (!EvaluateWithGradient( sample, gradient ))
+            return numeric::inf();
+
+        Kick( p, gradient, (iLeap+1 < fNLeapfrogSteps) ? fStepSize : 0.5 * fStepSize );
+    }
+
+    return Energy( sample, p );
+}
+
+} /* namespace vmcmc */
@@ -0,0 +1,145 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief Contains the implementation of the Hamiltonian Monte Carlo sampling
+ * algorithm.
+ */
+
+#ifndef VMCMC_HAMILTONIAN_H_
+#define VMCMC_HAMILTONIAN_H_
+
+#include <vmcmc/algorithm.hpp>
+
+namespace vmcmc
+{
+
+/**
+ * Implementation of the Hamiltonian (alias hybrid) Monte Carlo algorithm.
+ *
+ * Each step draws a random momentum and follows the Hamiltonian dynamics of
+ * the potential -log(likelihood * prior) for a fixed number of leapfrog
+ * steps, before the end point of the trajectory is accepted or rejected.
+ * This suppresses the random walk behaviour of the Metropolis algorithm and
+ * scales much better with the number of parameters.
+ *
+ * The target function must provide its gradient, see
+ * Algorithm::SetNegLogLikelihoodGradient(). Priors enter the acceptance
+ * probability, but not the dynamics. Trajectories leaving the parameter
+ * limits are rejected.
+ *
+ * The inverse mass matrix is given by the covariance matrix of the parameter
+ * configuration (ParameterConfig::GetCovarianceMatrix()). Thus, parameter
+ * errors and correlations, which roughly match the target distribution,
+ * make a step size of order 1 / (number of leapfrog steps) a good choice.
+ */
+class Hamiltonian : public Algorithm
+{
+public:
+    Hamiltonian();
+    virtual ~Hamiltonian();
+
+    virtual void Initialize() override;
+
+    virtual void Advance(size_t nSteps = 1) override;
+
+    virtual size_t NumberOfChains() override { return fNChains; }
+    virtual const Chain& GetChain(size_t cIndex = 0) override { return fChains[cIndex]; }
+
+    void SetNumberOfChains(size_t nChains) { fNChains = std::max<size_t>(nChains, 1); }
+
+    void SetRandomizeStartPoint(bool randomizeStartPoint) { fRandomizeStartPoint = randomizeStartPoint; }
+    bool IsRandomizeStartPoint() const { return fRandomizeStartPoint; }
+
+    void SetMultiThreading(bool enable);
+    bool IsMultiThreading() const { return fMultiThreading; }
+
+    /**
+     * Set the step size of the leapfrog integrator in units of the
+     * parameter errors.
+     * @param stepSize
+     */
+    void SetStepSize(double stepSize) { fStepSize = stepSize; }
+    double GetStepSize() const { return fStepSize; }
+
+    /**
+     * Set the number of leapfrog steps per trajectory.
+     * @param nSteps
+     */
+    void SetNumberOfLeapfrogSteps(size_t nSteps) { fNLeapfrogSteps = std::max<size_t>(nSteps, 1); }
+    size_t GetNumberOfLeapfrogSteps() const { return fNLeapfrogSteps; }
+
+    /**
+     * Get the Cholesky decomposition L L^T of the inverse mass matrix.
+     * @return
+     */
+    const MatrixLower& GetInverseMassCholesky() const { return fInverseMassCholesky; }
+
+protected:
+    struct ChainState
+    {
+        Sample fCurrent;
+        Sample fProposed;
+        std::vector<double> fGradient;
+        std::vector<double> fProposedGradient;
+        std::vector<double> fMomentum;
+        Random::engine_type fStream;
+    };
+
+    virtual bool CanAdvanceIndependently() const override { return true; }
+    virtual void AdvanceIndependently(size_t iChain, size_t nSteps) override { AdvanceChain( iChain, nSteps ); }
+
+    virtual void AdvanceChain(size_t iChain, size_t nSteps);
+
+    /**
+     * Follow a leapfrog trajectory from the current state of a chain.
+     * @return The total energy at the end of the trajectory, infinity if the
+     * trajectory left the support of the target.
+     */
+    double Integrate(ChainState& state);
+
+    /**
+     * Evaluate prior, -log(likelihood) and its gradient at the position of
+     * @p sample.
+     * @return False if the prior is zero.
+     */
+    bool EvaluateWithGradient(Sample& sample, std::vector<double>& gradient) const;
+
+    /**
+     * Update the momenta @p p by a leapfrog kick: p -= e L^T grad.
+     */
+    void Kick(std::vector<double>& p, const std::vector<double>& gradient, double epsilon) const;
+
+    /**
+     * Update the position of @p sample by a leapfrog step: x += e L p.
+     */
+    void Drift(Sample& sample, const std::vector<double>& p, double epsilon) const;
+
+    /**
+     * Get the total energy -log(likelihood * prior) + p^2 / 2.
+     */
+    double Energy(const Sample& sample, const std::vector<double>& p) const;
+
+    size_t fNChains;
+    bool fRandomizeStartPoint;
+
+    double fStepSize;
+    size_t fNLeapfrogSteps;
+
+    MatrixLower fInverseMassCholesky;
+
+    std::vector<Chain> fChains;
+    std::vector<ChainState> fStates;
+
+private:
+    bool fMultiThreading;
+};
+
+} /* namespace vmcmc */
+
+#endif /* VMCMC_HAMILTONIAN_H_ */
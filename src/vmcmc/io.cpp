@@ -9,12 +9,20 @@
  */
 
 #include <vmcmc/io.hpp>
+#include <vmcmc/checkpoint.hpp>
+#include <vmcmc/codec.hpp>
 #include <vmcmc/exception.hpp>
 #include <vmcmc/numeric.hpp>
 #include <vmcmc/logger.hpp>
 
 //#include <gnuplot_i.hpp>
 #include <iomanip>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -23,9 +31,65 @@ namespace vmcmc
 
 LOG_DEFINE("vmcmc.io");
 
+namespace {
+
+// binary file format constants
+const char kBinaryMagic[8] = { 'V', 'M', 'C', 'M', 'C', 'B', 'I', 'N' };
+constexpr uint64_t kBinaryByteOrderMark = 0x0102030405060708;
+constexpr uint64_t kBinaryVersion = 1;
+constexpr uint64_t kBinaryFloat64 = 1;
+constexpr uint64_t kBinaryCompressed = 2;
+
+struct BinaryFileHeader
+{
+    char fMagic[8];
+    uint64_t fByteOrderMark;
+    uint64_t fVersion;
+    uint64_t fDataType;
+    uint64_t fNChains;
+    uint64_t fNParams;
+    uint64_t fChunkSize;
+    uint64_t fNameBytes;
+};
+
+struct BinaryChunkHeader
+{
+    uint64_t fChainIndex;
+    uint64_t fNRows;
+};
+
+// followed by the compressed payload, padded to 8 bytes
+struct CompressedChunkHeader
+{
+    uint64_t fChainIndex;
+    uint64_t fNRows;
+    uint64_t fNBytes;
+};
+
+inline size_t padTo8(size_t n) { return (n + 7) & ~(size_t) 7; }
+
+// the size of an existing file, 0 if it does not exist
+size_t fileSize(const string& filePath)
+{
+    struct stat fileStat;
+    return (stat( filePath.c_str(), &fileStat ) == 0) ? fileStat.st_size : 0;
+}
+
+// discard the content written after a checkpoint
+void truncateFile(const string& filePath, size_t nBytes)
+{
+    if (fileSize( filePath ) < nBytes)
+        throw Exception() << "File '" << filePath << "' is shorter than at the checkpoint.";
+
+    if (truncate( filePath.c_str(), nBytes ) != 0)
+        throw Exception() << "Cannot truncate file '" << filePath << "'.";
+}
+
+}
+
 void Writer::Write(size_t chainIndex, const Sample& sample)
 {
-    Chain tmpChain;
+    Chain tmpChain( sample.size(), 1 );
     tmpChain.push_back( sample );
     Write(chainIndex, tmpChain, 0);
 }
@@ -73,9 +137,9 @@ string TextFileWriter::GetFilePath(int chainIndex) const
     return filePath.str();
 }
 
-void TextFileWriter::Initialize(size_t numberOfChains, const ParameterConfig& paramConfig)
+void TextFileWriter::Initialize(size_t numberOfChains, const ParameterConfig& paramConfig, bool append)
 {
-    Writer::Initialize(numberOfChains, paramConfig);
+    Writer::Initialize(numberOfChains, paramConfig, append);
 
     fFileStreams.clear();
 
@@ -98,20 +162,24 @@ void TextFileWriter::Initialize(size_t numberOfChains, const ParameterConfig& pa
 
     firstLine << fColumnSep << "negLogL."
             << fColumnSep << "Likelihood"
-            << fColumnSep << "Prior" << endl;
+            << fColumnSep << "Prior" << '\n';
 
     for (size_t c = 0; c < nFileStreams; c++) {
 
         const string filePath = GetFilePath( (fCombineChains) ? -1 : c );
 
-        fFileStreams.emplace_back( new ofstream(filePath, ios::trunc) );
+        // a continued file already starts with the column names
+        const bool continued = append && fileSize( filePath ) > 0;
+
+        fFileStreams.emplace_back( new ofstream(filePath, (continued) ? ios::app : ios::trunc) );
 
         ofstream& fileStrm = *fFileStreams.back();
 
         if (!fileStrm.is_open() || fileStrm.fail())
             throw Exception() << "TextWriter target file is in error state.";
 
-        fileStrm << firstLine.str();
+        if (!continued)
+            fileStrm << firstLine.str();
         fileStrm.precision(fPrecision);
     }
 }
@@ -127,24 +195,657 @@ void TextFileWriter::Write(size_t chainIndex, const Chain& chain, size_t startIn
 
     ofstream& fileStrm = *fFileStreams[chainIndex];
 
-    for (size_t i = startIndex; i < chain.size(); i++) {
-        const Sample& sample = chain[i];
+    if (startIndex >= chain.size())
+        return;
+
+    // write the distinct states once per step they were repeated
+    for (size_t run = chain.FindRun(startIndex); run < chain.NumberOfRuns(); run++) {
+        const size_t runStart = chain.GetRunStart(run);
+        const size_t runEnd = runStart + chain.GetRunLength(run);
+
+        const double* values = chain.GetRunValues(run);
+
+        for (size_t i = max(runStart, startIndex); i < runEnd; i++) {
+            fileStrm << chain.GetRunGeneration(run) + (i - runStart);
+
+            for (size_t p = 0; p < chain.NumberOfParams(); p++)
+                fileStrm << fColumnSep << values[p];
+
+            fileStrm << fColumnSep << chain.GetRunNegLogLikelihood(run);
+            fileStrm << fColumnSep << chain.GetRunLikelihood(run);
+            fileStrm << fColumnSep << chain.GetRunPrior(run);
+
+        //    fFileStream << "\t" << chain.IsAccepted(i);
+
+            // no flushing per line, the streams are flushed in Finalize()
+            fileStrm << '\n';
+        }
+    }
+}
+
+void TextFileWriter::Finalize()
+{
+    for (auto& fileStrm : fFileStreams)
+        fileStrm->flush();
+}
+
+void TextFileWriter::SaveState(CheckpointWriter& checkpoint)
+{
+    checkpoint.PutUInt( fFileStreams.size() );
+
+    for (size_t c = 0; c < fFileStreams.size(); c++) {
+        const string filePath = GetFilePath( (fCombineChains) ? -1 : c );
+
+        fFileStreams[c]->flush();
+        if (fFileStreams[c]->fail())
+            throw Exception() << "Error while writing to file '" << filePath << "'.";
+
+        syncFile( filePath );
+        checkpoint.PutUInt( fileSize( filePath ) );
+    }
+}
+
+void TextFileWriter::LoadState(CheckpointReader& checkpoint)
+{
+    if (checkpoint.GetUInt() != fFileStreams.size())
+        throw Exception() << "The checkpoint does not match the files of the text writer.";
+
+    // the streams append to the end of the truncated files
+    for (size_t c = 0; c < fFileStreams.size(); c++) {
+        fFileStreams[c]->flush();
+        truncateFile( GetFilePath( (fCombineChains) ? -1 : c ), checkpoint.GetUInt() );
+    }
+}
+
+BinaryFileWriter::BinaryFileWriter(const string& filePath, size_t chunkSize) :
+    fFilePath( filePath ),
+    fChunkSize( chunkSize ),
+    fDataType( kBinaryFloat64 )
+{ }
+
+BinaryFileWriter::~BinaryFileWriter()
+{ }
+
+void BinaryFileWriter::Initialize(size_t numberOfChains, const ParameterConfig& paramConfig, bool append)
+{
+    Writer::Initialize(numberOfChains, paramConfig, append);
+
+    const size_t nParams = paramConfig.size();
 
-        fileStrm << sample.GetGeneration();
+    // the chunk size is rounded up to a power of 2 by the chain
+    fChunks.assign( numberOfChains, Chain(nParams, max<size_t>(fChunkSize, 8)) );
 
-        for (const double& v : sample.Values())
-            fileStrm << fColumnSep << v;
+    string names;
+    for (size_t i = 0; i < nParams; i++) {
+        const string& pName = paramConfig[i].GetName();
+        names += (pName.empty()) ? "Param." + to_string(i) : pName;
+        names += '\0';
+    }
+    names.resize( padTo8( names.size() ), '\0' );
+
+    BinaryFileHeader header;
+    copy( kBinaryMagic, kBinaryMagic + 8, header.fMagic );
+    header.fByteOrderMark = kBinaryByteOrderMark;
+    header.fVersion = kBinaryVersion;
+    header.fDataType = fDataType;
+    header.fNChains = numberOfChains;
+    header.fNParams = nParams;
+    header.fChunkSize = (fChunks.empty()) ? 8 : fChunks.front().GetBlockSize();
+    header.fNameBytes = names.size();
+
+    fFileStream.close();
+
+    if (append && fileSize( fFilePath ) > 0) {
+        // chunks are only appended to a file with the same header
+        string existing( sizeof(header) + names.size(), '\0' );
+        ifstream( fFilePath, ios::binary ).read( &existing[0], existing.size() );
+
+        if (memcmp( existing.data(), &header, sizeof(header) ) != 0
+                || existing.compare( sizeof(header), names.size(), names ) != 0)
+            throw Exception() << "File '" << fFilePath << "' does not match the chains to be appended.";
+
+        fFileStream.open( fFilePath, ios::binary | ios::app );
+
+        if (!fFileStream.is_open() || fFileStream.fail())
+            throw Exception() << "BinaryFileWriter target file is in error state.";
+
+        return;
+    }
+
+    fFileStream.open( fFilePath, ios::binary | ios::trunc );
+
+    if (!fFileStream.is_open() || fFileStream.fail())
+        throw Exception() << "BinaryFileWriter target file is in error state.";
+
+    fFileStream.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+    fFileStream.write( names.data(), names.size() );
+}
+
+void BinaryFileWriter::Write(size_t chainIndex, const Chain& chain, size_t startIndex)
+{
+    LOG_ASSERT( fChunks.size() > chainIndex && fFileStream.is_open(),
+            "BinaryFileWriter is not properly initialized.");
+
+    if (startIndex >= chain.size())
+        return;
+
+    Chain& chunk = fChunks[chainIndex];
+
+    // append the new steps, expanding rejections into individual rows
+    for (size_t run = chain.FindRun(startIndex); run < chain.NumberOfRuns(); run++) {
+        const size_t runStart = chain.GetRunStart(run);
+        const size_t runEnd = runStart + chain.GetRunLength(run);
+
+        for (size_t i = max(runStart, startIndex); i < runEnd; i++) {
+            chunk.push_back( chain.GetRunValues(run), chain.GetRunNegLogLikelihood(run),
+                chain.GetRunLikelihood(run), chain.GetRunPrior(run),
+                chain.GetRunGeneration(run) + (i - runStart),
+                chain.IsRunAccepted(run) && i == runStart );
+
+            if (chunk.size() == chunk.GetBlockSize())
+                WriteChunk( chainIndex );
+        }
+    }
+}
+
+void BinaryFileWriter::Finalize()
+{
+    if (!fFileStream.is_open())
+        return;
 
-        fileStrm << fColumnSep << sample.GetNegLogLikelihood();
-        fileStrm << fColumnSep << sample.GetLikelihood();
-        fileStrm << fColumnSep << sample.GetPrior();
+    // write the incomplete chunks
+    for (size_t iChain = 0; iChain < fChunks.size(); iChain++)
+        if (!fChunks[iChain].empty())
+            WriteChunk( iChain );
 
-    //    fFileStream << "\t" << sample.IsAccepted();
+    fFileStream.close();
+
+    if (fFileStream.fail())
+        throw Exception() << "Error while writing to file '" << fFilePath << "'.";
+}
 
-        fileStrm << endl;
+void BinaryFileWriter::SaveState(CheckpointWriter& checkpoint)
+{
+    fFileStream.flush();
+    if (fFileStream.fail())
+        throw Exception() << "Error while writing to file '" << fFilePath << "'.";
+
+    syncFile( fFilePath );
+    checkpoint.PutUInt( fileSize( fFilePath ) );
+
+    // the rows of the incomplete chunks
+    checkpoint.PutUInt( fChunks.size() );
+
+    for (const Chain& chunk : fChunks) {
+        checkpoint.PutUInt( chunk.size() );
+
+        for (size_t i = 0; i < chunk.size(); i++) {
+            checkpoint.PutDoubles( ValueRange( chunk.GetRunValues(i), chunk.NumberOfParams() ) );
+            checkpoint.PutDouble( chunk.GetRunNegLogLikelihood(i) );
+            checkpoint.PutDouble( chunk.GetRunLikelihood(i) );
+            checkpoint.PutDouble( chunk.GetRunPrior(i) );
+            checkpoint.PutUInt( chunk.GetRunGeneration(i) );
+            checkpoint.PutUInt( chunk.IsRunAccepted(i) );
+        }
     }
 }
 
+void BinaryFileWriter::LoadState(CheckpointReader& checkpoint)
+{
+    // the stream appends to the end of the truncated file
+    fFileStream.flush();
+    truncateFile( fFilePath, checkpoint.GetUInt() );
+
+    if (checkpoint.GetUInt() != fChunks.size())
+        throw Exception() << "The checkpoint does not match the chains of the binary writer.";
+
+    for (Chain& chunk : fChunks) {
+        const size_t nRows = checkpoint.GetUInt();
+        if (nRows >= chunk.GetBlockSize())
+            throw Exception() << "The checkpoint does not match the chunk size of the binary writer.";
+
+        vector<double> values( chunk.NumberOfParams() );
+        chunk.Rewind();
+
+        for (size_t i = 0; i < nRows; i++) {
+            checkpoint.GetDoubles( values );
+            const double negLogLikelihood = checkpoint.GetDouble();
+            const double likelihood = checkpoint.GetDouble();
+            const double prior = checkpoint.GetDouble();
+            const size_t generation = checkpoint.GetUInt();
+            const bool accepted = checkpoint.GetUInt();
+
+            chunk.push_back( values.data(), negLogLikelihood, likelihood, prior, generation, accepted );
+        }
+    }
+}
+
+void BinaryFileWriter::WriteChunk(size_t chainIndex)
+{
+    Chain& chunk = fChunks[chainIndex];
+
+    const BinaryChunkHeader header{ chainIndex, chunk.size() };
+    const size_t nBytes = Chain::BlockBytes( chunk.NumberOfParams(), chunk.GetBlockSize(), false );
+
+    fFileStream.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+    fFileStream.write( static_cast<const char*>( chunk.GetBlockData(0) ), nBytes );
+
+    chunk.Rewind();
+}
+
+CompressedFileWriter::CompressedFileWriter(const string& filePath, size_t chunkSize) :
+    BinaryFileWriter( filePath, chunkSize ),
+    fDeferred( true )
+{
+    fDataType = kBinaryCompressed;
+}
+
+CompressedFileWriter::~CompressedFileWriter()
+{ }
+
+void CompressedFileWriter::WriteChunk(size_t chainIndex)
+{
+    Chain& chunk = fChunks[chainIndex];
+
+    const size_t nRows = chunk.size();
+    const size_t nParams = chunk.NumberOfParams();
+
+    fPayload.clear();
+
+    // generations
+    fGenerations.resize( nRows );
+    for (size_t i = 0; i < nRows; i++)
+        fGenerations[i] = chunk.GetRunGeneration(i);
+    codec::encodeDeltas( fGenerations.data(), nRows, fPayload );
+
+    // acceptance bitmap
+    const size_t bitmapStart = fPayload.size();
+    fPayload.resize( bitmapStart + (nRows + 7) / 8, 0 );
+    for (size_t i = 0; i < nRows; i++)
+        if (chunk.IsRunAccepted(i))
+            fPayload[bitmapStart + i / 8] |= (uint8_t) (1 << (i % 8));
+
+    // the double columns, each prefixed by its size
+    auto appendColumn = [this, nRows](const double* values, size_t stride) {
+        fColumn.clear();
+        codec::encodeXor( values, nRows, stride, fColumn );
+        codec::putVarint( fColumn.size(), fPayload );
+        fPayload.insert( fPayload.end(), fColumn.begin(), fColumn.end() );
+    };
+
+    // the parameter values of the chunk (a single block) are stored row-major
+    for (size_t p = 0; p < nParams; p++)
+        appendColumn( chunk.GetRunValues(0) + p, nParams );
+
+    fScalars.resize( nRows );
+
+    for (size_t i = 0; i < nRows; i++)
+        fScalars[i] = chunk.GetRunNegLogLikelihood(i);
+    appendColumn( fScalars.data(), 1 );
+
+    for (size_t i = 0; i < nRows; i++)
+        fScalars[i] = chunk.GetRunLikelihood(i);
+    appendColumn( fScalars.data(), 1 );
+
+    for (size_t i = 0; i < nRows; i++)
+        fScalars[i] = chunk.GetRunPrior(i);
+    appendColumn( fScalars.data(), 1 );
+
+    const CompressedChunkHeader header{ chainIndex, nRows, fPayload.size() };
+    fPayload.resize( padTo8( fPayload.size() ), 0 );
+
+    fFileStream.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+    fFileStream.write( reinterpret_cast<const char*>(fPayload.data()), fPayload.size() );
+
+    chunk.Rewind();
+}
+
+BinaryFileReader::BinaryFileReader(const string& filePath)
+{
+    const int fd = open( filePath.c_str(), O_RDONLY );
+    if (fd < 0)
+        throw Exception() << "Cannot open file '" << filePath << "'.";
+
+    struct stat fileStat;
+    const size_t fileSize = (fstat( fd, &fileStat ) == 0) ? fileStat.st_size : 0;
+
+    if (fileSize < sizeof(BinaryFileHeader)) {
+        close( fd );
+        throw Exception() << "File '" << filePath << "' is not a binary chain file.";
+    }
+
+    // a private mapping, so that appending to the chains does not modify the file
+    void* address = mmap( nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    close( fd );
+
+    if (address == MAP_FAILED)
+        throw Exception() << "Cannot map file '" << filePath << "'.";
+
+    shared_ptr<void> mapping( address, [fileSize](void* ptr) { munmap( ptr, fileSize ); } );
+    char* data = static_cast<char*>( address );
+
+    BinaryFileHeader header;
+    memcpy( &header, data, sizeof(header) );
+
+    if (!equal( kBinaryMagic, kBinaryMagic + 8, header.fMagic ))
+        throw Exception() << "File '" << filePath << "' is not a binary chain file.";
+    if (header.fByteOrderMark != kBinaryByteOrderMark)
+        throw Exception() << "File '" << filePath << "' was written with a different byte order.";
+    if (header.fVersion != kBinaryVersion
+            || (header.fDataType != kBinaryFloat64 && header.fDataType != kBinaryCompressed))
+        throw Exception() << "File '" << filePath << "' has an unsupported format version or data type.";
+    if (header.fChunkSize < 8 || (header.fChunkSize & (header.fChunkSize - 1)) != 0)
+        throw Exception() << "File '" << filePath << "' has an invalid chunk size.";
+
+    size_t pos = sizeof(header);
+
+    if (pos + header.fNameBytes > fileSize)
+        throw Exception() << "File '" << filePath << "' is truncated.";
+
+    for (size_t i = 0, nameStart = pos; i < header.fNParams; i++) {
+        fParameterNames.emplace_back( data + nameStart );
+        nameStart += fParameterNames.back().size() + 1;
+    }
+
+    pos += header.fNameBytes;
+
+    fChains.assign( header.fNChains, Chain(header.fNParams, header.fChunkSize) );
+
+    if (header.fDataType == kBinaryCompressed) {
+        ReadCompressedChunks( data + pos, data + fileSize );
+        return;
+    }
+
+    const size_t nPayloadBytes = Chain::BlockBytes( header.fNParams, header.fChunkSize, false );
+
+    // use the chunks as chain blocks in place
+    while (pos < fileSize) {
+        BinaryChunkHeader chunkHeader;
+
+        if (pos + sizeof(chunkHeader) + nPayloadBytes > fileSize)
+            throw Exception() << "File '" << filePath << "' is truncated.";
+
+        memcpy( &chunkHeader, data + pos, sizeof(chunkHeader) );
+        pos += sizeof(chunkHeader);
+
+        if (chunkHeader.fChainIndex >= fChains.size() || chunkHeader.fNRows > header.fChunkSize)
+            throw Exception() << "File '" << filePath << "' contains an invalid chunk.";
+
+        Chain& chain = fChains[chunkHeader.fChainIndex];
+
+        if (chain.size() == chain.capacity()) {
+            chain.AppendBlock( mapping, data + pos, chunkHeader.fNRows );
+        }
+        else {
+            // the chunks following an incomplete one (written by a resumed
+            // run, see Writer::Initialize()) are copied
+            Chain chunk( header.fNParams, header.fChunkSize );
+            chunk.AppendBlock( mapping, data + pos, chunkHeader.fNRows );
+
+            for (size_t i = 0; i < chunk.size(); i++)
+                chain.push_back( chunk.GetRunValues(i), chunk.GetRunNegLogLikelihood(i),
+                    chunk.GetRunLikelihood(i), chunk.GetRunPrior(i),
+                    chunk.GetRunGeneration(i), chunk.IsRunAccepted(i) );
+        }
+
+        pos += nPayloadBytes;
+    }
+}
+
+void BinaryFileReader::ReadCompressedChunks(const char* pos, const char* end)
+{
+    const size_t nParams = NumberOfParams();
+    const size_t chunkSize = fChains.empty() ? 0 : fChains.front().GetBlockSize();
+
+    vector<uint64_t> generations;
+    vector<double> values, negLogLikelihoods, likelihoods, priors;
+
+    while (pos < end) {
+        CompressedChunkHeader chunkHeader;
+
+        if (pos + sizeof(chunkHeader) > end)
+            throw Exception() << "Compressed chain file is truncated.";
+
+        memcpy( &chunkHeader, pos, sizeof(chunkHeader) );
+        pos += sizeof(chunkHeader);
+
+        if (chunkHeader.fChainIndex >= fChains.size() || chunkHeader.fNRows > chunkSize
+                || chunkHeader.fNBytes > (size_t) (end - pos))
+            throw Exception() << "Compressed chain file contains an invalid chunk.";
+
+        const size_t nRows = chunkHeader.fNRows;
+        const uint8_t* payload = reinterpret_cast<const uint8_t*>( pos );
+        const uint8_t* payloadEnd = payload + chunkHeader.fNBytes;
+
+        generations.resize( nRows );
+        codec::decodeDeltas( payload, payloadEnd, nRows, generations.data() );
+
+        const uint8_t* bitmap = payload;
+        payload += (nRows + 7) / 8;
+        if (payload > payloadEnd)
+            throw Exception() << "Compressed chain file contains an invalid chunk.";
+
+        auto decodeColumn = [&payload, payloadEnd, nRows](double* target, size_t stride) {
+            const size_t nBytes = codec::getVarint( payload, payloadEnd );
+            if (nBytes > (size_t) (payloadEnd - payload))
+                throw Exception() << "Compressed chain file contains an invalid chunk.";
+            codec::decodeXor( payload, payload + nBytes, nRows, target, stride );
+            payload += nBytes;
+        };
+
+        values.resize( nRows * nParams );
+        negLogLikelihoods.resize( nRows );
+        likelihoods.resize( nRows );
+        priors.resize( nRows );
+
+        for (size_t p = 0; p < nParams; p++)
+            decodeColumn( values.data() + p, nParams );
+        decodeColumn( negLogLikelihoods.data(), 1 );
+        decodeColumn( likelihoods.data(), 1 );
+        decodeColumn( priors.data(), 1 );
+
+        Chain& chain = fChains[chunkHeader.fChainIndex];
+        for (size_t i = 0; i < nRows; i++)
+            chain.push_back( values.data() + i * nParams, negLogLikelihoods[i], likelihoods[i],
+                priors[i], generations[i], (bitmap[i / 8] >> (i % 8)) & 1 );
+
+        pos += padTo8( chunkHeader.fNBytes );
+    }
+}
+
+AsyncWriter::AsyncWriter(shared_ptr<Writer> writer, size_t capacity) :
+    fCapacity( max<size_t>(capacity, 1) ),
+    fNStalls( 0 ),
+    fHead( 0 ),
+    fTail( 0 ),
+    fStop( false ),
+    fFinalize( false ),
+    fFailed( false )
+{
+    if (writer)
+        fWriters.push_back( writer );
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    Stop();
+}
+
+void AsyncWriter::Initialize(size_t numberOfChains, const ParameterConfig& paramConfig, bool append)
+{
+    Stop();
+
+    Writer::Initialize(numberOfChains, paramConfig, append);
+
+    for (auto& writer : fWriters)
+        writer->Initialize( numberOfChains, paramConfig, append );
+
+    fSlots.assign( fCapacity, Slot{ 0, Chain(paramConfig.size()) } );
+    fHead = 0;
+    fTail = 0;
+    fNStalls = 0;
+    fStop = false;
+    fFinalize = false;
+    fFailed = false;
+    fError = nullptr;
+
+    fThread = thread( &AsyncWriter::Drain, this );
+}
+
+void AsyncWriter::Write(size_t chainIndex, const Chain& chain, size_t startIndex)
+{
+    RethrowError();
+
+    LOG_ASSERT( fThread.joinable(), "AsyncWriter is not properly initialized." );
+
+    if (startIndex >= chain.size())
+        return;
+
+    const size_t tail = fTail.load( memory_order_relaxed );
+
+    // wait for the I/O thread to free a slot
+    if (tail - fHead.load( memory_order_acquire ) == fSlots.size()) {
+        fNStalls++;
+        unique_lock<mutex> lock( fMutex );
+        fNotFull.wait( lock, [this, tail]() {
+            return tail - fHead.load( memory_order_acquire ) < fSlots.size();
+        } );
+    }
+
+    Slot& slot = fSlots[tail % fSlots.size()];
+    slot.fChainIndex = chainIndex;
+    slot.fSamples.Rewind();
+
+    // copy the new steps, expanding rejections into individual rows
+    for (size_t run = chain.FindRun(startIndex); run < chain.NumberOfRuns(); run++) {
+        const size_t runStart = chain.GetRunStart(run);
+        const size_t runEnd = runStart + chain.GetRunLength(run);
+
+        for (size_t i = max(runStart, startIndex); i < runEnd; i++)
+            slot.fSamples.push_back( chain.GetRunValues(run), chain.GetRunNegLogLikelihood(run),
+                chain.GetRunLikelihood(run), chain.GetRunPrior(run),
+                chain.GetRunGeneration(run) + (i - runStart),
+                chain.IsRunAccepted(run) && i == runStart );
+    }
+
+    fTail.store( tail + 1, memory_order_release );
+    Notify( fNotEmpty );
+}
+
+void AsyncWriter::Finalize()
+{
+    if (fThread.joinable()) {
+        // the wrapped writers are finalized on the I/O thread as well
+        fFinalize = true;
+        Stop();
+    }
+    else {
+        for (auto& writer : fWriters)
+            writer->Finalize();
+    }
+
+    // the error state is only reset here
+    if (fFailed.load( memory_order_acquire )) {
+        fFailed = false;
+        rethrow_exception( fError );
+    }
+}
+
+void AsyncWriter::SaveState(CheckpointWriter& checkpoint)
+{
+    if (fThread.joinable()) {
+        const size_t tail = fTail.load( memory_order_relaxed );
+
+        unique_lock<mutex> lock( fMutex );
+        fNotFull.wait( lock, [this, tail]() {
+            return fHead.load( memory_order_acquire ) == tail;
+        } );
+    }
+
+    RethrowError();
+
+    // the I/O thread waits for the next slot, while the writers are accessed
+    for (auto& writer : fWriters)
+        writer->SaveState( checkpoint );
+}
+
+void AsyncWriter::LoadState(CheckpointReader& checkpoint)
+{
+    for (auto& writer : fWriters)
+        writer->LoadState( checkpoint );
+}
+
+void AsyncWriter::Drain()
+{
+    while (true) {
+        const size_t head = fHead.load( memory_order_relaxed );
+
+        if (head == fTail.load( memory_order_acquire )) {
+            // the stop flag is set after the last slot was written
+            if (fStop.load( memory_order_acquire ) && head == fTail.load( memory_order_acquire )) {
+                if (fFinalize && !fFailed.load( memory_order_relaxed )) {
+                    try {
+                        for (auto& writer : fWriters)
+                            writer->Finalize();
+                    }
+                    catch (...) {
+                        fError = current_exception();
+                        fFailed.store( true, memory_order_release );
+                    }
+                }
+                return;
+            }
+
+            unique_lock<mutex> lock( fMutex );
+            fNotEmpty.wait( lock, [this, head]() {
+                return head != fTail.load( memory_order_acquire ) || fStop.load( memory_order_acquire );
+            } );
+            continue;
+        }
+
+        Slot& slot = fSlots[head % fSlots.size()];
+
+        // after an error, the remaining slots are discarded
+        if (!fFailed.load( memory_order_relaxed )) {
+            try {
+                for (auto& writer : fWriters)
+                    writer->Write( slot.fChainIndex, slot.fSamples, 0 );
+            }
+            catch (...) {
+                fError = current_exception();
+                fFailed.store( true, memory_order_release );
+            }
+        }
+
+        fHead.store( head + 1, memory_order_release );
+        Notify( fNotFull );
+    }
+}
+
+void AsyncWriter::Stop()
+{
+    if (!fThread.joinable())
+        return;
+
+    fStop.store( true, memory_order_release );
+    Notify( fNotEmpty );
+    fThread.join();
+}
+
+void AsyncWriter::Notify(condition_variable& condition)
+{
+    // taking the lock orders the notification after a concurrent check of
+    // the wait predicate, so that no wakeup is lost
+    { lock_guard<mutex> lock( fMutex ); }
+    condition.notify_one();
+}
+
+void AsyncWriter::RethrowError()
+{
+    if (fFailed.load( memory_order_acquire ))
+        rethrow_exception( fError );
+}
+
 
 //namespace {
 //    void waitForKey ()
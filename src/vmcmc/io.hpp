@@ -23,12 +23,20 @@
 #include <vector>
 #include <deque>
 #include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 class Gnuplot;
 
 namespace vmcmc
 {
 
+class CheckpointWriter;
+class CheckpointReader;
+
 /**
  * Abstract base class for mechanisms writing output files or producing
  * visual output.
@@ -42,10 +50,40 @@ protected:
     virtual ~Writer() { };
 
 public:
-    virtual void Initialize(size_t /*numberOfChains*/, const ParameterConfig& /*paramConfig*/) { }
+    /**
+     * Prepare the output for the chains of a run.
+     * @param numberOfChains
+     * @param paramConfig
+     * @param append Continue the output of an interrupted run (see
+     * Algorithm::Resume()) instead of replacing it.
+     */
+    virtual void Initialize(size_t /*numberOfChains*/, const ParameterConfig& /*paramConfig*/,
+        bool /*append*/ = false) { }
     virtual void Write(size_t chainIndex, const Chain& chain, size_t startIndex) = 0;
     virtual void Finalize() { }
 
+    /**
+     * Flush the output written so far to the storage device and store its
+     * position, when the sampler saves a checkpoint (see
+     * Algorithm::SetCheckpointFile()).
+     * @param checkpoint
+     */
+    virtual void SaveState(CheckpointWriter& /*checkpoint*/) { }
+
+    /**
+     * Discard the output written after the checkpoint, once the writer was
+     * initialized to append to the output of an interrupted run (see
+     * Algorithm::Resume()).
+     * @param checkpoint
+     */
+    virtual void LoadState(CheckpointReader& /*checkpoint*/) { }
+
+    /**
+     * Whether Algorithm::AddWriter() wraps this writer in an AsyncWriter, to
+     * keep its encoding off the sampling thread.
+     */
+    virtual bool IsDeferred() const { return false; }
+
     void Write(size_t chainIndex, const Sample& sample);
 };
 
@@ -69,8 +107,13 @@ public:
 
     std::string GetFilePath(int chainIndex = -1) const;
 
-    virtual void Initialize(size_t numberOfChains, const ParameterConfig& paramConfig) override;
+    virtual void Initialize(size_t numberOfChains, const ParameterConfig& paramConfig,
+        bool append = false) override;
     virtual void Write(size_t chainIndex, const Chain& chain, size_t startIndex) override;
+    virtual void Finalize() override;
+
+    virtual void SaveState(CheckpointWriter& checkpoint) override;
+    virtual void LoadState(CheckpointReader& checkpoint) override;
 
     using Writer::Write;
 
@@ -85,6 +128,239 @@ public:
     std::vector<std::unique_ptr<std::ofstream>> fFileStreams;
 };
 
+/**
+ * A writer storing the samples of all chains in one binary file.
+ *
+ * The file starts with a header (format version, byte order mark, data
+ * type, number of chains and parameters, chunk size and parameter names),
+ * followed by chunks of a fixed number of rows of one chain each. The
+ * payload of a chunk holds the columns of the rows in the storage layout of
+ * a Chain block (see Chain::GetBlockData()), so that the file can be
+ * memory-mapped and analyzed without parsing (see BinaryFileReader).
+ * Compressed chains are expanded into one row per step.
+ */
+class BinaryFileWriter : public Writer
+{
+public:
+    BinaryFileWriter(const std::string& filePath = "vmcmc.bin",
+        size_t chunkSize = Chain::kDefaultBlockSize);
+    virtual ~BinaryFileWriter();
+
+    void SetFilePath(const std::string& filePath) { fFilePath = filePath; }
+    const std::string& GetFilePath() const { return fFilePath; }
+
+    /**
+     * Set the number of rows per chunk (rounded up to a power of 2, at least 8).
+     * @param chunkSize
+     */
+    void SetChunkSize(size_t chunkSize) { fChunkSize = chunkSize; }
+    size_t GetChunkSize() const { return fChunkSize; }
+
+    virtual void Initialize(size_t numberOfChains, const ParameterConfig& paramConfig,
+        bool append = false) override;
+    virtual void Write(size_t chainIndex, const Chain& chain, size_t startIndex) override;
+    virtual void Finalize() override;
+
+    /**
+     * Store the size of the file and the rows pending in incomplete chunks,
+     * which are written with the following rows.
+     * @param checkpoint
+     */
+    virtual void SaveState(CheckpointWriter& checkpoint) override;
+    virtual void LoadState(CheckpointReader& checkpoint) override;
+
+    using Writer::Write;
+
+protected:
+    virtual void WriteChunk(size_t chainIndex);
+
+    std::string fFilePath;
+    size_t fChunkSize;
+    // the data type code stored in the header
+    uint64_t fDataType;
+
+    std::ofstream fFileStream;
+    // rows of each chain pending until a chunk is complete
+    std::vector<Chain> fChunks;
+};
+
+/**
+ * A writer storing the samples of all chains in one binary file with
+ * compressed chunks.
+ *
+ * The file format corresponds to the one of BinaryFileWriter, but each
+ * column of a chunk is compressed with a codec suited to its content:
+ * - the generations are delta and zigzag encoded,
+ * - the acceptance flags are stored as a bitmap,
+ * - the parameter values, likelihoods and priors are XOR encoded (see
+ *   codec::encodeXor()), which stores the repeated values of rejected
+ *   steps in a single bit.
+ *
+ * Algorithm::AddWriter() wraps the writer in an AsyncWriter, which keeps
+ * the compression off the sampling thread (see SetDeferred()).
+ */
+class CompressedFileWriter : public BinaryFileWriter
+{
+public:
+    CompressedFileWriter(const std::string& filePath = "vmcmc.vmz",
+        size_t chunkSize = Chain::kDefaultBlockSize);
+    virtual ~CompressedFileWriter();
+
+    /**
+     * Set whether Algorithm::AddWriter() wraps the writer in an AsyncWriter
+     * (default), or compresses on the sampling thread.
+     * @param deferred
+     */
+    void SetDeferred(bool deferred) { fDeferred = deferred; }
+    virtual bool IsDeferred() const override { return fDeferred; }
+
+protected:
+    virtual void WriteChunk(size_t chainIndex) override;
+
+    bool fDeferred;
+
+    // scratch buffers
+    std::vector<uint8_t> fPayload;
+    std::vector<uint8_t> fColumn;
+    std::vector<uint64_t> fGenerations;
+    std::vector<double> fScalars;
+};
+
+/**
+ * Reads the chains of a file written by BinaryFileWriter or
+ * CompressedFileWriter.
+ *
+ * The file is memory-mapped. Uncompressed chunks are used as blocks of a
+ * Chain in place. Thereby the chains can be passed to ChainStatistics
+ * directly, without parsing the file, and only the pages actually accessed
+ * are read from disk. The mapping is kept alive by the chains (and their
+ * copies), even after the reader is destroyed.
+ * Compressed chunks are decoded into chains on construction.
+ */
+class BinaryFileReader
+{
+public:
+    BinaryFileReader(const std::string& filePath);
+
+    size_t NumberOfChains() const { return fChains.size(); }
+    size_t NumberOfParams() const { return fParameterNames.size(); }
+    const std::vector<std::string>& GetParameterNames() const { return fParameterNames; }
+
+    const Chain& GetChain(size_t cIndex = 0) const { return fChains[cIndex]; }
+
+private:
+    void ReadCompressedChunks(const char* pos, const char* end);
+
+    std::vector<std::string> fParameterNames;
+    std::vector<Chain> fChains;
+};
+
+/**
+ * A writer passing incoming samples to other writers on a background
+ * thread.
+ *
+ * Write() copies the new samples of a chain into a slot of a bounded ring
+ * buffer and returns immediately, while a dedicated I/O thread drains the
+ * buffer into the wrapped writers. Thereby sampling overlaps with the
+ * formatting and writing of the output. If all slots are occupied, Write()
+ * waits for the I/O thread to free one (backpressure), limiting the memory
+ * held by pending samples.
+ *
+ * The ring buffer is lock-free for one producer and one consumer, the
+ * threads only block on a condition variable while the buffer is full or
+ * empty. The slots keep their storage for the following samples. Write()
+ * must not be called concurrently, which Algorithm::Run() guarantees.
+ * The wrapped writers are also finalized on the I/O thread.
+ * After an error raised by a wrapped writer, the remaining samples are
+ * discarded and each call to Write() rethrows it, until Finalize() does.
+ */
+class AsyncWriter : public Writer
+{
+public:
+    AsyncWriter(std::shared_ptr<Writer> writer = nullptr, size_t capacity = 16);
+    virtual ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    /**
+     * Add a writer to be fed from the background thread.
+     * @param writer
+     */
+    void AddWriter(std::shared_ptr<Writer> writer) { fWriters.push_back( writer ); }
+    template <typename WriterT, typename... ArgsT>
+    void AddWriter(ArgsT&&... args);
+
+    /**
+     * Set the number of sample blocks (one block per call to Write()), which
+     * can be pending before Write() blocks.
+     * @param capacity
+     */
+    void SetCapacity(size_t capacity) { fCapacity = std::max<size_t>(capacity, 1); }
+    size_t GetCapacity() const { return fCapacity; }
+
+    /**
+     * Get the number of calls to Write(), which had to wait for a free slot.
+     * @return
+     */
+    size_t GetNumberOfStalls() const { return fNStalls; }
+
+    virtual void Initialize(size_t numberOfChains, const ParameterConfig& paramConfig,
+        bool append = false) override;
+    virtual void Write(size_t chainIndex, const Chain& chain, size_t startIndex) override;
+    virtual void Finalize() override;
+
+    /**
+     * Wait for the I/O thread to pass on the pending samples, before the
+     * states of the wrapped writers are saved.
+     * @param checkpoint
+     */
+    virtual void SaveState(CheckpointWriter& checkpoint) override;
+    virtual void LoadState(CheckpointReader& checkpoint) override;
+
+    using Writer::Write;
+
+protected:
+    struct Slot
+    {
+        size_t fChainIndex;
+        Chain fSamples;
+    };
+
+    void Drain();
+    void Stop();
+    void Notify(std::condition_variable& condition);
+    void RethrowError();
+
+    std::vector<std::shared_ptr<Writer>> fWriters;
+    size_t fCapacity;
+    size_t fNStalls;
+
+    std::vector<Slot> fSlots;
+    // monotonic counters of the slots read by the I/O thread and written by Write()
+    std::atomic<size_t> fHead;
+    std::atomic<size_t> fTail;
+    std::atomic<bool> fStop;
+    bool fFinalize;         // finalize the wrapped writers, when stopped
+
+    // wake up Write() waiting for a free slot, and the I/O thread waiting
+    // for a written slot
+    std::mutex fMutex;
+    std::condition_variable fNotFull;
+    std::condition_variable fNotEmpty;
+
+    std::atomic<bool> fFailed;
+    std::exception_ptr fError;
+
+    std::thread fThread;
+};
+
+template <typename WriterT, typename... ArgsT>
+inline void AsyncWriter::AddWriter(ArgsT&&... args)
+{
+    fWriters.push_back( std::make_shared<WriterT>(std::forward<ArgsT>(args)...) );
+}
+
 ///**
 // * Near-time graphic visualization of each chain's evolution.
 // *
@@ -84,6 +84,112 @@ double chiSquareToSigmas(double value, size_t nParams)
     return bm::quantile( bm::complement(normal, cProb/2.0) );
 }
 
+void fft(vector<complex<double>>& data, bool inverse)
+{
+    const size_t n = data.size();
+
+    if (n < 2)
+        return;
+
+    if ((n & (n - 1)) != 0)
+        throw Exception() << "The FFT input length " << n << " is not a power of 2.";
+
+    // bit-reversal permutation
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+
+        if (i < j)
+            swap( data[i], data[j] );
+    }
+
+    // twiddle factors for the largest stage, shared by all smaller stages
+    const double sign = (inverse) ? 1.0 : -1.0;
+    vector<complex<double>> twiddles( n/2 );
+    for (size_t k = 0; k < n/2; k++)
+        twiddles[k] = polar( 1.0, sign * constants::two_pi * (double) k / (double) n );
+
+    // iterative Cooley-Tukey butterflies
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half = len / 2;
+        const size_t stride = n / len;
+
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < half; k++) {
+                const complex<double> t = twiddles[k * stride] * data[i + k + half];
+                data[i + k + half] = data[i + k] - t;
+                data[i + k] += t;
+            }
+        }
+    }
+}
+
+vector<double> autoCorrelation(const vector<double>& series)
+{
+    const size_t n = series.size();
+
+    vector<double> result( n, 0.0 );
+
+    if (n == 0)
+        return result;
+
+    double mean = 0.0;
+    for (double x : series)
+        mean += x;
+    mean /= (double) n;
+
+    // zero-pad to at least 2n to avoid circular wrap-around
+    size_t m = 1;
+    while (m < 2*n)
+        m <<= 1;
+
+    vector<complex<double>> data( m, 0.0 );
+    for (size_t t = 0; t < n; t++)
+        data[t] = series[t] - mean;
+
+    // the inverse transform of the power spectrum yields the autocovariance
+    fft( data );
+
+    for (auto& c : data)
+        c = norm( c );
+
+    fft( data, true );
+
+    const double c0 = data[0].real();
+
+    if (c0 <= 0.0) {
+        result[0] = 1.0;
+        return result;
+    }
+
+    for (size_t k = 0; k < n; k++)
+        result[k] = data[k].real() / c0;
+
+    return result;
+}
+
+double integratedAutoCorrelationTime(const vector<double>& autoCorr)
+{
+    // Sum consecutive pairs Gamma_m = rho(2m) + rho(2m+1) while they are
+    // positive, enforcing a monotonically decreasing sequence.
+    double sum = 0.0;
+    double previousGamma = numeric::inf();
+
+    for (size_t m = 0; 2*m + 1 < autoCorr.size(); m++) {
+        double gamma = autoCorr[2*m] + autoCorr[2*m + 1];
+
+        if (gamma <= 0.0)
+            break;
+
+        gamma = std::min( gamma, previousGamma );
+        sum += gamma;
+        previousGamma = gamma;
+    }
+
+    return (sum > 0.0) ? 2.0 * sum - 1.0 : 1.0;
+}
 
 } /* namespace math */
 
@@ -14,7 +14,9 @@
 #define VMCMC_MATH_H_
 
 #include <cmath>
+#include <complex>
 #include <type_traits>
+#include <vector>
 
 #include <boost/math/special_functions/pow.hpp>
 #include <boost/math/constants/constants.hpp>
@@ -77,6 +79,33 @@ double chiSquareQuantileFromSigmas(double nSigmas, size_t nParams);
 double chiSquareCDF(double value, size_t nParams);
 double chiSquareToSigmas(double value, size_t nParams);
 
+/**
+ * In-place radix-2 fast Fourier transform.
+ * @param data The input sequence, its length must be a power of 2. It is
+ * replaced by its (unnormalized) discrete Fourier transform.
+ * @param inverse Calculate the inverse transform (without the 1/N
+ * normalization).
+ */
+void fft(std::vector<std::complex<double>>& data, bool inverse = false);
+
+/**
+ * Estimate the normalized autocorrelation function of a series for all lags
+ * at once, using a zero-padded FFT (O(N log N)).
+ * @param series The input series.
+ * @return The autocorrelation rho(k) = c(k) / c(0) for each lag
+ * k in [0, N), with the (biased) autocovariance
+ * c(k) = 1/N sum_t (x_t - mean)(x_{t+k} - mean).
+ */
+std::vector<double> autoCorrelation(const std::vector<double>& series);
+
+/**
+ * Estimate the integrated autocorrelation time tau = 1 + 2 sum_k rho(k),
+ * truncating the sum with Geyer's initial monotone sequence estimator.
+ * @param autoCorr The normalized autocorrelation function, starting at lag 0.
+ * @return
+ */
+double integratedAutoCorrelationTime(const std::vector<double>& autoCorr);
+
 
 // DEFINITIONS
 
@@ -8,12 +8,15 @@
  * @author marco@kleesiek.com
  */
 
+#include <checkpoint.hpp>
+#include <exception.hpp>
 #include <logger.hpp>
 #include <metropolis.hpp>
 #include <proposal.hpp>
 #include <random.hpp>
 #include <stringutils.hpp>
 #include <algorithm>
+#include <array>
 
 #ifdef USE_TBB
 #include <tbb/parallel_for.h>
@@ -28,6 +31,31 @@ namespace vmcmc
 
 LOG_DEFINE("vmcmc.metropolis");
 
+namespace
+{
+
+void PutSample(CheckpointWriter& checkpoint, const Sample& sample)
+{
+    checkpoint.PutDoubles( sample.Values() );
+    checkpoint.PutDouble( sample.GetNegLogLikelihood() );
+    checkpoint.PutDouble( sample.GetLikelihood() );
+    checkpoint.PutDouble( sample.GetPrior() );
+    checkpoint.PutUInt( sample.GetGeneration() );
+    checkpoint.PutUInt( sample.IsAccepted() );
+}
+
+void GetSample(CheckpointReader& checkpoint, Sample& sample)
+{
+    checkpoint.GetDoubles( sample.Values() );
+    sample.SetNegLogLikelihood( checkpoint.GetDouble() );
+    sample.SetLikelihood( checkpoint.GetDouble() );
+    sample.SetPrior( checkpoint.GetDouble() );
+    sample.SetGeneration( checkpoint.GetUInt() );
+    sample.SetAccepted( checkpoint.GetUInt() != 0 );
+}
+
+} /* anonymous namespace */
+
 /**
  * Private class encapsulating Sample chains for parallel tempering.
  *
@@ -39,14 +67,35 @@ LOG_DEFINE("vmcmc.metropolis");
  */
 struct MetropolisHastings::ChainConfig
 {
+    ChainConfig(const std::vector<double>& betas, const ParameterConfig& initialParamConf,
+            const Proposal* propFunc = nullptr) :
+        ChainConfig(betas.size(), initialParamConf, propFunc)
+    {
+        fBetas = betas;
+    }
+
     ChainConfig(size_t n, const ParameterConfig& initialParamConf,
             const Proposal* propFunc = nullptr) :
         // in case of parallel tempering, setup more than one chain
-        fPtChains( n, Chain() ),
+        fPtChains( n, Chain(initialParamConf.size()) ),
+        // the current state of each replica
+        fCurrentStates( n, Sample(initialParamConf.size()) ),
+        // scratch samples holding the proposed states of each chain
+        fNextStates( n, Sample(initialParamConf.size()) ),
+        fDelayedStates( n, Sample(initialParamConf.size()) ),
         // prepare parameter configurations
         fDynamicParamConfigs( n, initialParamConf ),
         // clone the default proposal function
-        fProposalFunctions( n )
+        fProposalFunctions( n ),
+        fNStageProposals( n, {{0, 0}} ),
+        fNStageAcceptances( n, {{0, 0}} ),
+        fBetas( n, 1.0 ),
+        fNSteps( 0 ),
+        fStepsSinceSwaps( 0 ),
+        fNSwapRounds( 0 ),
+        fNextAdaption( 10 ),
+        fNRoundTrips( 0 ),
+        fRoundTripSteps( 0 )
     {
         LOG_ASSERT( n > 0, "A Metropolis chain set requires at least 1 chain"
              << " (and corresponding beta value).");
@@ -58,20 +107,84 @@ struct MetropolisHastings::ChainConfig
         if (n > 0) {
             fNProposedSwaps.assign( n-1, 0 );
             fNAcceptedSwaps.assign( n-1, 0 );
+            fNAdaptionProposals.assign( n-1, 0 );
+            fNAdaptionRejections.assign( n-1, 0 );
         }
+
+        // initially, replica i is at temperature i, the coldest one heading up
+        for (size_t i = 0; i < n; i++)
+            fReplicas.push_back( i );
+        fDirections.assign( n, 0 );
+        fDirections[0] = +1;
+        fRoundTripStarts.assign( n, 0 );
+    }
+
+    /**
+     * Get the current state of the replica at a temperature.
+     */
+    Sample& GetCurrentState(size_t iBeta) { return fCurrentStates[fReplicas[iBeta]]; }
+
+    /**
+     * Start the trajectories of all replicas at their current temperature.
+     */
+    void ResetTrajectories()
+    {
+        fTrajectories.assign( fReplicas.size(), {} );
+        for (size_t iBeta = 0; iBeta < fReplicas.size(); iBeta++)
+            fTrajectories[fReplicas[iBeta]].emplace_back( fNSteps, iBeta );
     }
 
     std::vector<Chain> fPtChains;
+    std::vector<Sample> fCurrentStates;
+    std::vector<Sample> fNextStates;
+    std::vector<Sample> fDelayedStates;
     std::vector<ParameterConfig> fDynamicParamConfigs;
     std::vector<std::unique_ptr<Proposal>> fProposalFunctions;
+    std::vector<Random::engine_type> fStreams;
+
+    // proposals and acceptances in each stage of the delayed rejection
+    std::vector<std::array<size_t, 2>> fNStageProposals;
+    std::vector<std::array<size_t, 2>> fNStageAcceptances;
+
+    Random::engine_type fSwapStream;
     std::vector<size_t> fNProposedSwaps;
     std::vector<size_t> fNAcceptedSwaps;
+
+    // the (adapted) temperature ladder
+    std::vector<double> fBetas;
+
+    // swap schedule
+    size_t fNSteps;
+    size_t fStepsSinceSwaps;
+    size_t fNSwapRounds;
+
+    // swap statistics for the next ladder adaption
+    std::vector<size_t> fNAdaptionProposals;
+    std::vector<size_t> fNAdaptionRejections;
+    size_t fNextAdaption;
+
+    // the replica (state) at each temperature, and the trajectory of each
+    // replica along the temperature ladder, if recorded
+    std::vector<size_t> fReplicas;
+    std::vector<ReplicaTrajectory> fTrajectories;
+
+    // round trip tracking: the direction (+1 heading hot, -1 heading cold,
+    // 0 unknown) and round trip start of each replica
+    std::vector<int> fDirections;
+    std::vector<size_t> fRoundTripStarts;
+    size_t fNRoundTrips;
+    size_t fRoundTripSteps;
 };
 
 MetropolisHastings::MetropolisHastings() :
     fRandomizeStartPoint( false ),
     fBetas{ 1.0 },
     fPtFrequency( 200 ),
+    fSwapScheme( ESwapScheme::RandomPair ),
+    fAdaptiveBetas( false ),
+    fRecordTrajectories( false ),
+    fDelayedRejection( false ),
+    fDelayedRejectionScale( 0.2 ),
     fChainConfigs( 1 ),
     fMultiThreading( true )
 {
@@ -129,12 +242,73 @@ double MetropolisHastings::GetSwapAcceptanceRate(size_t iChain, ptrdiff_t iBeta)
         return 0.0;
     }
     else {
-        return chainConfig->fNAcceptedSwaps[iBeta] / chainConfig->fNProposedSwaps[iBeta];
+        return (double) chainConfig->fNAcceptedSwaps[iBeta] / chainConfig->fNProposedSwaps[iBeta];
     }
 
 
 }
 
+double MetropolisHastings::GetStageAcceptanceRate(size_t iChain, size_t iStage, size_t iBeta) const
+{
+    LOG_ASSERT( iChain < fChainConfigs.size() && fChainConfigs[iChain] );
+    LOG_ASSERT( iStage < 2 && iBeta < fChainConfigs[iChain]->fBetas.size() );
+
+    const size_t nProposals = fChainConfigs[iChain]->fNStageProposals[iBeta][iStage];
+
+    return (nProposals > 0) ?
+        (double) fChainConfigs[iChain]->fNStageAcceptances[iBeta][iStage] / nProposals : 0.0;
+}
+
+const vector<double>& MetropolisHastings::GetBetas(size_t iChain) const
+{
+    if (iChain >= fChainConfigs.size() || !fChainConfigs[iChain])
+        return fBetas;
+
+    return fChainConfigs[iChain]->fBetas;
+}
+
+const Proposal& MetropolisHastings::GetProposalFunction(size_t iChain, size_t iBeta) const
+{
+    LOG_ASSERT( iChain < fChainConfigs.size() && fChainConfigs[iChain]
+        && iBeta < fChainConfigs[iChain]->fProposalFunctions.size(), "The sampler is not initialized." );
+
+    return *fChainConfigs[iChain]->fProposalFunctions[iBeta];
+}
+
+size_t MetropolisHastings::GetNumberOfRoundTrips(size_t iChain) const
+{
+    if (iChain >= fChainConfigs.size() || !fChainConfigs[iChain])
+        return 0;
+
+    return fChainConfigs[iChain]->fNRoundTrips;
+}
+
+double MetropolisHastings::GetMeanRoundTripTime(size_t iChain) const
+{
+    const size_t nRoundTrips = GetNumberOfRoundTrips( iChain );
+
+    return (nRoundTrips > 0) ? (double) fChainConfigs[iChain]->fRoundTripSteps / nRoundTrips : 0.0;
+}
+
+const vector<size_t>& MetropolisHastings::GetReplicas(size_t iChain) const
+{
+    LOG_ASSERT( iChain < fChainConfigs.size() && fChainConfigs[iChain] );
+
+    return fChainConfigs[iChain]->fReplicas;
+}
+
+const MetropolisHastings::ReplicaTrajectory& MetropolisHastings::GetReplicaTrajectory(size_t iChain,
+    size_t iReplica) const
+{
+    static const ReplicaTrajectory sEmpty;
+
+    if (iChain >= fChainConfigs.size() || !fChainConfigs[iChain]
+            || iReplica >= fChainConfigs[iChain]->fTrajectories.size())
+        return sEmpty;
+
+    return fChainConfigs[iChain]->fTrajectories[iReplica];
+}
+
 void MetropolisHastings::Initialize()
 {
     Algorithm::Initialize();
@@ -157,38 +331,59 @@ void MetropolisHastings::Initialize()
     }
 
     // initialize chain configurations
-    for (auto& chainConfig : fChainConfigs) {
+    for (size_t iChainConfig = 0; iChainConfig < fChainConfigs.size(); iChainConfig++) {
+        auto& chainConfig = fChainConfigs[iChainConfig];
 
         chainConfig.reset(
-            new ChainConfig(nBetas, fParameterConfig, fProposalFunction.get()) );
-
-        // for each PT (beta) chain, setup an individual parameter configuration
-        const double initialErrorScaling = fParameterConfig.GetErrorScaling();
-        for (size_t iBeta = 0; iBeta < nBetas; iBeta++) {
+            new ChainConfig(fBetas, fParameterConfig, fProposalFunction.get()) );
 
-            // scale parameter configurations
-            if (iBeta > 0)
-                chainConfig->fDynamicParamConfigs[iBeta].SetErrorScaling(
-                    initialErrorScaling / sqrt(fBetas[iBeta]) );
+        // each tempered chain and the swap proposals draw from their own stream
+        for (size_t iBeta = 0; iBeta < nBetas; iBeta++)
+            chainConfig->fStreams.push_back( CreateStream( iChainConfig, iBeta ) );
+        chainConfig->fSwapStream = CreateStream( iChainConfig, nBetas );
 
-            // update proposal functions with parameter configuration
-            chainConfig->fProposalFunctions[iBeta]->UpdateParameterConfig(
-                chainConfig->fDynamicParamConfigs[iBeta] );
-        }
+        // for each PT (beta) chain, setup an individual parameter configuration
+        for (size_t iBeta = 0; iBeta < nBetas; iBeta++)
+            ScaleTemperedChain( *chainConfig, iBeta );
 
         // setup start points
-        for (auto& chain : chainConfig->fPtChains) {
+        for (size_t iBeta = 0; iBeta < nBetas; iBeta++) {
             // if required, randomize the starting vector for each chain
             if (fRandomizeStartPoint) {
                 startPoint.Values() = GetParameterConfig().GetStartValues(true);
                 Evaluate( startPoint );
             }
 
-            chain.reserve( GetTotalLength()+1 );
-
+            Chain& chain = chainConfig->fPtChains[iBeta];
+            // only the 'cold' chains are spilled
+            PrepareChain( chain, (iBeta == 0) ? (ptrdiff_t) iChainConfig : -1 );
             chain.push_back( startPoint );
+
+            chainConfig->fCurrentStates[iBeta] = startPoint;
         }
+
+        if (fRecordTrajectories)
+            chainConfig->ResetTrajectories();
     }
+
+    if (fAdaptiveBetas && nBetas > 2 && GetBurnIn() == 0)
+        LOG(Warn, "The temperature ladder is only adapted during the burn-in.");
+}
+
+void MetropolisHastings::ScaleTemperedChain(ChainConfig& chainConfig, size_t iBeta, double previousBeta)
+{
+    // scale parameter configurations
+    if (iBeta > 0)
+        chainConfig.fDynamicParamConfigs[iBeta].SetErrorScaling(
+            fParameterConfig.GetErrorScaling() / sqrt(chainConfig.fBetas[iBeta]) );
+
+    // the proposal width scales with 1/sqrt(beta)
+    Proposal& proposal = *chainConfig.fProposalFunctions[iBeta];
+    if (previousBeta > 0.0 && proposal.Rescale( sqrt(previousBeta / chainConfig.fBetas[iBeta]) ))
+        return;
+
+    // update proposal functions with parameter configuration
+    proposal.UpdateParameterConfig( chainConfig.fDynamicParamConfigs[iBeta] );
 }
 
 double MetropolisHastings::CalculateMHRatio(const Sample& prevState, const Sample& nextState,
@@ -205,16 +400,38 @@ double MetropolisHastings::CalculateMHRatio(const Sample& prevState, const Sampl
 }
 
 void MetropolisHastings::Advance(size_t nSteps)
+{
+    const size_t nChainConfigs = fChainConfigs.size();
+
+    // in lock-step, the swap rounds of all chain sets are due at the same steps
+    while (nSteps > 0) {
+        const size_t nChainSteps = StepsUntilSwaps( 0, nSteps );
+
+        AdvanceChains( nChainSteps );
+
+        for (size_t iChainConfig = 0; iChainConfig < nChainConfigs; iChainConfig++)
+            ProposeSwaps( iChainConfig, nChainSteps );
+
+        nSteps -= nChainSteps;
+    }
+}
+
+void MetropolisHastings::AdvanceChains(size_t nSteps)
 {
     const size_t nChainConfigs = fChainConfigs.size();
     const size_t nBetas = fBetas.size();
 
     /**
-     * In case of multi-core parallelization, all active chains
-     * (number of chain sets * number of PT beta values)
+     * With a batch target function, the proposals of all active chains
+     * (number of chain sets * number of PT beta values) are evaluated
+     * together, step by step.
+     * Otherwise, in case of multi-core parallelization, all active chains
      * are progressed in parallel by nSteps each.
      */
-    if (fMultiThreading) {
+    if (fBatchNegLogLikelihood) {
+        AdvanceBatch( nSteps );
+    }
+    else if (fMultiThreading) {
 #ifdef USE_TBB
         const size_t nTotalChains = nChainConfigs * nBetas;
 
@@ -237,22 +454,250 @@ void MetropolisHastings::Advance(size_t nSteps)
             for (size_t iBeta = 0; iBeta < nBetas; iBeta++)
                 AdvanceChainConfig( iChainConfig, iBeta, nSteps );
     }
+}
+
+void MetropolisHastings::AdvanceIndependently(size_t iChainConfig, size_t nSteps)
+{
+    while (nSteps > 0) {
+        const size_t nChainSteps = StepsUntilSwaps( iChainConfig, nSteps );
+
+        AdvanceChainSet( iChainConfig, nChainSteps );
+        ProposeSwaps( iChainConfig, nChainSteps );
+
+        nSteps -= nChainSteps;
+    }
+}
+
+void MetropolisHastings::AdvanceChainSet(size_t iChainConfig, size_t nSteps)
+{
+    const size_t nBetas = fBetas.size();
+
+    // the tempered chains of a chain set only synchronize with each other
+    // for the swap proposals, not with the chains of other sets
+    if (fMultiThreading && nBetas > 1) {
+#ifdef USE_TBB
+        parallel_for(
+            blocked_range<size_t>(0, nBetas),
+            [&](const blocked_range<size_t>& range) {
+                for (size_t iBeta = range.begin(); iBeta < range.end(); iBeta++)
+                    this->AdvanceChainConfig( iChainConfig, iBeta, nSteps );
+            }
+        );
+#else
+        LOG(Fatal, "TBB not available - multi-threading should be deactivated.");
+#endif
+    }
+    else {
+        for (size_t iBeta = 0; iBeta < nBetas; iBeta++)
+            AdvanceChainConfig( iChainConfig, iBeta, nSteps );
+    }
+}
+
+size_t MetropolisHastings::StepsUntilSwaps(size_t iChainConfig, size_t nSteps) const
+{
+    // random swap proposals are drawn for a whole advancement
+    if (fBetas.size() < 2 || fSwapScheme == ESwapScheme::RandomPair)
+        return nSteps;
+
+    return std::min( nSteps, fPtFrequency - fChainConfigs[iChainConfig]->fStepsSinceSwaps );
+}
+
+void MetropolisHastings::ProposeSwaps(size_t iChainConfig, size_t nSteps)
+{
+    ChainConfig& chainConfig = *fChainConfigs[iChainConfig];
+    const size_t nBetas = fBetas.size();
+
+    chainConfig.fNSteps += nSteps;
 
     if (nBetas < 2)
         return;
 
-    // propose sample swaps between tempered chains in each chain config:
-    const double swapProposalProb = (double) nSteps / (double) fPtFrequency;
+    Random::ScopedEngine stream( chainConfig.fSwapStream );
 
-    for (size_t iChainConfig = 0; iChainConfig < nChainConfigs; iChainConfig++)
-        if ( Random::Instance().Bool( swapProposalProb ) )
-            ProposePtSwapping(iChainConfig);
+    if (fSwapScheme == ESwapScheme::RandomPair) {
+        // propose sample swaps with a mean frequency
+        const double swapProposalProb = (double) nSteps / (double) fPtFrequency;
+
+        if ( Random::Instance().Bool( swapProposalProb ) ) {
+            ProposePtSwapping( iChainConfig );
+            TrackRoundTrips( iChainConfig );
+        }
+    }
+    else {
+        chainConfig.fStepsSinceSwaps += nSteps;
+        if (chainConfig.fStepsSinceSwaps < fPtFrequency)
+            return;
+        chainConfig.fStepsSinceSwaps = 0;
+
+        // propose swaps of all even or all odd pairs in turns
+        for (size_t iColder = chainConfig.fNSwapRounds % 2; iColder+1 < nBetas; iColder += 2)
+            ProposePtSwap( iChainConfig, iColder );
+
+        chainConfig.fNSwapRounds++;
+        TrackRoundTrips( iChainConfig );
+    }
+
+    // adapt the temperature ladder during the burn-in
+    if (fAdaptiveBetas && nBetas > 2 && chainConfig.fNSteps <= GetBurnIn()) {
+        const size_t nMinProposals = *std::min_element( chainConfig.fNAdaptionProposals.begin(),
+            chainConfig.fNAdaptionProposals.end() );
+
+        if (nMinProposals >= chainConfig.fNextAdaption) {
+            AdaptBetas( iChainConfig );
+            chainConfig.fNextAdaption *= 2;
+        }
+    }
+}
+
+double MetropolisHastings::CalculateMHRatio(const Sample& prevState, const Sample& rejectedState,
+    const Sample& nextState, double proposalDensityRatio, double beta)
+{
+    if (nextState.GetPrior() == 0.0)
+        return 0.0;
+
+    // the probabilities of rejecting the first stage proposal, starting from
+    // the current state and from the second stage proposal
+    const double rejectionPrev = 1.0 - CalculateMHRatio( prevState, rejectedState, 1.0, beta );
+    const double rejectionNext = 1.0 - CalculateMHRatio( nextState, rejectedState, 1.0, beta );
+
+    if (rejectionNext == 0.0)
+        return 0.0;
+
+    LOG_ASSERT( rejectionPrev > 0.0, "The first stage proposal cannot have been rejected." );
+
+    return std::min(1.0, proposalDensityRatio * rejectionNext / rejectionPrev
+        * nextState.GetPrior()/prevState.GetPrior()
+        * exp( beta * (prevState.GetNegLogLikelihood() - nextState.GetNegLogLikelihood()) )
+    );
+}
+
+void MetropolisHastings::SaveState(CheckpointWriter& checkpoint) const
+{
+    checkpoint.PutUInt( fChainConfigs.size() );
+    checkpoint.PutDoubles( fBetas );
+
+    for (const auto& chainConfig : fChainConfigs) {
+        checkpoint.PutDoubles( chainConfig->fBetas );
+        checkpoint.PutUInt( chainConfig->fNSteps );
+        checkpoint.PutUInt( chainConfig->fStepsSinceSwaps );
+        checkpoint.PutUInt( chainConfig->fNSwapRounds );
+        checkpoint.PutUInt( chainConfig->fNextAdaption );
+        checkpoint.PutUInt( chainConfig->fNRoundTrips );
+        checkpoint.PutUInt( chainConfig->fRoundTripSteps );
+
+        for (size_t iBeta = 0; iBeta < fBetas.size(); iBeta++) {
+            checkpoint.PutUInt( chainConfig->fReplicas[iBeta] );
+            checkpoint.PutUInt( chainConfig->fDirections[iBeta] + 1 );
+            checkpoint.PutUInt( chainConfig->fRoundTripStarts[iBeta] );
+        }
+
+        // the states of the replicas, and the chain tails, proposal
+        // functions and streams of the temperatures
+        for (size_t iBeta = 0; iBeta < fBetas.size(); iBeta++) {
+            PutSample( checkpoint, chainConfig->fCurrentStates[iBeta] );
+
+            // the tail precedes the swaps after the last step, unless it
+            // was discarded
+            const Chain& chain = chainConfig->fPtChains[iBeta];
+            if (chain.IsLastStepStored())
+                PutSample( checkpoint, chain.GetSample( chain.size()-1 ) );
+            else
+                PutSample( checkpoint, chainConfig->GetCurrentState(iBeta) );
+
+            chainConfig->fProposalFunctions[iBeta]->SaveState( checkpoint );
+            checkpoint.PutObject( chainConfig->fStreams[iBeta] );
+
+            for (size_t iStage = 0; iStage < 2; iStage++) {
+                checkpoint.PutUInt( chainConfig->fNStageProposals[iBeta][iStage] );
+                checkpoint.PutUInt( chainConfig->fNStageAcceptances[iBeta][iStage] );
+            }
+        }
+
+        for (size_t iBeta = 0; iBeta+1 < fBetas.size(); iBeta++) {
+            checkpoint.PutUInt( chainConfig->fNProposedSwaps[iBeta] );
+            checkpoint.PutUInt( chainConfig->fNAcceptedSwaps[iBeta] );
+            checkpoint.PutUInt( chainConfig->fNAdaptionProposals[iBeta] );
+            checkpoint.PutUInt( chainConfig->fNAdaptionRejections[iBeta] );
+        }
+        checkpoint.PutObject( chainConfig->fSwapStream );
+    }
+}
+
+void MetropolisHastings::LoadState(CheckpointReader& checkpoint)
+{
+    vector<double> betas( fBetas.size() );
+
+    if (checkpoint.GetUInt() != fChainConfigs.size())
+        throw Exception() << "The checkpoint does not match the number of chains.";
+
+    checkpoint.GetDoubles( betas );
+    if (betas != fBetas)
+        throw Exception() << "The checkpoint does not match the parallel tempering betas.";
+
+    for (auto& chainConfig : fChainConfigs) {
+        // restore the (adapted) ladder before the proposal functions
+        checkpoint.GetDoubles( chainConfig->fBetas );
+        for (size_t iBeta = 0; iBeta < fBetas.size(); iBeta++)
+            ScaleTemperedChain( *chainConfig, iBeta );
+
+        chainConfig->fNSteps = checkpoint.GetUInt();
+        chainConfig->fStepsSinceSwaps = checkpoint.GetUInt();
+        chainConfig->fNSwapRounds = checkpoint.GetUInt();
+        chainConfig->fNextAdaption = checkpoint.GetUInt();
+        chainConfig->fNRoundTrips = checkpoint.GetUInt();
+        chainConfig->fRoundTripSteps = checkpoint.GetUInt();
+
+        for (size_t iBeta = 0; iBeta < fBetas.size(); iBeta++) {
+            chainConfig->fReplicas[iBeta] = checkpoint.GetUInt();
+            chainConfig->fDirections[iBeta] = (int) checkpoint.GetUInt() - 1;
+            chainConfig->fRoundTripStarts[iBeta] = checkpoint.GetUInt();
+        }
+
+        for (size_t iBeta = 0; iBeta < fBetas.size(); iBeta++) {
+            GetSample( checkpoint, chainConfig->fCurrentStates[iBeta] );
+
+            // the chain continues from the restored tail
+            Sample& tail = chainConfig->fNextStates[iBeta];
+            GetSample( checkpoint, tail );
+
+            Chain& chain = chainConfig->fPtChains[iBeta];
+            chain.clear();
+            chain.push_back( tail );
+
+            chainConfig->fProposalFunctions[iBeta]->LoadState( checkpoint );
+            checkpoint.GetObject( chainConfig->fStreams[iBeta] );
+
+            for (size_t iStage = 0; iStage < 2; iStage++) {
+                chainConfig->fNStageProposals[iBeta][iStage] = checkpoint.GetUInt();
+                chainConfig->fNStageAcceptances[iBeta][iStage] = checkpoint.GetUInt();
+            }
+        }
+
+        if (fRecordTrajectories)
+            chainConfig->ResetTrajectories();
+
+        for (size_t iBeta = 0; iBeta+1 < fBetas.size(); iBeta++) {
+            chainConfig->fNProposedSwaps[iBeta] = checkpoint.GetUInt();
+            chainConfig->fNAcceptedSwaps[iBeta] = checkpoint.GetUInt();
+            chainConfig->fNAdaptionProposals[iBeta] = checkpoint.GetUInt();
+            chainConfig->fNAdaptionRejections[iBeta] = checkpoint.GetUInt();
+        }
+        checkpoint.GetObject( chainConfig->fSwapStream );
+    }
 }
 
 void MetropolisHastings::Finalize()
 {
     const size_t nBetas = fBetas.size();
 
+    if (fDelayedRejection) {
+        for (size_t i = 0 ; i < fChainConfigs.size(); i++) {
+            LOG(Info, "Delayed rejection acc. rates in chain " << i << ": "
+                << GetStageAcceptanceRate( i, 0 ) << " (1st stage), "
+                << GetStageAcceptanceRate( i, 1 ) << " (2nd stage)");
+        }
+    }
+
     if (nBetas < 2) {
         LOG(Info, "No parallel tempering.");
     }
@@ -263,10 +708,8 @@ void MetropolisHastings::Finalize()
 
             // output the individual acceptance rates
             vector<double> accRates(nBetas, 0.0);
-            for (size_t b = 0 ; b < nBetas; b++) {
-                ChainStatistics stats( fChainConfigs[i]->fPtChains[b] );
-                accRates[b] = stats.GetAccRate();
-            }
+            for (size_t b = 0 ; b < nBetas; b++)
+                accRates[b] = fChainConfigs[i]->fPtChains[b].GetAccRate();
             LOG(Info, "Metrop. acc. rates in chain set " << i << ": " << accRates);
 
             // output the parallel tempering swap acceptance rates
@@ -276,6 +719,12 @@ void MetropolisHastings::Finalize()
                      / fChainConfigs[i]->fNProposedSwaps[b];
             }
             LOG(Info, "PT swap acc. rates in chain set " << i << ": " << swapRates);
+
+            if (fAdaptiveBetas)
+                LOG(Info, "Adapted betas in chain set " << i << ": " << fChainConfigs[i]->fBetas);
+
+            LOG(Info, "PT round trips in chain set " << i << ": " << GetNumberOfRoundTrips(i)
+                << " (mean round trip time: " << GetMeanRoundTripTime(i) << " steps)");
         }
     }
 
@@ -294,48 +743,201 @@ void MetropolisHastings::AdvanceChainConfig(size_t iChainConfig, size_t iBeta, s
 
     LOG_ASSERT( chainConfig.fProposalFunctions[iBeta], "No proposal function defined." );
 
-    Proposal* proposal = chainConfig.fProposalFunctions[iBeta].get();
-    ParameterConfig& paramConfig = chainConfig.fDynamicParamConfigs[iBeta];
-
-    Chain& chain = chainConfig.fPtChains[iBeta];
+    // the chain itself may be empty during the burn-in
+    LOG_ASSERT( chainConfig.GetCurrentState(iBeta).size() == fParameterConfig.size(),
+        "No starting point in chain " << iChainConfig << "/" << iBeta << "." );
 
-    LOG_ASSERT( !chain.empty(), "No starting point in chain " << iChainConfig
-        << "/" << iBeta << "." );
+    Random::ScopedEngine stream( chainConfig.fStreams[iBeta] );
 
     for (size_t iStep = 0; iStep < nSteps; iStep++) {
 
-        const Sample& previousState = chain.back();
+        // propose the next point in the parameter space
+        const double proposalAsymmetry = ProposeState( iChainConfig, iBeta );
 
-        // prepare the upcoming sample
-        Sample nextState( previousState );
-        nextState.IncrementGeneration();
-        nextState.Reset();
+        // evaluate likelihood and prior
+        Evaluate( chainConfig.fNextStates[iBeta] );
 
-        // propose the next point in the parameter space
-        const double proposalAsymmetry = proposal->Transition( previousState, nextState );
+        if (AcceptOrReject( iChainConfig, iBeta, proposalAsymmetry ))
+            continue;
 
-        // attempt reflection if limits are exceeded
-        paramConfig.ReflectFromLimits( nextState.Values() );
+        // after a rejection, try again with a narrower proposal
+        ProposeDelayedState( iChainConfig, iBeta );
+        Evaluate( chainConfig.fDelayedStates[iBeta] );
+        AcceptOrRejectDelayed( iChainConfig, iBeta );
+    }
+}
 
-        // evaluate likelihood and prior
-        Evaluate( nextState );
+void MetropolisHastings::AdvanceBatch(size_t nSteps)
+{
+    const size_t nChainConfigs = fChainConfigs.size();
+    const size_t nBetas = fBetas.size();
+    const size_t nTotalChains = nChainConfigs * nBetas;
 
-        const double mhRatio = CalculateMHRatio( previousState, nextState,
-            proposalAsymmetry, fBetas[iBeta] );
+    fBatchSamples.resize( nTotalChains );
+    fBatchAsymmetries.resize( nTotalChains );
 
-        const bool proposalAccepted = Random::Instance().Bool( mhRatio );
+    for (size_t iChainConfig = 0; iChainConfig < nChainConfigs; iChainConfig++)
+        for (size_t iBeta = 0; iBeta < nBetas; iBeta++)
+            fBatchSamples[iChainConfig * nBetas + iBeta] = &fChainConfigs[iChainConfig]->fNextStates[iBeta];
+
+    for (size_t iStep = 0; iStep < nSteps; iStep++) {
 
-        if (proposalAccepted) {
-            nextState.SetAccepted( true );
-            chain.push_back( nextState );
+        // gather the proposals of all chains ...
+        for (size_t iChain = 0; iChain < nTotalChains; iChain++) {
+            Random::ScopedEngine stream( fChainConfigs[iChain / nBetas]->fStreams[iChain % nBetas] );
+            fBatchAsymmetries[iChain] = ProposeState( iChain / nBetas, iChain % nBetas );
         }
-        else {
-            nextState = previousState;
-            nextState.SetAccepted( false );
-            nextState.IncrementGeneration();
-            chain.push_back( nextState );
+
+        // ... evaluate them in one call ...
+        EvaluateBatch( fBatchSamples.data(), nTotalChains );
+
+        // ... and complete the step of each chain
+        fDelayedSamples.clear();
+        fDelayedIndices.clear();
+
+        for (size_t iChain = 0; iChain < nTotalChains; iChain++) {
+            Random::ScopedEngine stream( fChainConfigs[iChain / nBetas]->fStreams[iChain % nBetas] );
+            if (AcceptOrReject( iChain / nBetas, iChain % nBetas, fBatchAsymmetries[iChain] ))
+                continue;
+
+            ProposeDelayedState( iChain / nBetas, iChain % nBetas );
+            fDelayedSamples.push_back( &fChainConfigs[iChain / nBetas]->fDelayedStates[iChain % nBetas] );
+            fDelayedIndices.push_back( iChain );
         }
+
+        if (fDelayedSamples.empty())
+            continue;
+
+        // the second stage proposals are evaluated in another batch
+        EvaluateBatch( fDelayedSamples.data(), fDelayedSamples.size() );
+
+        for (size_t iChain : fDelayedIndices) {
+            Random::ScopedEngine stream( fChainConfigs[iChain / nBetas]->fStreams[iChain % nBetas] );
+            AcceptOrRejectDelayed( iChain / nBetas, iChain % nBetas );
+        }
+    }
+}
+
+double MetropolisHastings::ProposeState(size_t iChainConfig, size_t iBeta)
+{
+    ChainConfig& chainConfig = *fChainConfigs[iChainConfig];
+
+    // The current and the proposed state are held in per-chain samples,
+    // which keep their value buffers between steps. Together with the
+    // scratch buffers of the proposal function and the reserved chain
+    // storage, a step does not require any heap allocations.
+    const Sample& previousState = chainConfig.GetCurrentState(iBeta);
+    Sample& nextState = chainConfig.fNextStates[iBeta];
+
+    // prepare the upcoming sample
+    nextState.SetGeneration( previousState.GetGeneration() + 1 );
+    nextState.Reset();
+
+    // propose the next point in the parameter space
+    const double proposalAsymmetry = chainConfig.fProposalFunctions[iBeta]->Transition( previousState, nextState );
+
+    // attempt reflection if limits are exceeded, a point still outside is
+    // rejected by the limit check before evaluating the prior
+    fLimits.Reflect( nextState.Values() );
+
+    return proposalAsymmetry;
+}
+
+bool MetropolisHastings::AcceptOrReject(size_t iChainConfig, size_t iBeta, double proposalAsymmetry)
+{
+    ChainConfig& chainConfig = *fChainConfigs[iChainConfig];
+
+    Sample& previousState = chainConfig.GetCurrentState(iBeta);
+    Sample& nextState = chainConfig.fNextStates[iBeta];
+
+    const double mhRatio = CalculateMHRatio( previousState, nextState,
+        proposalAsymmetry, chainConfig.fBetas[iBeta] );
+
+    const bool proposalAccepted = Random::Instance().Bool( mhRatio );
+
+    chainConfig.fNStageProposals[iBeta][0]++;
+
+    if (proposalAccepted) {
+        chainConfig.fNStageAcceptances[iBeta][0]++;
+        nextState.SetAccepted( true );
+        swap( previousState, nextState );
+    }
+    else if (fDelayedRejection) {
+        // keep the rejected proposal for the second stage
+        return false;
+    }
+
+    CompleteStep( chainConfig, iBeta, proposalAccepted );
+
+    return true;
+}
+
+void MetropolisHastings::ProposeDelayedState(size_t iChainConfig, size_t iBeta)
+{
+    ChainConfig& chainConfig = *fChainConfigs[iChainConfig];
+
+    const Sample& previousState = chainConfig.GetCurrentState(iBeta);
+    Sample& delayedState = chainConfig.fDelayedStates[iBeta];
+
+    delayedState.SetGeneration( previousState.GetGeneration() + 1 );
+    delayedState.Reset();
+
+    // draw another first stage step and shrink it, which keeps the second
+    // stage proposal symmetric
+    chainConfig.fProposalFunctions[iBeta]->Transition( previousState, delayedState );
+
+    Vector& values = delayedState.Values();
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = previousState[i] + fDelayedRejectionScale * (values[i] - previousState[i]);
+
+    fLimits.Reflect( values );
+}
+
+void MetropolisHastings::AcceptOrRejectDelayed(size_t iChainConfig, size_t iBeta)
+{
+    ChainConfig& chainConfig = *fChainConfigs[iChainConfig];
+
+    Sample& previousState = chainConfig.GetCurrentState(iBeta);
+    const Sample& rejectedState = chainConfig.fNextStates[iBeta];
+    Sample& delayedState = chainConfig.fDelayedStates[iBeta];
+
+    double mhRatio = 0.0;
+
+    if (delayedState.GetPrior() != 0.0) {
+        Proposal& proposal = *chainConfig.fProposalFunctions[iBeta];
+
+        const double densityRatio = exp( proposal.LogDensity( delayedState.Values(), rejectedState.Values() )
+            - proposal.LogDensity( previousState.Values(), rejectedState.Values() ) );
+
+        mhRatio = CalculateMHRatio( previousState, rejectedState, delayedState,
+            densityRatio, chainConfig.fBetas[iBeta] );
+    }
+
+    const bool proposalAccepted = Random::Instance().Bool( mhRatio );
+
+    chainConfig.fNStageProposals[iBeta][1]++;
+
+    if (proposalAccepted) {
+        chainConfig.fNStageAcceptances[iBeta][1]++;
+        delayedState.SetAccepted( true );
+        swap( previousState, delayedState );
+    }
+
+    CompleteStep( chainConfig, iBeta, proposalAccepted );
+}
+
+void MetropolisHastings::CompleteStep(ChainConfig& chainConfig, size_t iBeta, bool accepted)
+{
+    Sample& currentState = chainConfig.GetCurrentState(iBeta);
+
+    if (!accepted) {
+        currentState.SetAccepted( false );
+        currentState.IncrementGeneration();
     }
+
+    chainConfig.fProposalFunctions[iBeta]->Adapt( currentState.Values(), accepted );
+
+    chainConfig.fPtChains[iBeta].push_back( currentState );
 }
 
 void MetropolisHastings::ProposePtSwapping(size_t iChainConfig)
@@ -343,19 +945,24 @@ void MetropolisHastings::ProposePtSwapping(size_t iChainConfig)
     if (fBetas.size() < 2)
         return;
 
-    auto& chainConfig = fChainConfigs[iChainConfig];
-
     // randomly pick 2 adjacent chains
     const size_t colderChainIndex = Random::Instance().Uniform<size_t>(0, fBetas.size()-2);
 
-    Chain& colderChain = chainConfig->fPtChains[colderChainIndex];
-    const double colderBeta = fBetas[colderChainIndex];
+    ProposePtSwap( iChainConfig, colderChainIndex );
+}
+
+bool MetropolisHastings::ProposePtSwap(size_t iChainConfig, size_t iColder)
+{
+    auto& chainConfig = fChainConfigs[iChainConfig];
+
+    const Sample& colderState = chainConfig->GetCurrentState(iColder);
+    const double colderBeta = chainConfig->fBetas[iColder];
 
-    Chain& warmerChain = chainConfig->fPtChains[colderChainIndex+1];
-    const double warmerBeta = fBetas[colderChainIndex+1];
+    const Sample& warmerState = chainConfig->GetCurrentState(iColder+1);
+    const double warmerBeta = chainConfig->fBetas[iColder+1];
 
-    const double colderNegLogL = colderChain.back().GetNegLogLikelihood();
-    const double warmerNegLogL = warmerChain.back().GetNegLogLikelihood();
+    const double colderNegLogL = colderState.GetNegLogLikelihood();
+    const double warmerNegLogL = warmerState.GetNegLogLikelihood();
 
     // calculate the swap probability
     const double ptRatio = std::min(1.0, exp(
@@ -363,15 +970,93 @@ void MetropolisHastings::ProposePtSwapping(size_t iChainConfig)
           + warmerBeta * (warmerNegLogL-colderNegLogL)
     ) );
 
-    chainConfig->fNProposedSwaps[colderChainIndex]++;
+    chainConfig->fNProposedSwaps[iColder]++;
+    chainConfig->fNAdaptionProposals[iColder]++;
 
     const bool performSwap = Random::Instance().Bool( ptRatio );
     if (performSwap) {
-        LOG(Debug, "Sampler " << colderChainIndex << " and " << colderChainIndex+1 << " swapped.");
-        swap(colderChain.back(), warmerChain.back());
+        LOG(Debug, "Sampler " << iColder << " and " << iColder+1 << " swapped.");
+        // the replicas exchange their temperatures, the chains continue with
+        // the state of the new replica in the next step
+        vector<size_t>& replicas = chainConfig->fReplicas;
+        std::swap( replicas[iColder], replicas[iColder+1] );
+
+        if (fRecordTrajectories) {
+            chainConfig->fTrajectories[replicas[iColder]].emplace_back( chainConfig->fNSteps, iColder );
+            chainConfig->fTrajectories[replicas[iColder+1]].emplace_back( chainConfig->fNSteps, iColder+1 );
+        }
 
-        chainConfig->fNAcceptedSwaps[colderChainIndex]++;
+        chainConfig->fNAcceptedSwaps[iColder]++;
     }
+    else {
+        chainConfig->fNAdaptionRejections[iColder]++;
+    }
+
+    return performSwap;
+}
+
+void MetropolisHastings::TrackRoundTrips(size_t iChainConfig)
+{
+    ChainConfig& chainConfig = *fChainConfigs[iChainConfig];
+
+    // a round trip starts, when a replica leaves the coldest chain, and ends,
+    // when it returns after visiting the hottest chain
+    const size_t coldest = chainConfig.fReplicas.front();
+    if (chainConfig.fDirections[coldest] < 0) {
+        chainConfig.fNRoundTrips++;
+        chainConfig.fRoundTripSteps += chainConfig.fNSteps - chainConfig.fRoundTripStarts[coldest];
+    }
+    if (chainConfig.fDirections[coldest] <= 0) {
+        chainConfig.fDirections[coldest] = +1;
+        chainConfig.fRoundTripStarts[coldest] = chainConfig.fNSteps;
+    }
+
+    const size_t hottest = chainConfig.fReplicas.back();
+    if (chainConfig.fDirections[hottest] > 0)
+        chainConfig.fDirections[hottest] = -1;
+}
+
+void MetropolisHastings::AdaptBetas(size_t iChainConfig)
+{
+    ChainConfig& chainConfig = *fChainConfigs[iChainConfig];
+
+    const vector<double>& betas = chainConfig.fBetas;
+    const size_t nPairs = betas.size() - 1;
+
+    // The cumulative rejection rate along the ladder (the communication
+    // barrier) is interpolated linearly between the betas. The new betas
+    // divide it into equal parts. A lower bound on the rejection rates keeps
+    // the ladder strictly decreasing.
+    vector<double> barrier( nPairs+1, 0.0 );
+    for (size_t i = 0; i < nPairs; i++) {
+        const double rejectionRate = (double) chainConfig.fNAdaptionRejections[i]
+            / chainConfig.fNAdaptionProposals[i];
+        barrier[i+1] = barrier[i] + std::max( rejectionRate, 1E-3 );
+    }
+
+    vector<double> newBetas( betas );
+
+    size_t iSegment = 0;
+    for (size_t k = 1; k < nPairs; k++) {
+        const double target = barrier[nPairs] * k / nPairs;
+        while (barrier[iSegment+1] < target)
+            iSegment++;
+
+        const double fraction = (target - barrier[iSegment]) / (barrier[iSegment+1] - barrier[iSegment]);
+        newBetas[k] = betas[iSegment] + fraction * (betas[iSegment+1] - betas[iSegment]);
+    }
+
+    LOG(Debug, "Adapted betas of chain set " << iChainConfig << ": " << newBetas);
+
+    // the coldest and the hottest chain are unchanged, the proposals of the
+    // others keep their adapted state
+    const vector<double> previousBetas = chainConfig.fBetas;
+    chainConfig.fBetas = newBetas;
+    for (size_t k = 1; k < nPairs; k++)
+        ScaleTemperedChain( chainConfig, k, previousBetas[k] );
+
+    chainConfig.fNAdaptionProposals.assign( nPairs, 0 );
+    chainConfig.fNAdaptionRejections.assign( nPairs, 0 );
 }
 
 } /* namespace vmcmc */
@@ -35,13 +35,59 @@ class Proposal;
  * thus constructing flatter distributions. For each value of beta, an
  * individual sampling chain, together with it's own parameter configuration
  * and proposal function is set up.
+ *
+ * States of adjacent tempered chains are swapped either for a random pair
+ * of chains (ESwapScheme::RandomPair) or in deterministic rounds, which
+ * alternate between all even and all odd pairs of chains
+ * (ESwapScheme::EvenOdd, see Syed et al., "Non-reversible parallel tempering:
+ * a scalable highly parallel MCMC scheme", JRSS B 84, 2022). The latter
+ * lets the states travel along the temperature ladder ballistically instead
+ * of diffusively. A swap only exchanges the indices of the replicas (states)
+ * at two temperatures, the chain of each temperature keeps its own history.
+ * Optionally, the ladder is adapted during the burn-in, such that all pairs
+ * swap with the same probability. The number of round trips of states
+ * between the coldest and the hottest chain is reported as a diagnostic.
+ *
+ * With delayed rejection (Tierney & Mira, "Some adaptive Monte Carlo methods
+ * for Bayesian inference", Stat. Med. 18, 1999), a rejected proposal is
+ * followed by a second, narrower proposal from the same state within the
+ * same step. Its acceptance probability accounts for the rejected first
+ * proposal, such that the target distribution is preserved. Combined with
+ * ProposalAdaptive, this corresponds to DRAM (Haario et al., 2006).
  */
 class MetropolisHastings: public Algorithm
 {
+public:
+    enum class ESwapScheme {
+        RandomPair, // propose a swap of a random adjacent pair
+        EvenOdd     // propose swaps of all even or all odd adjacent pairs in turns
+    };
+
+    /**
+     * The trajectory of a replica along the temperature ladder, as a list of
+     * (step, beta index) pairs, at which the replica entered a temperature.
+     */
+    using ReplicaTrajectory = std::vector<std::pair<size_t, size_t>>;
+
 public:
     static double CalculateMHRatio(const Sample& prevState, const Sample& nextState,
         double proposalAsymmetry = 1.0, double beta = 1.0);
 
+    /**
+     * Calculate the acceptance probability of a second stage proposal after
+     * a rejected first stage proposal (delayed rejection), for symmetric
+     * proposal functions.
+     * @param prevState The current state x.
+     * @param rejectedState The rejected first stage proposal y1.
+     * @param nextState The second stage proposal y2.
+     * @param proposalDensityRatio The ratio q1(y2 -> y1) / q1(x -> y1) of
+     * the first stage proposal densities.
+     * @param beta
+     * @return
+     */
+    static double CalculateMHRatio(const Sample& prevState, const Sample& rejectedState,
+        const Sample& nextState, double proposalDensityRatio, double beta = 1.0);
+
 public:
     MetropolisHastings();
     virtual ~MetropolisHastings();
@@ -61,18 +107,86 @@ public:
     void SetBetas(ContainerT betas);
     const std::vector<double>& GetBetas() const { return fBetas; }
 
+    /**
+     * Get the (adapted) temperature ladder of a chain set.
+     * @param iChain Index of the chain set.
+     * @return
+     */
+    const std::vector<double>& GetBetas(size_t iChain) const;
+
+    void SetSwapScheme(ESwapScheme scheme) { fSwapScheme = scheme; }
+    ESwapScheme GetSwapScheme() const { return fSwapScheme; }
+
+    /**
+     * Set the mean number of steps between two swap proposals
+     * (ESwapScheme::RandomPair) or the number of steps between two swap rounds
+     * (ESwapScheme::EvenOdd).
+     * @param nSteps
+     */
+    void SetPtFrequency(size_t nSteps) { fPtFrequency = std::max<size_t>( nSteps, 1 ); }
+    size_t GetPtFrequency() const { return fPtFrequency; }
+
+    /**
+     * Adapt the temperature ladder during the burn-in (see
+     * Algorithm::SetBurnIn()), such that all adjacent pairs of tempered
+     * chains swap with the same probability. The coldest and hottest beta
+     * stay fixed. The ladder is recalculated from the swap rejection rates
+     * after 10, 20, 40, ... swap proposals per pair.
+     * @param enable
+     */
+    void SetAdaptiveBetas(bool enable) { fAdaptiveBetas = enable; }
+    bool IsAdaptiveBetas() const { return fAdaptiveBetas; }
+
     template <typename ProposalT, typename... ArgsT>
     void SetProposalFunction(ArgsT&&... args);
     void SetProposalFunction(std::shared_ptr<Proposal> proposalFunction) { fProposalFunction = proposalFunction; }
     std::shared_ptr<Proposal> GetProposalFunction() { return fProposalFunction; };
     std::shared_ptr<const Proposal> GetProposalFunction() const { return fProposalFunction; }
 
+    /**
+     * Get the proposal function of a tempered chain, e.g. to inspect its
+     * adapted state after a run.
+     * @param iChain Index of the chain set.
+     * @param iBeta Index of the temperature.
+     * @return
+     */
+    const Proposal& GetProposalFunction(size_t iChain, size_t iBeta) const;
+
     void SetRandomizeStartPoint(bool randomizeStartPoint) { fRandomizeStartPoint = randomizeStartPoint; }
     bool IsRandomizeStartPoint() const { return fRandomizeStartPoint; }
 
     void SetMultiThreading(bool enable);
     bool IsMultiThreading() const { return fMultiThreading; }
 
+    /**
+     * Try a second proposal after each rejection (see the class description),
+     * which requires a symmetric proposal function providing its density
+     * (see Proposal::LogDensity()). This pays off for expensive targets,
+     * where the additional evaluation gains more effective samples than
+     * the next step.
+     * @param enable
+     */
+    void SetDelayedRejection(bool enable) { fDelayedRejection = enable; }
+    bool IsDelayedRejection() const { return fDelayedRejection; }
+
+    /**
+     * Set the step size of the second stage proposals relative to the first
+     * stage proposals (default 0.2).
+     * @param scale
+     */
+    void SetDelayedRejectionScale(double scale) { fDelayedRejectionScale = scale; }
+    double GetDelayedRejectionScale() const { return fDelayedRejectionScale; }
+
+    /**
+     * Get the fraction of accepted proposals in a stage of the delayed
+     * rejection, relative to the proposals in that stage.
+     * @param iChain Index of the chain set.
+     * @param iStage 0 for the first, 1 for the second stage.
+     * @param iBeta Index of the tempered chain.
+     * @return
+     */
+    double GetStageAcceptanceRate(size_t iChain, size_t iStage, size_t iBeta = 0) const;
+
     /**
      * Get the fraction of accepted swaps between tempered chains.
      * @param iChain Index of the chain set.
@@ -81,22 +195,179 @@ public:
      */
     double GetSwapAcceptanceRate(size_t iChain, ptrdiff_t iBeta = -1) const;
 
+    /**
+     * Get the number of round trips of states from the coldest to the
+     * hottest tempered chain and back.
+     * @param iChain Index of the chain set.
+     * @return
+     */
+    size_t GetNumberOfRoundTrips(size_t iChain) const;
+
+    /**
+     * Get the mean number of steps of a round trip (see
+     * GetNumberOfRoundTrips()).
+     * @param iChain Index of the chain set.
+     * @return 0 if no round trip was completed.
+     */
+    double GetMeanRoundTripTime(size_t iChain) const;
+
+    /**
+     * Get the index of the replica at each temperature of a chain set.
+     * @param iChain Index of the chain set.
+     * @return
+     */
+    const std::vector<size_t>& GetReplicas(size_t iChain) const;
+
+    /**
+     * Record the trajectories of the replicas along the temperature ladder
+     * (see GetReplicaTrajectory()). Only accepted swaps are recorded. The
+     * trajectories of a resumed run start at the checkpoint.
+     * @param enable
+     */
+    void SetRecordTrajectories(bool enable) { fRecordTrajectories = enable; }
+    bool IsRecordTrajectories() const { return fRecordTrajectories; }
+
+    /**
+     * Get the recorded trajectory of a replica (see SetRecordTrajectories()).
+     * @param iChain Index of the chain set.
+     * @param iReplica Index of the replica, initially at temperature
+     * GetBetas()[iReplica].
+     * @return
+     */
+    const ReplicaTrajectory& GetReplicaTrajectory(size_t iChain, size_t iReplica) const;
+
 protected:
+    struct ChainConfig;
+
+    /**
+     * The chain sets are independent without a batch target function.
+     */
+    virtual bool CanAdvanceIndependently() const override { return !fBatchNegLogLikelihood; }
+
+    /**
+     * Advance all tempered chains of a chain set and propose a swap
+     * between them.
+     */
+    virtual void AdvanceIndependently(size_t iChainConfig, size_t nSteps) override;
+
+    /**
+     * Save the current state, proposal function and swap counters of each
+     * tempered chain.
+     */
+    virtual void SaveState(CheckpointWriter& checkpoint) const override;
+    virtual void LoadState(CheckpointReader& checkpoint) override;
+
     void AdvanceChainConfig(size_t iChainConfig, size_t iBeta, size_t nSteps = 1);
+    void AdvanceBatch(size_t nSteps = 1);
+
+    /**
+     * Get the number of steps, by which all chains of a chain set can be
+     * advanced before the next swap round is due.
+     */
+    size_t StepsUntilSwaps(size_t iChainConfig, size_t nSteps) const;
+
+    /**
+     * Propose the swaps due after advancing a chain set by @p nSteps.
+     */
+    void ProposeSwaps(size_t iChainConfig, size_t nSteps);
+
+    /**
+     * Propose a swap of a randomly picked pair of adjacent tempered chains.
+     */
     void ProposePtSwapping(size_t iChainConfig);
 
+    /**
+     * Propose a swap of the states of two adjacent tempered chains.
+     * @param iChainConfig
+     * @param iColder The index of the colder chain.
+     * @return True if the states were swapped.
+     */
+    bool ProposePtSwap(size_t iChainConfig, size_t iColder);
+
+    /**
+     * Update the directions of the states on the temperature ladder after
+     * swaps and count the completed round trips.
+     */
+    void TrackRoundTrips(size_t iChainConfig);
+
+    /**
+     * Recalculate the temperature ladder of a chain set from the swap
+     * rejection rates, such that the rejection rates are equalized.
+     */
+    void AdaptBetas(size_t iChainConfig);
+
+    /**
+     * Scale the parameter configuration and proposal function of a tempered
+     * chain according to its beta.
+     * @param previousBeta If positive, the proposal function is rescaled
+     * from this beta, keeping its adapted state (see Proposal::Rescale()).
+     */
+    void ScaleTemperedChain(ChainConfig& chainConfig, size_t iBeta, double previousBeta = 0.0);
+
+    /**
+     * Propose the next state of a chain (without evaluating it).
+     * @return The proposal asymmetry.
+     */
+    double ProposeState(size_t iChainConfig, size_t iBeta);
+
+    /**
+     * Accept or reject the evaluated proposal of a chain and append the
+     * resulting state to the chain, unless a second stage follows.
+     * @return False if the proposal was rejected and a second stage proposal
+     * is due (see SetDelayedRejection()).
+     */
+    bool AcceptOrReject(size_t iChainConfig, size_t iBeta, double proposalAsymmetry);
+
+    /**
+     * Propose the second stage state of a chain after a rejection (without
+     * evaluating it).
+     */
+    void ProposeDelayedState(size_t iChainConfig, size_t iBeta);
+
+    /**
+     * Accept or reject the evaluated second stage proposal of a chain and
+     * append the resulting state to the chain.
+     */
+    void AcceptOrRejectDelayed(size_t iChainConfig, size_t iBeta);
+
+    /**
+     * Complete the step of a chain, appending its current state.
+     */
+    void CompleteStep(ChainConfig& chainConfig, size_t iBeta, bool accepted);
+
     bool fRandomizeStartPoint;
 
     std::vector<double> fBetas;
     std::shared_ptr<Proposal> fProposalFunction;
 
     size_t fPtFrequency;
+    ESwapScheme fSwapScheme;
+    bool fAdaptiveBetas;
+    bool fRecordTrajectories;
+
+    bool fDelayedRejection;
+    double fDelayedRejectionScale;
 
-    struct ChainConfig;
     std::vector<std::unique_ptr<ChainConfig>> fChainConfigs;
 
 private:
+    /**
+     * Advance all chains of all chain sets by @p nSteps.
+     */
+    void AdvanceChains(size_t nSteps);
+
+    /**
+     * Advance all tempered chains of a chain set by @p nSteps.
+     */
+    void AdvanceChainSet(size_t iChainConfig, size_t nSteps);
+
     bool fMultiThreading;
+
+    // scratch buffers for batched evaluations
+    std::vector<Sample*> fBatchSamples;
+    std::vector<double> fBatchAsymmetries;
+    std::vector<Sample*> fDelayedSamples;
+    std::vector<size_t> fDelayedIndices;
 };
 
 template <typename ProposalT, typename... ArgsT>
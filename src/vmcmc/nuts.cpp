@@ -0,0 +1,310 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/logger.hpp>
+#include <vmcmc/nuts.hpp>
+#include <vmcmc/numeric.hpp>
+#include <vmcmc/random.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace vmcmc
+{
+
+LOG_DEFINE("vmcmc.nuts");
+
+namespace
+{
+
+// energy error, beyond which a trajectory is considered divergent
+constexpr double sMaxEnergyError = 1000.0;
+
+// dual averaging parameters, as proposed by Hoffman & Gelman
+constexpr double sAdaptGamma = 0.05;
+constexpr double sAdaptT0 = 10.0;
+constexpr double sAdaptKappa = 0.75;
+
+inline double logSumExp(double a, double b)
+{
+    if (a == -numeric::inf())
+        return b;
+    if (b == -numeric::inf())
+        return a;
+    return max(a, b) + log1p( exp( -fabs(a - b) ) );
+}
+
+/**
+ * Generalized no-U-turn criterion for a trajectory with the momenta
+ * @p pMinus and @p pPlus at its ends and the summed momenta rhoA + rhoB.
+ */
+inline bool isNoUTurn(const vector<double>& pMinus, const vector<double>& pPlus,
+    const vector<double>& rhoA, const vector<double>& rhoB)
+{
+    double dotMinus = 0.0;
+    double dotPlus = 0.0;
+    for (size_t i = 0; i < rhoA.size(); i++) {
+        const double rho = rhoA[i] + rhoB[i];
+        dotMinus += pMinus[i] * rho;
+        dotPlus += pPlus[i] * rho;
+    }
+    return dotMinus > 0.0 && dotPlus > 0.0;
+}
+
+}
+
+NoUTurn::NoUTurn() :
+    fTargetAccRate( 0.8 ),
+    fWarmupLength( 1000 ),
+    fMaxTreeDepth( 10 )
+{
+    fStepSize = 0.5;
+}
+
+NoUTurn::~NoUTurn()
+{ }
+
+void NoUTurn::Initialize()
+{
+    Hamiltonian::Initialize();
+
+    const size_t nParams = fParameterConfig.size();
+
+    PhasePoint point;
+    point.fSample = Sample( nParams );
+    point.fMomentum.resize( nParams );
+    point.fGradient.resize( nParams );
+
+    TreeLevel level;
+    level.fProposal = point;
+    level.fRhoInit.resize( nParams );
+    level.fRhoFinal.resize( nParams );
+    level.fInitEnd.resize( nParams );
+    level.fFinalBegin.resize( nParams );
+
+    TreeState tree;
+    tree.fPoint = tree.fForward = tree.fBackward = tree.fSelected = tree.fProposal = point;
+    tree.fRho.resize( nParams );
+    tree.fRhoSubtree.resize( nParams );
+    tree.fForwardEnd.resize( nParams );
+    tree.fBackwardEnd.resize( nParams );
+    tree.fSubtreeBegin.resize( nParams );
+    tree.fSubtreeEnd.resize( nParams );
+    tree.fLevels.assign( fMaxTreeDepth, level );
+
+    tree.fStepSize = fStepSize;
+    tree.fLogStepSizeAvg = 0.0;
+    tree.fMu = log( 10.0 * fStepSize );
+    tree.fHBar = 0.0;
+    tree.fNAdaptions = 0;
+    tree.fNDivergences = 0;
+
+    fTrees.assign( fNChains, tree );
+}
+
+bool NoUTurn::Leapfrog(PhasePoint& z, double epsilon) const
+{
+    Kick( z.fMomentum, z.fGradient, 0.5 * epsilon );
+    Drift( z.fSample, z.fMomentum, epsilon );
+
+    if (!EvaluateWithGradient( z.fSample, z.fGradient ))
+        return false;
+
+    Kick( z.fMomentum, z.fGradient, 0.5 * epsilon );
+
+    return true;
+}
+
+void NoUTurn::AdvanceChain(size_t iChain, size_t nSteps)
+{
+    ChainState& state = fStates[iChain];
+    TreeState& tree = fTrees[iChain];
+    Chain& chain = fChains[iChain];
+
+    Random::ScopedEngine stream( state.fStream );
+    auto& random = Random::Instance();
+
+    for (size_t iStep = 0; iStep < nSteps; iStep++) {
+
+        // start from the current state with random momenta
+        PhasePoint& z = tree.fPoint;
+        z.fSample = state.fCurrent;
+        z.fGradient = state.fGradient;
+        random.Normal( z.fMomentum.data(), z.fMomentum.size() );
+
+        tree.fInitialEnergy = Energy( z.fSample, z.fMomentum );
+        tree.fNLeapfrog = 0;
+        tree.fSumAcceptProb = 0.0;
+        tree.fDivergent = false;
+
+        tree.fForward = z;
+        tree.fBackward = z;
+        tree.fSelected = z;
+        tree.fRho = z.fMomentum;
+        tree.fForwardEnd = z.fMomentum;
+        tree.fBackwardEnd = z.fMomentum;
+
+        double logSumWeight = 0.0;
+        bool accepted = false;
+
+        for (size_t depth = 0; depth < fMaxTreeDepth; depth++) {
+
+            fill( tree.fRhoSubtree.begin(), tree.fRhoSubtree.end(), 0.0 );
+            double logSumWeightSubtree = -numeric::inf();
+
+            // double the trajectory in a random direction
+            const bool forward = random.Bool( 0.5 );
+
+            z = (forward) ? tree.fForward : tree.fBackward;
+
+            const bool valid = BuildTree( tree, depth, tree.fProposal,
+                tree.fSubtreeBegin, tree.fSubtreeEnd, tree.fRhoSubtree,
+                (forward) ? 1.0 : -1.0, logSumWeightSubtree );
+
+            if (!valid)
+                break;
+
+            if (forward)
+                tree.fForward = z;
+            else
+                tree.fBackward = z;
+
+            // select from the new subtree, biased towards leaving the start point
+            if (random.Bool( exp(logSumWeightSubtree - logSumWeight) )) {
+                tree.fSelected = tree.fProposal;
+                accepted = true;
+            }
+            logSumWeight = logSumExp( logSumWeight, logSumWeightSubtree );
+
+            // check the no-U-turn criterion across the merged trajectory and
+            // between the old trajectory and the new subtree
+            vector<double>& pFarEnd = (forward) ? tree.fBackwardEnd : tree.fForwardEnd;
+            vector<double>& pNearEnd = (forward) ? tree.fForwardEnd : tree.fBackwardEnd;
+
+            const bool persist = isNoUTurn( pFarEnd, tree.fSubtreeEnd, tree.fRho, tree.fRhoSubtree )
+                && isNoUTurn( pFarEnd, tree.fSubtreeBegin, tree.fRho, tree.fSubtreeBegin )
+                && isNoUTurn( pNearEnd, tree.fSubtreeEnd, tree.fRhoSubtree, pNearEnd );
+
+            for (size_t i = 0; i < tree.fRho.size(); i++)
+                tree.fRho[i] += tree.fRhoSubtree[i];
+            pNearEnd.swap( tree.fSubtreeEnd );
+
+            if (!persist)
+                break;
+        }
+
+        if (tree.fDivergent)
+            tree.fNDivergences++;
+
+        AdaptStepSize( tree, (tree.fNLeapfrog > 0) ? tree.fSumAcceptProb / tree.fNLeapfrog : 0.0 );
+
+        if (accepted) {
+            const size_t generation = state.fCurrent.GetGeneration();
+            state.fCurrent = tree.fSelected.fSample;
+            state.fCurrent.SetGeneration( generation );
+            state.fGradient = tree.fSelected.fGradient;
+        }
+
+        state.fCurrent.SetAccepted( accepted );
+        state.fCurrent.IncrementGeneration();
+
+        chain.push_back( state.fCurrent );
+    }
+}
+
+bool NoUTurn::BuildTree(TreeState& tree, size_t depth, PhasePoint& proposal,
+    vector<double>& pBegin, vector<double>& pEnd,
+    vector<double>& rho, double direction, double& logSumWeight)
+{
+    PhasePoint& z = tree.fPoint;
+
+    if (depth == 0) {
+        tree.fNLeapfrog++;
+
+        const double energy = Leapfrog( z, direction * tree.fStepSize )
+            ? Energy( z.fSample, z.fMomentum ) : numeric::inf();
+
+        const double deltaEnergy = tree.fInitialEnergy - energy;
+
+        if (!(deltaEnergy > -sMaxEnergyError)) {
+            tree.fDivergent = true;
+            return false;
+        }
+
+        logSumWeight = logSumExp( logSumWeight, deltaEnergy );
+        tree.fSumAcceptProb += (deltaEnergy > 0.0) ? 1.0 : exp( deltaEnergy );
+
+        proposal = z;
+        for (size_t i = 0; i < rho.size(); i++)
+            rho[i] += z.fMomentum[i];
+        pBegin = z.fMomentum;
+        pEnd = z.fMomentum;
+
+        return true;
+    }
+
+    TreeLevel& level = tree.fLevels[depth];
+
+    // build the initial subtree
+    fill( level.fRhoInit.begin(), level.fRhoInit.end(), 0.0 );
+    double logSumWeightInit = -numeric::inf();
+
+    if (!BuildTree( tree, depth-1, proposal, pBegin, level.fInitEnd,
+            level.fRhoInit, direction, logSumWeightInit ))
+        return false;
+
+    // build the final subtree
+    fill( level.fRhoFinal.begin(), level.fRhoFinal.end(), 0.0 );
+    double logSumWeightFinal = -numeric::inf();
+
+    if (!BuildTree( tree, depth-1, level.fProposal, level.fFinalBegin, pEnd,
+            level.fRhoFinal, direction, logSumWeightFinal ))
+        return false;
+
+    // multinomial sampling from the merged subtrees
+    const double logSumWeightSubtree = logSumExp( logSumWeightInit, logSumWeightFinal );
+    logSumWeight = logSumExp( logSumWeight, logSumWeightSubtree );
+
+    if (Random::Instance().Bool( exp(logSumWeightFinal - logSumWeightSubtree) ))
+        proposal = level.fProposal;
+
+    for (size_t i = 0; i < rho.size(); i++)
+        rho[i] += level.fRhoInit[i] + level.fRhoFinal[i];
+
+    // check the no-U-turn criterion across the merged subtree and between
+    // both halves
+    return isNoUTurn( pBegin, pEnd, level.fRhoInit, level.fRhoFinal )
+        && isNoUTurn( pBegin, level.fFinalBegin, level.fRhoInit, level.fFinalBegin )
+        && isNoUTurn( level.fInitEnd, pEnd, level.fRhoFinal, level.fInitEnd );
+}
+
+void NoUTurn::AdaptStepSize(TreeState& tree, double acceptStat) const
+{
+    if (tree.fNAdaptions >= fWarmupLength)
+        return;
+
+    const double m = (double) ++tree.fNAdaptions;
+
+    // dual averaging of the log step size
+    const double eta = 1.0 / (m + sAdaptT0);
+    tree.fHBar = (1.0 - eta) * tree.fHBar + eta * (fTargetAccRate - acceptStat);
+
+    const double logStepSize = tree.fMu - sqrt(m) / sAdaptGamma * tree.fHBar;
+
+    const double weight = pow( m, -sAdaptKappa );
+    tree.fLogStepSizeAvg = weight * logStepSize + (1.0 - weight) * tree.fLogStepSizeAvg;
+
+    // after warmup, continue with the averaged step size
+    tree.fStepSize = (tree.fNAdaptions < fWarmupLength) ? exp( logStepSize ) : exp( tree.fLogStepSizeAvg );
+}
+
+} /* namespace vmcmc */
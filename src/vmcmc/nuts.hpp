@@ -0,0 +1,176 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief Contains the implementation of the No-U-Turn sampler.
+ */
+
+#ifndef VMCMC_NUTS_H_
+#define VMCMC_NUTS_H_
+
+#include <vmcmc/hamiltonian.hpp>
+
+namespace vmcmc
+{
+
+/**
+ * Implementation of the No-U-Turn sampler (NUTS, Hoffman & Gelman, 2014).
+ *
+ * Instead of following trajectories of fixed length like Hamiltonian, each
+ * step builds a binary tree of leapfrog states by repeatedly doubling the
+ * trajectory in a random direction, until it starts to turn back on itself
+ * or the maximum tree depth is reached. The next state is drawn from the
+ * trajectory with multinomial weights, biased towards the latest subtree.
+ *
+ * During the warmup steps, the leapfrog step size of each chain is adapted
+ * by dual averaging to yield the target acceptance statistic. Afterwards,
+ * the averaged step size is kept fixed. The warmup states are part of the
+ * chains.
+ *
+ * The storage for the trajectory tree is allocated once per chain in
+ * Initialize(), so that building trees does not allocate any memory.
+ */
+class NoUTurn : public Hamiltonian
+{
+public:
+    NoUTurn();
+    virtual ~NoUTurn();
+
+    virtual void Initialize() override;
+
+    /**
+     * Set the mean acceptance statistic, the step size adaptation aims for.
+     * @param accRate
+     */
+    void SetTargetAccRate(double accRate) { fTargetAccRate = accRate; }
+    double GetTargetAccRate() const { return fTargetAccRate; }
+
+    /**
+     * Set the number of steps, during which the step size is adapted.
+     * @param nSteps
+     */
+    void SetWarmupLength(size_t nSteps) { fWarmupLength = nSteps; }
+    size_t GetWarmupLength() const { return fWarmupLength; }
+
+    /**
+     * Set the maximum depth of the trajectory tree, limiting the number of
+     * leapfrog steps per sample to 2^depth - 1.
+     * @param depth
+     */
+    void SetMaxTreeDepth(size_t depth) { fMaxTreeDepth = std::max<size_t>(depth, 1); }
+    size_t GetMaxTreeDepth() const { return fMaxTreeDepth; }
+
+    /**
+     * Get the current (or, after warmup, the adapted) step size of a chain.
+     * @param cIndex The chain index.
+     * @return
+     */
+    double GetAdaptedStepSize(size_t cIndex = 0) const { return fTrees[cIndex].fStepSize; }
+
+    /**
+     * Get the number of trajectories of a chain, which were terminated due
+     * to a diverging energy.
+     * @param cIndex The chain index.
+     * @return
+     */
+    size_t GetNumberOfDivergences(size_t cIndex = 0) const { return fTrees[cIndex].fNDivergences; }
+
+protected:
+    /**
+     * A point in phase space, together with the target function values.
+     */
+    struct PhasePoint
+    {
+        Sample fSample;
+        std::vector<double> fMomentum;
+        std::vector<double> fGradient;
+    };
+
+    /**
+     * Scratch storage for building a subtree of a given depth.
+     */
+    struct TreeLevel
+    {
+        PhasePoint fProposal;
+        std::vector<double> fRhoInit;
+        std::vector<double> fRhoFinal;
+        std::vector<double> fInitEnd;
+        std::vector<double> fFinalBegin;
+    };
+
+    /**
+     * Trajectory storage and step size adaptation state of one chain.
+     */
+    struct TreeState
+    {
+        PhasePoint fPoint;
+        PhasePoint fForward;
+        PhasePoint fBackward;
+        PhasePoint fSelected;
+        PhasePoint fProposal;
+
+        std::vector<double> fRho;
+        std::vector<double> fRhoSubtree;
+        std::vector<double> fForwardEnd;
+        std::vector<double> fBackwardEnd;
+        std::vector<double> fSubtreeBegin;
+        std::vector<double> fSubtreeEnd;
+
+        std::vector<TreeLevel> fLevels;
+
+        double fInitialEnergy;
+        size_t fNLeapfrog;
+        double fSumAcceptProb;
+        bool fDivergent;
+
+        double fStepSize;
+        double fLogStepSizeAvg;
+        double fMu;
+        double fHBar;
+        size_t fNAdaptions;
+        size_t fNDivergences;
+    };
+
+    virtual void AdvanceChain(size_t iChain, size_t nSteps) override;
+
+    /**
+     * Build a subtree of 2^depth leapfrog steps, starting from
+     * TreeState::fPoint, which is advanced to the end of the subtree.
+     * @param tree
+     * @param depth
+     * @param[out] proposal The state selected from the subtree.
+     * @param[out] pBegin The momenta at the beginning of the subtree.
+     * @param[out] pEnd The momenta at the end of the subtree.
+     * @param[in,out] rho The sum of momenta, incremented by the subtree.
+     * @param direction +1 or -1 for integration forward or backward in time.
+     * @param[in,out] logSumWeight The log of the summed multinomial weights,
+     * incremented by the subtree.
+     * @return False if the subtree diverged or made a U-turn.
+     */
+    bool BuildTree(TreeState& tree, size_t depth, PhasePoint& proposal,
+        std::vector<double>& pBegin, std::vector<double>& pEnd,
+        std::vector<double>& rho, double direction, double& logSumWeight);
+
+    /**
+     * Perform one leapfrog step of the phase point @p z.
+     * @return False if the step left the support of the target.
+     */
+    bool Leapfrog(PhasePoint& z, double epsilon) const;
+
+    void AdaptStepSize(TreeState& tree, double acceptStat) const;
+
+    double fTargetAccRate;
+    size_t fWarmupLength;
+    size_t fMaxTreeDepth;
+
+    std::vector<TreeState> fTrees;
+};
+
+} /* namespace vmcmc */
+
+#endif /* VMCMC_NUTS_H_ */
@@ -250,14 +250,51 @@ bool ParameterConfig::ReflectFromLimits(Vector& somePoint) const
 {
     LOG_ASSERT( somePoint.size() == fParameters.size() );
 
-    bool reflectionSuccessful = false;
+    bool reflectionSuccessful = true;
 
     for (size_t i = 0; i < fParameters.size(); i++) {
-        if (fParameters[i].ReflectFromLimits( somePoint[i] ))
-            reflectionSuccessful = true;
+        if (!fParameters[i].ReflectFromLimits( somePoint[i] ))
+            reflectionSuccessful = false;
     }
 
     return reflectionSuccessful;
 }
 
+ParameterLimits ParameterConfig::GetLimits() const
+{
+    return ParameterLimits( *this );
+}
+
+ParameterLimits::ParameterLimits(const ParameterConfig& paramConfig) :
+    fLower( paramConfig.size(), -numeric::inf() ),
+    fUpper( paramConfig.size(), numeric::inf() )
+{
+    for (size_t i = 0; i < paramConfig.size(); i++) {
+        const Parameter& param = paramConfig[i];
+        if (param.GetLowerLimit())
+            fLower[i] = param.GetLowerLimit().get();
+        if (param.GetUpperLimit())
+            fUpper[i] = param.GetUpperLimit().get();
+    }
+}
+
+bool ParameterLimits::Reflect(double* somePoint) const
+{
+    bool inside = true;
+
+    for (size_t i = 0; i < fLower.size(); i++) {
+        double& value = somePoint[i];
+
+        if (value < fLower[i])
+            value = 2.0 * fLower[i] - value;
+        else if (value > fUpper[i])
+            value = 2.0 * fUpper[i] - value;
+
+        // check if we've hit the other limit
+        inside &= (value >= fLower[i]) & (value <= fUpper[i]);
+    }
+
+    return inside;
+}
+
 } /* namespace vmcmc */
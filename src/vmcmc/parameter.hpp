@@ -16,6 +16,7 @@
 #include <vmcmc/blas.hpp>
 
 #include <string>
+#include <vector>
 #include <boost/optional.hpp>
 
 namespace vmcmc
@@ -101,6 +102,48 @@ protected:
     bool fFixed;
 };
 
+class ParameterConfig;
+
+/**
+ * A flat table of the lower and upper limits of all parameters, with
+ * -/+ infinity for unset limits.
+ *
+ * Samplers check each proposal against this table before evaluating the prior
+ * and the likelihood. Without the branches on the optional limits of each
+ * Parameter, the check compiles to a few vectorizable comparisons.
+ */
+class ParameterLimits
+{
+public:
+    ParameterLimits() { }
+    explicit ParameterLimits(const ParameterConfig& paramConfig);
+
+    size_t size() const { return fLower.size(); }
+
+    const std::vector<double>& GetLower() const { return fLower; }
+    const std::vector<double>& GetUpper() const { return fUpper; }
+
+    /**
+     * Checks if a point is inside the limits.
+     * @param somePoint A pointer to size() values.
+     * @return False, if any value is outside its limits or NaN.
+     */
+    bool IsInside(const double* somePoint) const;
+    bool IsInside(const Vector& somePoint) const { return IsInside( somePoint.data().data() ); }
+
+    /**
+     * Reflect all values of a point exceeding a limit from that limit.
+     * @param somePoint A pointer to size() values to be reflected.
+     * @return True, if the point is inside the limits afterwards.
+     */
+    bool Reflect(double* somePoint) const;
+    bool Reflect(Vector& somePoint) const { return Reflect( somePoint.data().data() ); }
+
+private:
+    std::vector<double> fLower;
+    std::vector<double> fUpper;
+};
+
 /**
  * A list of parameters, describing the parameter space of the target function
  * to be evaluated. In addition to listing the individual parameter properties,
@@ -178,12 +221,27 @@ public:
      */
     bool ReflectFromLimits(Vector& somePoint) const;
 
+    /**
+     * Get a table of the parameter limits, which is faster to check than the
+     * individual parameters.
+     */
+    ParameterLimits GetLimits() const;
+
 private:
     std::vector<Parameter> fParameters;
     double fErrorScaling;
     MatrixUnitLower fCorrelations;
 };
 
+inline bool ParameterLimits::IsInside(const double* somePoint) const
+{
+    // no early exit, keeping the loop free of branches
+    bool inside = true;
+    for (size_t i = 0; i < fLower.size(); i++)
+        inside &= (somePoint[i] >= fLower[i]) & (somePoint[i] <= fUpper[i]);
+    return inside;
+}
+
 } /* namespace vmcmc */
 
 #endif /* VMCMC_PARAMETER_H_ */
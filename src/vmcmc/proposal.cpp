@@ -8,27 +8,88 @@
  * @author marco@kleesiek.com
  */
 
+#include <checkpoint.hpp>
+#include <exception.hpp>
 #include <logger.hpp>
+#include <math.hpp>
 #include <proposal.hpp>
 #include <random.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 namespace vmcmc
 {
 
 LOG_DEFINE("vmcmc.proposal");
 
+namespace
+{
+
+// log densities (up to a constant) of the univariate distributions
+inline double LogDensity(const std::normal_distribution<double>& dist, double z)
+{
+    return -0.5 * math::pow<2>( (z - dist.mean()) / dist.stddev() );
+}
+
+inline double LogDensity(const std::student_t_distribution<double>& dist, double z)
+{
+    return -0.5 * (dist.n() + 1.0) * log1p( z * z / dist.n() );
+}
+
+} /* anonymous namespace */
+
+double Proposal::LogDensity(const Vector& /*s1*/, const Vector& /*s2*/)
+{
+    throw Exception() << "The proposal function does not provide its density.";
+}
+
 template <typename DistributionT>
 double ProposalDistribution<DistributionT>::Transition(const Vector& s1, Vector& s2)
 {
     LOG_ASSERT(s1.size() == s2.size());
     LOG_ASSERT(s1.size() == fCholeskyDecomp.size1());
 
-    s2 = Random::Instance().FromMultiVariateDistribution(
-        fDistribution, s1, fCholeskyDecomp );
+    Random::Instance().FromMultiVariateDistribution(
+        fDistribution, s1, fCholeskyDecomp, fNoise, s2 );
 
     return 1.0;
 }
 
+template <typename DistributionT>
+void ProposalDistribution<DistributionT>::Decorrelate(const Vector& s1, const Vector& s2, double scale)
+{
+    const size_t n = s1.size();
+
+    LOG_ASSERT(n == s2.size());
+    LOG_ASSERT(n == fCholeskyDecomp.size1());
+
+    if (fNoise.size() != n)
+        fNoise.resize( n, false );
+
+    // forward substitution, fixed parameters (zero diagonal) do not move
+    for (size_t j = 0; j < n; j++) {
+        double sum = (s2[j] - s1[j]) / scale;
+        for (size_t i = 0; i < j; i++)
+            sum -= fCholeskyDecomp(j, i) * fNoise[i];
+        const double diagonal = fCholeskyDecomp(j, j);
+        fNoise[j] = (diagonal != 0.0) ? sum / diagonal : 0.0;
+    }
+}
+
+template <typename DistributionT>
+double ProposalDistribution<DistributionT>::LogDensity(const Vector& s1, const Vector& s2)
+{
+    Decorrelate( s1, s2 );
+
+    // the variates are independent, the Jacobian is constant
+    double result = 0.0;
+    for (size_t i = 0; i < fNoise.size(); i++)
+        result += vmcmc::LogDensity( fDistribution, fNoise[i] );
+
+    return result;
+}
+
 template <typename DistributionT>
 void ProposalDistribution<DistributionT>::UpdateParameterConfig(const ParameterConfig& paramConfig)
 {
@@ -36,6 +97,193 @@ void ProposalDistribution<DistributionT>::UpdateParameterConfig(const ParameterC
     fCholeskyDecomp = paramConfig.GetCholeskyDecomp();
 }
 
+template <typename DistributionT>
+void ProposalDistribution<DistributionT>::SaveState(CheckpointWriter& checkpoint) const
+{
+    // the distribution may cache values (e.g. the second of a pair of normal variates)
+    checkpoint.PutObject( fDistribution );
+    checkpoint.PutDoubles( fCholeskyDecomp.data() );
+}
+
+template <typename DistributionT>
+void ProposalDistribution<DistributionT>::LoadState(CheckpointReader& checkpoint)
+{
+    checkpoint.GetObject( fDistribution );
+    checkpoint.GetDoubles( fCholeskyDecomp.data() );
+}
+
+ProposalAdaptive::ProposalAdaptive() :
+    fTargetAccRate( 0.234 ),
+    fAdaptionLength( 0 ),
+    fInitialWeight( 10.0 ),
+    fNAdaptions( 0 ),
+    fLogScale( 0.0 ),
+    fWeight( 0.0 )
+{ }
+
+double ProposalAdaptive::Transition(const Vector& s1, Vector& s2)
+{
+    const size_t n = s1.size();
+
+    LOG_ASSERT(n == s2.size());
+    LOG_ASSERT(n == fCholeskyDecomp.size1());
+
+    if (fNoise.size() != n)
+        fNoise.resize( n, false );
+
+    Random::Instance().Normal( &fNoise[0], n );
+
+    // s2 = s1 + scale * L * z, evaluated explicitly on the lower triangle
+    const double scale = GetScale();
+    for (size_t j = 0; j < n; j++) {
+        double sum = 0.0;
+        for (size_t i = 0; i <= j; i++)
+            sum += fCholeskyDecomp(j, i) * fNoise[i];
+        s2[j] = s1[j] + scale * sum;
+    }
+
+    return 1.0;
+}
+
+double ProposalAdaptive::LogDensity(const Vector& s1, const Vector& s2)
+{
+    Decorrelate( s1, s2, GetScale() );
+
+    double result = 0.0;
+    for (size_t i = 0; i < fNoise.size(); i++)
+        result -= 0.5 * math::pow<2>( fNoise[i] );
+
+    return result;
+}
+
+void ProposalAdaptive::UpdateParameterConfig(const ParameterConfig& paramConfig)
+{
+    ProposalNormal::UpdateParameterConfig(paramConfig);
+
+    // restart adaptation from the new configuration
+    fNAdaptions = 0;
+    fLogScale = 0.0;
+    fWeight = 0.0;
+    fMean.resize( 0, false );
+
+    FindActiveDimensions();
+}
+
+void ProposalAdaptive::FindActiveDimensions()
+{
+    fActive.clear();
+    for (size_t i = 0; i < fCholeskyDecomp.size1(); i++)
+        if (fCholeskyDecomp(i, i) > 0.0)
+            fActive.push_back( i );
+}
+
+void ProposalAdaptive::Adapt(const Vector& state, bool accepted)
+{
+    if (fAdaptionLength > 0 && fNAdaptions >= fAdaptionLength)
+        return;
+
+    LOG_ASSERT(state.size() == fCholeskyDecomp.size1());
+
+    fNAdaptions++;
+
+    // Robbins-Monro update of the global scale towards the target acceptance rate
+    const double gain = 1.0 / pow( (double) fNAdaptions, 0.6 );
+    fLogScale += gain * ((accepted ? 1.0 : 0.0) - fTargetAccRate);
+
+    // the first state defines the mean, the covariance is still the prior one
+    if (fWeight == 0.0) {
+        fMean = state;
+        fUpdate.resize( state.size(), false );
+        fWeight = std::max( fInitialWeight, 1.0 );
+        return;
+    }
+
+    // Welford update of the weighted mean and covariance:
+    // C' = (n-1)/n C + (n-1)/n^2 (x-m)(x-m)^T, with n the new weight
+    fWeight += 1.0;
+    const double n = fWeight;
+
+    // the zero rows and columns of fixed dimensions are skipped
+    const double updateScale = sqrt(n - 1.0) / n;
+    fill( fUpdate.begin(), fUpdate.end(), 0.0 );
+    for (size_t i : fActive) {
+        const double delta = state[i] - fMean[i];
+        fMean[i] += delta / n;
+        fUpdate[i] = delta * updateScale;
+    }
+
+    fPrevious = fCholeskyDecomp;
+
+    const double rescale = sqrt( (n - 1.0) / n );
+    for (size_t a = 0; a < fActive.size(); a++)
+        for (size_t b = 0; b <= a; b++)
+            fCholeskyDecomp(fActive[a], fActive[b]) *= rescale;
+
+    if (choleskyUpdate( fCholeskyDecomp, fUpdate ) != 0)
+        Refactorize( state, rescale );
+}
+
+void ProposalAdaptive::Refactorize(const Vector& state, double rescale)
+{
+    LOG(Debug, "Rank-1 update of the proposal covariance failed, decomposing it anew.");
+
+    const size_t m = fActive.size();
+    // the update vector, recovered from the updated mean
+    const double updateScale = 1.0 / sqrt(fWeight - 1.0);
+
+    // C' = (n-1)/n L L^T + u u^T, restricted to the active dimensions
+    Matrix cov( m, m );
+    for (size_t a = 0; a < m; a++) {
+        const size_t i = fActive[a];
+        for (size_t b = 0; b <= a; b++) {
+            const size_t j = fActive[b];
+            double sum = 0.0;
+            for (size_t k = 0; k <= j; k++)
+                sum += fPrevious(i, k) * fPrevious(j, k);
+            cov(a, b) = rescale * rescale * sum
+                + math::pow<2>( updateScale ) * (state[i] - fMean[i]) * (state[j] - fMean[j]);
+        }
+    }
+
+    MatrixLower factor( m, m );
+    const size_t result = choleskyDecompose( cov, factor );
+
+    // without a valid decomposition, the previous one is kept
+    fCholeskyDecomp = fPrevious;
+    if (result != 0)
+        return;
+
+    for (size_t a = 0; a < m; a++)
+        for (size_t b = 0; b <= a; b++)
+            fCholeskyDecomp(fActive[a], fActive[b]) = factor(a, b);
+}
+
+void ProposalAdaptive::SaveState(CheckpointWriter& checkpoint) const
+{
+    ProposalNormal::SaveState( checkpoint );
+
+    checkpoint.PutUInt( fNAdaptions );
+    checkpoint.PutDouble( fLogScale );
+    checkpoint.PutDouble( fWeight );
+    checkpoint.PutDoubles( fMean );
+}
+
+void ProposalAdaptive::LoadState(CheckpointReader& checkpoint)
+{
+    ProposalNormal::LoadState( checkpoint );
+
+    fNAdaptions = checkpoint.GetUInt();
+    fLogScale = checkpoint.GetDouble();
+    fWeight = checkpoint.GetDouble();
+
+    // the mean is only defined after the first adaption
+    fMean.resize( (fWeight > 0.0) ? fCholeskyDecomp.size1() : 0, false );
+    fUpdate.resize( fMean.size(), false );
+    checkpoint.GetDoubles( fMean );
+
+    FindActiveDimensions();
+}
+
 // explicit instantiation definitions
 template class ProposalDistribution< std::normal_distribution<double> >;
 template class ProposalDistribution< std::student_t_distribution<double> >;
@@ -19,9 +19,14 @@
 #include <vmcmc/sample.hpp>
 #include <vmcmc/random.hpp>
 
+#include <cmath>
+
 namespace vmcmc
 {
 
+class CheckpointWriter;
+class CheckpointReader;
+
 /**
  * Base class for proposal functions (alias transition kernels) used by
  * Metropolis-Hastings algorithms to propose a new point in the parameter
@@ -45,7 +50,51 @@ public:
 
     double Transition(const Sample& s1, Sample& s2) { return Transition(s1.Values(), s2.Values()); }
 
+    /**
+     * Evaluate the logarithm of the proposal density for a transition,
+     * up to a constant. Delayed rejection requires the density to correct
+     * the acceptance probability of the second stage.
+     * The default implementation throws, since the density is unknown.
+     * @param s1 The original state.
+     * @param s2 The proposed state.
+     * @return log q(s1 -> s2) + const.
+     */
+    virtual double LogDensity(const Vector& s1, const Vector& s2);
+
     virtual void UpdateParameterConfig(const ParameterConfig& /*paramConfig*/) { };
+
+    /**
+     * Scale the width of the proposal, keeping any adapted state (e.g. when
+     * the temperature of a tempered chain changes).
+     * The default implementation does nothing.
+     * @param factor
+     * @return False, if rescaling is not supported and the proposal has to
+     * be updated with a scaled parameter configuration instead.
+     */
+    virtual bool Rescale(double /*factor*/) { return false; }
+
+    /**
+     * Notify the proposal function about the outcome of a step, allowing
+     * adaptive proposals to learn from the chain history.
+     * The default implementation does nothing.
+     * @param state The current state of the chain after the step.
+     * @param accepted Whether the last proposal was accepted.
+     */
+    virtual void Adapt(const Vector& /*state*/, bool /*accepted*/) { }
+
+    /**
+     * Save the internal state (e.g. adapted covariances) to a checkpoint.
+     * The default implementation saves nothing.
+     * @param checkpoint
+     */
+    virtual void SaveState(CheckpointWriter& /*checkpoint*/) const { }
+
+    /**
+     * Restore the state saved by SaveState(), after UpdateParameterConfig()
+     * was called with the original parameter configuration.
+     * @param checkpoint
+     */
+    virtual void LoadState(CheckpointReader& /*checkpoint*/) { }
 };
 
 
@@ -68,13 +117,27 @@ public:
     double Transition(const Vector& s1, Vector& s2) override;
     using Proposal::Transition;
 
+    double LogDensity(const Vector& s1, const Vector& s2) override;
+
     void UpdateParameterConfig(const ParameterConfig& paramConfig) override;
 
+    bool Rescale(double factor) override { fCholeskyDecomp *= factor; return true; }
+
+    void SaveState(CheckpointWriter& checkpoint) const override;
+    void LoadState(CheckpointReader& checkpoint) override;
+
     const MatrixLower& GetCholeskyDecomp() const { return fCholeskyDecomp; }
 
 protected:
+    /**
+     * Transform a step s2 - s1 back to the independent variates drawn from
+     * the distribution, z = L^-1 (s2 - s1) / scale, stored in fNoise.
+     */
+    void Decorrelate(const Vector& s1, const Vector& s2, double scale = 1.0);
+
     DistributionT fDistribution;
     MatrixLower fCholeskyDecomp;
+    Vector fNoise;  // scratch buffer, avoids allocations in Transition
 };
 
 /**
@@ -89,6 +152,86 @@ public:
     virtual ProposalNormal* Clone() const override { return new ProposalNormal(*this); }
 };
 
+/**
+ * Adaptive Metropolis proposal function (Haario et al., 2001), drawing from a
+ * multivariate normal distribution whose covariance matrix is learned from
+ * the history of the chain.
+ *
+ * The proposal starts from the covariance matrix of the parameter
+ * configuration, which enters the empirical covariance with the weight of
+ * SetInitialWeight() pseudo samples and keeps it positive definit.
+ * With each call to Adapt(), the Cholesky decomposition of the running
+ * covariance is kept current by a rank-1 update in O(n^2) instead of a full
+ * decomposition. Additionally, a global scale factor is tuned towards the
+ * target acceptance rate by a Robbins-Monro update with diminishing gain.
+ *
+ * Fixed parameters (or parameters with zero error) keep a zero width.
+ * If the rank-1 update fails numerically, the covariance is decomposed anew.
+ *
+ * To strictly preserve the stationary distribution, adaptation can be
+ * limited to a number of steps (e.g. the burn-in) with SetAdaptionLength().
+ */
+class ProposalAdaptive : public ProposalNormal
+{
+public:
+    ProposalAdaptive();
+    virtual ~ProposalAdaptive() { }
+
+    virtual ProposalAdaptive* Clone() const override { return new ProposalAdaptive(*this); }
+
+    double Transition(const Vector& s1, Vector& s2) override;
+    using Proposal::Transition;
+
+    double LogDensity(const Vector& s1, const Vector& s2) override;
+
+    void UpdateParameterConfig(const ParameterConfig& paramConfig) override;
+
+    void Adapt(const Vector& state, bool accepted) override;
+
+    void SaveState(CheckpointWriter& checkpoint) const override;
+    void LoadState(CheckpointReader& checkpoint) override;
+
+    void SetTargetAccRate(double accRate) { fTargetAccRate = accRate; }
+    double GetTargetAccRate() const { return fTargetAccRate; }
+
+    /**
+     * Set the number of steps, after which adaptation stops.
+     * @param nSteps 0 (default) for continuous adaptation.
+     */
+    void SetAdaptionLength(size_t nSteps) { fAdaptionLength = nSteps; }
+    size_t GetAdaptionLength() const { return fAdaptionLength; }
+
+    /**
+     * Set the weight (in number of samples) of the covariance matrix from
+     * the parameter configuration in the empirical covariance.
+     * @param nSamples
+     */
+    void SetInitialWeight(double nSamples) { fInitialWeight = nSamples; }
+    double GetInitialWeight() const { return fInitialWeight; }
+
+    size_t GetNumberOfAdaptions() const { return fNAdaptions; }
+    double GetScale() const { return std::exp( fLogScale ); }
+    const Vector& GetMean() const { return fMean; }
+
+private:
+    double fTargetAccRate;
+    size_t fAdaptionLength;
+    double fInitialWeight;
+
+    size_t fNAdaptions;
+    double fLogScale;
+    double fWeight;
+    Vector fMean;
+    Vector fUpdate; // scratch buffer for the rank-1 update
+
+    // the dimensions with a nonzero proposal width (e.g. not fixed)
+    std::vector<size_t> fActive;
+    MatrixLower fPrevious; // the decomposition before the current update
+
+    void FindActiveDimensions();
+    void Refactorize(const Vector& state, double rescale);
+};
+
 /**
  * Proposal function drawing randomly from a multivariate Student-T distribution.
  */
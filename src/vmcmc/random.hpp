@@ -18,8 +18,12 @@
 #include <random>
 #include <type_traits>
 #include <cmath>
+#include <cstdint>
 #include <atomic>
 #include <thread>
+#include <array>
+#include <iostream>
+#include <algorithm>
 
 #include <boost/numeric/ublas/vector.hpp>
 #include <boost/numeric/ublas/matrix.hpp>
@@ -30,6 +34,223 @@ namespace vmcmc
 
 namespace ublas = boost::numeric::ublas;
 
+/**
+ * Counter-based pseudo random number generator Philox4x32-10 by Salmon et
+ * al., "Parallel random numbers: as easy as 1, 2, 3" (SC '11).
+ *
+ * Each block of four 32 bit numbers is a bijective function of a 128 bit
+ * counter, encrypted with a 64 bit key in 10 rounds. The engine state is
+ * merely the key, a stream number (upper half of the counter) and the block
+ * position (lower half of the counter). Thus, engines with different keys or
+ * streams produce independent sequences, which do not depend on the order,
+ * in which the engines are advanced (e.g. by different threads), and
+ * skipping ahead is O(1).
+ *
+ * Satisfies the requirements of a STL random number engine.
+ */
+class Philox4x32
+{
+public:
+    typedef uint32_t result_type;
+
+    static constexpr uint64_t default_seed = 20111115u;
+
+    /**
+     * Construct an engine.
+     * @param seed The key.
+     * @param stream The stream number.
+     */
+    explicit Philox4x32(uint64_t seed = default_seed, uint64_t stream = 0) { this->seed( seed, stream ); }
+
+    void seed(uint64_t seed = default_seed, uint64_t stream = 0);
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+    result_type operator()();
+
+    /**
+     * Advance the engine by @p n numbers in constant time.
+     * @param n
+     */
+    void discard(unsigned long long n);
+
+    /**
+     * Fill a buffer with the next @p n numbers of the sequence, which is
+     * equivalent to, but faster than, @p n subsequent calls of operator().
+     * Complete blocks are generated from independent counters in a loop,
+     * which the compiler can vectorize.
+     * @param[out] result
+     * @param n
+     */
+    void Generate(result_type* result, size_t n);
+
+    uint64_t GetKey() const { return fKey; }
+    uint64_t GetStream() const { return fStream; }
+
+    /**
+     * Get the number of the next block.
+     * @return
+     */
+    uint64_t GetPosition() const { return fPosition; }
+
+    /**
+     * Calculate the block of four numbers at the given counter.
+     * @param key
+     * @param stream
+     * @param position
+     * @param[out] result
+     */
+    static void Block(uint64_t key, uint64_t stream, uint64_t position, result_type* result);
+
+    friend bool operator==(const Philox4x32& lhs, const Philox4x32& rhs);
+    friend std::ostream& operator<<(std::ostream& os, const Philox4x32& engine);
+    friend std::istream& operator>>(std::istream& is, Philox4x32& engine);
+
+private:
+    uint64_t fKey;
+    uint64_t fStream;
+    uint64_t fPosition; // of the next block
+    std::array<result_type, 4> fBlock; // the previous block
+    uint32_t fIndex; // of the next number in the previous block
+};
+
+inline void Philox4x32::seed(uint64_t seed, uint64_t stream)
+{
+    fKey = seed;
+    fStream = stream;
+    fPosition = 0;
+    fBlock.fill( 0 );
+    fIndex = 4;
+}
+
+inline void Philox4x32::Block(uint64_t key, uint64_t stream, uint64_t position, result_type* result)
+{
+    uint32_t c0 = (uint32_t) position;
+    uint32_t c1 = (uint32_t) (position >> 32);
+    uint32_t c2 = (uint32_t) stream;
+    uint32_t c3 = (uint32_t) (stream >> 32);
+    uint32_t k0 = (uint32_t) key;
+    uint32_t k1 = (uint32_t) (key >> 32);
+
+    for (int round = 0; round < 10; round++) {
+        const uint64_t p0 = (uint64_t) 0xD2511F53u * c0;
+        const uint64_t p1 = (uint64_t) 0xCD9E8D57u * c2;
+
+        c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t) p1;
+        c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t) p0;
+
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+
+    result[0] = c0;
+    result[1] = c1;
+    result[2] = c2;
+    result[3] = c3;
+}
+
+inline auto Philox4x32::operator()() -> result_type
+{
+    if (fIndex == 4) {
+        Block( fKey, fStream, fPosition++, fBlock.data() );
+        fIndex = 0;
+    }
+    return fBlock[fIndex++];
+}
+
+inline void Philox4x32::discard(unsigned long long n)
+{
+    const uint32_t nBuffered = 4 - fIndex;
+    if (n <= nBuffered) {
+        fIndex += (uint32_t) n;
+        return;
+    }
+
+    n -= nBuffered;
+    fPosition += n / 4;
+    fIndex = 4;
+
+    if (n % 4 != 0) {
+        Block( fKey, fStream, fPosition++, fBlock.data() );
+        fIndex = (uint32_t) (n % 4);
+    }
+}
+
+inline void Philox4x32::Generate(result_type* result, size_t n)
+{
+    while (n > 0 && fIndex < 4) {
+        *result++ = fBlock[fIndex++];
+        n--;
+    }
+
+    const size_t nBlocks = n / 4;
+    for (size_t b = 0; b < nBlocks; b++)
+        Block( fKey, fStream, fPosition + b, result + 4*b );
+    fPosition += nBlocks;
+
+    for (size_t i = 4*nBlocks; i < n; i++)
+        result[i] = (*this)();
+}
+
+inline bool operator==(const Philox4x32& lhs, const Philox4x32& rhs)
+{
+    return lhs.fKey == rhs.fKey && lhs.fStream == rhs.fStream
+        && lhs.fPosition == rhs.fPosition && lhs.fIndex == rhs.fIndex;
+}
+
+inline bool operator!=(const Philox4x32& lhs, const Philox4x32& rhs)
+{
+    return !(lhs == rhs);
+}
+
+inline std::ostream& operator<<(std::ostream& os, const Philox4x32& engine)
+{
+    return os << engine.fKey << ' ' << engine.fStream << ' '
+        << engine.fPosition << ' ' << engine.fIndex;
+}
+
+inline std::istream& operator>>(std::istream& is, Philox4x32& engine)
+{
+    Philox4x32 result;
+    if (is >> result.fKey >> result.fStream >> result.fPosition >> result.fIndex) {
+        if (result.fIndex > 4) {
+            is.setstate( std::ios::failbit );
+            return is;
+        }
+        // restore the previous block
+        if (result.fIndex < 4)
+            Philox4x32::Block( result.fKey, result.fStream, result.fPosition-1, result.fBlock.data() );
+        engine = result;
+    }
+    return is;
+}
+
+namespace detail
+{
+
+/**
+ * Fill a buffer with random numbers from an arbitrary engine.
+ */
+template <typename EngineT>
+inline void GenerateBits(EngineT& engine, typename EngineT::result_type* result, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        result[i] = engine();
+}
+
+/**
+ * @overload
+ */
+inline void GenerateBits(Philox4x32& engine, Philox4x32::result_type* result, size_t n)
+{
+    engine.Generate( result, n );
+}
+
+} /* namespace detail */
+
 /**
  * A thread-safe interface for STL style pesudo random number generators (PRNG).
  * Each thread accesses it's own static instance of a PRNG, which is
@@ -37,6 +258,10 @@ namespace ublas = boost::numeric::ublas;
  * In order for each new PRNG instance to be constructed with a new seed, a
  * global variable Random::sSeed (initially to be set with Random::Seed),
  * is incremented and used in each PRNG's constructor.
+ *
+ * Since threads are scheduled non-deterministically, sampling chains own
+ * their engines (see Algorithm::CreateStream()) and temporarily bind them
+ * to the instance of the executing thread with a ScopedEngine.
  * @tparam EngineT Underlying random number generator (e.g. std::mt19937).
  */
 template <typename EngineT>
@@ -59,6 +284,31 @@ public:
      */
     static RandomPrototype& Instance();
 
+    /**
+     * Binds an engine to the instance of the current thread for the lifetime
+     * of this object, such that all numbers drawn via Instance() in this
+     * scope are taken from that engine.
+     * Without thread_local support (NO_TLS), binding is not thread-safe.
+     */
+    class ScopedEngine
+    {
+    public:
+        explicit ScopedEngine(engine_type& engine) :
+            fInstance( Instance() ),
+            fEngine( engine )
+        {
+            std::swap( fInstance.fEngine, fEngine );
+        }
+        ~ScopedEngine() { std::swap( fInstance.fEngine, fEngine ); }
+
+        ScopedEngine(const ScopedEngine& other) = delete;
+        void operator=(const ScopedEngine& other) = delete;
+
+    private:
+        RandomPrototype& fInstance;
+        engine_type& fEngine;
+    };
+
 protected:
     static std::atomic<result_type> sSeed;
 
@@ -118,6 +368,19 @@ public:
     template <typename FloatT = double>
     bool Bool(FloatT probability = 0.5);
 
+    /**
+     * Fill a buffer with random uniform numbers in the range [min, max).
+     * The numbers are calculated with 53 bit resolution from blocks of
+     * random bits generated in bulk.
+     * @param[out] result
+     * @param n
+     * @param min
+     * @param max
+     */
+    template <typename FloatT>
+    typename std::enable_if<std::is_floating_point<FloatT>::value>::type
+    Uniform(FloatT* result, size_t n, FloatT min = 0.0, FloatT max = 1.0);
+
     /**
      * Draw from a gaussian / normal distribution.
      * @param mean
@@ -127,6 +390,20 @@ public:
     template <typename FloatT = double>
     FloatT Normal(FloatT mean = 0.0, FloatT sigma = 1.0);
 
+    /**
+     * Fill a buffer (e.g. the noise of a proposal) with draws from a normal
+     * distribution.
+     * The numbers are calculated pairwise by the Box-Muller transformation
+     * from blocks of random bits generated in bulk. For an odd @p n, the
+     * last pair is incomplete and its second number is discarded.
+     * @param[out] result
+     * @param n
+     * @param mean
+     * @param sigma
+     */
+    template <typename FloatT>
+    void Normal(FloatT* result, size_t n, FloatT mean = 0.0, FloatT sigma = 1.0);
+
     template <typename FloatT = double>
     FloatT StudentT(FloatT n = 1.0, FloatT mean = 0.0, FloatT sigma = 1.0);
 
@@ -186,6 +463,21 @@ public:
     template <typename DistributionT, typename VectorT, typename MatrixT>
     VectorT FromMultiVariateDistribution(DistributionT& dist, const VectorT& mean, const MatrixT& cholesky);
 
+    /**
+     * Draw from a custom multivariate distribution into preallocated buffers.
+     * This overload does not allocate any memory, if @p noise and @p result
+     * already match the size of @p mean.
+     * @param dist
+     * @param mean A vector of mean values.
+     * @param cholesky The lower triangular matrix cholesky decomposition of
+     * the covariance matrix.
+     * @param[out] noise Scratch buffer for the uncorrelated random values.
+     * @param[out] result The drawn vector. Must not alias @p mean.
+     */
+    template <typename DistributionT, typename VectorT, typename MatrixT>
+    void FromMultiVariateDistribution(DistributionT& dist, const VectorT& mean, const MatrixT& cholesky,
+        VectorT& noise, VectorT& result);
+
     /**
      * Draw from a custom multivariate distribution without correlations.
      * @param dist
@@ -207,6 +499,12 @@ public:
     result_type operator()();
 
 private:
+    /**
+     * Convert 64 random bits into a uniform number in the open interval
+     * (0, 1) with 53 bit resolution.
+     */
+    static double ToUnitInterval(uint32_t hi, uint32_t lo);
+
     engine_type fEngine;
 };
 
@@ -329,6 +627,66 @@ inline FloatT RandomPrototype<EngineT>::Normal(FloatT mean, FloatT sigma)
     return std::normal_distribution<FloatT>(mean, sigma)(*this);
 }
 
+template <typename EngineT>
+inline double RandomPrototype<EngineT>::ToUnitInterval(uint32_t hi, uint32_t lo)
+{
+    static_assert(engine_type::min() == 0 && engine_type::max() == 0xFFFFFFFFu,
+        "The bulk API requires an engine with 32 random bits per number.");
+
+    const uint64_t bits = ((uint64_t) hi << 21) ^ (lo >> 11);
+    return ((double) bits + 0.5) / 9007199254740992.0; // 2^53
+}
+
+template <typename EngineT>
+template <typename FloatT>
+typename std::enable_if<std::is_floating_point<FloatT>::value>::type
+inline RandomPrototype<EngineT>::Uniform(FloatT* result, size_t n, FloatT min, FloatT max)
+{
+    constexpr size_t kChunk = 128;
+    result_type bits[2 * kChunk];
+
+    for (size_t first = 0; first < n; first += kChunk) {
+        const size_t m = std::min( n - first, kChunk );
+
+        detail::GenerateBits( fEngine, bits, 2 * m );
+
+        for (size_t i = 0; i < m; i++) {
+            // map (0, 1) to [min, max), excluding the rounded upper bound
+            const FloatT u = (FloatT) ToUnitInterval( bits[2*i], bits[2*i+1] );
+            const FloatT value = min + (max - min) * u;
+            result[first + i] = (value < max) ? value : min;
+        }
+    }
+}
+
+template <typename EngineT>
+template <typename FloatT>
+inline void RandomPrototype<EngineT>::Normal(FloatT* result, size_t n, FloatT mean, FloatT sigma)
+{
+    constexpr size_t kChunk = 128; // numbers per chunk
+    result_type bits[2 * kChunk];
+
+    for (size_t first = 0; first < n; first += kChunk) {
+        const size_t m = std::min( n - first, kChunk );
+        const size_t nPairs = (m + 1) / 2;
+
+        detail::GenerateBits( fEngine, bits, 4 * nPairs );
+
+        FloatT* out = result + first;
+        for (size_t p = 0; p < nPairs; p++) {
+            const double u1 = ToUnitInterval( bits[4*p], bits[4*p+1] );
+            const double u2 = ToUnitInterval( bits[4*p+2], bits[4*p+3] );
+
+            const double r = sqrt( -2.0 * log(u1) );
+            const double phi = 6.283185307179586 * u2; // 2 pi
+
+            out[2*p] = mean + sigma * (FloatT) (r * cos(phi));
+            if (2*p+1 < m)
+                out[2*p+1] = mean + sigma * (FloatT) (r * sin(phi));
+        }
+    }
+}
+
 template <typename EngineT>
 template <typename DistributionT>
 inline typename DistributionT::result_type RandomPrototype<EngineT>::FromDistribution(DistributionT& dist)
@@ -339,16 +697,40 @@ inline typename DistributionT::result_type RandomPrototype<EngineT>::FromDistrib
 template <typename EngineT>
 template <typename DistributionT, typename VectorT, typename MatrixT>
 inline VectorT RandomPrototype<EngineT>::FromMultiVariateDistribution(DistributionT& dist, const VectorT& mean, const MatrixT& cholesky)
+{
+    VectorT noise( mean.size() );
+    VectorT result( mean.size() );
+
+    FromMultiVariateDistribution( dist, mean, cholesky, noise, result );
+
+    return result;
+}
+
+template <typename EngineT>
+template <typename DistributionT, typename VectorT, typename MatrixT>
+inline void RandomPrototype<EngineT>::FromMultiVariateDistribution(DistributionT& dist, const VectorT& mean,
+    const MatrixT& cholesky, VectorT& noise, VectorT& result)
 {
     LOG_DEFINE("vmcmc.random");
     LOG_ASSERT( mean.size() == cholesky.size1() );
 
-    VectorT noise( mean.size() );
+    if (noise.size() != mean.size())
+        noise.resize( mean.size(), false );
+    if (result.size() != mean.size())
+        result.resize( mean.size(), false );
 
     for (size_t i = 0; i < noise.size(); ++i)
         noise[i] = dist(*this);
 
-    return mean + ublas::prod(noise, cholesky);
+    // result = mean + prod(cholesky, noise), such that the covariance is
+    // L L^T, evaluated explicitly on the lower triangle (ublas creates a
+    // temporary for the product)
+    for (size_t j = 0; j < result.size(); ++j) {
+        double sum = 0.0;
+        for (size_t i = 0; i <= j; ++i)
+            sum += cholesky(j, i) * noise[i];
+        result[j] = mean[j] + sum;
+    }
 }
 
 template <typename EngineT>
@@ -402,9 +784,10 @@ inline IndexType RandomPrototype<EngineT>::Discrete(const ProbRangeT& probabilit
 
 
 /**
- * Typedef for the default random number generator, based on the Mersenne Twister.
+ * Typedef for the default random number generator, based on the counter-based
+ * Philox engine.
  */
-using Random = RandomPrototype<std::mt19937>;
+using Random = RandomPrototype<Philox4x32>;
 
 } /* namespace vmcmc */
 
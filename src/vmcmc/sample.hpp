@@ -18,6 +18,7 @@
 #include <vmcmc/numeric.hpp>
 
 #include <initializer_list>
+#include <utility>
 
 namespace vmcmc
 {
@@ -65,7 +66,14 @@ public:
     double GetPrior() const { return fPrior; }
 
     void SetAccepted(bool value) { fAccepted = value; }
-    double IsAccepted() const { return fAccepted; }
+    bool IsAccepted() const { return fAccepted; }
+
+    /**
+     * Exchange the contents of two samples without reallocating their
+     * parameter values.
+     * @param other
+     */
+    void swap(Sample& other);
 
     void operator+= (const Sample& other);
     void operator-= (const Sample& other);
@@ -140,6 +148,21 @@ inline void Sample::operator/= (double factor)
     Reset();
 }
 
+inline void Sample::swap(Sample& other)
+{
+    std::swap( fGeneration, other.fGeneration );
+    fParameterValues.swap( other.fParameterValues );
+    std::swap( fLikelihood, other.fLikelihood );
+    std::swap( fNegLogLikelihood, other.fNegLogLikelihood );
+    std::swap( fPrior, other.fPrior );
+    std::swap( fAccepted, other.fAccepted );
+}
+
+inline void swap(Sample& s1, Sample& s2)
+{
+    s1.swap( s2 );
+}
+
 inline bool Sample::operator!= (const Sample& other) const
 {
     return fParameterValues != other.fParameterValues;
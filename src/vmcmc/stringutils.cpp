@@ -11,6 +11,7 @@
 
 #include <vmcmc/stringutils.hpp>
 #include <vmcmc/sample.hpp>
+#include <vmcmc/chain.hpp>
 
 using namespace std;
 
@@ -23,4 +24,11 @@ ostream& operator<< (ostream& strm, const Sample& sample)
     return strm;
 }
 
+ostream& operator<< (ostream& strm, const SampleView& sample)
+{
+    strm << sample.Values() << " " << sample.GetPrior()
+         << " (" << sample.GetLikelihood() << ", " << sample.GetNegLogLikelihood() << ")";
+    return strm;
+}
+
 }
@@ -23,6 +23,7 @@ namespace vmcmc
 {
 
 class Sample;
+class SampleView;
 
 /**
  * Join an STL style container and output to a stream with its values joined by
@@ -76,6 +77,14 @@ inline std::string join(const SequenceT& sequence, const SeparatorT& separator,
  */
 std::ostream& operator<< (std::ostream& strm, const Sample& sample);
 
+/**
+ * Custom stream operator overload for SampleView.
+ * @param strm
+ * @param sample
+ * @return
+ */
+std::ostream& operator<< (std::ostream& strm, const SampleView& sample);
+
 /**
  * Serialize any STL pair to an output stream.
  * @param strm An output stream.
@@ -24,7 +24,8 @@ namespace vmcmc {
  *
  * This typetrait checks whether the passed template argument is an STL-like
  * container. In that case, the static ::value member variable evaluates
- * to true.
+ * to true. Containers with proxy iterators, dereferencing to their value_type
+ * by value (like vmcmc::Chain), are accepted as well.
  * Inspired by http://stackoverflow.com/a/16316640/6908762.
  */
 template<typename T>
@@ -57,8 +58,9 @@ struct is_container
             ( std::is_same<decltype(pt->end()),iterator>::value   || std::is_same<decltype(pt->end()),const_iterator>::value  ) &&
               std::is_same<decltype(cpt->begin()),const_iterator>::value &&
               std::is_same<decltype(cpt->end()),const_iterator>::value &&
-            ( std::is_same<decltype(**pi),value_type &>::value    || std::is_same<decltype(**pi),value_type const &>::value   ) &&
-              std::is_same<decltype(**pci),value_type const &>::value;
+            ( std::is_same<decltype(**pi),value_type &>::value    || std::is_same<decltype(**pi),value_type const &>::value   ||
+              std::is_same<decltype(**pi),value_type>::value ) &&
+            ( std::is_same<decltype(**pci),value_type const &>::value || std::is_same<decltype(**pci),value_type>::value );
     }
 
     template<typename A>
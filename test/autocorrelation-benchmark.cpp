@@ -0,0 +1,95 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief Compares the FFT based autocorrelation time estimate with the
+ * lag-by-lag calculation on a long chain.
+ */
+
+#include <vmcmc/chain.hpp>
+#include <vmcmc/random.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+using namespace vmcmc;
+
+namespace {
+
+/**
+ * Fill a chain with an AR(1) process x_t = phi x_{t-1} + e_t, which has the
+ * integrated autocorrelation time (1 + phi) / (1 - phi).
+ */
+Chain makeAR1Chain(size_t length, double phi)
+{
+    Random::Instance().Seed(123);
+
+    Chain chain( 1 );
+    chain.reserve( length );
+
+    Sample sample( 1 );
+    double x = 0.0;
+
+    for (size_t t = 0; t < length; t++) {
+        x = phi * x + Random::Instance().Normal();
+        sample[0] = x;
+        sample.SetGeneration( t );
+        chain.push_back( sample );
+    }
+
+    return chain;
+}
+
+template<class FunctionT>
+double measureSeconds(FunctionT function)
+{
+    const auto start = chrono::steady_clock::now();
+    function();
+    return chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+}
+
+} /* anonymous namespace */
+
+TEST(AutoCorrelationBenchmark, FFTvsLagByLag)
+{
+    const double phi = 0.99;
+    const Chain chain = makeAR1Chain( 1000000, phi );
+
+    // the previous implementation: sum up the lags until the correlation
+    // stays below a threshold
+    double lagByLagTime = 0.0;
+    const double lagByLagSeconds = measureSeconds( [&]() {
+        ChainStatistics stats( chain );
+
+        size_t cThresholdMaintained = 0;
+        for (size_t lag = 1; lag < chain.size(); lag++) {
+            const double ac = stats.GetAutoCorrelation(lag)[0];
+            lagByLagTime += ac;
+
+            if (fabs(ac) < 0.01 && ++cThresholdMaintained >= 3)
+                break;
+        }
+        lagByLagTime = 1.0 + 2.0 * lagByLagTime;
+    } );
+
+    double fftTime = 0.0;
+    const double fftSeconds = measureSeconds( [&]() {
+        ChainStatistics stats( chain );
+        fftTime = stats.GetAutoCorrelationTime()[0];
+    } );
+
+    cout << "Lag-by-lag: tau = " << lagByLagTime << " (" << lagByLagSeconds << " s)" << endl;
+    cout << "FFT:        tau = " << fftTime << " (" << fftSeconds << " s)" << endl;
+
+    const double expected = (1.0 + phi) / (1.0 - phi);
+    EXPECT_NEAR( expected, fftTime, 0.2 * expected );
+    EXPECT_LT( fftSeconds, lagByLagSeconds );
+}
@@ -60,6 +60,46 @@ TEST(BLAS, CholeskyDecomposition)
     ASSERT_EQ( 4, choleskyDecompose(cov, cholesky) ) << "Cholesky decomposition should have failed.";
 }
 
+TEST(BLAS, CholeskyUpdate)
+{
+    constexpr size_t N = 4;
+
+    Matrix cov(N, N);
+    for (size_t i = 0; i < N; ++i)
+        for (size_t j = 0; j < N; ++j)
+            cov(i, j) = (i == j) ? 2.0 + (double) i : 0.3 / (1.0 + i + j);
+
+    MatrixLower cholesky(N, N);
+    ASSERT_EQ( 0, choleskyDecompose(cov, cholesky) );
+
+    const Vector x( {0.5, -1.0, 2.0, 0.1} );
+    const Matrix updated = cov + ublas::outer_prod(x, x);
+
+    // rank-1 update
+    Vector scratch = x;
+    ASSERT_EQ( 0, choleskyUpdate(cholesky, scratch) );
+
+    MatrixLower expected(N, N);
+    ASSERT_EQ( 0, choleskyDecompose(updated, expected) );
+
+    for (size_t i = 0; i < N; ++i)
+        for (size_t j = 0; j <= i; ++j)
+            ASSERT_NEAR( expected(i, j), cholesky(i, j), 1E-12 );
+
+    // downdate back to the original matrix
+    scratch = x;
+    ASSERT_EQ( 0, choleskyUpdate(cholesky, scratch, true) );
+
+    ASSERT_EQ( 0, choleskyDecompose(cov, expected) );
+    for (size_t i = 0; i < N; ++i)
+        for (size_t j = 0; j <= i; ++j)
+            ASSERT_NEAR( expected(i, j), cholesky(i, j), 1E-12 );
+
+    // a downdate resulting in an indefinite matrix fails
+    scratch = Vector( {0.0, 0.0, 3.0, 0.0} );
+    ASSERT_EQ( 3, choleskyUpdate(cholesky, scratch, true) );
+}
+
 TEST(BLAS, Vector)
 {
     Vector v1( {0.0, 1.0, 2.0} );
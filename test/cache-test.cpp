@@ -0,0 +1,104 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/cache.hpp>
+
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace vmcmc;
+
+TEST(LikelihoodCache, FindAndInsert)
+{
+    LikelihoodCache cache( 100, 2 );
+
+    const double point[2] = { 1.0, -2.0 };
+    double likelihood = 0.0, negLogLikelihood = 0.0;
+
+    ASSERT_FALSE( cache.Find( point, likelihood, negLogLikelihood ) );
+
+    cache.Insert( point, exp(-2.5), 2.5 );
+
+    ASSERT_TRUE( cache.Find( point, likelihood, negLogLikelihood ) );
+    ASSERT_EQ( exp(-2.5), likelihood );
+    ASSERT_EQ( 2.5, negLogLikelihood );
+
+    // keys are compared exactly
+    const double neighbour[2] = { 1.0, nextafter( -2.0, 0.0 ) };
+    ASSERT_FALSE( cache.Find( neighbour, likelihood, negLogLikelihood ) );
+
+    ASSERT_EQ( 1U, cache.GetHits() );
+    ASSERT_EQ( 2U, cache.GetMisses() );
+
+    cache.clear();
+    ASSERT_FALSE( cache.Find( point, likelihood, negLogLikelihood ) );
+    ASSERT_EQ( 0U, cache.GetHits() );
+    ASSERT_EQ( 1U, cache.GetMisses() );
+}
+
+TEST(LikelihoodCache, BoundedCapacity)
+{
+    LikelihoodCache cache( 64, 1, 8 );
+    ASSERT_EQ( 64U, cache.GetCapacity() );
+
+    const size_t nPoints = 1000;
+
+    for (size_t i = 0; i < nPoints; i++) {
+        const double x = i;
+        cache.Insert( &x, 0.0, (double) i );
+    }
+
+    size_t nFound = 0;
+
+    for (size_t i = 0; i < nPoints; i++) {
+        const double x = i;
+        double likelihood, negLogLikelihood;
+        if (cache.Find( &x, likelihood, negLogLikelihood )) {
+            ASSERT_EQ( (double) i, negLogLikelihood );
+            nFound++;
+        }
+    }
+
+    ASSERT_GT( nFound, 0U );
+    ASSERT_LE( nFound, cache.GetCapacity() );
+}
+
+TEST(LikelihoodCache, MultiThreading)
+{
+    LikelihoodCache cache( 4096, 3 );
+
+    const size_t nThreads = 4;
+    const size_t nPoints = 1000;
+
+    // all threads evaluate the same points, storing consistent results
+    auto work = [&]() {
+        for (size_t i = 0; i < nPoints; i++) {
+            const double point[3] = { (double) i, 0.5 * i, -1.0 };
+            double likelihood, negLogLikelihood;
+            if (cache.Find( point, likelihood, negLogLikelihood ))
+                ASSERT_EQ( 1.5 * i, negLogLikelihood );
+            else
+                cache.Insert( point, exp(-1.5 * i), 1.5 * i );
+        }
+    };
+
+    vector<thread> threads;
+    for (size_t i = 0; i < nThreads; i++)
+        threads.emplace_back( work );
+    for (thread& t : threads)
+        t.join();
+
+    ASSERT_EQ( nThreads * nPoints, cache.GetHits() + cache.GetMisses() );
+    ASSERT_GE( cache.GetMisses(), nPoints / 2 );
+}
@@ -9,7 +9,9 @@
  */
 
 #include <vmcmc/chain.hpp>
+#include <vmcmc/exception.hpp>
 #include <gtest/gtest.h>
+#include <fstream>
 
 using namespace std;
 using namespace vmcmc;
@@ -84,3 +86,404 @@ TEST(Chain, CovarianceMatrix)
     ASSERT_DOUBLE_EQ( 1.0, cov(1, 1) );
     ASSERT_DOUBLE_EQ( 1.0, cov(2, 2) );
 }
+
+TEST(Chain, ColumnarStorage)
+{
+    // use a tiny block size to cross several block boundaries
+    Chain testChain( 3, 4 );
+    ASSERT_EQ( 4, testChain.GetBlockSize() );
+
+    testChain.reserve( 10 );
+    ASSERT_EQ( 12, testChain.capacity() );
+    ASSERT_TRUE( testChain.empty() );
+
+    Sample testSample{ 0.0, 1.0, 2.0 };
+    for (size_t i = 0; i < 10; i++) {
+        testSample = { (double) i, 1.0, -(double) i };
+        testSample.SetGeneration( i );
+        testSample.SetNegLogLikelihood( 0.5 * i );
+        testSample.SetAccepted( i % 2 == 0 );
+        testChain.push_back( testSample );
+    }
+
+    ASSERT_EQ( 10, testChain.size() );
+    ASSERT_EQ( 12, testChain.capacity() );
+
+    for (size_t i = 0; i < testChain.size(); i++) {
+        const SampleView view = testChain[i];
+        ASSERT_EQ( i, view.GetGeneration() );
+        ASSERT_EQ( 3, view.size() );
+        ASSERT_DOUBLE_EQ( (double) i, view[0] );
+        ASSERT_DOUBLE_EQ( -(double) i, view.Values()[2] );
+        ASSERT_DOUBLE_EQ( 0.5 * i, view.GetNegLogLikelihood() );
+        ASSERT_EQ( i % 2 == 0, view.IsAccepted() );
+    }
+
+    ASSERT_EQ( (Sample{ 9.0, 1.0, -9.0 }), testChain.back() );
+
+    testSample = { 5.0, 5.0, 5.0 };
+    testSample.SetGeneration( 5 );
+    testChain.SetSample( 5, testSample );
+    ASSERT_EQ( testSample, testChain.GetSample(5) );
+
+    Chain copiedChain( testChain );
+    ASSERT_EQ( testChain.size(), copiedChain.size() );
+    ASSERT_EQ( testChain.GetSample(7), copiedChain.GetSample(7) );
+
+    size_t count = 0;
+    for (const SampleView& view : copiedChain)
+        ASSERT_EQ( count++, view.GetGeneration() );
+    ASSERT_EQ( 10, count );
+}
+
+TEST(Chain, CompressedRejections)
+{
+    Chain plainChain( 2, 4 );
+    Chain compressedChain( 2, 4 );
+    compressedChain.SetCompressed( true );
+
+    // runs of rejected steps with varying lengths
+    const vector<size_t> runLengths{ 1, 3, 1, 6, 2, 1, 4 };
+
+    Sample testSample( 2 );
+    size_t generation = 0;
+
+    for (size_t r = 0; r < runLengths.size(); r++) {
+        testSample = { (double) r, 0.5 * (double) (r*r) };
+        testSample.SetNegLogLikelihood( 10.0 - (double) r );
+        testSample.SetAccepted( true );
+
+        for (size_t k = 0; k < runLengths[r]; k++) {
+            testSample.SetGeneration( generation++ );
+            plainChain.push_back( testSample );
+            compressedChain.push_back( testSample );
+            testSample.SetAccepted( false );
+        }
+    }
+
+    ASSERT_EQ( plainChain.size(), compressedChain.size() );
+    ASSERT_EQ( plainChain.size(), plainChain.NumberOfRuns() );
+    ASSERT_EQ( runLengths.size(), compressedChain.NumberOfRuns() );
+    ASSERT_EQ( 3, compressedChain.GetRunLength(1) );
+
+    for (size_t i = 0; i < plainChain.size(); i++)
+        ASSERT_EQ( plainChain.GetSample(i), compressedChain.GetSample(i) );
+
+    ChainStatistics plainStats( plainChain );
+    ChainStatistics compressedStats( compressedChain );
+
+    for (const auto& range : vector<pair<ptrdiff_t, ptrdiff_t>>{ {0, -1}, {2, 13}, {5, -3} }) {
+        plainStats.SelectRange( range.first, range.second );
+        compressedStats.SelectRange( range.first, range.second );
+
+        ASSERT_EQ( plainStats.GetMode(), compressedStats.GetMode() );
+        ASSERT_EQ( plainStats.GetMean(), compressedStats.GetMean() );
+        ASSERT_DOUBLE_EQ( plainStats.GetMedian(1), compressedStats.GetMedian(1) );
+        ASSERT_DOUBLE_EQ( plainStats.GetAccRate(), compressedStats.GetAccRate() );
+
+        for (size_t p = 0; p < 2; p++) {
+            ASSERT_NEAR( plainStats.GetVariance()[p], compressedStats.GetVariance()[p], 1E-12 );
+            ASSERT_NEAR( plainStats.GetRms()[p], compressedStats.GetRms()[p], 1E-12 );
+            ASSERT_NEAR( plainStats.GetAutoCorrelation(3)[p], compressedStats.GetAutoCorrelation(3)[p], 1E-12 );
+        }
+
+        ASSERT_NEAR( plainStats.GetCovarianceMatrix()(1, 0), compressedStats.GetCovarianceMatrix()(1, 0), 1E-12 );
+        ASSERT_EQ( plainStats.GetConfidenceInterval(0, 3.0, 0.68), compressedStats.GetConfidenceInterval(0, 3.0, 0.68) );
+    }
+
+    Chain copiedChain( compressedChain );
+    ASSERT_EQ( compressedChain.NumberOfRuns(), copiedChain.NumberOfRuns() );
+    for (size_t i = 0; i < plainChain.size(); i++)
+        ASSERT_EQ( plainChain.GetSample(i), copiedChain.GetSample(i) );
+
+    // overwriting the tail splits it off the last run
+    testSample = { -1.0, -1.0 };
+    testSample.SetGeneration( generation-1 );
+    compressedChain.SetSample( compressedChain.size()-1, testSample );
+
+    ASSERT_EQ( runLengths.size() + 1, compressedChain.NumberOfRuns() );
+    ASSERT_EQ( testSample, compressedChain.back() );
+    ASSERT_EQ( 3, compressedChain.GetRunLength( compressedChain.NumberOfRuns()-2 ) );
+
+    ASSERT_THROW( compressedChain.SetSample( 2, testSample ), Exception );
+    ASSERT_THROW( compressedChain.SetCompressed( false ), Exception );
+}
+
+TEST(Chain, OnlineStatistics)
+{
+    Chain testChain( 3, 8 );
+    testChain.SetCompressed( true );
+
+    Sample testSample( 3 );
+    for (size_t i = 0; i < 50; i++) {
+        // every third step is rejected
+        if (i % 3 != 2)
+            testSample = { sin( (double) i ), 0.1 * (double) i, cos( 0.3 * (double) i ) };
+        testSample.SetGeneration( i );
+        testSample.SetAccepted( i % 3 != 2 );
+        testChain.push_back( testSample );
+    }
+
+    // accumulate in two portions
+    OnlineStatistics online;
+    online.Add( testChain, 0 );
+    ASSERT_EQ( 3, online.NumberOfParams() );
+
+    for (size_t i = 50; i < 60; i++) {
+        testSample = { (double) i, 1.0, -1.0 };
+        testSample.SetGeneration( i );
+        testSample.SetAccepted( true );
+        testChain.push_back( testSample );
+    }
+    online.Add( testChain, 50 );
+
+    ChainStatistics stats( testChain );
+
+    ASSERT_EQ( 60, online.GetCount() );
+    ASSERT_DOUBLE_EQ( stats.GetAccRate(), online.GetAccRate() );
+
+    for (size_t p = 0; p < 3; p++) {
+        ASSERT_NEAR( stats.GetMean()[p], online.GetMean()[p], 1E-12 );
+        ASSERT_NEAR( stats.GetVariance()[p], online.GetVariance()[p], 1E-12 );
+        ASSERT_NEAR( stats.GetRms()[p], online.GetRms()[p], 1E-12 );
+
+        for (size_t q = 0; q <= p; q++)
+            ASSERT_NEAR( stats.GetCovarianceMatrix()(p, q), online.GetCovarianceMatrix()(p, q), 1E-12 );
+    }
+
+    online.Reset();
+    ASSERT_EQ( 0, online.GetCount() );
+    ASSERT_EQ( 3, online.NumberOfParams() );
+    ASSERT_EQ( 0.0, online.GetAccRate() );
+}
+
+TEST(Chain, AutoCorrelationFunction)
+{
+    Chain plainChain( 1 );
+    Chain compressedChain( 1 );
+    compressedChain.SetCompressed( true );
+
+    Sample testSample( 1 );
+    for (size_t i = 0; i < 200; i++) {
+        if (i % 4 != 3)
+            testSample = { sin( 0.2 * (double) i ) };
+        testSample.SetGeneration( i );
+        testSample.SetAccepted( i % 4 != 3 );
+
+        plainChain.push_back( testSample );
+        compressedChain.push_back( testSample );
+    }
+
+    ChainStatistics plainStats( plainChain );
+    ChainStatistics compressedStats( compressedChain );
+
+    plainStats.SelectRange( 10, -1 );
+    compressedStats.SelectRange( 10, -1 );
+
+    const vector<double>& plainRho = plainStats.GetAutoCorrelationFunction(0);
+    const vector<double>& compressedRho = compressedStats.GetAutoCorrelationFunction(0);
+
+    ASSERT_EQ( 190, plainRho.size() );
+    ASSERT_EQ( plainRho.size(), compressedRho.size() );
+    ASSERT_DOUBLE_EQ( 1.0, plainRho[0] );
+
+    // the FFT estimate matches the lag-by-lag estimate up to its normalization
+    for (size_t lag = 1; lag < 20; lag++) {
+        ASSERT_NEAR( plainRho[lag], compressedRho[lag], 1E-12 );
+
+        const double rescaled = plainRho[lag] * 190.0 / (double) (190 - lag) * 189.0 / 190.0;
+        ASSERT_NEAR( plainStats.GetAutoCorrelation(lag)[0], rescaled, 1E-9 );
+    }
+
+    ASSERT_NEAR( plainStats.GetAutoCorrelationTime()[0], compressedStats.GetAutoCorrelationTime()[0], 1E-9 );
+    ASSERT_GT( plainStats.GetAutoCorrelationTime()[0], 1.0 );
+}
+
+TEST(Chain, Window)
+{
+    const string spillFile = "chain-test.spill";
+
+    // blocks of 16 rows, at least 40 rows in memory (4 blocks)
+    Chain chain( 2, 16 );
+    chain.SetWindow( 40 );
+    chain.SetSpillFile( spillFile );
+
+    ASSERT_THROW( chain.SetCompressed( true ), Exception );
+
+    for (size_t i = 0; i < 1000; i++) {
+        const double values[2] = { (double) i, -(double) i };
+        chain.push_back( values, (double) i, 1.0, 1.0, i, i % 3 == 0 );
+    }
+
+    ASSERT_EQ( 1000, chain.size() );
+    ASSERT_EQ( 4 * 16, chain.capacity() - chain.GetFirstIndex() );
+    ASSERT_EQ( 59 * 16, chain.GetFirstIndex() );
+    ASSERT_LE( chain.GetFirstIndex(), 1000 - 40 );
+
+    for (size_t i = chain.GetFirstIndex(); i < chain.size(); i++) {
+        ASSERT_EQ( (double) i, chain.GetValue( i, 0 ) );
+        ASSERT_EQ( i, chain.GetGeneration( i ) );
+    }
+
+    // the statistics only cover the steps in memory
+    ChainStatistics stats( chain );
+    ASSERT_EQ( chain.GetFirstIndex(), stats.GetIndices().first );
+    ASSERT_DOUBLE_EQ( (chain.GetFirstIndex() + 999) / 2.0, stats.GetMean()[0] );
+
+    // a selection ending before the window is empty
+    stats.SelectRange( 0, 100 );
+    ASSERT_EQ( chain.GetFirstIndex(), stats.GetIndices().first );
+    ASSERT_EQ( chain.GetFirstIndex(), stats.GetIndices().second );
+    stats.SelectRange();
+
+    // the full history is restored from the spill file
+    const Chain history = chain.GetHistory();
+    ASSERT_EQ( 1000, history.size() );
+    ASSERT_EQ( 0, history.GetFirstIndex() );
+
+    for (size_t i = 0; i < history.size(); i++) {
+        ASSERT_EQ( (double) i, history.GetValue( i, 0 ) );
+        ASSERT_EQ( -(double) i, history.GetValue( i, 1 ) );
+        ASSERT_EQ( i, history.GetGeneration( i ) );
+        ASSERT_EQ( i % 3 == 0, history.IsAccepted( i ) );
+    }
+
+    ChainStatistics historyStats( history );
+    ASSERT_DOUBLE_EQ( 499.5, historyStats.GetMean()[0] );
+
+    // a windowed chain without a spill file cannot restore its history
+    Chain copy( chain );
+    ASSERT_EQ( chain.GetFirstIndex(), copy.GetFirstIndex() );
+    ASSERT_EQ( chain.back().GetGeneration(), copy.back().GetGeneration() );
+    ASSERT_THROW( copy.GetHistory(), Exception );
+
+    remove( spillFile.c_str() );
+}
+
+TEST(Chain, WindowAppendingToSpillFile)
+{
+    const string spillFile = "chain-test-append.spill";
+
+    auto fill = [](Chain& chain, size_t first, size_t n) {
+        for (size_t i = first; i < first + n; i++) {
+            const double values[2] = { (double) i, -(double) i };
+            chain.push_back( values, (double) i, 1.0, 1.0, i, true );
+        }
+    };
+
+    size_t nSpilledBytes = 0;
+    {
+        Chain interrupted( 2, 16 );
+        interrupted.SetWindow( 40 );
+        interrupted.SetSpillFile( spillFile );
+        fill( interrupted, 0, 200 );
+
+        nSpilledBytes = interrupted.SyncSpillFile();
+        ASSERT_EQ( interrupted.GetFirstIndex() * Chain::BlockBytes( 2, 16, false ) / 16, nSpilledBytes );
+
+        // the blocks spilled after the checkpoint are discarded
+        fill( interrupted, 200, 100 );
+    }
+
+    // a shorter file cannot be continued
+    Chain invalid( 2, 16 );
+    ASSERT_THROW( invalid.SetSpillFile( spillFile, 1 << 20 ), Exception );
+
+    // a resumed chain keeps the blocks of the interrupted one, also when cleared
+    Chain resumed( 2, 16 );
+    resumed.SetWindow( 40 );
+    resumed.SetSpillFile( spillFile, nSpilledBytes );
+    fill( resumed, 1000, 100 );
+    resumed.clear();
+    fill( resumed, 200, 300 );
+
+    ASSERT_EQ( 300, resumed.size() );
+    ASSERT_GT( resumed.GetFirstIndex(), 0 );
+
+    // the history only covers the resumed chain
+    const Chain history = resumed.GetHistory();
+    ASSERT_EQ( 300, history.size() );
+    for (size_t i = 0; i < history.size(); i++) {
+        ASSERT_EQ( 200 + i, history.GetGeneration( i ) );
+        ASSERT_EQ( (double) (200 + i), history.GetValue( i, 0 ) );
+    }
+
+    ifstream file( spillFile, ios::binary | ios::ate );
+    ASSERT_EQ( nSpilledBytes + resumed.GetFirstIndex() * Chain::BlockBytes( 2, 16, false ) / 16,
+        (size_t) file.tellg() );
+    file.close();
+
+    remove( spillFile.c_str() );
+}
+
+TEST(Chain, Rewind)
+{
+    Chain chain( 1, 16 );
+
+    for (size_t i = 0; i < 100; i++) {
+        const double value = (double) i;
+        chain.push_back( &value, 0.0, 1.0, 1.0, i, true );
+    }
+
+    const size_t capacity = chain.capacity();
+    const double* storage = chain.GetValues( 0 );
+
+    // the blocks are reused for the following rows
+    chain.Rewind();
+    ASSERT_EQ( 0, chain.size() );
+    ASSERT_EQ( 0, chain.GetNumberOfSteps() );
+    ASSERT_EQ( capacity, chain.capacity() );
+
+    const double value = 42.0;
+    chain.push_back( &value, 0.0, 1.0, 1.0, 0, true );
+    ASSERT_EQ( storage, chain.GetValues( 0 ) );
+    ASSERT_EQ( 42.0, chain.GetValue(0, 0) );
+
+    chain.clear();
+    ASSERT_EQ( 0, chain.capacity() );
+}
+
+TEST(Chain, Thinning)
+{
+    Chain chain( 1 );
+    chain.SetThinning( 100, 10 );
+
+    for (size_t i = 0; i <= 1000; i++) {
+        const double value = (double) i;
+        chain.push_back( &value, 0.0, 1.0, 1.0, i, i % 4 == 0 );
+        ASSERT_EQ( i >= 100 && i % 10 == 0, chain.IsLastStepStored() );
+    }
+
+    ASSERT_THROW( chain.SetThinning( 0, 1 ), Exception );
+
+    // steps 100, 110, ... 1000
+    ASSERT_EQ( 91, chain.size() );
+    ASSERT_EQ( 1001, chain.GetNumberOfSteps() );
+    ASSERT_EQ( 250, chain.GetNumberOfAcceptedSteps() );
+    ASSERT_DOUBLE_EQ( 0.25, chain.GetAccRate() );
+
+    for (size_t i = 0; i < chain.size(); i++) {
+        ASSERT_EQ( 100 + 10*i, chain.GetGeneration(i) );
+        ASSERT_EQ( (double) (100 + 10*i), chain.GetValue(i, 0) );
+    }
+
+    // thinned chains do not merge rejected steps into runs
+    Chain compressed( 1 );
+    compressed.SetCompressed( true );
+    compressed.SetThinning( 0, 2 );
+
+    const double value = 1.0;
+    for (size_t i = 0; i < 10; i++)
+        compressed.push_back( &value, 0.0, 1.0, 1.0, i, i == 0 );
+
+    ASSERT_EQ( 5, compressed.size() );
+    ASSERT_EQ( 5, compressed.NumberOfRuns() );
+    ASSERT_EQ( 8, compressed.GetGeneration(4) );
+
+    const Chain copy( chain );
+    ASSERT_EQ( chain.GetNumberOfSteps(), copy.GetNumberOfSteps() );
+    ASSERT_EQ( chain.GetThinning(), copy.GetThinning() );
+
+    chain.clear();
+    ASSERT_EQ( 0, chain.GetNumberOfSteps() );
+}
@@ -0,0 +1,117 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/codec.hpp>
+#include <vmcmc/exception.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+
+using namespace std;
+using namespace vmcmc;
+
+TEST(Codec, Varint)
+{
+    ASSERT_EQ( 0, codec::zigzagEncode(0) );
+    ASSERT_EQ( 1, codec::zigzagEncode(-1) );
+    ASSERT_EQ( 2, codec::zigzagEncode(1) );
+    ASSERT_EQ( numeric_limits<int64_t>::min(), codec::zigzagDecode( codec::zigzagEncode( numeric_limits<int64_t>::min() ) ) );
+    ASSERT_EQ( -12345, codec::zigzagDecode( codec::zigzagEncode(-12345) ) );
+
+    const vector<uint64_t> values = { 0, 1, 127, 128, 300, numeric_limits<uint64_t>::max() };
+
+    vector<uint8_t> buffer;
+    for (uint64_t value : values)
+        codec::putVarint( value, buffer );
+
+    ASSERT_EQ( 1+1+1+2+2+10, buffer.size() );
+
+    const uint8_t* pos = buffer.data();
+    for (uint64_t value : values)
+        ASSERT_EQ( value, codec::getVarint( pos, buffer.data() + buffer.size() ) );
+    ASSERT_EQ( buffer.data() + buffer.size(), pos );
+
+    ASSERT_THROW( codec::getVarint( pos, buffer.data() + buffer.size() ), Exception );
+}
+
+TEST(Codec, Bits)
+{
+    vector<uint8_t> buffer;
+    codec::BitWriter writer( buffer );
+    writer.Put( 1, 1 );
+    writer.Put( 0x1234567890ABCDEF, 64 );
+    writer.Put( 5, 3 );
+    writer.Flush();
+
+    ASSERT_EQ( 9, buffer.size() );
+
+    codec::BitReader reader( buffer.data(), buffer.data() + buffer.size() );
+    ASSERT_EQ( 1, reader.Get(1) );
+    ASSERT_EQ( 0x1234567890ABCDEF, reader.Get(64) );
+    ASSERT_EQ( 5, reader.Get(3) );
+    ASSERT_EQ( 0, reader.Get(4) );
+    ASSERT_THROW( reader.Get(1), Exception );
+}
+
+TEST(Codec, Deltas)
+{
+    vector<uint64_t> values;
+    for (uint64_t i = 0; i < 100; i++)
+        values.push_back( 1000000 + i - (i % 7 == 0 ? 3 : 0) );
+
+    vector<uint8_t> buffer;
+    codec::encodeDeltas( values.data(), values.size(), buffer );
+
+    // one byte per small difference
+    ASSERT_EQ( 3 + 99, buffer.size() );
+
+    vector<uint64_t> decoded( values.size() );
+    const uint8_t* pos = buffer.data();
+    codec::decodeDeltas( pos, buffer.data() + buffer.size(), decoded.size(), decoded.data() );
+    ASSERT_EQ( values, decoded );
+}
+
+TEST(Codec, Xor)
+{
+    // a chain-like column: repeated values, random walk, special values
+    vector<double> values;
+    double x = 0.5;
+    for (size_t i = 0; i < 1000; i++) {
+        if (i % 3 == 0)
+            x += sin( (double) i ) * 0.01;
+        values.push_back( x );
+    }
+    values[10] = 0.0;
+    values[11] = -numeric_limits<double>::infinity();
+    values[12] = numeric_limits<double>::max();
+    values[13] = numeric_limits<double>::denorm_min();
+    values[14] = -0.0;
+
+    vector<uint8_t> buffer;
+    codec::encodeXor( values.data(), values.size(), 1, buffer );
+
+    // repetitions are cheap
+    ASSERT_LT( buffer.size(), values.size() * sizeof(double) / 2 );
+
+    vector<double> decoded( values.size() );
+    codec::decodeXor( buffer.data(), buffer.data() + buffer.size(), decoded.size(), decoded.data(), 1 );
+
+    for (size_t i = 0; i < values.size(); i++)
+        ASSERT_EQ( 0, memcmp( &values[i], &decoded[i], sizeof(double) ) ) << i;
+
+    // strided access
+    vector<double> interleaved( 2 * values.size(), 0.0 );
+    codec::decodeXor( buffer.data(), buffer.data() + buffer.size(), values.size(), interleaved.data() + 1, 2 );
+    ASSERT_EQ( values[500], interleaved[1001] );
+
+    ASSERT_THROW( codec::decodeXor( buffer.data(), buffer.data() + 10, values.size(), decoded.data(), 1 ), Exception );
+}
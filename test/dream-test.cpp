@@ -0,0 +1,132 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/dream.hpp>
+#include <vmcmc/math.hpp>
+#include <vmcmc/random.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace vmcmc;
+
+TEST(Dream, Archive)
+{
+    Dream mcmc;
+    mcmc.SetMultiThreading(false);
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const vector<double>& p) {
+        return 0.5 * ( math::pow<2>( p[0] ) + math::pow<2>( p[1] ) );
+    } );
+
+    mcmc.SetNumberOfChains(4);
+    mcmc.SetArchiveThinning(10);
+    mcmc.SetTotalLength(1E3);
+
+    mcmc.Initialize();
+    ASSERT_EQ( 20, mcmc.GetArchiveSize() );
+
+    // the archive grows by the number of chains every 10 steps
+    mcmc.Advance(15);
+    ASSERT_EQ( 24, mcmc.GetArchiveSize() );
+    mcmc.Advance(5);
+    ASSERT_EQ( 28, mcmc.GetArchiveSize() );
+
+    for (size_t iChain = 0; iChain < 4; iChain++) {
+        const Chain& chain = mcmc.GetChain(iChain);
+        ASSERT_EQ( 21, chain.size() );
+        for (size_t i = 0; i < chain.size(); i++)
+            ASSERT_EQ( i, chain.GetGeneration(i) );
+    }
+}
+
+TEST(Dream, Run)
+{
+    Random::Instance().Seed(123);
+
+    // strongly correlated, badly scaled normal distribution
+    const double sigma[] = { 1.0, 10.0, 0.1 };
+    const double rho = 0.95;
+
+    Dream mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+    pList.SetParameter( 2, Parameter("test3", 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [&](const vector<double>& p) {
+        const double x = (p[0] - 1.0) / sigma[0];
+        const double y = p[1] / sigma[1];
+        const double z = p[2] / sigma[2];
+        return 0.5 * (x*x - 2.0*rho*x*y + y*y) / (1.0 - rho*rho) + 0.5 * z*z;
+    } );
+
+    mcmc.SetNumberOfChains(4);
+    mcmc.SetRandomizeStartPoint(true);
+    mcmc.SetTotalLength(2E4);
+
+    mcmc.Run();
+
+    ChainSetStatistics& stats = mcmc.GetStatistics();
+    ASSERT_LT( stats.GetGelmanRubin(), 1.1 );
+
+    for (size_t iChain = 0; iChain < 4; iChain++) {
+        ChainStatistics chainStats( mcmc.GetChain(iChain) );
+        chainStats.SelectPercentageRange( 0.5 );
+
+        ASSERT_NEAR( 1.0, chainStats.GetMean()[0], 0.3 );
+        ASSERT_NEAR( sigma[0], chainStats.GetError()[0], 0.3 );
+        ASSERT_NEAR( sigma[1], chainStats.GetError()[1], 3.0 );
+        ASSERT_NEAR( sigma[2], chainStats.GetError()[2], 0.03 );
+        ASSERT_NEAR( rho, chainStats.GetCorrelationMatrix()(1, 0), 0.1 );
+        ASSERT_GT( chainStats.GetAccRate(), 0.1 );
+    }
+}
+
+TEST(Dream, Bimodal)
+{
+    Random::Instance().Seed(123);
+
+    Dream mcmc;
+    mcmc.SetMultiThreading(false);
+
+    // two well separated modes of equal weight
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 5.0, -20.0, 20.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const vector<double>& p) {
+        return -log( exp( -0.5 * math::pow<2>(p[0] - 5.0) ) + exp( -0.5 * math::pow<2>(p[0] + 5.0) ) );
+    } );
+
+    mcmc.SetNumberOfChains(3);
+    mcmc.SetTotalLength(2E4);
+
+    mcmc.Run();
+
+    // each chain visits both modes
+    for (size_t iChain = 0; iChain < 3; iChain++) {
+        const Chain& chain = mcmc.GetChain(iChain);
+
+        size_t nPositive = 0;
+        for (size_t i = 0; i < chain.size(); i++)
+            if (chain.GetValue(i, 0) > 0.0)
+                nPositive++;
+
+        ASSERT_NEAR( 0.5, (double) nPositive / chain.size(), 0.15 );
+    }
+}
@@ -0,0 +1,148 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/ensemble.hpp>
+#include <vmcmc/math.hpp>
+#include <vmcmc/random.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace vmcmc;
+
+namespace {
+
+// run a correlated normal distribution, optionally stretched along the
+// second parameter, and return the ensemble statistics
+double runCorrelatedNormal(double stretch, Vector& mean, Vector& error)
+{
+    const double rho = 0.9;
+
+    Ensemble mcmc;
+    mcmc.SetMultiThreading(false);
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, stretch) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [=](const vector<double>& p) {
+        const double x = p[0] - 1.0;
+        const double y = p[1] / stretch;
+        return 0.5 * (x*x - 2.0*rho*x*y + y*y) / (1.0 - rho*rho);
+    } );
+
+    mcmc.SetNumberOfWalkers(16);
+    mcmc.SetTotalLength(2E3);
+
+    mcmc.Run();
+
+    const Chain ensemble = mcmc.GetEnsembleChain(500);
+    EXPECT_EQ( 1501 * 16, ensemble.size() );
+
+    ChainStatistics stats( ensemble );
+    mean = stats.GetMean().Values();
+    error = stats.GetError();
+
+    return stats.GetAccRate();
+}
+
+}
+
+TEST(Ensemble, Walkers)
+{
+    Ensemble mcmc;
+    mcmc.SetMultiThreading(false);
+
+    ParameterConfig pList;
+    for (size_t i = 0; i < 3; i++)
+        pList.SetParameter( i, Parameter("p" + to_string(i), 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const vector<double>& p) {
+        return 0.5 * ( math::pow<2>( p[0] ) + math::pow<2>( p[1] ) + math::pow<2>( p[2] ) );
+    } );
+    mcmc.SetTotalLength(100);
+
+    // by default, 4 walkers per parameter
+    mcmc.Initialize();
+    ASSERT_EQ( 12, mcmc.NumberOfChains() );
+
+    // rounded up to an even number
+    mcmc.SetNumberOfWalkers(7);
+    mcmc.Initialize();
+    ASSERT_EQ( 8, mcmc.NumberOfChains() );
+
+    mcmc.Advance(10);
+    for (size_t iWalker = 0; iWalker < 8; iWalker++) {
+        ASSERT_EQ( 11, mcmc.GetChain(iWalker).size() );
+        ASSERT_EQ( 10, mcmc.GetChain(iWalker).GetGeneration(10) );
+    }
+
+    const Chain ensemble = mcmc.GetEnsembleChain(1);
+    ASSERT_EQ( 80, ensemble.size() );
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT_EQ( mcmc.GetChain(1).GetValue(1, i), ensemble.GetValue(1, i) );
+        ASSERT_EQ( mcmc.GetChain(0).GetValue(10, i), ensemble.GetValue(72, i) );
+    }
+}
+
+TEST(Ensemble, AffineInvariance)
+{
+    Random::Instance().Seed(123);
+
+    Vector mean, error;
+
+    const double accRate = runCorrelatedNormal( 1.0, mean, error );
+    ASSERT_NEAR( 1.0, mean[0], 0.15 );
+    ASSERT_NEAR( 0.0, mean[1], 0.15 );
+    ASSERT_NEAR( 1.0, error[0], 0.1 );
+    ASSERT_NEAR( 1.0, error[1], 0.1 );
+
+    // a badly scaled target is sampled just as efficiently
+    const double accRateStretched = runCorrelatedNormal( 1000.0, mean, error );
+    ASSERT_NEAR( 1.0, mean[0], 0.15 );
+    ASSERT_NEAR( 0.0, mean[1], 150.0 );
+    ASSERT_NEAR( 1.0, error[0], 0.1 );
+    ASSERT_NEAR( 1000.0, error[1], 100.0 );
+
+    ASSERT_NEAR( accRate, accRateStretched, 0.05 );
+}
+
+TEST(Ensemble, BatchNegLogLikelihood)
+{
+    Ensemble mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+    mcmc.SetParameterConfig( pList );
+
+    size_t nCalls = 0;
+    mcmc.SetBatchNegLogLikelihood( [&](const double* points, size_t nPoints, size_t dim, double* results) {
+        nCalls++;
+        for (size_t k = 0; k < nPoints; k++)
+            results[k] = 0.5 * ( math::pow<2>( points[k*dim] ) + math::pow<2>( points[k*dim+1] ) );
+    } );
+
+    mcmc.SetNumberOfWalkers(10);
+    mcmc.SetTotalLength(500);
+
+    mcmc.Run();
+
+    // one call per half ensemble and step (including the start points),
+    // plus the evaluation of each walker's mean in Finalize()
+    ASSERT_EQ( 2 * 501 + 10, nCalls );
+
+    const Chain ensemble = mcmc.GetEnsembleChain(100);
+    ChainStatistics stats( ensemble );
+    ASSERT_NEAR( 0.0, stats.GetMean()[0], 0.2 );
+    ASSERT_NEAR( 1.0, stats.GetError()[0], 0.15 );
+}
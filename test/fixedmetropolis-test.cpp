@@ -0,0 +1,84 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/fixedmetropolis.hpp>
+#include <vmcmc/exception.hpp>
+#include <vmcmc/math.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace vmcmc;
+
+TEST(FixedMetropolis, EvaluateNegLogLikelihood)
+{
+    auto mcmc = makeFixedMetropolis<3>( [](double p1, double p2, double p3) {
+        return p1 + 10.0 * p2 + 100.0 * p3;
+    } );
+
+    ASSERT_DOUBLE_EQ( 321.0, mcmc.EvaluateNegLogLikelihood( array<double, 3>{{ 1.0, 2.0, 3.0 }} ) );
+    ASSERT_DOUBLE_EQ( 321.0, mcmc.EvaluateNegLogLikelihood( vector<double>{ 1.0, 2.0, 3.0 } ) );
+}
+
+TEST(FixedMetropolis, Run)
+{
+    Random::Instance().Seed(123);
+
+    auto mcmc = makeFixedMetropolis<2>( [](double p1, double p2) {
+        return 0.5 * ( math::pow<2>( p1 - 1.0 ) + math::pow<2>( p2 / 2.0 ) );
+    } );
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 2.0, 0.0) );
+    pList.SetErrorScaling( 2.0 );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetMultiThreading(false);
+    mcmc.SetNumberOfChains(2);
+    mcmc.SetTotalLength(2E4);
+
+    mcmc.Run();
+
+    ASSERT_EQ( 2, mcmc.NumberOfChains() );
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& chain = mcmc.GetChain(iChain);
+        ASSERT_EQ( 20001, chain.size() );
+
+        for (size_t i = 0; i < chain.size(); i++) {
+            ASSERT_EQ( i, chain.GetGeneration(i) );
+            ASSERT_GE( chain.GetValue(i, 1), 0.0 );
+        }
+
+        ChainStatistics stats( chain );
+        ASSERT_NEAR( 1.0, stats.GetMean()[0], 0.15 );
+        ASSERT_NEAR( 1.0, stats.GetError()[0], 0.15 );
+        // half-normal distribution, truncated at the lower limit
+        ASSERT_NEAR( 2.0 * sqrt(2.0 / constants::pi), stats.GetMean()[1], 0.3 );
+
+        ASSERT_GT( stats.GetAccRate(), 0.1 );
+        ASSERT_LT( stats.GetAccRate(), 0.9 );
+    }
+}
+
+TEST(FixedMetropolis, ParameterMismatch)
+{
+    auto mcmc = makeFixedMetropolis<2>( [](double p1, double p2) {
+        return p1 * p2;
+    } );
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+
+    ASSERT_THROW( mcmc.Initialize(), Exception );
+}
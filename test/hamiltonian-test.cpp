@@ -0,0 +1,125 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/hamiltonian.hpp>
+#include <vmcmc/exception.hpp>
+#include <vmcmc/math.hpp>
+#include <vmcmc/random.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace vmcmc;
+
+TEST(Hamiltonian, SetNegLogLikelihoodGradient)
+{
+    Hamiltonian mcmc;
+
+    mcmc.SetNegLogLikelihoodGradient( [](const vector<double>& p, vector<double>& gradient) {
+        gradient[0] = p[0];
+        gradient[1] = 4.0 * p[1];
+        return 0.5 * p[0] * p[0] + 2.0 * p[1] * p[1];
+    } );
+    ASSERT_TRUE( mcmc.HasGradient() );
+
+    vector<double> gradient;
+    ASSERT_DOUBLE_EQ( 5.0, mcmc.EvaluateNegLogLikelihood( {1.0, 1.5}, gradient ) );
+    ASSERT_EQ( vector<double>({ 1.0, 6.0 }), gradient );
+
+    // samplers without gradient support evaluate the plain target function
+    ASSERT_DOUBLE_EQ( 5.0, mcmc.EvaluateNegLogLikelihood( {1.0, 1.5} ) );
+    ASSERT_DOUBLE_EQ( exp(-5.0), mcmc.EvaluateLikelihood( {1.0, 1.5} ) );
+
+    mcmc.SetNegLogLikelihood( [](const vector<double>& p) { return p[0]; } );
+    ASSERT_FALSE( mcmc.HasGradient() );
+
+    mcmc.SetParameterConfig( ParameterConfig(2) );
+    ASSERT_THROW( mcmc.Initialize(), Exception );
+}
+
+TEST(Hamiltonian, Run)
+{
+    Random::Instance().Seed(123);
+
+    // correlated normal distribution
+    const double sigma[] = { 1.0, 2.0 };
+    const double rho = 0.8;
+
+    Hamiltonian mcmc;
+    mcmc.SetMultiThreading(false);
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 2.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihoodGradient( [&](const vector<double>& p, vector<double>& gradient) {
+        const double x = (p[0] - 1.0) / sigma[0];
+        const double y = p[1] / sigma[1];
+        const double norm = 1.0 / (1.0 - rho*rho);
+        gradient[0] = norm * (x - rho*y) / sigma[0];
+        gradient[1] = norm * (y - rho*x) / sigma[1];
+        return 0.5 * norm * (x*x - 2.0*rho*x*y + y*y);
+    } );
+
+    mcmc.SetNumberOfChains(2);
+    mcmc.SetStepSize(0.2);
+    mcmc.SetNumberOfLeapfrogSteps(10);
+    mcmc.SetTotalLength(5E3);
+
+    mcmc.Run();
+
+    ASSERT_EQ( 2, mcmc.NumberOfChains() );
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& chain = mcmc.GetChain(iChain);
+        ASSERT_EQ( 5001, chain.size() );
+        ASSERT_EQ( 5000, chain.GetGeneration(5000) );
+
+        ChainStatistics stats( chain );
+        ASSERT_GT( stats.GetAccRate(), 0.8 );
+
+        ASSERT_NEAR( 1.0, stats.GetMean()[0], 0.1 );
+        ASSERT_NEAR( 0.0, stats.GetMean()[1], 0.2 );
+        ASSERT_NEAR( sigma[0], stats.GetError()[0], 0.1 );
+        ASSERT_NEAR( sigma[1], stats.GetError()[1], 0.2 );
+        ASSERT_NEAR( rho, stats.GetCorrelationMatrix()(1, 0), 0.1 );
+
+        ASSERT_EQ( 5001, mcmc.GetOnlineStatistics(iChain).GetCount() );
+    }
+}
+
+TEST(Hamiltonian, Limits)
+{
+    Random::Instance().Seed(123);
+
+    Hamiltonian mcmc;
+    mcmc.SetMultiThreading(false);
+
+    // a half-normal distribution
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 1.0, 1.0, 0.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihoodGradient( [](const vector<double>& p, vector<double>& gradient) {
+        gradient[0] = p[0];
+        return 0.5 * p[0] * p[0];
+    } );
+    mcmc.SetTotalLength(1E4);
+
+    mcmc.Run();
+
+    const Chain& chain = mcmc.GetChain();
+    for (size_t i = 0; i < chain.size(); i++)
+        ASSERT_GE( chain.GetValue(i, 0), 0.0 );
+
+    ChainStatistics stats( chain );
+    ASSERT_NEAR( sqrt(2.0 / constants::pi), stats.GetMean()[0], 0.1 );
+}
@@ -9,7 +9,10 @@
  */
 
 #include <vmcmc/io.hpp>
+#include <vmcmc/exception.hpp>
+#include <vmcmc/chain.hpp>
 #include <cstdio>
+#include <cmath>
 #include <gtest/gtest.h>
 
 using namespace std;
@@ -67,3 +70,245 @@ TEST(IO, TextFileWriter)
 
     remove( writer4.GetFilePath().c_str() );
 }
+
+TEST(IO, AsyncWriter)
+{
+    // records the generations and first parameter values, slowly
+    struct RecordingWriter : public Writer
+    {
+        virtual void Initialize(size_t numberOfChains, const ParameterConfig&, bool) override
+        {
+            fGenerations.assign( numberOfChains, vector<size_t>() );
+            fValues.assign( numberOfChains, vector<double>() );
+        }
+        virtual void Write(size_t chainIndex, const Chain& chain, size_t startIndex) override
+        {
+            this_thread::sleep_for( chrono::microseconds(200) );
+            fNWrites++;
+            if (fThrow)
+                throw Exception() << "Write failed.";
+            for (size_t i = startIndex; i < chain.size(); i++) {
+                fGenerations[chainIndex].push_back( chain.GetGeneration(i) );
+                fValues[chainIndex].push_back( chain.GetValue(i, 0) );
+            }
+        }
+        vector<vector<size_t>> fGenerations;
+        vector<vector<double>> fValues;
+        size_t fNWrites = 0;
+        bool fThrow = false;
+    };
+
+    ParameterConfig pc;
+    pc.SetParameter(0, "p1", 0.0, 1.0);
+    pc.SetParameter(1, "p2", 0.0, 1.0);
+
+    auto recorder = make_shared<RecordingWriter>();
+    AsyncWriter writer( recorder, 2 );
+    ASSERT_EQ( 2, writer.GetCapacity() );
+
+    // two compressed chains, written in blocks of 10 steps
+    vector<Chain> chains( 2, Chain(2) );
+    for (auto& chain : chains)
+        chain.SetCompressed(true);
+
+    writer.Initialize( 2, pc );
+
+    vector<Sample> states( 2, Sample{ 0.0, 0.0 } );
+    for (size_t iBlock = 0; iBlock < 20; iBlock++) {
+        for (size_t iChain = 0; iChain < 2; iChain++) {
+            Chain& chain = chains[iChain];
+            Sample& s = states[iChain];
+            const size_t startIndex = chain.size();
+            for (size_t i = startIndex; i < startIndex + 10; i++) {
+                // repeat each state 3 times
+                s.SetGeneration( i );
+                s.SetAccepted( i % 3 == 0 );
+                if (i % 3 == 0)
+                    s[0] = i + iChain * 1000;
+                chain.push_back( s );
+            }
+            writer.Write( iChain, chain, startIndex );
+        }
+    }
+
+    writer.Finalize();
+
+    // the writer is faster than the recorder
+    ASSERT_GT( writer.GetNumberOfStalls(), 0 );
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        ASSERT_EQ( 200, recorder->fGenerations[iChain].size() );
+        for (size_t i = 0; i < 200; i++) {
+            ASSERT_EQ( i, recorder->fGenerations[iChain][i] );
+            ASSERT_EQ( i - i % 3 + iChain * 1000, recorder->fValues[iChain][i] );
+        }
+    }
+
+    // errors are passed on to the sampling thread
+    writer.Initialize( 2, pc );
+    recorder->fThrow = true;
+    writer.Write( 0, chains[0], 0 );
+    ASSERT_THROW( writer.Finalize(), Exception );
+
+    // the failed writer does not receive any more samples
+    writer.Initialize( 2, pc );
+    recorder->fNWrites = 0;
+    size_t nThrown = 0;
+    for (size_t i = 0; i < 20; i++) {
+        try {
+            writer.Write( 0, chains[0], 0 );
+            this_thread::sleep_for( chrono::microseconds(500) );
+        }
+        catch (const Exception&) {
+            nThrown++;
+        }
+    }
+    ASSERT_THROW( writer.Finalize(), Exception );
+    ASSERT_EQ( 1, recorder->fNWrites );
+    ASSERT_GT( nThrown, 1 );
+
+    // Finalize() resets the error state
+    ASSERT_NO_THROW( writer.Finalize() );
+}
+
+TEST(IO, BinaryFile)
+{
+    ParameterConfig pc;
+    pc.SetParameter(0, "p1", 0.0, 1.0);
+    pc.SetParameter(1, "", 0.0, 1.0);
+    pc.SetParameter(2, "p3", 0.0, 1.0);
+
+    // a compressed and an uncompressed chain, not filling the last chunk
+    vector<Chain> chains( 2, Chain(3) );
+    chains[0].SetCompressed(true);
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        Sample s{ 0.0, 1.0, 2.0 };
+        for (size_t i = 0; i < 100; i++) {
+            s.SetGeneration( i );
+            s.SetAccepted( i % 4 == 0 );
+            if (s.IsAccepted()) {
+                s[0] = i * 0.1 + iChain;
+                s.SetNegLogLikelihood( i );
+                s.SetLikelihood( 1.0 / (i+1) );
+                s.SetPrior( 0.5 );
+            }
+            chains[iChain].push_back( s );
+        }
+    }
+
+    BinaryFileWriter writer( "io-test.bin", 10 );
+    writer.Initialize( 2, pc );
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        writer.Write( iChain, chains[iChain], 0 );
+        writer.Write( iChain, chains[iChain], 90 );
+    }
+    writer.Finalize();
+
+    {
+        BinaryFileReader reader( "io-test.bin" );
+
+        ASSERT_EQ( 2, reader.NumberOfChains() );
+        ASSERT_EQ( vector<string>({ "p1", "Param.1", "p3" }), reader.GetParameterNames() );
+
+        for (size_t iChain = 0; iChain < 2; iChain++) {
+            const Chain& chain = reader.GetChain(iChain);
+            ASSERT_EQ( 16, chain.GetBlockSize() );
+            ASSERT_EQ( 110, chain.size() );
+
+            for (size_t i = 0; i < 110; i++) {
+                const size_t j = (i < 100) ? i : i - 10;
+                ASSERT_EQ( chains[iChain].GetGeneration(j), chain.GetGeneration(i) );
+                ASSERT_EQ( chains[iChain].GetValue(j, 0), chain.GetValue(i, 0) );
+                ASSERT_EQ( chains[iChain].GetValue(j, 2), chain.GetValue(i, 2) );
+                ASSERT_EQ( chains[iChain].GetNegLogLikelihood(j), chain.GetNegLogLikelihood(i) );
+                ASSERT_EQ( chains[iChain].GetLikelihood(j), chain.GetLikelihood(i) );
+                ASSERT_EQ( chains[iChain].GetPrior(j), chain.GetPrior(i) );
+                ASSERT_EQ( chains[iChain].IsAccepted(j), chain.IsAccepted(i) );
+            }
+        }
+
+        // copies of the mapped chains are independent, and the chains can be
+        // analyzed in place
+        Chain chain = reader.GetChain(1);
+        chain.push_back( Sample{ 1.0, 2.0, 3.0 } );
+        ASSERT_EQ( 111, chain.size() );
+        ASSERT_EQ( 110, reader.GetChain(1).size() );
+
+        ChainStatistics stats( reader.GetChain(0) );
+        stats.SelectRange( 0, 100 );
+        ChainStatistics originalStats( chains[0] );
+        ASSERT_DOUBLE_EQ( originalStats.GetMean()[0], stats.GetMean()[0] );
+    }
+
+    ASSERT_THROW( BinaryFileReader( "io-test-missing.bin" ), Exception );
+
+    remove( "io-test.bin" );
+}
+
+TEST(IO, CompressedFile)
+{
+    ParameterConfig pc;
+    pc.SetParameter(0, "p1", 0.0, 1.0);
+    pc.SetParameter(1, "p2", 0.0, 1.0);
+
+    // a random walk with many rejections
+    vector<Chain> chains( 3, Chain(2) );
+
+    for (size_t iChain = 0; iChain < 3; iChain++) {
+        Sample s{ 0.0, 1.0 };
+        for (size_t i = 0; i < 3000; i++) {
+            s.SetGeneration( i );
+            s.SetAccepted( i % 5 == 0 );
+            if (s.IsAccepted()) {
+                s[0] += sin( (double) i ) / (iChain + 1);
+                s[1] = cos( (double) i );
+                s.SetNegLogLikelihood( 0.5 * (s[0]*s[0] + s[1]*s[1]) );
+                s.SetLikelihood( exp(-s.GetNegLogLikelihood()) );
+                s.SetPrior( 1.0 );
+            }
+            chains[iChain].push_back( s );
+        }
+    }
+
+    // compress on the background thread
+    auto compressedWriter = make_shared<CompressedFileWriter>( "io-test.vmz", 256 );
+    auto binaryWriter = make_shared<BinaryFileWriter>( "io-test.bin", 256 );
+    AsyncWriter writer( compressedWriter );
+    writer.AddWriter( binaryWriter );
+
+    writer.Initialize( 3, pc );
+    for (size_t iChain = 0; iChain < 3; iChain++)
+        writer.Write( iChain, chains[iChain], 0 );
+    writer.Finalize();
+
+    {
+        BinaryFileReader reader( "io-test.vmz" );
+
+        ASSERT_EQ( 3, reader.NumberOfChains() );
+        ASSERT_EQ( vector<string>({ "p1", "p2" }), reader.GetParameterNames() );
+
+        for (size_t iChain = 0; iChain < 3; iChain++) {
+            const Chain& chain = reader.GetChain(iChain);
+            ASSERT_EQ( 3000, chain.size() );
+
+            for (size_t i = 0; i < 3000; i++) {
+                ASSERT_EQ( chains[iChain].GetGeneration(i), chain.GetGeneration(i) );
+                ASSERT_EQ( chains[iChain].GetValue(i, 0), chain.GetValue(i, 0) );
+                ASSERT_EQ( chains[iChain].GetValue(i, 1), chain.GetValue(i, 1) );
+                ASSERT_EQ( chains[iChain].GetNegLogLikelihood(i), chain.GetNegLogLikelihood(i) );
+                ASSERT_EQ( chains[iChain].GetLikelihood(i), chain.GetLikelihood(i) );
+                ASSERT_EQ( chains[iChain].GetPrior(i), chain.GetPrior(i) );
+                ASSERT_EQ( chains[iChain].IsAccepted(i), chain.IsAccepted(i) );
+            }
+        }
+    }
+
+    // the rejections make the compressed file much smaller
+    ifstream compressed( "io-test.vmz", ios::binary | ios::ate );
+    ifstream uncompressed( "io-test.bin", ios::binary | ios::ate );
+    ASSERT_LT( compressed.tellg() * 3, uncompressed.tellg() );
+
+    remove( "io-test.vmz" );
+    remove( "io-test.bin" );
+}
@@ -99,3 +99,67 @@ TEST(Math, ChiSquareToSigmas)
     ASSERT_NEAR( 2.0, chiSquareToSigmas(4.0, 1), 0.001 );
     ASSERT_NEAR( 2.0, chiSquareToSigmas(6.18, 2), 0.001 );
 }
+
+TEST(Math, FFT)
+{
+    vector<complex<double>> data{ 1.0, 2.0, -1.0, 0.5, 3.0, 0.0, -2.0, 1.5 };
+    const vector<complex<double>> input = data;
+    const size_t n = data.size();
+
+    fft( data );
+
+    // compare to the naive discrete Fourier transform
+    for (size_t k = 0; k < n; k++) {
+        complex<double> expected = 0.0;
+        for (size_t t = 0; t < n; t++)
+            expected += input[t] * polar( 1.0, -constants::two_pi * (double) (k*t) / (double) n );
+
+        ASSERT_NEAR( expected.real(), data[k].real(), 1E-12 );
+        ASSERT_NEAR( expected.imag(), data[k].imag(), 1E-12 );
+    }
+
+    fft( data, true );
+
+    for (size_t t = 0; t < n; t++)
+        ASSERT_NEAR( input[t].real(), data[t].real() / (double) n, 1E-12 );
+
+    vector<complex<double>> invalid( 6 );
+    ASSERT_THROW( fft( invalid ), Exception );
+}
+
+TEST(Math, AutoCorrelation)
+{
+    const vector<double> series{ 0.3, 1.2, 0.8, -0.4, -1.1, 0.2, 0.9, 1.4, 0.1, -0.6, -0.2 };
+    const size_t n = series.size();
+
+    const vector<double> rho = autoCorrelation( series );
+    ASSERT_EQ( n, rho.size() );
+    ASSERT_DOUBLE_EQ( 1.0, rho[0] );
+
+    double mean = 0.0;
+    for (double x : series)
+        mean += x / (double) n;
+
+    double c0 = 0.0;
+    for (size_t t = 0; t < n; t++)
+        c0 += pow<2>( series[t] - mean );
+
+    for (size_t k = 1; k < n; k++) {
+        double ck = 0.0;
+        for (size_t t = 0; t + k < n; t++)
+            ck += (series[t] - mean) * (series[t+k] - mean);
+
+        ASSERT_NEAR( ck / c0, rho[k], 1E-12 );
+    }
+
+    ASSERT_EQ( 1.0, autoCorrelation( vector<double>(5, 2.0) )[0] );
+    ASSERT_EQ( 1.0, integratedAutoCorrelationTime( {1.0} ) );
+
+    // exponentially decaying correlations, as for an AR(1) process
+    const double phi = 0.8;
+    vector<double> arRho( 1000 );
+    for (size_t k = 0; k < arRho.size(); k++)
+        arRho[k] = std::pow( phi, (double) k );
+
+    ASSERT_NEAR( (1.0 + phi) / (1.0 - phi), integratedAutoCorrelationTime( arRho ), 1E-6 );
+}
@@ -0,0 +1,78 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ *
+ * @brief Measures the per-step overhead of the Metropolis samplers with a
+ * cheap target function.
+ */
+
+#include <vmcmc/metropolis.hpp>
+#include <vmcmc/fixedmetropolis.hpp>
+#include <vmcmc/math.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+using namespace vmcmc;
+
+namespace {
+
+const size_t kNSteps = 1000000;
+
+ParameterConfig makeParameterConfig()
+{
+    ParameterConfig pList;
+    for (size_t i = 0; i < 4; i++)
+        pList.SetParameter( i, Parameter("p" + to_string(i), 0.0, 1.0) );
+    pList.SetErrorScaling( 1.2 );
+    return pList;
+}
+
+double gaussian4D(double p1, double p2, double p3, double p4)
+{
+    return 0.5 * (math::pow<2>(p1) + math::pow<2>(p2) + math::pow<2>(p3) + math::pow<2>(p4));
+}
+
+template<class AlgorithmT>
+double measureSecondsPerStep(AlgorithmT& mcmc)
+{
+    mcmc.SetParameterConfig( makeParameterConfig() );
+    mcmc.SetMultiThreading( false );
+    mcmc.SetTotalLength( kNSteps );
+
+    mcmc.Initialize();
+
+    const auto start = chrono::steady_clock::now();
+    mcmc.Advance( kNSteps );
+    const double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+    return seconds / (double) kNSteps;
+}
+
+} /* anonymous namespace */
+
+TEST(MetropolisBenchmark, FixedVsDynamic)
+{
+    MetropolisHastings dynamicMcmc;
+    dynamicMcmc.SetNegLogLikelihood<4>( gaussian4D );
+    const double dynamicTime = measureSecondsPerStep( dynamicMcmc );
+
+    auto fixedMcmc = makeFixedMetropolis<4>( [](double p1, double p2, double p3, double p4) {
+        return gaussian4D(p1, p2, p3, p4);
+    } );
+    const double fixedTime = measureSecondsPerStep( fixedMcmc );
+
+    cout << "MetropolisHastings: " << dynamicTime * 1E9 << " ns/step" << endl;
+    cout << "FixedMetropolis<4>: " << fixedTime * 1E9 << " ns/step" << endl;
+
+    EXPECT_EQ( kNSteps+1, fixedMcmc.GetChain().size() );
+    EXPECT_EQ( kNSteps+1, dynamicMcmc.GetChain().size() );
+}
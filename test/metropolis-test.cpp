@@ -9,6 +9,8 @@
  */
 
 #include <vmcmc/metropolis.hpp>
+#include <vmcmc/exception.hpp>
+#include <vmcmc/io.hpp>
 #include <vmcmc/math.hpp>
 #include <vmcmc/stringutils.hpp>
 #include <vmcmc/random.hpp>
@@ -16,9 +18,37 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <set>
+#include <sstream>
+#include <thread>
+
 using namespace std;
 using namespace vmcmc;
 
+namespace {
+
+// global counter of heap allocations, see the replaced operator new below
+atomic<size_t> sNAllocations( 0 );
+
+}
+
+void* operator new(size_t size)
+{
+    sNAllocations++;
+    if (void* ptr = malloc( size ))
+        return ptr;
+    throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free( ptr );
+}
+
 TEST(Metropolis, SetBetas)
 {
     MetropolisHastings mcmc;
@@ -103,6 +133,20 @@ TEST(Metropolis, CalculateMHRatio)
 
     mhRatio = MetropolisHastings::CalculateMHRatio(s2, s1);
     ASSERT_DOUBLE_EQ(1.0, mhRatio);
+
+    // second stage after the rejection of s2
+    Sample s3( { 0.5, 0.0 } );
+    mcmc.Evaluate( s3 );
+
+    mhRatio = MetropolisHastings::CalculateMHRatio(s1, s2, s3, 1.0);
+    ASSERT_DOUBLE_EQ( exp(-0.25) * (1.0 - exp(-0.75)) / (1.0 - exp(-1.0)), mhRatio );
+
+    mhRatio = MetropolisHastings::CalculateMHRatio(s1, s2, s3, 0.5);
+    ASSERT_DOUBLE_EQ( 0.5 * exp(-0.25) * (1.0 - exp(-0.75)) / (1.0 - exp(-1.0)), mhRatio );
+
+    // a second stage proposal less likely than the rejected one
+    mhRatio = MetropolisHastings::CalculateMHRatio(s1, s3, s2, 1.0);
+    ASSERT_DOUBLE_EQ(0.0, mhRatio);
 }
 
 TEST(Metropolis, Run)
@@ -151,12 +195,976 @@ TEST(Metropolis, Run)
     ASSERT_EQ( 0.0, mcmc.GetChain(0).front().GetNegLogLikelihood() );
     ASSERT_EQ( 1.0, mcmc.GetChain(0).front().GetPrior() );
 
-    ASSERT_NEAR( 0.25, stats.GetChainStats(0).GetAccRate(), 0.01 );
-    ASSERT_NEAR( 0.32, stats.GetChainStats(1).GetAccRate(), 0.01 );
-    ASSERT_NEAR( 0.29, mcmc.GetSwapAcceptanceRate(0), 0.01 );
+    ASSERT_NEAR( 0.31, stats.GetChainStats(0).GetAccRate(), 0.01 );
+    ASSERT_NEAR( 0.28, stats.GetChainStats(1).GetAccRate(), 0.01 );
+    ASSERT_NEAR( 0.20, mcmc.GetSwapAcceptanceRate(0), 0.01 );
 
     ASSERT_NEAR( 0.0, stats.GetChainStats(0).GetMean()[0], 0.25 );
     ASSERT_NEAR( 1.0, stats.GetChainStats(0).GetError()[0], 0.25 );
     ASSERT_NEAR( 0.0, stats.GetChainStats(0).GetMode()[0], 0.25 );
     ASSERT_NEAR( 0.0, stats.GetChainStats(0).GetMedian(0), 0.25 );
+
+    ChainStatistics fullStats( mcmc.GetChain(0) );
+    ASSERT_EQ( 1001, mcmc.GetOnlineStatistics(0).GetCount() );
+    ASSERT_NEAR( fullStats.GetMean()[1], mcmc.GetOnlineStatistics(0).GetMean()[1], 1E-9 );
+    ASSERT_NEAR( fullStats.GetAccRate(), mcmc.GetOnlineStatistics(0).GetAccRate(), 1E-9 );
+}
+
+TEST(Metropolis, AdaptiveProposal)
+{
+    MetropolisHastings mcmc;
+    mcmc.SetMultiThreading(false);
+
+    // a badly scaled starting configuration for a strongly correlated target
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetProposalFunction<ProposalAdaptive>();
+
+    const double sigma[] = { 10.0, 0.1 };
+    const double rho = 0.9;
+    mcmc.SetNegLogLikelihood( [&](const std::vector<double>& params) {
+        const double x = params[0] / sigma[0];
+        const double y = params[1] / sigma[1];
+        return 0.5 * (x*x - 2.0*rho*x*y + y*y) / (1.0 - rho*rho);
+    } );
+
+    mcmc.SetNumberOfChains(1);
+    mcmc.SetTotalLength(2E4);
+
+    mcmc.Run();
+
+    const Chain& chain = mcmc.GetChain(0);
+
+    // the acceptance rate after burn-in approaches the target rate
+    ChainStatistics stats( chain );
+    stats.SelectPercentageRange( 0.5 );
+    ASSERT_NEAR( 0.234, stats.GetAccRate(), 0.05 );
+
+    ASSERT_NEAR( 0.0, stats.GetMean()[0], 3.0 );
+    ASSERT_NEAR( sigma[0], stats.GetError()[0], 3.0 );
+    ASSERT_NEAR( sigma[1], stats.GetError()[1], 0.03 );
+}
+
+TEST(Metropolis, CompressRejections)
+{
+    MetropolisHastings mcmc;
+    mcmc.SetMultiThreading(false);
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+    pList.SetErrorScaling( 2.0 );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const std::vector<double>& params) {
+        return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+    } );
+
+    mcmc.SetRandomizeStartPoint(false);
+    mcmc.SetTotalLength(1E3);
+    mcmc.SetBetas( {1.0, 0.1} );
+    mcmc.SetCompressRejections(true);
+
+    mcmc.Run();
+
+    const Chain& chain = mcmc.GetChain(0);
+
+    ASSERT_TRUE( chain.IsCompressed() );
+    ASSERT_EQ( 1001, chain.size() );
+    ASSERT_LT( chain.NumberOfRuns(), chain.size() / 2 );
+
+    // the steps are still addressed individually
+    size_t nAccepted = 0;
+    for (size_t i = 0; i < chain.size(); i++) {
+        ASSERT_EQ( i, chain[i].GetGeneration() );
+        if (i > 0 && chain.IsAccepted(i))
+            nAccepted++;
+    }
+
+    ChainStatistics stats( chain );
+    ASSERT_DOUBLE_EQ( (double) nAccepted / 1000.0, stats.GetAccRate() );
+    ASSERT_NEAR( 0.0, stats.GetMean()[0], 0.5 );
+    ASSERT_NEAR( 1.0, stats.GetError()[0], 0.5 );
+}
+
+TEST(Metropolis, AllocationFreeSteps)
+{
+    Random::Instance().Seed(123);
+
+    MetropolisHastings mcmc;
+    mcmc.SetMultiThreading(false);
+
+    ParameterConfig pList;
+    for (size_t i = 0; i < 40; i++)
+        pList.SetParameter( i, Parameter("p" + to_string(i), 0.0, 1.0) );
+    pList.SetErrorScaling( 0.1 );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const std::vector<double>& params) {
+        double result = 0.0;
+        for (const double& p : params)
+            result += 0.5 * math::pow<2>( p );
+        return result;
+    } );
+
+    mcmc.SetNumberOfChains(2);
+    mcmc.SetTotalLength(1E3);
+
+    mcmc.Initialize();
+
+    // warm up thread-local instances and scratch buffers
+    mcmc.Advance(10);
+
+    const size_t nSteps = 500;
+
+    sNAllocations = 0;
+    mcmc.Advance(nSteps);
+    const size_t nAllocations = sNAllocations;
+
+    ASSERT_EQ( nSteps + 11, mcmc.GetChain(0).size() );
+
+    ASSERT_EQ( 0, nAllocations );
+}
+
+TEST(Metropolis, BatchNegLogLikelihood)
+{
+    MetropolisHastings mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0, -5.0, 5.0) );
+    pList.SetErrorScaling( 2.0 );
+
+    mcmc.SetParameterConfig( pList );
+
+    size_t nCalls = 0;
+    size_t nFullBatches = 0;
+
+    mcmc.SetBatchNegLogLikelihood( [&](const double* points, size_t nPoints, size_t dim, double* results) {
+        nCalls++;
+        if (nPoints == 4)
+            nFullBatches++;
+
+        for (size_t i = 0; i < nPoints; i++)
+            results[i] = 0.5 * ( math::pow<2>( points[i*dim] ) + math::pow<2>( points[i*dim+1] ) );
+    } );
+
+    ASSERT_DOUBLE_EQ( 2.5, mcmc.EvaluateNegLogLikelihood( {1.0, 2.0} ) );
+    ASSERT_EQ( 1, nCalls );
+
+    mcmc.SetNumberOfChains(2);
+    mcmc.SetBetas( {1.0, 0.1} );
+    mcmc.SetTotalLength(1E3);
+
+    mcmc.Initialize();
+    mcmc.Advance(10);
+
+    // one batch per step, holding the proposals of all 2x2 chains
+    nCalls = nFullBatches = 0;
+    mcmc.Advance(500);
+
+    ASSERT_EQ( 500, nCalls );
+    ASSERT_GT( nFullBatches, 400 );
+    ASSERT_EQ( 511, mcmc.GetChain(0).size() );
+    ASSERT_EQ( 511, mcmc.GetChain(1).size() );
+
+    ChainStatistics stats( mcmc.GetChain(0) );
+    ASSERT_NEAR( 0.0, stats.GetMean()[0], 0.5 );
+    ASSERT_EQ( mcmc.GetChain(0).back().GetNegLogLikelihood(),
+        mcmc.EvaluateNegLogLikelihood( Sample( mcmc.GetChain(0).back() ).Values().data() ) );
+}
+
+TEST(Metropolis, LikelihoodCache)
+{
+    auto run = [](size_t cacheCapacity, atomic<size_t>& nCalls) {
+        unique_ptr<MetropolisHastings> mcmc( new MetropolisHastings() );
+
+        ParameterConfig pList;
+        pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+        pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+        mcmc->SetParameterConfig( pList );
+        mcmc->SetNegLogLikelihood( [&](const std::vector<double>& params) {
+            nCalls++;
+            return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+        } );
+
+        mcmc->SetNumberOfChains(2);
+        mcmc->SetBetas( {1.0, 0.3} );
+        mcmc->SetTotalLength(1000);
+        mcmc->SetSeed(7);
+        mcmc->SetLikelihoodCache(cacheCapacity);
+        mcmc->Run();
+
+        return mcmc;
+    };
+
+    atomic<size_t> nUncachedCalls( 0 ), nCachedCalls( 0 );
+    auto uncached = run( 0, nUncachedCalls );
+    auto cached = run( 1024, nCachedCalls );
+
+    ASSERT_EQ( 0U, uncached->GetLikelihoodCacheHits() + uncached->GetLikelihoodCacheMisses() );
+
+    // the cache does not alter the chains
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& expected = uncached->GetChain(iChain);
+        const Chain& chain = cached->GetChain(iChain);
+
+        ASSERT_EQ( expected.size(), chain.size() );
+        for (size_t i = 0; i < chain.size(); i++) {
+            ASSERT_EQ( expected.GetNegLogLikelihood(i), chain.GetNegLogLikelihood(i) );
+            ASSERT_EQ( expected[i].Values()[1], chain[i].Values()[1] );
+        }
+    }
+
+    // only the misses are passed to the target
+    ASSERT_EQ( nCachedCalls.load(), cached->GetLikelihoodCacheMisses() );
+    ASSERT_EQ( nUncachedCalls.load(), nCachedCalls + cached->GetLikelihoodCacheHits() );
+
+    // the current state of a chain was evaluated just before
+    Sample last( cached->GetChain(0).back() );
+    const size_t nHits = cached->GetLikelihoodCacheHits();
+    const size_t nCalls = nCachedCalls;
+
+    ASSERT_TRUE( cached->Evaluate( last ) );
+    ASSERT_EQ( cached->GetChain(0).back().GetNegLogLikelihood(), last.GetNegLogLikelihood() );
+    ASSERT_EQ( nHits + 1, cached->GetLikelihoodCacheHits() );
+    ASSERT_EQ( nCalls, nCachedCalls.load() );
+}
+
+TEST(Metropolis, LimitRejections)
+{
+    MetropolisHastings mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.5, 1.0, 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0, -0.2, 2.0) );
+
+    mcmc.SetParameterConfig( pList );
+
+    size_t nPriorCalls = 0, nLikelihoodCalls = 0;
+    bool outside = false;
+
+    mcmc.SetPrior( [&](const std::vector<double>& params) {
+        nPriorCalls++;
+        outside |= !pList.IsInsideLimits( params );
+        return (params[1] < 1.5) ? 1.0 : 0.0;
+    } );
+    mcmc.SetNegLogLikelihood( [&](const std::vector<double>& params) {
+        nLikelihoodCalls++;
+        outside |= !pList.IsInsideLimits( params );
+        return 0.5 * math::pow<2>( params[1] );
+    } );
+
+    mcmc.SetTotalLength(2000);
+    mcmc.Run();
+
+    // points outside the limits never reach the prior or the likelihood
+    ASSERT_FALSE( outside );
+    ASSERT_GT( mcmc.GetLimitRejections(), 0U );
+    ASSERT_GT( mcmc.GetPriorRejections(), 0U );
+    ASSERT_EQ( nPriorCalls - mcmc.GetPriorRejections(), nLikelihoodCalls );
+}
+
+TEST(Metropolis, DelayedRejection)
+{
+    auto run = [](bool delayedRejection, bool batch) {
+        unique_ptr<MetropolisHastings> mcmc( new MetropolisHastings() );
+
+        // proposals much wider than the target
+        ParameterConfig pList;
+        pList.SetParameter( 0, Parameter("test1", 0.0, 5.0) );
+        pList.SetParameter( 1, Parameter("test2", 0.0, 5.0) );
+
+        mcmc->SetParameterConfig( pList );
+        if (batch) {
+            mcmc->SetBatchNegLogLikelihood( [](const double* points, size_t nPoints, size_t dim, double* results) {
+                for (size_t i = 0; i < nPoints; i++)
+                    results[i] = 0.5 * ( math::pow<2>( points[i*dim] ) + math::pow<2>( points[i*dim+1] ) );
+            } );
+        }
+        else {
+            mcmc->SetNegLogLikelihood( [](const std::vector<double>& params) {
+                return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+            } );
+        }
+
+        mcmc->SetNumberOfChains(2);
+        mcmc->SetTotalLength(20000);
+        mcmc->SetSeed(11);
+        mcmc->SetDelayedRejection(delayedRejection);
+        mcmc->Run();
+
+        return mcmc;
+    };
+
+    auto plain = run( false, false );
+    auto delayed = run( true, false );
+
+    ASSERT_DOUBLE_EQ( plain->GetChain(0).GetAccRate(), plain->GetStageAcceptanceRate(0, 0) );
+    ASSERT_EQ( 0.0, plain->GetStageAcceptanceRate(0, 1) );
+
+    // the second stage salvages many of the rejected steps
+    ASSERT_GT( delayed->GetStageAcceptanceRate(0, 1), delayed->GetStageAcceptanceRate(0, 0) );
+    ASSERT_GT( delayed->GetChain(0).GetAccRate(), 1.5 * plain->GetChain(0).GetAccRate() );
+
+    // and preserves the target distribution
+    ChainStatistics stats( delayed->GetChain(0) );
+    stats.SelectPercentageRange( 0.1, 1.0 );
+    ASSERT_NEAR( 0.0, stats.GetMean()[0], 0.1 );
+    ASSERT_NEAR( 1.0, stats.GetVariance()[0], 0.15 );
+    ASSERT_NEAR( 1.0, stats.GetVariance()[1], 0.15 );
+
+    // the second stage proposals of all chains are evaluated in batches
+    auto batched = run( true, true );
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& expected = delayed->GetChain(iChain);
+        const Chain& chain = batched->GetChain(iChain);
+
+        ASSERT_EQ( expected.size(), chain.size() );
+        for (size_t i = 0; i < chain.size(); i++)
+            ASSERT_EQ( expected[i].Values()[0], chain[i].Values()[0] );
+    }
+}
+
+TEST(Metropolis, Asynchronous)
+{
+    // counts the samples passed to the writer for each chain
+    struct CountingWriter : public Writer
+    {
+        virtual void Initialize(size_t numberOfChains, const ParameterConfig&, bool) override
+        {
+            fCounts.assign( numberOfChains, 0 );
+        }
+        virtual void Write(size_t chainIndex, const Chain& chain, size_t startIndex) override
+        {
+            fCounts[chainIndex] += chain.size() - startIndex;
+        }
+        vector<size_t> fCounts;
+    };
+
+    MetropolisHastings mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+    pList.SetErrorScaling( 2.0 );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const std::vector<double>& params) {
+        return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+    } );
+
+    auto writer = make_shared<CountingWriter>();
+    mcmc.AddWriter( writer );
+
+    mcmc.SetNumberOfChains(4);
+    mcmc.SetBetas( {1.0, 0.3, 0.1} );
+    mcmc.SetTotalLength(5E3 + 25);
+    mcmc.SetAsynchronous(true);
+
+    mcmc.Run();
+
+    ASSERT_EQ( 4, writer->fCounts.size() );
+
+    for (size_t iChain = 0; iChain < 4; iChain++) {
+        ASSERT_EQ( 5026, mcmc.GetChain(iChain).size() );
+        ASSERT_EQ( 5025, mcmc.GetChain(iChain).GetGeneration(5025) );
+        ASSERT_EQ( 5026, writer->fCounts[iChain] );
+        ASSERT_EQ( 5026, mcmc.GetOnlineStatistics(iChain).GetCount() );
+
+        ChainStatistics stats( mcmc.GetChain(iChain) );
+        ASSERT_NEAR( 0.0, stats.GetMean()[0], 0.25 );
+        ASSERT_NEAR( 1.0, stats.GetError()[0], 0.2 );
+        ASSERT_GT( mcmc.GetSwapAcceptanceRate(iChain), 0.0 );
+    }
+}
+
+TEST(Metropolis, ReproducibleStreams)
+{
+    auto run = [](bool multiThreading, bool asynchronous) {
+        unique_ptr<MetropolisHastings> mcmc( new MetropolisHastings() );
+
+        ParameterConfig pList;
+        pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+        pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+        mcmc->SetParameterConfig( pList );
+        mcmc->SetNegLogLikelihood( [](const std::vector<double>& params) {
+            return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+        } );
+
+        mcmc->SetNumberOfChains(4);
+        mcmc->SetBetas( {1.0, 0.3, 0.1} );
+        mcmc->SetTotalLength(2000);
+        mcmc->SetSeed(42);
+        mcmc->SetMultiThreading(multiThreading);
+        mcmc->SetAsynchronous(asynchronous);
+        mcmc->Run();
+
+        return mcmc;
+    };
+
+    // the chains do not depend on the number and scheduling of threads
+    auto serial = run( false, false );
+    auto parallel = run( true, false );
+    auto asynchronous = run( true, true );
+
+    for (size_t iChain = 0; iChain < 4; iChain++) {
+        const Chain& expected = serial->GetChain(iChain);
+
+        for (MetropolisHastings* mcmc : { parallel.get(), asynchronous.get() }) {
+            const Chain& chain = mcmc->GetChain(iChain);
+
+            ASSERT_EQ( expected.size(), chain.size() );
+            for (size_t i = 0; i < chain.size(); i++) {
+                ASSERT_EQ( expected.GetNegLogLikelihood(i), chain.GetNegLogLikelihood(i) );
+                ASSERT_EQ( expected[i].Values()[0], chain[i].Values()[0] );
+            }
+            ASSERT_EQ( serial->GetSwapAcceptanceRate(iChain), mcmc->GetSwapAcceptanceRate(iChain) );
+        }
+    }
+}
+
+TEST(Metropolis, EvenOddSwaps)
+{
+    auto run = [](bool asynchronous) {
+        unique_ptr<MetropolisHastings> mcmc( new MetropolisHastings() );
+
+        ParameterConfig pList;
+        pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+        pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+        mcmc->SetParameterConfig( pList );
+        mcmc->SetNegLogLikelihood( [](const std::vector<double>& params) {
+            return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+        } );
+
+        // a poorly spaced ladder
+        mcmc->SetNumberOfChains(2);
+        mcmc->SetBetas( {1.0, 0.9, 0.8, 0.001} );
+        mcmc->SetSwapScheme( MetropolisHastings::ESwapScheme::EvenOdd );
+        mcmc->SetPtFrequency(5);
+        mcmc->SetAdaptiveBetas(true);
+        mcmc->SetBurnIn(5000);
+        mcmc->SetTotalLength(10000);
+        mcmc->SetSeed(42);
+        mcmc->SetAsynchronous(asynchronous);
+        mcmc->Run();
+
+        return mcmc;
+    };
+
+    auto mcmc = run( false );
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        // all pairs are proposed in each round
+        for (size_t iPair = 0; iPair < 3; iPair++)
+            ASSERT_GT( mcmc->GetSwapAcceptanceRate(iChain, iPair), 0.0 );
+
+        // the ladder is spread out between the fixed coldest and hottest beta
+        const vector<double>& betas = mcmc->GetBetas(iChain);
+        ASSERT_EQ( 4, betas.size() );
+        ASSERT_EQ( 1.0, betas.front() );
+        ASSERT_EQ( 0.001, betas.back() );
+        ASSERT_TRUE( std::is_sorted( betas.rbegin(), betas.rend() ) );
+        ASSERT_LT( betas[2], 0.5 );
+
+        ASSERT_GT( mcmc->GetNumberOfRoundTrips(iChain), 10 );
+        ASSERT_GT( mcmc->GetMeanRoundTripTime(iChain), 0.0 );
+    }
+
+    // the schedule does not depend on the execution
+    auto asynchronous = run( true );
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        ASSERT_EQ( mcmc->GetBetas(iChain), asynchronous->GetBetas(iChain) );
+        ASSERT_EQ( mcmc->GetNumberOfRoundTrips(iChain), asynchronous->GetNumberOfRoundTrips(iChain) );
+    }
+}
+
+TEST(Metropolis, AdaptiveBetasWithAdaptiveProposal)
+{
+    MetropolisHastings mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const std::vector<double>& params) {
+        return 0.5 * ( math::pow<2>( params[0] / 3.0 ) + math::pow<2>( params[1] / 0.5 ) );
+    } );
+
+    mcmc.SetNumberOfChains(1);
+    mcmc.SetBetas( {1.0, 0.9, 0.8, 0.01} );
+    mcmc.SetPtFrequency(5);
+    mcmc.SetAdaptiveBetas(true);
+    mcmc.SetProposalFunction<ProposalAdaptive>();
+    mcmc.SetBurnIn(10000);
+    mcmc.SetTotalLength(20000);
+    mcmc.SetSeed(42);
+    mcmc.Run();
+
+    const vector<double>& betas = mcmc.GetBetas(0);
+    ASSERT_NE( 0.9, betas[1] );
+
+    for (size_t iBeta = 1; iBeta < 3; iBeta++) {
+        const auto& prop = dynamic_cast<const ProposalAdaptive&>( mcmc.GetProposalFunction(0, iBeta) );
+
+        // the adaptation was not restarted, when the ladder changed
+        ASSERT_EQ( 20000, prop.GetNumberOfAdaptions() );
+
+        // the proposal learned the shape of the tempered target
+        const MatrixLower& L = prop.GetCholeskyDecomp();
+        ASSERT_NEAR( 6.0, L(0, 0) / L(1, 1), 1.5 );
+        ASSERT_NEAR( 3.0 / sqrt(betas[iBeta]), L(0, 0), 1.0 );
+    }
+}
+
+TEST(Metropolis, ReplicaTrajectories)
+{
+    MetropolisHastings mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const std::vector<double>& params) {
+        return 0.5 * math::pow<2>( params[0] );
+    } );
+
+    mcmc.SetBetas( {1.0, 0.5, 0.25, 0.1} );
+    mcmc.SetSwapScheme( MetropolisHastings::ESwapScheme::EvenOdd );
+    mcmc.SetPtFrequency(10);
+    mcmc.SetRecordTrajectories(true);
+    mcmc.SetTotalLength(5000);
+    mcmc.Run();
+
+    const vector<size_t>& replicas = mcmc.GetReplicas(0);
+    ASSERT_EQ( 4, replicas.size() );
+    ASSERT_TRUE( std::is_permutation( replicas.begin(), replicas.end(), vector<size_t>{ 0, 1, 2, 3 }.begin() ) );
+
+    size_t nSwaps = 0;
+
+    for (size_t iReplica = 0; iReplica < 4; iReplica++) {
+        const auto& trajectory = mcmc.GetReplicaTrajectory(0, iReplica);
+
+        // each replica starts at its own temperature and moves to adjacent ones
+        ASSERT_FALSE( trajectory.empty() );
+        ASSERT_EQ( 0, trajectory.front().first );
+        ASSERT_EQ( iReplica, trajectory.front().second );
+
+        for (size_t i = 1; i < trajectory.size(); i++) {
+            ASSERT_LE( trajectory[i-1].first, trajectory[i].first );
+            ASSERT_EQ( 1, std::abs( (ptrdiff_t) trajectory[i].second - (ptrdiff_t) trajectory[i-1].second ) );
+        }
+
+        ASSERT_EQ( iReplica, replicas[ trajectory.back().second ] );
+        nSwaps += trajectory.size() - 1;
+    }
+
+    // each accepted swap moves two replicas
+    const vector<double> nAccepted = {
+        mcmc.GetSwapAcceptanceRate(0, 0) * 250,
+        mcmc.GetSwapAcceptanceRate(0, 1) * 250,
+        mcmc.GetSwapAcceptanceRate(0, 2) * 250
+    };
+    ASSERT_NEAR( nAccepted[0] + nAccepted[1] + nAccepted[2], nSwaps / 2.0, 1E-6 );
+}
+
+TEST(Metropolis, Resume)
+{
+    const string checkpointFile = "metropolis-test.ckp";
+
+    auto setup = [](MetropolisHastings& mcmc, size_t totalLength, size_t nEvaluations = 0) {
+        ParameterConfig pList;
+        pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+        pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+        mcmc.SetParameterConfig( pList );
+
+        // simulate a crash after a number of evaluations
+        auto nRemaining = make_shared<size_t>( nEvaluations );
+        mcmc.SetNegLogLikelihood( [nRemaining](const std::vector<double>& params) {
+            if (*nRemaining > 0 && --(*nRemaining) == 0)
+                throw Exception() << "Crash.";
+            return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+        } );
+
+        mcmc.SetNumberOfChains(2);
+        mcmc.SetBetas( {1.0, 0.3} );
+        mcmc.SetProposalFunction<ProposalAdaptive>();
+        mcmc.SetMultiThreading(false);
+        mcmc.SetTotalLength(totalLength);
+    };
+
+    // the uninterrupted reference run
+    MetropolisHastings reference;
+    setup( reference, 2000 );
+    Random::Instance().GetEngine().seed( 123 );
+    reference.Run();
+
+    // the output of both runs goes to the same files
+    auto textWriter = make_shared<TextFileWriter>( "", "metropolis-test" );
+    auto binaryWriter = make_shared<BinaryFileWriter>( "metropolis-test.bin", 64 );
+
+    // a run interrupted after half of the steps ...
+    MetropolisHastings interrupted;
+    setup( interrupted, 1000 );
+    interrupted.SetCheckpointFile( checkpointFile, 5 );
+    interrupted.AddWriter( textWriter );
+    interrupted.AddWriter( binaryWriter );
+    Random::Instance().GetEngine().seed( 123 );
+    interrupted.Run();
+
+    // ... and resumed from the checkpoint by a new instance
+    MetropolisHastings resumed;
+    setup( resumed, 2000 );
+    resumed.AddWriter( textWriter );
+    resumed.AddWriter( binaryWriter );
+    Random::Instance().GetEngine().seed( 456 );
+    resumed.Resume( checkpointFile );
+
+    const BinaryFileReader reader( binaryWriter->GetFilePath() );
+    ASSERT_EQ( 2, reader.NumberOfChains() );
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& expected = reference.GetChain(iChain);
+        const Chain& chain = resumed.GetChain(iChain);
+
+        ASSERT_EQ( 1001, chain.size() );
+
+        // the online statistics continue from the checkpoint
+        const OnlineStatistics& stats = resumed.GetOnlineStatistics(iChain);
+        ASSERT_EQ( 2001, stats.GetCount() );
+        ASSERT_EQ( reference.GetOnlineStatistics(iChain).GetNumberOfAccepted(), stats.GetNumberOfAccepted() );
+        ASSERT_DOUBLE_EQ( reference.GetOnlineStatistics(iChain).GetMean()[0], stats.GetMean()[0] );
+
+        // the files hold all steps of both runs
+        const Chain& written = reader.GetChain(iChain);
+        ASSERT_EQ( expected.size(), written.size() );
+
+        ifstream textFile( textWriter->GetFilePath(iChain) );
+        string line;
+        getline( textFile, line );
+        ASSERT_EQ( 0, line.find("Generation") );
+
+        for (size_t i = 0; i < expected.size(); i++) {
+            ASSERT_EQ( i, written.GetGeneration(i) );
+            ASSERT_EQ( expected[i].Values()[0], written[i].Values()[0] );
+            ASSERT_EQ( expected.GetNegLogLikelihood(i), written.GetNegLogLikelihood(i) );
+
+            size_t generation;
+            ASSERT_TRUE( getline( textFile, line ) );
+            ASSERT_TRUE( istringstream( line ) >> generation );
+            ASSERT_EQ( i, generation );
+        }
+        ASSERT_FALSE( getline( textFile, line ) );
+
+        textFile.close();
+        remove( textWriter->GetFilePath(iChain).c_str() );
+
+        for (size_t i = 0; i < chain.size(); i++) {
+            ASSERT_EQ( expected.GetGeneration(1000 + i), chain.GetGeneration(i) );
+            ASSERT_EQ( expected.GetNegLogLikelihood(1000 + i), chain.GetNegLogLikelihood(i) );
+            ASSERT_EQ( expected[1000 + i].Values()[0], chain[i].Values()[0] );
+            ASSERT_EQ( expected[1000 + i].Values()[1], chain[i].Values()[1] );
+        }
+
+        ASSERT_EQ( reference.GetSwapAcceptanceRate(iChain), resumed.GetSwapAcceptanceRate(iChain) );
+    }
+
+    // a run crashing between two checkpoints (at step 1000), after writing
+    // further steps ...
+    auto crashTextWriter = make_shared<TextFileWriter>( "", "metropolis-test-crash" );
+    auto crashBinaryWriter = make_shared<BinaryFileWriter>( "metropolis-test-crash.bin", 64 );
+    auto compressedWriter = make_shared<CompressedFileWriter>( "metropolis-test-crash.vmz", 64 );
+
+    MetropolisHastings crashed;
+    setup( crashed, 2000, 4 * 1130 );
+    crashed.SetCheckpointFile( checkpointFile, 5 );
+    crashed.AddWriter( crashTextWriter );
+    crashed.AddWriter( crashBinaryWriter );
+    crashed.AddWriter( compressedWriter );
+    Random::Instance().GetEngine().seed( 123 );
+    ASSERT_THROW( crashed.Run(), Exception );
+
+    // ... discards the output written after the checkpoint, when resumed
+    MetropolisHastings recovered;
+    setup( recovered, 2000 );
+    recovered.AddWriter( crashTextWriter );
+    recovered.AddWriter( crashBinaryWriter );
+    recovered.AddWriter( compressedWriter );
+    Random::Instance().GetEngine().seed( 456 );
+    recovered.Resume( checkpointFile );
+
+    for (const string& filePath : { crashBinaryWriter->GetFilePath(), compressedWriter->GetFilePath() }) {
+        const BinaryFileReader crashReader( filePath );
+        ASSERT_EQ( 2, crashReader.NumberOfChains() );
+
+        for (size_t iChain = 0; iChain < 2; iChain++) {
+            const Chain& expected = reference.GetChain(iChain);
+            const Chain& written = crashReader.GetChain(iChain);
+            ASSERT_EQ( 2001, written.size() );
+
+            for (size_t i = 0; i < written.size(); i++) {
+                ASSERT_EQ( i, written.GetGeneration(i) );
+                ASSERT_EQ( expected[i].Values()[0], written[i].Values()[0] );
+            }
+        }
+
+        remove( filePath.c_str() );
+    }
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        ifstream textFile( crashTextWriter->GetFilePath(iChain) );
+        string line;
+        getline( textFile, line );
+        ASSERT_EQ( 0, line.find("Generation") );
+
+        size_t generation;
+        for (size_t i = 0; i < 2001; i++) {
+            ASSERT_TRUE( getline( textFile, line ) );
+            ASSERT_TRUE( istringstream( line ) >> generation );
+            ASSERT_EQ( i, generation );
+        }
+        ASSERT_FALSE( getline( textFile, line ) );
+
+        textFile.close();
+        remove( crashTextWriter->GetFilePath(iChain).c_str() );
+    }
+
+    // the checkpoint does not match a different configuration
+    MetropolisHastings mismatch;
+    setup( mismatch, 2000 );
+    mismatch.SetNumberOfChains(3);
+    ASSERT_THROW( mismatch.Resume( checkpointFile ), Exception );
+
+    remove( checkpointFile.c_str() );
+    remove( binaryWriter->GetFilePath().c_str() );
+}
+
+TEST(Metropolis, ChainWindow)
+{
+    const string spillPrefix = "metropolis-test";
+
+    MetropolisHastings mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+    pList.SetErrorScaling( 2.0 );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const std::vector<double>& params) {
+        return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+    } );
+
+    mcmc.SetNumberOfChains(2);
+    mcmc.SetBetas( {1.0, 0.5} );
+    mcmc.SetTotalLength(2E4);
+    mcmc.SetChainWindow(1000, spillPrefix);
+
+    mcmc.Run();
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& chain = mcmc.GetChain(iChain);
+
+        ASSERT_EQ( 20001, chain.size() );
+        ASSERT_GT( chain.GetFirstIndex(), 15000 );
+        ASSERT_LE( chain.capacity() - chain.GetFirstIndex(), 3 * Chain::kDefaultBlockSize );
+        ASSERT_EQ( 20001, mcmc.GetOnlineStatistics(iChain).GetCount() );
+
+        // the final diagnostics cover the full chain, restored from the spill file
+        const ChainStatistics& stats = mcmc.GetStatistics().GetChainStats(iChain);
+        ASSERT_EQ( 20001, stats.GetChain().size() );
+        ASSERT_EQ( 0, stats.GetChain().GetFirstIndex() );
+        ASSERT_EQ( chain.back().GetGeneration(), stats.GetChain().back().GetGeneration() );
+
+        remove( (spillPrefix + "-" + to_string(iChain) + ".spill").c_str() );
+    }
+}
+
+TEST(Metropolis, ChainWindowWithoutSpillFile)
+{
+    MetropolisHastings mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+    pList.SetErrorScaling( 2.0 );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const std::vector<double>& params) {
+        return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+    } );
+
+    mcmc.SetNumberOfChains(2);
+    mcmc.SetTotalLength(2E4);
+    mcmc.SetChainWindow(1000);
+
+    mcmc.Run();
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& chain = mcmc.GetChain(iChain);
+        ASSERT_GT( chain.GetFirstIndex(), 0 );
+
+        // the online statistics still cover all steps
+        const OnlineStatistics& online = mcmc.GetOnlineStatistics(iChain);
+        ASSERT_EQ( 20001, online.GetCount() );
+        ASSERT_NEAR( 0.0, online.GetMean()[0], 0.25 );
+        ASSERT_NEAR( 1.0, online.GetCovarianceMatrix()(0, 0), 0.3 );
+    }
+}
+
+TEST(Metropolis, BurnInAndThinning)
+{
+    MetropolisHastings mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+    pList.SetErrorScaling( 2.0 );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const std::vector<double>& params) {
+        return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+    } );
+
+    mcmc.SetNumberOfChains(2);
+    mcmc.SetBetas( {1.0, 0.3} );
+    mcmc.SetTotalLength(2E4);
+    mcmc.SetBurnIn(1000);
+    mcmc.SetThinning(10);
+
+    mcmc.Run();
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& chain = mcmc.GetChain(iChain);
+
+        // generations 1000, 1010, ... 20000
+        ASSERT_EQ( 1901, chain.size() );
+        ASSERT_EQ( 1000, chain.GetGeneration(0) );
+        ASSERT_EQ( 20000, chain.back().GetGeneration() );
+        ASSERT_EQ( 20001, chain.GetNumberOfSteps() );
+        // the online statistics count all steps
+        ASSERT_EQ( 20001, mcmc.GetOnlineStatistics(iChain).GetCount() );
+        ASSERT_DOUBLE_EQ( chain.GetAccRate(), mcmc.GetOnlineStatistics(iChain).GetAccRate() );
+
+        ASSERT_GT( chain.GetAccRate(), 0.1 );
+        ASSERT_LT( chain.GetAccRate(), 0.9 );
+
+        ChainStatistics stats( chain );
+        ASSERT_NEAR( 0.0, stats.GetMean()[0], 0.25 );
+        ASSERT_NEAR( 1.0, stats.GetError()[0], 0.2 );
+    }
+}
+
+TEST(Metropolis, OnlineStatisticsWithThinning)
+{
+    auto run = [](size_t burnIn, size_t thinning) {
+        unique_ptr<MetropolisHastings> mcmc( new MetropolisHastings() );
+
+        ParameterConfig pList;
+        pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+        pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+        mcmc->SetParameterConfig( pList );
+        mcmc->SetNegLogLikelihood( [](const std::vector<double>& params) {
+            return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+        } );
+
+        mcmc->SetNumberOfChains(2);
+        mcmc->SetTotalLength(5000);
+        mcmc->SetSeed(3);
+        mcmc->SetBurnIn(burnIn);
+        mcmc->SetThinning(thinning);
+        mcmc->Run();
+
+        return mcmc;
+    };
+
+    auto full = run( 0, 1 );
+    auto thinned = run( 0, 7 );
+    auto burnedIn = run( 500, 3 );
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const OnlineStatistics& expected = full->GetOnlineStatistics(iChain);
+        ASSERT_EQ( 5001, expected.GetCount() );
+
+        // discarding steps at the storage level does not alter the statistics
+        for (MetropolisHastings* mcmc : { thinned.get(), burnedIn.get() }) {
+            const OnlineStatistics& stats = mcmc->GetOnlineStatistics(iChain);
+
+            ASSERT_LT( mcmc->GetChain(iChain).size(), 5001 );
+            ASSERT_EQ( expected.GetCount(), stats.GetCount() );
+            ASSERT_EQ( expected.GetNumberOfAccepted(), stats.GetNumberOfAccepted() );
+            ASSERT_DOUBLE_EQ( mcmc->GetChain(iChain).GetAccRate(), stats.GetAccRate() );
+
+            for (size_t i = 0; i < 2; i++) {
+                ASSERT_DOUBLE_EQ( expected.GetMean()[i], stats.GetMean()[i] );
+                for (size_t j = 0; j <= i; j++)
+                    ASSERT_DOUBLE_EQ( expected.GetCovarianceMatrix()(i, j), stats.GetCovarianceMatrix()(i, j) );
+            }
+        }
+    }
+}
+
+TEST(Metropolis, CompressedFileWriterOffSamplingThread)
+{
+    // records the threads compressing the chunks
+    struct RecordingWriter : public CompressedFileWriter
+    {
+        RecordingWriter() : CompressedFileWriter( "metropolis-test.vmz", 64 ) { }
+        virtual void WriteChunk(size_t chainIndex) override
+        {
+            fThreads.insert( this_thread::get_id() );
+            CompressedFileWriter::WriteChunk( chainIndex );
+        }
+        set<thread::id> fThreads;
+    };
+
+    MetropolisHastings mcmc;
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihood( [](const std::vector<double>& params) {
+        return 0.5 * ( math::pow<2>( params[0] ) + math::pow<2>( params[1] ) );
+    } );
+
+    mcmc.SetNumberOfChains(2);
+    mcmc.SetMultiThreading(false);
+    mcmc.SetTotalLength(1000);
+
+    auto writer = make_shared<RecordingWriter>();
+    ASSERT_TRUE( writer->IsDeferred() );
+    mcmc.AddWriter( writer );
+
+    mcmc.Run();
+
+    // the chunks are compressed on the I/O thread of an AsyncWriter
+    ASSERT_FALSE( writer->fThreads.empty() );
+    ASSERT_EQ( 0, writer->fThreads.count( this_thread::get_id() ) );
+
+    const BinaryFileReader reader( writer->GetFilePath() );
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& chain = mcmc.GetChain(iChain);
+        const Chain& written = reader.GetChain(iChain);
+        ASSERT_EQ( chain.size(), written.size() );
+
+        for (size_t i = 0; i < chain.size(); i++) {
+            ASSERT_EQ( chain.GetGeneration(i), written.GetGeneration(i) );
+            ASSERT_EQ( chain.GetValue(i, 0), written.GetValue(i, 0) );
+        }
+    }
+
+    remove( writer->GetFilePath().c_str() );
 }
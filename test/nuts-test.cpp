@@ -0,0 +1,173 @@
+/**
+ * @file
+ *
+ * @copyright Copyright 2016 Marco Kleesiek.
+ * Released under the GNU Lesser General Public License v3.
+ *
+ * @date 16.10.2026
+ * @author marco@kleesiek.com
+ */
+
+#include <vmcmc/nuts.hpp>
+#include <vmcmc/math.hpp>
+#include <vmcmc/random.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+using namespace vmcmc;
+
+namespace {
+
+// global counter of heap allocations, see the replaced operator new below
+atomic<size_t> sNAllocations( 0 );
+
+}
+
+void* operator new(size_t size)
+{
+    sNAllocations++;
+    if (void* ptr = malloc( size ))
+        return ptr;
+    throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free( ptr );
+}
+
+TEST(NoUTurn, Run)
+{
+    Random::Instance().Seed(123);
+
+    // correlated normal distribution, badly matched by the parameter errors
+    const double sigma[] = { 1.0, 10.0 };
+    const double rho = 0.9;
+
+    NoUTurn mcmc;
+    mcmc.SetMultiThreading(false);
+
+    ParameterConfig pList;
+    pList.SetParameter( 0, Parameter("test1", 0.0, 1.0) );
+    pList.SetParameter( 1, Parameter("test2", 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihoodGradient( [&](const vector<double>& p, vector<double>& gradient) {
+        const double x = (p[0] - 1.0) / sigma[0];
+        const double y = p[1] / sigma[1];
+        const double norm = 1.0 / (1.0 - rho*rho);
+        gradient[0] = norm * (x - rho*y) / sigma[0];
+        gradient[1] = norm * (y - rho*x) / sigma[1];
+        return 0.5 * norm * (x*x - 2.0*rho*x*y + y*y);
+    } );
+
+    mcmc.SetNumberOfChains(2);
+    mcmc.SetWarmupLength(500);
+    mcmc.SetTotalLength(4E3);
+
+    mcmc.Run();
+
+    for (size_t iChain = 0; iChain < 2; iChain++) {
+        const Chain& chain = mcmc.GetChain(iChain);
+        ASSERT_EQ( 4001, chain.size() );
+        ASSERT_EQ( 4000, chain.GetGeneration(4000) );
+
+        ASSERT_GT( mcmc.GetAdaptedStepSize(iChain), 0.0 );
+        ASSERT_LT( mcmc.GetAdaptedStepSize(iChain), 2.0 );
+        // divergences only occur with too large step sizes early in the warmup
+        ASSERT_LT( mcmc.GetNumberOfDivergences(iChain), 40 );
+
+        ChainStatistics stats( chain );
+        stats.SelectRange( 500 );
+
+        ASSERT_NEAR( 1.0, stats.GetMean()[0], 0.15 );
+        ASSERT_NEAR( 0.0, stats.GetMean()[1], 1.5 );
+        ASSERT_NEAR( sigma[0], stats.GetError()[0], 0.1 );
+        ASSERT_NEAR( sigma[1], stats.GetError()[1], 1.5 );
+        ASSERT_NEAR( rho, stats.GetCorrelationMatrix()(1, 0), 0.05 );
+    }
+}
+
+TEST(NoUTurn, HighDimension)
+{
+    Random::Instance().Seed(123);
+
+    constexpr size_t nParams = 50;
+
+    NoUTurn mcmc;
+    mcmc.SetMultiThreading(false);
+
+    ParameterConfig pList;
+    for (size_t i = 0; i < nParams; i++)
+        pList.SetParameter( i, Parameter("p" + to_string(i), 0.5, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihoodGradient( [](const vector<double>& p, vector<double>& gradient) {
+        double result = 0.0;
+        for (size_t i = 0; i < p.size(); i++) {
+            const double sigma = 1.0 + i / 25.0;
+            gradient[i] = p[i] / (sigma * sigma);
+            result += 0.5 * math::pow<2>( p[i] / sigma );
+        }
+        return result;
+    } );
+
+    mcmc.SetWarmupLength(200);
+    mcmc.SetTotalLength(1E3);
+
+    mcmc.Run();
+
+    ChainStatistics stats( mcmc.GetChain() );
+    stats.SelectRange( 200 );
+
+    // nearly independent samples: the autocorrelation times stay small
+    for (size_t i = 0; i < nParams; i++) {
+        const double sigma = 1.0 + i / 25.0;
+        ASSERT_NEAR( 0.0, stats.GetMean()[i], 0.3 * sigma );
+        ASSERT_NEAR( sigma, stats.GetError()[i], 0.2 * sigma );
+        ASSERT_LT( stats.GetAutoCorrelationTime()[i], 5.0 );
+    }
+}
+
+TEST(NoUTurn, AllocationFreeTrajectories)
+{
+    Random::Instance().Seed(123);
+
+    NoUTurn mcmc;
+    mcmc.SetMultiThreading(false);
+
+    ParameterConfig pList;
+    for (size_t i = 0; i < 20; i++)
+        pList.SetParameter( i, Parameter("p" + to_string(i), 0.0, 1.0) );
+
+    mcmc.SetParameterConfig( pList );
+    mcmc.SetNegLogLikelihoodGradient( [](const vector<double>& p, vector<double>& gradient) {
+        double result = 0.0;
+        for (size_t i = 0; i < p.size(); i++) {
+            gradient[i] = p[i];
+            result += 0.5 * math::pow<2>( p[i] );
+        }
+        return result;
+    } );
+
+    mcmc.SetTotalLength(1E3);
+
+    mcmc.Initialize();
+
+    // warm up thread-local instances
+    mcmc.Advance(10);
+
+    const size_t nSteps = 200;
+
+    sNAllocations = 0;
+    mcmc.Advance(nSteps);
+    const size_t nAllocations = sNAllocations;
+
+    ASSERT_EQ( nSteps + 11, mcmc.GetChain(0).size() );
+    ASSERT_EQ( 0, nAllocations );
+}
@@ -13,7 +13,9 @@
 #include <vmcmc/stringutils.hpp>
 
 #include <boost/numeric/ublas/io.hpp>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
 #include <gtest/gtest.h>
 
@@ -40,6 +42,47 @@ TEST(Parameter, Limits)
     ASSERT_THROW( Parameter("bad parameter", 0.0, 1.0, 1.0, -1.0), Exception );
 }
 
+TEST(ParameterConfig, Limits)
+{
+    ParameterConfig paramConfig;
+    paramConfig.SetParameter( 0, "bounded", 0.0, 1.0, -1.0, +1.0 );
+    paramConfig.SetParameter( 1, "lower", 0.0, 1.0, 0.0 );
+    paramConfig.SetParameter( 2, "free", 0.0, 1.0 );
+
+    const ParameterLimits limits = paramConfig.GetLimits();
+    ASSERT_EQ( 3U, limits.size() );
+    ASSERT_EQ( -1.0, limits.GetLower()[0] );
+    ASSERT_EQ( +1.0, limits.GetUpper()[0] );
+    ASSERT_TRUE( std::isinf( limits.GetUpper()[1] ) );
+    ASSERT_TRUE( std::isinf( limits.GetLower()[2] ) );
+
+    Vector point( 3 );
+    point[0] = 1.0; point[1] = 0.0; point[2] = -1E300;
+    ASSERT_TRUE( limits.IsInside( point ) );
+    ASSERT_TRUE( paramConfig.IsInsideLimits( point ) );
+
+    point[1] = -0.5;
+    ASSERT_FALSE( limits.IsInside( point ) );
+    ASSERT_FALSE( paramConfig.IsInsideLimits( point ) );
+
+    point[1] = numeric_limits<double>::quiet_NaN();
+    ASSERT_FALSE( limits.IsInside( point ) );
+
+    // a single failed reflection fails the point
+    point[0] = 3.5; point[1] = -0.5;
+    Vector copy = point;
+    ASSERT_FALSE( limits.Reflect( point ) );
+    ASSERT_FALSE( paramConfig.ReflectFromLimits( copy ) );
+    ASSERT_DOUBLE_EQ( -1.5, point[0] );
+    ASSERT_DOUBLE_EQ( 0.5, point[1] );
+    ASSERT_EQ( point[0], copy[0] );
+    ASSERT_EQ( point[1], copy[1] );
+
+    point[0] = 1.5;
+    ASSERT_TRUE( limits.Reflect( point ) );
+    ASSERT_DOUBLE_EQ( 0.5, point[0] );
+}
+
 TEST(ParameterConfig, Correlations)
 {
     ParameterConfig paramConfig;
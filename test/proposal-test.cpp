@@ -11,6 +11,8 @@
 #include <vmcmc/proposal.hpp>
 #include <vmcmc/stringutils.hpp>
 
+#include <cmath>
+
 #include <gtest/gtest.h>
 
 using namespace std;
@@ -63,7 +65,7 @@ TEST(ProposalNormal, Transition)
     Sample v2( 2 );
     prop.Transition(v1, v2);
 
-    double exp[] = { 1.36504, 0.181683 };
+    double exp[] = { 0.259572, 0.769496 };
     for (size_t i = 0; i < v2.size(); i++)
         ASSERT_NEAR( exp[i], v2[i], 0.001 );
 }
@@ -103,14 +105,184 @@ TEST(ProposalStudentT, Transition)
     Sample v2( 2 );
     prop.Transition(v1, v2);
 
-    double exp1[] = { 1.90133, 0.03373 };
+    double exp1[] = { -1.057991, 0.771692 };
     for (size_t i = 0; i < v2.size(); i++)
         ASSERT_NEAR( exp1[i], v2[i], 0.001 );
 
     prop.SetDOF(2.0);
     prop.Transition(v1, v2);
 
-    double exp2[] = { -1.75956, 1.27399 };
+    double exp2[] = { -0.082594, -0.167062 };
     for (size_t i = 0; i < v2.size(); i++)
         ASSERT_NEAR( exp2[i], v2[i], 0.001 );
 }
+
+TEST(ProposalNormal, LogDensity)
+{
+    ParameterConfig pc;
+    pc.SetParameter(0, "p1", 0.0, 2.0);
+    pc.SetParameter(1, "p2", 0.0, 3.0);
+
+    ProposalNormal prop;
+    prop.UpdateParameterConfig( pc );
+
+    ProposalStudentT propT( 3.0 );
+    propT.UpdateParameterConfig( pc );
+
+    Vector s1( 2 ), s2( 2 );
+    s1[0] = 1.0; s1[1] = 1.0;
+    s2[0] = 2.0; s2[1] = -2.0;
+
+    ASSERT_DOUBLE_EQ( -0.5 * (0.25 + 1.0), prop.LogDensity( s1, s2 ) );
+    ASSERT_DOUBLE_EQ( -2.0 * (log1p(0.25 / 3.0) + log1p(1.0 / 3.0)), propT.LogDensity( s1, s2 ) );
+    ASSERT_DOUBLE_EQ( 0.0, prop.LogDensity( s1, s1 ) );
+
+    // a step against the correlation is less likely, the density is still
+    // symmetric
+    pc.SetCorrelation(0, 1, 0.8);
+    prop.UpdateParameterConfig( pc );
+    propT.UpdateParameterConfig( pc );
+
+    ASSERT_LT( prop.LogDensity( s1, s2 ), -0.5 * (0.25 + 1.0) );
+    ASSERT_DOUBLE_EQ( prop.LogDensity( s1, s2 ), prop.LogDensity( s2, s1 ) );
+    ASSERT_DOUBLE_EQ( propT.LogDensity( s1, s2 ), propT.LogDensity( s2, s1 ) );
+}
+
+TEST(ProposalAdaptive, Adapt)
+{
+    Random::Instance().Seed(123);
+
+    ParameterConfig pc;
+    pc.SetParameter(0, "p1", 0.0, 1.0);
+    pc.SetParameter(1, "p2", 0.0, 1.0);
+
+    ProposalAdaptive prop;
+    prop.SetInitialWeight(1.0);
+    prop.UpdateParameterConfig( pc );
+
+    // feed samples from a correlated normal distribution
+    const double sigma[] = { 3.0, 0.5 };
+    const double rho = 0.9;
+
+    std::normal_distribution<double> normal;
+    vector<Vector> samples;
+    Vector state(2);
+    for (size_t i = 0; i < 20000; i++) {
+        const double z1 = normal( Random::Instance() );
+        const double z2 = normal( Random::Instance() );
+        state[0] = 1.0 + sigma[0] * z1;
+        state[1] = -1.0 + sigma[1] * (rho * z1 + sqrt(1.0 - rho*rho) * z2);
+        prop.Adapt( state, true );
+        samples.push_back( state );
+    }
+
+    ASSERT_EQ( 20000, prop.GetNumberOfAdaptions() );
+    ASSERT_NEAR( 1.0, prop.GetMean()[0], 0.1 );
+    ASSERT_NEAR( -1.0, prop.GetMean()[1], 0.02 );
+
+    // compare to a full decomposition of the empirical covariance
+    Vector mean( 2, 0.0 );
+    for (auto& s : samples)
+        mean += s / (double) samples.size();
+
+    Matrix cov( 2, 2, 0.0 );
+    for (auto& s : samples)
+        cov += ublas::outer_prod(s - mean, s - mean) / (double) samples.size();
+
+    MatrixLower expected( 2, 2 );
+    ASSERT_EQ( 0, choleskyDecompose(cov, expected) );
+
+    for (size_t i = 0; i < 2; i++)
+        for (size_t j = 0; j <= i; j++)
+            ASSERT_NEAR( expected(i, j), prop.GetCholeskyDecomp()(i, j), 0.01 );
+
+    ASSERT_NEAR( sigma[0], prop.GetCholeskyDecomp()(0, 0), 0.1 );
+
+    // a clone continues from the adapted state
+    unique_ptr<ProposalAdaptive> prop2( prop.Clone() );
+    ASSERT_EQ( prop.GetCholeskyDecomp(), prop2->GetCholeskyDecomp() );
+    ASSERT_EQ( prop.GetScale(), prop2->GetScale() );
+
+    // updating the configuration restarts the adaptation
+    prop.UpdateParameterConfig( pc );
+    ASSERT_EQ( 0, prop.GetNumberOfAdaptions() );
+    ASSERT_EQ( 1.0, prop.GetScale() );
+    ASSERT_EQ( pc.GetCholeskyDecomp(), prop.GetCholeskyDecomp() );
+}
+
+TEST(ProposalAdaptive, FixedParameter)
+{
+    Random::Instance().Seed(123);
+
+    ParameterConfig pc;
+    pc.SetParameter(0, "p1", 0.0, 1.0);
+    pc.SetParameter(1, Parameter::FixedParameter("p2", 5.0));
+    pc.SetParameter(2, "p3", 0.0, 1.0);
+
+    ProposalAdaptive prop;
+    prop.SetInitialWeight(1.0);
+    prop.UpdateParameterConfig( pc );
+    ASSERT_EQ( 0.0, prop.GetCholeskyDecomp()(1, 1) );
+
+    const double sigma[] = { 2.0, 0.0, 0.5 };
+
+    std::normal_distribution<double> normal;
+    Vector state(3);
+    state[1] = 5.0;
+    for (size_t i = 0; i < 20000; i++) {
+        state[0] = sigma[0] * normal( Random::Instance() );
+        state[2] = sigma[2] * normal( Random::Instance() );
+        prop.Adapt( state, true );
+    }
+
+    // the parameters following the fixed one adapt as well
+    const MatrixLower& L = prop.GetCholeskyDecomp();
+    ASSERT_NEAR( sigma[0], L(0, 0), 0.05 );
+    ASSERT_NEAR( sigma[2], L(2, 2), 0.02 );
+    ASSERT_NEAR( 0.0, L(2, 0), 0.02 );
+
+    // the fixed parameter keeps a zero width
+    ASSERT_EQ( 0.0, L(1, 0) );
+    ASSERT_EQ( 0.0, L(1, 1) );
+    ASSERT_EQ( 0.0, L(2, 1) );
+
+    Vector s1( state ), s2( 3 );
+    prop.Transition( s1, s2 );
+    ASSERT_EQ( 5.0, s2[1] );
+    ASSERT_NE( s1[2], s2[2] );
+}
+
+TEST(ProposalAdaptive, Scale)
+{
+    ParameterConfig pc;
+    pc.SetParameter(0, "p1", 0.0, 1.0);
+
+    ProposalAdaptive prop;
+    prop.SetAdaptionLength(100);
+    prop.UpdateParameterConfig( pc );
+
+    const Vector state( 1, 0.0 );
+
+    // too many acceptances increase the scale ...
+    for (size_t i = 0; i < 50; i++)
+        prop.Adapt( state, true );
+    const double scale = prop.GetScale();
+    ASSERT_GT( scale, 1.0 );
+
+    // ... too many rejections decrease it
+    for (size_t i = 0; i < 50; i++)
+        prop.Adapt( state, false );
+    ASSERT_LT( prop.GetScale(), scale );
+
+    // no more adaptation after the adaption length
+    const double finalScale = prop.GetScale();
+    prop.Adapt( state, true );
+    ASSERT_EQ( 100, prop.GetNumberOfAdaptions() );
+    ASSERT_EQ( finalScale, prop.GetScale() );
+
+    // the scale applies to the proposed step
+    Random::Instance().Seed(123);
+    Vector s1( 1, 0.0 ), s2( 1 );
+    prop.Transition( s1, s2 );
+    ASSERT_NE( 0.0, s2[0] );
+}
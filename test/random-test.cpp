@@ -12,7 +12,10 @@
 #include <vmcmc/blas.hpp>
 #include <vmcmc/stringutils.hpp>
 
+#include <limits>
+#include <sstream>
 #include <thread>
+#include <vector>
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
@@ -34,10 +37,10 @@ TEST(Random, SingletonInitialization) {
 
     Random& rand = Random::Instance();
 
-    ASSERT_EQ(42, rand.Uniform(0, 100)) << "Deterministic random"
+    ASSERT_EQ(89, rand.Uniform(0, 100)) << "Deterministic random"
             "number generator with unexpected result.";
 
-    ASSERT_DOUBLE_EQ(43.624248925001041, rand.Uniform(-99.0, +99.0));
+    ASSERT_DOUBLE_EQ(16.973737787722513, rand.Uniform(-99.0, +99.0));
 }
 
 TEST(Random, UniformMultithreaded) {
@@ -105,3 +108,105 @@ TEST(Random, MultivariateNormal) {
     ASSERT_NEAR( 3.0, covariance(acc34), 0.60 );
 
 }
+
+TEST(Random, Philox) {
+
+    // known answers of the reference implementation (Random123)
+    Philox4x32::result_type block[4];
+
+    Philox4x32::Block( 0, 0, 0, block );
+    ASSERT_EQ( 0x6627e8d5u, block[0] );
+    ASSERT_EQ( 0xe169c58du, block[1] );
+    ASSERT_EQ( 0xbc57ac4cu, block[2] );
+    ASSERT_EQ( 0x9b00dbd8u, block[3] );
+
+    Philox4x32::Block( 0x299f31d0a4093822ull, 0x0370734413198a2eull, 0x85a308d3243f6a88ull, block );
+    ASSERT_EQ( 0xd16cfe09u, block[0] );
+    ASSERT_EQ( 0x94fdccebu, block[1] );
+    ASSERT_EQ( 0x5001e420u, block[2] );
+    ASSERT_EQ( 0x24126ea1u, block[3] );
+
+    Philox4x32 engine( 123, 7 );
+    vector<Philox4x32::result_type> sequence( 103 );
+    for (auto& r : sequence)
+        r = engine();
+
+    // skipping ahead
+    for (size_t n : { 0, 1, 3, 4, 5, 42, 100 }) {
+        Philox4x32 skipped( 123, 7 );
+        skipped.discard( 2 );
+        skipped.discard( n );
+        ASSERT_EQ( sequence[2 + n], skipped() );
+    }
+
+    // bulk generation continues the sequence
+    Philox4x32 bulk( 123, 7 );
+    vector<Philox4x32::result_type> result( sequence.size() );
+    bulk();
+    bulk.Generate( result.data() + 1, 37 );
+    bulk.Generate( result.data() + 38, result.size() - 38 );
+    result[0] = sequence[0];
+    ASSERT_EQ( sequence, result );
+    ASSERT_EQ( engine, bulk );
+
+    // different streams are independent
+    Philox4x32 other( 123, 8 );
+    ASSERT_NE( sequence[0], other() );
+
+    // serialization
+    stringstream buffer;
+    Philox4x32 saved( 123, 7 );
+    saved.discard( 5 );
+    buffer << saved;
+    Philox4x32 restored;
+    buffer >> restored;
+    ASSERT_EQ( saved, restored );
+    ASSERT_EQ( sequence[5], restored() );
+}
+
+TEST(Random, BulkNormal) {
+
+    Random& rand = Random::Instance();
+
+    vector<double> values( 100001, numeric_limits<double>::quiet_NaN() );
+    rand.Normal( values.data(), values.size(), 5.0, 2.0 );
+
+    accumulator_set<double, stats<tag::mean, tag::variance> > acc;
+    for (double v : values) {
+        ASSERT_TRUE( std::isfinite(v) );
+        acc( v );
+    }
+
+    ASSERT_NEAR( 5.0, mean(acc), 0.02 );
+    ASSERT_NEAR( 4.0, variance(acc), 0.05 );
+
+    vector<double> uniform( 10001 );
+    rand.Uniform( uniform.data(), uniform.size(), -1.0, 3.0 );
+
+    accumulator_set<double, stats<tag::mean> > accUniform;
+    for (double u : uniform) {
+        ASSERT_GE( u, -1.0 );
+        ASSERT_LT( u, 3.0 );
+        accUniform( u );
+    }
+    ASSERT_NEAR( 1.0, mean(accUniform), 0.05 );
+}
+
+TEST(Random, ScopedEngine) {
+
+    Random& rand = Random::Instance();
+    const Random::engine_type threadEngine = rand.GetEngine();
+
+    Random::engine_type stream( 42, 1 );
+    Random::engine_type expected( 42, 1 );
+
+    {
+        Random::ScopedEngine binding( stream );
+        ASSERT_EQ( expected(), Random::Instance()() );
+        ASSERT_EQ( expected(), rand() );
+    }
+
+    // the stream has advanced, the thread engine is untouched
+    ASSERT_EQ( expected, stream );
+    ASSERT_EQ( threadEngine, rand.GetEngine() );
+}